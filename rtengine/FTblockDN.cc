@@ -31,6 +31,7 @@
 #include "cplx_wavelet_dec.h"
 #include "color.h"
 #include "curves.h"
+#include "fftwplancache.h"
 #include "iccmatrices.h"
 #include "iccstore.h"
 #include "imagefloat.h"
@@ -41,6 +42,7 @@
 #include "mytime.h"
 #include "opthelper.h"
 #include "procparams.h"
+#include "rt_algo.h"
 #include "rt_math.h"
 #include "sleef.h"
 #include "../rtgui/threadutils.h"
@@ -77,8 +79,6 @@ namespace rtengine
  */
 
 
-extern MyMutex *fftwMutex;
-
 
 namespace
 {
@@ -500,8 +500,6 @@ BENCHFUN
         return;
     }
 
-    MyMutex::MyLock lock(*fftwMutex);
-
     const nrquality nrQuality = (dnparams.smethod == "shal") ? QUALITY_STANDARD : QUALITY_HIGH;//shrink method
     const float qhighFactor = (nrQuality == QUALITY_HIGH) ? 1.f / static_cast<float>(settings->nrhigh) : 1.0f;
     const bool useNoiseCCurve = (noiseCCurve && noiseCCurve.getSum() > 5.f);
@@ -754,27 +752,29 @@ BENCHFUN
             // calculate min size of numblox_W.
             int min_numblox_W = ceil((static_cast<float>((MIN(imwidth, ((numtiles_W - 1) * tileWskip) + tilewidth)) - ((numtiles_W - 1) * tileWskip))) / (offset)) + 2 * blkrad;
 
-            // these are needed only for creation of the plans and will be freed before entering the parallel loop
-            fftwf_plan plan_forward_blox[2];
-            fftwf_plan plan_backward_blox[2];
+            FFTWPlanCache::Plan plan_forward_blox[2];
+            FFTWPlanCache::Plan plan_backward_blox[2];
+            bool detailPlansOk = false;
 
             if (denoiseLuminance) {
-                float *Lbloxtmp  = reinterpret_cast<float*>(fftwf_malloc(max_numblox_W * TS * TS * sizeof(float)));
-                float *fLbloxtmp = reinterpret_cast<float*>(fftwf_malloc(max_numblox_W * TS * TS * sizeof(float)));
-
-                int nfwd[2] = {TS, TS};
-
-                //for DCT:
-                fftw_r2r_kind fwdkind[2] = {FFTW_REDFT10, FFTW_REDFT10};
-                fftw_r2r_kind bwdkind[2] = {FFTW_REDFT01, FFTW_REDFT01};
-
-                // Creating the plans with FFTW_MEASURE instead of FFTW_ESTIMATE speeds up the execute a bit
-                plan_forward_blox[0]  = fftwf_plan_many_r2r(2, nfwd, max_numblox_W, Lbloxtmp, nullptr, 1, TS * TS, fLbloxtmp, nullptr, 1, TS * TS, fwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-                plan_backward_blox[0] = fftwf_plan_many_r2r(2, nfwd, max_numblox_W, fLbloxtmp, nullptr, 1, TS * TS, Lbloxtmp, nullptr, 1, TS * TS, bwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-                plan_forward_blox[1]  = fftwf_plan_many_r2r(2, nfwd, min_numblox_W, Lbloxtmp, nullptr, 1, TS * TS, fLbloxtmp, nullptr, 1, TS * TS, fwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-                plan_backward_blox[1] = fftwf_plan_many_r2r(2, nfwd, min_numblox_W, fLbloxtmp, nullptr, 1, TS * TS, Lbloxtmp, nullptr, 1, TS * TS, bwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-                fftwf_free(Lbloxtmp);
-                fftwf_free(fLbloxtmp);
+                // the plans are cached, creating them with FFTW_MEASURE instead of FFTW_ESTIMATE speeds up the execute a bit
+                FFTWPlanCache &planCache = FFTWPlanCache::getInstance();
+
+                for (unsigned int planFlags : {FFTW_MEASURE | FFTW_DESTROY_INPUT, FFTW_ESTIMATE | FFTW_DESTROY_INPUT}) {
+                    plan_forward_blox[0]  = planCache.getPlan(TS, TS, max_numblox_W, TS * TS, FFTW_REDFT10, planFlags);
+                    plan_backward_blox[0] = planCache.getPlan(TS, TS, max_numblox_W, TS * TS, FFTW_REDFT01, planFlags);
+                    plan_forward_blox[1]  = planCache.getPlan(TS, TS, min_numblox_W, TS * TS, FFTW_REDFT10, planFlags);
+                    plan_backward_blox[1] = planCache.getPlan(TS, TS, min_numblox_W, TS * TS, FFTW_REDFT01, planFlags);
+                    detailPlansOk = plan_forward_blox[0] && plan_backward_blox[0] && plan_forward_blox[1] && plan_backward_blox[1];
+
+                    if (detailPlansOk) {
+                        break;
+                    }
+                }
+
+                if (!detailPlansOk) {
+                    fprintf(stderr, "RGB_denoise: fftw planning failed, luminance detail is not denoised!\n");
+                }
             }
 
 #ifndef _OPENMP
@@ -819,7 +819,7 @@ BENCHFUN
                 fLbloxArray[i] = nullptr;
             }
 
-            if (numtiles > 1 && denoiseLuminance) {
+            if (numtiles > 1 && denoiseLuminance && detailPlansOk) {
                 for (int i = 0; i < denoiseNestedLevels * numthreads; ++i) {
                     LbloxArray[i]  = reinterpret_cast<float*>(fftwf_malloc(max_numblox_W * TS * TS * sizeof(float)));
                     fLbloxArray[i] = reinterpret_cast<float*>(fftwf_malloc(max_numblox_W * TS * TS * sizeof(float)));
@@ -1314,7 +1314,7 @@ BENCHFUN
                             // Main detail recovery algorithm: Block loop
                             //DCT block data storage
 
-                            if (denoiseLuminance /*&& execwavelet*/) {
+                            if (denoiseLuminance && detailPlansOk /*&& execwavelet*/) {
                                 //residual between input and denoised L channel
                                 array2D<float> Ldetail(width, height, ARRAY2D_CLEAR_DATA);
                                 //pixel weight
@@ -1406,9 +1406,9 @@ BENCHFUN
                                         //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
                                         //fftwf_print_plan (plan_forward_blox);
                                         if (numblox_W == max_numblox_W) {
-                                            fftwf_execute_r2r(plan_forward_blox[0], Lblox, fLblox);    // DCT an entire row of tiles
+                                            fftwf_execute_r2r(plan_forward_blox[0].get(), Lblox, fLblox);    // DCT an entire row of tiles
                                         } else {
-                                            fftwf_execute_r2r(plan_forward_blox[1], Lblox, fLblox);    // DCT an entire row of tiles
+                                            fftwf_execute_r2r(plan_forward_blox[1].get(), Lblox, fLblox);    // DCT an entire row of tiles
                                         }
 
                                         //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -1424,9 +1424,9 @@ BENCHFUN
 
                                         //now perform inverse FT of an entire row of blocks
                                         if (numblox_W == max_numblox_W) {
-                                            fftwf_execute_r2r(plan_backward_blox[0], fLblox, Lblox);    //for DCT
+                                            fftwf_execute_r2r(plan_backward_blox[0].get(), fLblox, Lblox);    //for DCT
                                         } else {
-                                            fftwf_execute_r2r(plan_backward_blox[1], fLblox, Lblox);    //for DCT
+                                            fftwf_execute_r2r(plan_backward_blox[1].get(), fLblox, Lblox);    //for DCT
                                         }
 
                                         int topproc = (vblk - blkrad) * offset;
@@ -1754,13 +1754,6 @@ BENCHFUN
                 }
             }
 
-            if (denoiseLuminance) {
-                // destroy the plans
-                fftwf_destroy_plan(plan_forward_blox[0]);
-                fftwf_destroy_plan(plan_backward_blox[0]);
-                fftwf_destroy_plan(plan_forward_blox[1]);
-                fftwf_destroy_plan(plan_backward_blox[1]);
-            }
         } while (memoryAllocationFailed && numTries < 2 && (options.rgbDenoiseThreadLimit == 0) && !ponder);
 
         if (memoryAllocationFailed) {
@@ -2095,65 +2088,16 @@ void ImProcFunctions::RGBoutput_tile_row(float *bloxrow_L, float ** Ldetail, flo
 
 float ImProcFunctions::Mad(const float * DataList, const int datalen)
 {
-    if (datalen <= 1) { // Avoid possible buffer underrun
-        return 0;
-    }
-
     //computes Median Absolute Deviation
     //DataList values should mostly have abs val < 256 because we are in Lab mode (32768)
-    int histo[32768] ALIGNED64 = {0};
-
-    //calculate histogram of absolute values of wavelet coeffs
-    for (int i = 0; i < datalen; ++i) {
-        histo[static_cast<int>(rtengine::min(32768.f, fabsf(DataList[i])))]++;
-    }
-
-    //find median of histogram
-    int lmedian = 0, count = 0;
-
-    while (count < datalen / 2) {
-        count += histo[lmedian];
-        ++lmedian;
-    }
-
-    int count_ = count - histo[lmedian - 1];
-
-    // interpolate
-    return ((lmedian - 1) + (datalen / 2 - count_) / (static_cast<float>(count - count_))) / 0.6745f;
+    return findMedianAbs(DataList, datalen, 32769) / 0.6745f;
 }
 
 float ImProcFunctions::MadRgb(const float * DataList, const int datalen)
 {
-    if (datalen <= 1) { // Avoid possible buffer underrun
-        return 0;
-    }
-
     //computes Median Absolute Deviation
     //DataList values should mostly have abs val < 65536 because we are in RGB mode
-    int * histo = new int[65536];
-
-    for (int i = 0; i < 65536; ++i) {
-        histo[i] = 0;
-    }
-
-    //calculate histogram of absolute values of wavelet coeffs
-    for (int i = 0; i < datalen; ++i) {
-        histo[static_cast<int>(rtengine::min(65535.f, fabsf(DataList[i])))]++;
-    }
-
-    //find median of histogram
-    int lmedian = 0, count = 0;
-
-    while (count < datalen / 2) {
-        count += histo[lmedian];
-        ++lmedian;
-    }
-
-    int count_ = count - histo[lmedian - 1];
-
-    // interpolate
-    delete[] histo;
-    return ((lmedian - 1) + (datalen / 2 - count_) / (static_cast<float>(count - count_))) / 0.6745f;
+    return findMedianAbs(DataList, datalen, 65536) / 0.6745f;
 }
 
 
@@ -474,7 +474,7 @@ int RawImageSource::interpolateBadPixelsXtrans(const PixelsMap &bitmapBads)
  *  (Taken from Emil Martinec idea)
  *  (Optimized by Ingo Weyrich 2013, 2015, and 2019)
 */
-int RawImageSource::findHotDeadPixels(PixelsMap &bpMap, const float thresh, const bool findHotPixels, const bool findDeadPixels) const
+int RawImageSource::findHotDeadPixels(PixelsMap &bpMap, const float thresh, const bool findHotPixels, const bool findDeadPixels, std::vector<badPix> *found) const
 {
     BENCHFUN
     const float varthresh = (20.f * (thresh / 100.f) + 1.f) / 24.f;
@@ -487,6 +487,7 @@ int RawImageSource::findHotDeadPixels(PixelsMap &bpMap, const float thresh, cons
 #endif
     {
         array2D<float> cfablur(W, 5, ARRAY2D_CLEAR_DATA);
+        std::vector<badPix> foundThr;
         int firstRow = -1;
         int lastRow = -1;
 
@@ -541,6 +542,10 @@ int RawImageSource::findHotDeadPixels(PixelsMap &bpMap, const float thresh, cons
                         // mark the pixel as "bad"
                         bpMap.set(cc, rr);
                         ++counter;
+
+                        if (found) {
+                            foundThr.emplace_back(cc, rr);
+                        }
                     }
                 } //end of pixel evaluation
             }
@@ -584,10 +589,21 @@ int RawImageSource::findHotDeadPixels(PixelsMap &bpMap, const float thresh, cons
                         // mark the pixel as "bad"
                         bpMap.set(cc, rr);
                         ++counter;
+
+                        if (found) {
+                            foundThr.emplace_back(cc, rr);
+                        }
                     }
                 }//end of pixel evaluation
             }
         }
+
+        if (found) {
+#ifdef _OPENMP
+            #pragma omp critical(findHotDeadPixels)
+#endif
+            found->insert(found->end(), foundThr.begin(), foundThr.end());
+        }
     }//end of parallel processing
 
     return counter;
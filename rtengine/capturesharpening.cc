@@ -33,25 +33,26 @@
 
 namespace {
 
-void compute13x13kernel(float sigma, float kernel[13][13]) {
+void compute13kernel(float sigma, float kernel[13]) {
 
+    // 1D factors of the 13x13 kernel, normalized for the circular support of radius 6 used by gauss13sep
     const double temp = -2.f * rtengine::SQR(sigma);
+    for (int i = -6; i <= 6; ++i) {
+        kernel[i + 6] = std::exp(rtengine::SQR(i) / temp);
+    }
+
     float sum = 0.f;
     for (int i = -6; i <= 6; ++i) {
         for (int j = -6; j <= 6; ++j) {
-            if((rtengine::SQR(i) + rtengine::SQR(j)) <= rtengine::SQR(3.0 * 2.0)) {
-                kernel[i + 6][j + 6] = std::exp((rtengine::SQR(i) + rtengine::SQR(j)) / temp);
-                sum += kernel[i + 6][j + 6];
-            } else {
-                kernel[i + 6][j + 6] = 0.f;
+            if ((rtengine::SQR(i) + rtengine::SQR(j)) <= rtengine::SQR(3.0 * 2.0)) {
+                sum += kernel[i + 6] * kernel[j + 6];
             }
         }
     }
 
+    const float norm = 1.f / std::sqrt(sum);
     for (int i = 0; i < 13; ++i) {
-        for (int j = 0; j < 13; ++j) {
-            kernel[i][j] /= sum;
-        }
+        kernel[i] *= norm;
     }
 }
 
@@ -267,67 +268,14 @@ void gauss9x9div(float** RESTRICT src, float** RESTRICT dst, float** RESTRICT di
     }
 }
 
-void gauss13x13div(float** RESTRICT src, float** RESTRICT dst, float** RESTRICT divBuffer, const int tileSize, const float kernel[13][13])
-{
-    const float c60 = kernel[0][6];
-    const float c53 = kernel[1][3];
-    const float c52 = kernel[1][4];
-    const float c51 = kernel[1][5];
-    const float c50 = kernel[1][6];
-    const float c44 = kernel[2][2];
-    const float c42 = kernel[2][4];
-    const float c41 = kernel[2][5];
-    const float c40 = kernel[2][6];
-    const float c33 = kernel[3][3];
-    const float c32 = kernel[3][4];
-    const float c31 = kernel[3][5];
-    const float c30 = kernel[3][6];
-    const float c22 = kernel[4][4];
-    const float c21 = kernel[4][5];
-    const float c20 = kernel[4][6];
-    const float c11 = kernel[5][5];
-    const float c10 = kernel[5][6];
-    const float c00 = kernel[6][6];
-
-    for (int i = 6; i < tileSize - 6; ++i) {
-        // I tried hand written SSE code but gcc vectorizes better
-#if defined(__clang__)
-        #pragma clang loop vectorize(assume_safety)
-#elif defined(__GNUC__)
-        #pragma GCC ivdep
-#endif
-        for (int j = 6; j < tileSize - 6; ++j) {
-            const float val = c60 * (src[i - 6][j] + src[i][j - 6] + src[i][j + 6] + src[i + 6][j]) +
-                              c53 * ((src[i - 5][j - 3] + src[i - 5][j + 3]) + (src[i - 3][j - 5] + src[i - 3][j + 5]) + (src[i + 3][j - 5] + src[i + 3][j + 5]) + (src[i + 5][j - 3] + src[i + 5][j + 3])) +
-                              c52 * ((src[i - 5][j - 2] + src[i - 5][j + 2]) + (src[i - 2][j - 5] + src[i - 2][j + 5]) + (src[i + 2][j - 5] + src[i + 2][j + 5]) + (src[i + 5][j - 2] + src[i + 5][j + 2])) +
-                              c51 * ((src[i - 5][j - 1] + src[i - 5][j + 1]) + (src[i - 1][j - 5] + src[i - 1][j + 5]) + (src[i + 1][j - 5] + src[i + 1][j + 5]) + (src[i + 5][j - 1] + src[i + 5][j + 1])) +
-                              c50 * ((src[i - 5][j] + src[i][j - 5] + src[i][j + 5] + src[i + 5][j]) + ((src[i - 4][j - 3] + src[i - 4][j + 3]) + (src[i - 3][j - 4] + src[i - 3][j + 4]) + (src[i + 3][j - 4] + src[i + 3][j + 4]) + (src[i + 4][j - 3] + src[i + 4][j + 3]))) +
-                              c44 * (src[i - 4][j - 4] + src[i - 4][j + 4] + src[i + 4][j - 4] + src[i + 4][j + 4]) +
-                              c42 * ((src[i - 4][j - 2] + src[i - 4][j + 2]) + (src[i - 2][j - 4] + src[i - 2][j + 4]) + (src[i + 2][j - 4] + src[i + 2][j + 4]) + (src[i + 4][j - 2] + src[i + 4][j + 2])) +
-                              c41 * ((src[i - 4][j - 1] + src[i - 4][j + 1]) + (src[i - 1][j - 4] + src[i - 1][j + 4]) + (src[i + 1][j - 4] + src[i + 1][j + 4]) + (src[i + 4][j - 1] + src[i + 4][j + 1])) +
-                              c40 * (src[i - 4][j] + src[i][j - 4] + src[i][j + 4] + src[i + 4][j]) +
-                              c33 * (src[i - 3][j - 3] + src[i - 3][j + 3] + src[i + 3][j - 3] + src[i + 3][j + 3]) +
-                              c32 * ((src[i - 3][j - 2] + src[i - 3][j + 2]) + (src[i - 2][j - 3] + src[i - 2][j + 3]) + (src[i + 2][j - 3] + src[i + 2][j + 3]) + (src[i + 3][j - 2] + src[i + 3][j + 2])) +
-                              c31 * ((src[i - 3][j - 1] + src[i - 3][j + 1]) + (src[i - 1][j - 3] + src[i - 1][j + 3]) + (src[i + 1][j - 3] + src[i + 1][j + 3]) + (src[i + 3][j - 1] + src[i + 3][j + 1])) +
-                              c30 * (src[i - 3][j] + src[i][j - 3] + src[i][j + 3] + src[i + 3][j]) +
-                              c22 * (src[i - 2][j - 2] + src[i - 2][j + 2] + src[i + 2][j - 2] + src[i + 2][j + 2]) +
-                              c21 * ((src[i - 2][j - 1] + src[i - 2][j + 1]) + (src[i - 1][j - 2] + src[i - 1][j + 2]) + (src[i + 1][j - 2] + src[i + 1][j + 2]) + (src[i + 2][j - 1] + src[i + 2][j + 1])) +
-                              c20 * (src[i - 2][j] + src[i][j - 2] + src[i][j + 2] + src[i + 2][j]) +
-                              c11 * (src[i - 1][j - 1] + src[i - 1][j + 1] + src[i + 1][j - 1] + src[i + 1][j + 1]) +
-                              c10 * (src[i - 1][j] + src[i][j - 1] + src[i][j + 1] + src[i + 1][j]) +
-                              c00 * src[i][j];
-
-            dst[i][j] = divBuffer[i][j] / std::max(val, 0.00001f);
-        }
-    }
-}
-
-void gauss3x3mult(float** RESTRICT src, float** RESTRICT dst, const int tileSize, const float kernel[3][3])
+float gauss3x3mult(float** RESTRICT src, float** RESTRICT dst, const int tileSize, const float kernel[3][3])
 {
     const float c11 = kernel[0][0];
     const float c10 = kernel[0][1];
     const float c00 = kernel[1][1];
 
+    float update = 0.f;
+
     for (int i = 1; i < tileSize - 1; i++) {
 #if defined(__clang__)
         #pragma clang loop vectorize(assume_safety)
@@ -339,12 +287,14 @@ void gauss3x3mult(float** RESTRICT src, float** RESTRICT dst, const int tileSize
                               c10 * (src[i - 1][j] + src[i][j - 1] + src[i][j + 1] + src[i + 1][j]) + 
                               c00 * src[i][j];
             dst[i][j] *= val;
+            update += std::fabs(val - 1.f);
         }
     }
 
+    return update / rtengine::SQR(tileSize - 2);
 }
 
-void gauss5x5mult (float** RESTRICT src, float** RESTRICT dst, const int tileSize, const float kernel[5][5])
+float gauss5x5mult (float** RESTRICT src, float** RESTRICT dst, const int tileSize, const float kernel[5][5])
 {
 
     const float c21 = kernel[0][1];
@@ -353,6 +303,8 @@ void gauss5x5mult (float** RESTRICT src, float** RESTRICT dst, const int tileSiz
     const float c10 = kernel[1][2];
     const float c00 = kernel[2][2];
 
+    float update = 0.f;
+
     for (int i = 2; i < tileSize - 2; ++i) {
         // I tried hand written SSE code but gcc vectorizes better
 #if defined(__clang__)
@@ -368,11 +320,14 @@ void gauss5x5mult (float** RESTRICT src, float** RESTRICT dst, const int tileSiz
                               c00 * src[i][j];
 
             dst[i][j] *= val;
+            update += std::fabs(val - 1.f);
         }
     }
+
+    return update / rtengine::SQR(tileSize - 4);
 }
 
-void gauss7x7mult(float** RESTRICT src, float** RESTRICT dst, const int tileSize, const float kernel[7][7])
+float gauss7x7mult(float** RESTRICT src, float** RESTRICT dst, const int tileSize, const float kernel[7][7])
 {
 
     const float c31 = kernel[0][2];
@@ -384,6 +339,8 @@ void gauss7x7mult(float** RESTRICT src, float** RESTRICT dst, const int tileSize
     const float c10 = kernel[2][3];
     const float c00 = kernel[3][3];
 
+    float update = 0.f;
+
     for (int i = 3; i < tileSize - 3; ++i) {
         // I tried hand written SSE code but gcc vectorizes better
 #if defined(__clang__)
@@ -402,11 +359,14 @@ void gauss7x7mult(float** RESTRICT src, float** RESTRICT dst, const int tileSize
                               c00 * src[i][j];
 
             dst[i][j] *= val;
+            update += std::fabs(val - 1.f);
         }
     }
+
+    return update / rtengine::SQR(tileSize - 6);
 }
 
-void gauss9x9mult(float** RESTRICT src, float** RESTRICT dst, const int tileSize, const float kernel[9][9])
+float gauss9x9mult(float** RESTRICT src, float** RESTRICT dst, const int tileSize, const float kernel[9][9])
 {
 
     const float c42 = kernel[0][2];
@@ -423,6 +383,8 @@ void gauss9x9mult(float** RESTRICT src, float** RESTRICT dst, const int tileSize
     const float c10 = kernel[3][4];
     const float c00 = kernel[4][4];
 
+    float update = 0.f;
+
     for (int i = 4; i < tileSize - 4; ++i) {
         // I tried hand written SSE code but gcc vectorizes better
 #if defined(__clang__)
@@ -445,66 +407,104 @@ void gauss9x9mult(float** RESTRICT src, float** RESTRICT dst, const int tileSize
                               c10 * (src[i - 1][j] + src[i][j - 1] + src[i][j + 1] + src[i + 1][j]) +
                               c00 * src[i][j];
             dst[i][j] *= val;
+            update += std::fabs(val - 1.f);
         }
     }
+
+    return update / rtengine::SQR(tileSize - 8);
 }
 
-void gauss13x13mult(float** RESTRICT src, float** RESTRICT dst, const int tileSize, const float kernel[13][13])
+void gauss13sep(float** RESTRICT src, float** RESTRICT tmp, float** RESTRICT dst, const int tileSize, const float kernel[13])
 {
-
-    const float c60 = kernel[0][6];
-    const float c53 = kernel[1][3];
-    const float c52 = kernel[1][4];
-    const float c51 = kernel[1][5];
-    const float c50 = kernel[1][6];
-    const float c44 = kernel[2][2];
-    const float c42 = kernel[2][4];
-    const float c41 = kernel[2][5];
-    const float c40 = kernel[2][6];
-    const float c33 = kernel[3][3];
-    const float c32 = kernel[3][4];
-    const float c31 = kernel[3][5];
-    const float c30 = kernel[3][6];
-    const float c22 = kernel[4][4];
-    const float c21 = kernel[4][5];
-    const float c20 = kernel[4][6];
-    const float c11 = kernel[5][5];
-    const float c10 = kernel[5][6];
-    const float c00 = kernel[6][6];
+    // separable 13 tap gaussian, horizontal pass on all rows, vertical pass where the kernel fits into the tile.
+    // Like the smaller kernels, the 13x13 kernel has circular support, so the 56 taps of the square outside of radius 6 are subtracted again.
+    const float c6 = kernel[0];
+    const float c5 = kernel[1];
+    const float c4 = kernel[2];
+    const float c3 = kernel[3];
+    const float c2 = kernel[4];
+    const float c1 = kernel[5];
+    const float c0 = kernel[6];
+    const float c66 = c6 * c6;
+    const float c65 = c6 * c5;
+    const float c64 = c6 * c4;
+    const float c63 = c6 * c3;
+    const float c62 = c6 * c2;
+    const float c61 = c6 * c1;
+    const float c55 = c5 * c5;
+    const float c54 = c5 * c4;
+
+    for (int i = 0; i < tileSize; ++i) {
+#if defined(__clang__)
+        #pragma clang loop vectorize(assume_safety)
+#elif defined(__GNUC__)
+        #pragma GCC ivdep
+#endif
+        for (int j = 6; j < tileSize - 6; ++j) {
+            tmp[i][j] = c6 * (src[i][j - 6] + src[i][j + 6]) +
+                        c5 * (src[i][j - 5] + src[i][j + 5]) +
+                        c4 * (src[i][j - 4] + src[i][j + 4]) +
+                        c3 * (src[i][j - 3] + src[i][j + 3]) +
+                        c2 * (src[i][j - 2] + src[i][j + 2]) +
+                        c1 * (src[i][j - 1] + src[i][j + 1]) +
+                        c0 * src[i][j];
+        }
+    }
 
     for (int i = 6; i < tileSize - 6; ++i) {
-        // I tried hand written SSE code but gcc vectorizes better
 #if defined(__clang__)
         #pragma clang loop vectorize(assume_safety)
 #elif defined(__GNUC__)
         #pragma GCC ivdep
 #endif
         for (int j = 6; j < tileSize - 6; ++j) {
-            const float val = c60 * (src[i - 6][j] + src[i][j - 6] + src[i][j + 6] + src[i + 6][j]) +
-                              c53 * ((src[i - 5][j - 3] + src[i - 5][j + 3]) + (src[i - 3][j - 5] + src[i - 3][j + 5]) + (src[i + 3][j - 5] + src[i + 3][j + 5]) + (src[i + 5][j - 3] + src[i + 5][j + 3])) +
-                              c52 * ((src[i - 5][j - 2] + src[i - 5][j + 2]) + (src[i - 2][j - 5] + src[i - 2][j + 5]) + (src[i + 2][j - 5] + src[i + 2][j + 5]) + (src[i + 5][j - 2] + src[i + 5][j + 2])) +
-                              c51 * ((src[i - 5][j - 1] + src[i - 5][j + 1]) + (src[i - 1][j - 5] + src[i - 1][j + 5]) + (src[i + 1][j - 5] + src[i + 1][j + 5]) + (src[i + 5][j - 1] + src[i + 5][j + 1])) +
-                              c50 * ((src[i - 5][j] + src[i][j - 5] + src[i][j + 5] + src[i + 5][j]) + ((src[i - 4][j - 3] + src[i - 4][j + 3]) + (src[i - 3][j - 4] + src[i - 3][j + 4]) + (src[i + 3][j - 4] + src[i + 3][j + 4]) + (src[i + 4][j - 3] + src[i + 4][j + 3]))) +
-                              c44 * (src[i - 4][j - 4] + src[i - 4][j + 4] + src[i + 4][j - 4] + src[i + 4][j + 4]) +
-                              c42 * ((src[i - 4][j - 2] + src[i - 4][j + 2]) + (src[i - 2][j - 4] + src[i - 2][j + 4]) + (src[i + 2][j - 4] + src[i + 2][j + 4]) + (src[i + 4][j - 2] + src[i + 4][j + 2])) +
-                              c41 * ((src[i - 4][j - 1] + src[i - 4][j + 1]) + (src[i - 1][j - 4] + src[i - 1][j + 4]) + (src[i + 1][j - 4] + src[i + 1][j + 4]) + (src[i + 4][j - 1] + src[i + 4][j + 1])) +
-                              c40 * (src[i - 4][j] + src[i][j - 4] + src[i][j + 4] + src[i + 4][j]) +
-                              c33 * (src[i - 3][j - 3] + src[i - 3][j + 3] + src[i + 3][j - 3] + src[i + 3][j + 3]) +
-                              c32 * ((src[i - 3][j - 2] + src[i - 3][j + 2]) + (src[i - 2][j - 3] + src[i - 2][j + 3]) + (src[i + 2][j - 3] + src[i + 2][j + 3]) + (src[i + 3][j - 2] + src[i + 3][j + 2])) +
-                              c31 * ((src[i - 3][j - 1] + src[i - 3][j + 1]) + (src[i - 1][j - 3] + src[i - 1][j + 3]) + (src[i + 1][j - 3] + src[i + 1][j + 3]) + (src[i + 3][j - 1] + src[i + 3][j + 1])) +
-                              c30 * (src[i - 3][j] + src[i][j - 3] + src[i][j + 3] + src[i + 3][j]) +
-                              c22 * (src[i - 2][j - 2] + src[i - 2][j + 2] + src[i + 2][j - 2] + src[i + 2][j + 2]) +
-                              c21 * ((src[i - 2][j - 1] + src[i - 2][j + 1]) + (src[i - 1][j - 2] + src[i - 1][j + 2]) + (src[i + 1][j - 2] + src[i + 1][j + 2]) + (src[i + 2][j - 1] + src[i + 2][j + 1])) +
-                              c20 * (src[i - 2][j] + src[i][j - 2] + src[i][j + 2] + src[i + 2][j]) +
-                              c11 * (src[i - 1][j - 1] + src[i - 1][j + 1] + src[i + 1][j - 1] + src[i + 1][j + 1]) +
-                              c10 * (src[i - 1][j] + src[i][j - 1] + src[i][j + 1] + src[i + 1][j]) +
-                              c00 * src[i][j];
+            const float square = c6 * (tmp[i - 6][j] + tmp[i + 6][j]) +
+                                 c5 * (tmp[i - 5][j] + tmp[i + 5][j]) +
+                                 c4 * (tmp[i - 4][j] + tmp[i + 4][j]) +
+                                 c3 * (tmp[i - 3][j] + tmp[i + 3][j]) +
+                                 c2 * (tmp[i - 2][j] + tmp[i + 2][j]) +
+                                 c1 * (tmp[i - 1][j] + tmp[i + 1][j]) +
+                                 c0 * tmp[i][j];
+            const float corners = c66 * (src[i - 6][j - 6] + src[i - 6][j + 6] + src[i + 6][j - 6] + src[i + 6][j + 6]) +
+                                  c65 * ((src[i - 6][j - 5] + src[i - 6][j + 5]) + (src[i - 5][j - 6] + src[i - 5][j + 6]) + (src[i + 5][j - 6] + src[i + 5][j + 6]) + (src[i + 6][j - 5] + src[i + 6][j + 5])) +
+                                  c64 * ((src[i - 6][j - 4] + src[i - 6][j + 4]) + (src[i - 4][j - 6] + src[i - 4][j + 6]) + (src[i + 4][j - 6] + src[i + 4][j + 6]) + (src[i + 6][j - 4] + src[i + 6][j + 4])) +
+                                  c63 * ((src[i - 6][j - 3] + src[i - 6][j + 3]) + (src[i - 3][j - 6] + src[i - 3][j + 6]) + (src[i + 3][j - 6] + src[i + 3][j + 6]) + (src[i + 6][j - 3] + src[i + 6][j + 3])) +
+                                  c62 * ((src[i - 6][j - 2] + src[i - 6][j + 2]) + (src[i - 2][j - 6] + src[i - 2][j + 6]) + (src[i + 2][j - 6] + src[i + 2][j + 6]) + (src[i + 6][j - 2] + src[i + 6][j + 2])) +
+                                  c61 * ((src[i - 6][j - 1] + src[i - 6][j + 1]) + (src[i - 1][j - 6] + src[i - 1][j + 6]) + (src[i + 1][j - 6] + src[i + 1][j + 6]) + (src[i + 6][j - 1] + src[i + 6][j + 1])) +
+                                  c55 * (src[i - 5][j - 5] + src[i - 5][j + 5] + src[i + 5][j - 5] + src[i + 5][j + 5]) +
+                                  c54 * ((src[i - 5][j - 4] + src[i - 5][j + 4]) + (src[i - 4][j - 5] + src[i - 4][j + 5]) + (src[i + 4][j - 5] + src[i + 4][j + 5]) + (src[i + 5][j - 4] + src[i + 5][j + 4]));
+            dst[i][j] = square - corners;
+        }
+    }
+}
 
-            dst[i][j] *= val;
+void gauss13sepdiv(float** RESTRICT src, float** RESTRICT dst, float** RESTRICT divBuffer, float** RESTRICT blurBuffer, float** RESTRICT tmpBuffer, const int tileSize, const float kernel[13])
+{
+    gauss13sep(src, tmpBuffer, blurBuffer, tileSize, kernel);
+
+    for (int i = 6; i < tileSize - 6; ++i) {
+        for (int j = 6; j < tileSize - 6; ++j) {
+            dst[i][j] = divBuffer[i][j] / std::max(blurBuffer[i][j], 0.00001f);
         }
     }
 }
 
+float gauss13sepmult(float** RESTRICT src, float** RESTRICT dst, float** RESTRICT blurBuffer, float** RESTRICT tmpBuffer, const int tileSize, const float kernel[13])
+{
+    gauss13sep(src, tmpBuffer, blurBuffer, tileSize, kernel);
+
+    float update = 0.f;
+
+    for (int i = 6; i < tileSize - 6; ++i) {
+        for (int j = 6; j < tileSize - 6; ++j) {
+            dst[i][j] *= blurBuffer[i][j];
+            update += std::fabs(blurBuffer[i][j] - 1.f);
+        }
+    }
+
+    return update / rtengine::SQR(tileSize - 12);
+}
+
 void buildClipMaskBayer(const float * const *rawData, int W, int H, float** clipMask, const float whites[2][2])
 {
 
@@ -757,14 +757,14 @@ bool checkForStop(float** tmpIThr, float** iterCheck, int fullTileSize, int bord
     return false;
 }
 
-void CaptureDeconvSharpening (float** luminance, const float* const * oldLuminance, const float * const * blend, int W, int H, float sigma, float sigmaCornerOffset, int iterations, bool checkIterStop, rtengine::ProgressListener* plistener, double startVal, double endVal)
+void CaptureDeconvSharpening (float** luminance, const float* const * oldLuminance, const float * const * blend, int W, int H, int offsetX, int offsetY, int fullWidth, int fullHeight, float sigma, float sigmaCornerOffset, int iterations, bool checkIterStop, rtengine::ProgressListener* plistener, double startVal, double endVal)
 {
 BENCHFUN
     const bool is9x9 = (sigma <= 1.5f && sigmaCornerOffset == 0.f);
     const bool is7x7 = (sigma <= 1.15f && sigmaCornerOffset == 0.f);
     const bool is5x5 = (sigma <= 0.84f && sigmaCornerOffset == 0.f);
     const bool is3x3 = (sigma < 0.6f && sigmaCornerOffset == 0.f);
-    float kernel13[13][13];
+    float kernel13[13];
     float kernel9[9][9];
     float kernel7[7][7];
     float kernel5[5][5];
@@ -778,20 +778,22 @@ BENCHFUN
     } else if (is9x9) {
         compute9x9kernel(sigma, kernel9);
     } else {
-        compute13x13kernel(sigma, kernel13);
+        compute13kernel(sigma, kernel13);
     }
 
     constexpr int tileSize = 32;
     const int border = (is3x3 || is5x5 || is7x7) ? iterations <= 30 ? 5 : 7 : 8;
     const int fullTileSize = tileSize + 2 * border;
     const float cornerRadius = std::min<float>(2.f, sigma + sigmaCornerOffset);
-    const float cornerDistance = sqrt(rtengine::SQR(W * 0.5f) + rtengine::SQR(H * 0.5f));
+    const float cornerDistance = sqrt(rtengine::SQR(fullWidth * 0.5f) + rtengine::SQR(fullHeight * 0.5f));
     const float distanceFactor = (cornerRadius - sigma) / cornerDistance;
 
     double progress = startVal;
     const double progressStep = (endVal - startVal) * rtengine::SQR(tileSize) / (W * H);
 
     constexpr float minBlend = 0.01f;
+    // stop iterating a tile when the remaining iterations can't change it by more than 0.1% on average
+    constexpr float convergenceLimit = 0.001f;
 
 #ifdef _OPENMP
     #pragma omp parallel
@@ -803,6 +805,9 @@ BENCHFUN
         tmpThr.fill(1.f);
         array2D<float> lumThr(fullTileSize, fullTileSize);
         array2D<float> iterCheck(tileSize, tileSize);
+        // intermediate buffers for the separable 13x13 gaussian
+        array2D<float> blurThr(fullTileSize, fullTileSize);
+        array2D<float> sepThr(fullTileSize, fullTileSize);
 #ifdef _OPENMP
         #pragma omp for schedule(dynamic,16) collapse(2)
 #endif
@@ -869,8 +874,8 @@ BENCHFUN
                     for (int k = 0; k < iterations; ++k) {
                         // apply 3x3 gaussian blur and divide luminance by result of gaussian blur
                         gauss3x3div(tmpIThr, tmpThr, lumThr, fullTileSize, kernel3);
-                        gauss3x3mult(tmpThr, tmpIThr, fullTileSize, kernel3);
-                        if (checkIterStop && k < iterations - 1 && checkForStop(tmpIThr, iterCheck, fullTileSize, border)) {
+                        const float update = gauss3x3mult(tmpThr, tmpIThr, fullTileSize, kernel3);
+                        if (checkIterStop && k < iterations - 1 && (update * (iterations - k - 1) < convergenceLimit || checkForStop(tmpIThr, iterCheck, fullTileSize, border))) {
                             break;
                         }
                     }
@@ -878,8 +883,8 @@ BENCHFUN
                     for (int k = 0; k < iterations; ++k) {
                         // apply 5x5 gaussian blur and divide luminance by result of gaussian blur
                         gauss5x5div(tmpIThr, tmpThr, lumThr, fullTileSize, kernel5);
-                        gauss5x5mult(tmpThr, tmpIThr, fullTileSize, kernel5);
-                        if (checkIterStop && k < iterations - 1 && checkForStop(tmpIThr, iterCheck, fullTileSize, border)) {
+                        const float update = gauss5x5mult(tmpThr, tmpIThr, fullTileSize, kernel5);
+                        if (checkIterStop && k < iterations - 1 && (update * (iterations - k - 1) < convergenceLimit || checkForStop(tmpIThr, iterCheck, fullTileSize, border))) {
                             break;
                         }
                     }
@@ -887,8 +892,8 @@ BENCHFUN
                     for (int k = 0; k < iterations; ++k) {
                         // apply 5x5 gaussian blur and divide luminance by result of gaussian blur
                         gauss7x7div(tmpIThr, tmpThr, lumThr, fullTileSize, kernel7);
-                        gauss7x7mult(tmpThr, tmpIThr, fullTileSize, kernel7);
-                        if (checkIterStop && k < iterations - 1 && checkForStop(tmpIThr, iterCheck, fullTileSize, border)) {
+                        const float update = gauss7x7mult(tmpThr, tmpIThr, fullTileSize, kernel7);
+                        if (checkIterStop && k < iterations - 1 && (update * (iterations - k - 1) < convergenceLimit || checkForStop(tmpIThr, iterCheck, fullTileSize, border))) {
                             break;
                         }
                     }
@@ -896,24 +901,24 @@ BENCHFUN
                     for (int k = 0; k < iterations; ++k) {
                         // apply 5x5 gaussian blur and divide luminance by result of gaussian blur
                         gauss9x9div(tmpIThr, tmpThr, lumThr, fullTileSize, kernel9);
-                        gauss9x9mult(tmpThr, tmpIThr, fullTileSize, kernel9);
-                        if (checkIterStop && k < iterations - 1 && checkForStop(tmpIThr, iterCheck, fullTileSize, border)) {
+                        const float update = gauss9x9mult(tmpThr, tmpIThr, fullTileSize, kernel9);
+                        if (checkIterStop && k < iterations - 1 && (update * (iterations - k - 1) < convergenceLimit || checkForStop(tmpIThr, iterCheck, fullTileSize, border))) {
                             break;
                         }
                     }
                 } else {
                     if (sigmaCornerOffset != 0.f) {
-                        const float distance = sqrt(rtengine::SQR(i + tileSize / 2 - H / 2) + rtengine::SQR(j + tileSize / 2 - W / 2));
+                        const float distance = sqrt(rtengine::SQR(offsetY + i + tileSize / 2 - fullHeight / 2) + rtengine::SQR(offsetX + j + tileSize / 2 - fullWidth / 2));
                         const float sigmaTile = static_cast<float>(sigma) + distanceFactor * distance;
                         if (sigmaTile >= 0.4f) {
                             if (sigmaTile > 1.5f) { // have to use 13x13 kernel
-                                float lkernel13[13][13];
-                                compute13x13kernel(static_cast<float>(sigma) + distanceFactor * distance, lkernel13);
+                                float lkernel13[13];
+                                compute13kernel(static_cast<float>(sigma) + distanceFactor * distance, lkernel13);
                                 for (int k = 0; k < iterations; ++k) {
-                                    // apply 13x13 gaussian blur and divide luminance by result of gaussian blur
-                                    gauss13x13div(tmpIThr, tmpThr, lumThr, fullTileSize, lkernel13);
-                                    gauss13x13mult(tmpThr, tmpIThr, fullTileSize, lkernel13);
-                                    if (checkIterStop && k < iterations - 1 && checkForStop(tmpIThr, iterCheck, fullTileSize, border)) {
+                                    // apply separable 13x13 gaussian blur and divide luminance by result of gaussian blur
+                                    gauss13sepdiv(tmpIThr, tmpThr, lumThr, blurThr, sepThr, fullTileSize, lkernel13);
+                                    const float update = gauss13sepmult(tmpThr, tmpIThr, blurThr, sepThr, fullTileSize, lkernel13);
+                                    if (checkIterStop && k < iterations - 1 && (update * (iterations - k - 1) < convergenceLimit || checkForStop(tmpIThr, iterCheck, fullTileSize, border))) {
                                         break;
                                     }
                                 }
@@ -923,8 +928,8 @@ BENCHFUN
                                 for (int k = 0; k < iterations; ++k) {
                                     // apply 9x9 gaussian blur and divide luminance by result of gaussian blur
                                     gauss9x9div(tmpIThr, tmpThr, lumThr, fullTileSize, lkernel9);
-                                    gauss9x9mult(tmpThr, tmpIThr, fullTileSize, lkernel9);
-                                    if (checkIterStop && k < iterations - 1 && checkForStop(tmpIThr, iterCheck, fullTileSize, border)) {
+                                    const float update = gauss9x9mult(tmpThr, tmpIThr, fullTileSize, lkernel9);
+                                    if (checkIterStop && k < iterations - 1 && (update * (iterations - k - 1) < convergenceLimit || checkForStop(tmpIThr, iterCheck, fullTileSize, border))) {
                                         break;
                                     }
                                 }
@@ -934,8 +939,8 @@ BENCHFUN
                                 for (int k = 0; k < iterations; ++k) {
                                     // apply 7x7 gaussian blur and divide luminance by result of gaussian blur
                                     gauss7x7div(tmpIThr, tmpThr, lumThr, fullTileSize, lkernel7);
-                                    gauss7x7mult(tmpThr, tmpIThr, fullTileSize, lkernel7);
-                                    if (checkIterStop && k < iterations - 1 && checkForStop(tmpIThr, iterCheck, fullTileSize, border)) {
+                                    const float update = gauss7x7mult(tmpThr, tmpIThr, fullTileSize, lkernel7);
+                                    if (checkIterStop && k < iterations - 1 && (update * (iterations - k - 1) < convergenceLimit || checkForStop(tmpIThr, iterCheck, fullTileSize, border))) {
                                         break;
                                     }
                                 }
@@ -945,8 +950,8 @@ BENCHFUN
                                 for (int k = 0; k < iterations; ++k) {
                                     // apply 7x7 gaussian blur and divide luminance by result of gaussian blur
                                     gauss5x5div(tmpIThr, tmpThr, lumThr, fullTileSize, lkernel5);
-                                    gauss5x5mult(tmpThr, tmpIThr, fullTileSize, lkernel5);
-                                    if (checkIterStop && k < iterations - 1 && checkForStop(tmpIThr, iterCheck, fullTileSize, border)) {
+                                    const float update = gauss5x5mult(tmpThr, tmpIThr, fullTileSize, lkernel5);
+                                    if (checkIterStop && k < iterations - 1 && (update * (iterations - k - 1) < convergenceLimit || checkForStop(tmpIThr, iterCheck, fullTileSize, border))) {
                                         break;
                                     }
                                 }
@@ -954,10 +959,10 @@ BENCHFUN
                         }
                     } else {
                         for (int k = 0; k < iterations; ++k) {
-                            // apply 13x13 gaussian blur and divide luminance by result of gaussian blur
-                            gauss13x13div(tmpIThr, tmpThr, lumThr, fullTileSize, kernel13);
-                            gauss13x13mult(tmpThr, tmpIThr, fullTileSize, kernel13);
-                            if (checkIterStop && k < iterations - 1 && checkForStop(tmpIThr, iterCheck, fullTileSize, border)) {
+                            // apply separable 13x13 gaussian blur and divide luminance by result of gaussian blur
+                            gauss13sepdiv(tmpIThr, tmpThr, lumThr, blurThr, sepThr, fullTileSize, kernel13);
+                            const float update = gauss13sepmult(tmpThr, tmpIThr, blurThr, sepThr, fullTileSize, kernel13);
+                            if (checkIterStop && k < iterations - 1 && (update * (iterations - k - 1) < convergenceLimit || checkForStop(tmpIThr, iterCheck, fullTileSize, border))) {
                                 break;
                             }
                         }
@@ -1005,6 +1010,26 @@ void RawImageSource::captureSharpening(const procparams::CaptureSharpeningParams
         return;
     }
 
+    MyMutex::MyLock lock(deferredMutex);
+
+    if (demosaicDeferred) {
+        // the binned preview doesn't show capture sharpening, it's applied once the image is demosaiced
+        deferredSharpening = true;
+        deferredShowMask = showMask;
+        deferredSharpeningParams = sharpeningParams;
+
+        if (demosaicWindowW > 0 && !showMask) {
+            // but the already demosaiced window of the detail crops is sharpened right away
+            captureSharpeningArea(sharpeningParams, false, conrastThreshold, radius, demosaicWindowX, demosaicWindowY, demosaicWindowW, demosaicWindowH);
+        }
+        return;
+    }
+
+    captureSharpeningArea(sharpeningParams, showMask, conrastThreshold, radius, 0, 0, W, H);
+}
+
+void RawImageSource::captureSharpeningArea(const procparams::CaptureSharpeningParams &sharpeningParams, bool showMask, double &conrastThreshold, double &radius, int x, int y, int w, int h) {
+
     if (plistener) {
         plistener->setProgressStr(M("TP_PDSHARPENING_LABEL"));
         plistener->setProgress(0.0);
@@ -1017,45 +1042,62 @@ BENCHFUN
                                     { 0.019334, 0.119193, 0.950227 }
                                 };
 
+    // auto contrast and auto radius are frame statistics, for a part of the frame we use the values of the last full frame run if available
+    const bool fullFrame = x == 0 && y == 0 && w == W && h == H;
+    const bool autoContrast = sharpeningParams.autoContrast && (fullFrame || lastAutoSharpenContrast < 0.0);
+    const bool autoRadius = sharpeningParams.autoRadius && (fullFrame || lastAutoSharpenRadius < 0.0);
+
+    if (sharpeningParams.autoContrast && !autoContrast) {
+        conrastThreshold = lastAutoSharpenContrast;
+    }
+
+    if (sharpeningParams.autoRadius && !autoRadius) {
+        radius = lastAutoSharpenRadius;
+    }
+
     float contrast = conrastThreshold / 100.0;
 
     const float clipVal = (ri->get_white(1) - ri->get_cblack(1)) * scale_mul[1];
 
-    const array2D<float>& redVals = redCache ? *redCache : red;
-    const array2D<float>& greenVals = greenCache ? *greenCache : green;
-    const array2D<float>& blueVals = blueCache ? *blueCache : blue;
+    array2D<float> rawArea(w, h, x, y, rawData, ARRAY2D_BYREFERENCE);
+    array2D<float> redArea(w, h, x, y, red, ARRAY2D_BYREFERENCE);
+    array2D<float> greenArea(w, h, x, y, green, ARRAY2D_BYREFERENCE);
+    array2D<float> blueArea(w, h, x, y, blue, ARRAY2D_BYREFERENCE);
+    const array2D<float> redVals(w, h, x, y, redCache ? static_cast<float**>(*redCache) : static_cast<float**>(red), ARRAY2D_BYREFERENCE);
+    const array2D<float> greenVals(w, h, x, y, greenCache ? static_cast<float**>(*greenCache) : static_cast<float**>(green), ARRAY2D_BYREFERENCE);
+    const array2D<float> blueVals(w, h, x, y, blueCache ? static_cast<float**>(*blueCache) : static_cast<float**>(blue), ARRAY2D_BYREFERENCE);
 
-    array2D<float> clipMask(W, H);
+    array2D<float> clipMask(w, h);
     constexpr float clipLimit = 0.95f;
     constexpr float maxSigma = 2.f;
 
     if (getSensorType() == ST_BAYER) {
         const float whites[2][2] = {
-                                    {(ri->get_white(FC(0,0)) - c_black[FC(0,0)]) * scale_mul[FC(0,0)] * clipLimit, (ri->get_white(FC(0,1)) - c_black[FC(0,1)]) * scale_mul[FC(0,1)] * clipLimit},
-                                    {(ri->get_white(FC(1,0)) - c_black[FC(1,0)]) * scale_mul[FC(1,0)] * clipLimit, (ri->get_white(FC(1,1)) - c_black[FC(1,1)]) * scale_mul[FC(1,1)] * clipLimit}
+                                    {(ri->get_white(FC(y, x)) - c_black[FC(y, x)]) * scale_mul[FC(y, x)] * clipLimit, (ri->get_white(FC(y, x + 1)) - c_black[FC(y, x + 1)]) * scale_mul[FC(y, x + 1)] * clipLimit},
+                                    {(ri->get_white(FC(y + 1, x)) - c_black[FC(y + 1, x)]) * scale_mul[FC(y + 1, x)] * clipLimit, (ri->get_white(FC(y + 1, x + 1)) - c_black[FC(y + 1, x + 1)]) * scale_mul[FC(y + 1, x + 1)] * clipLimit}
                                    };
-        buildClipMaskBayer(rawData, W, H, clipMask, whites);
-        const unsigned int fc[2] = {FC(0,0), FC(1,0)};
-        if (sharpeningParams.autoRadius) {
-            radius = std::min(calcRadiusBayer(rawData, W, H, 1000.f, clipVal, fc), maxSigma);
+        buildClipMaskBayer(rawArea, w, h, clipMask, whites);
+        const unsigned int fc[2] = {FC(y, x), FC(y + 1, x)};
+        if (autoRadius) {
+            radius = std::min(calcRadiusBayer(rawArea, w, h, 1000.f, clipVal, fc), maxSigma);
         }
     } else if (getSensorType() == ST_FUJI_XTRANS) {
         float whites[6][6];
         for (int i = 0; i < 6; ++i) {
             for (int j = 0; j < 6; ++j) {
-                const auto color = ri->XTRANSFC(i, j);
+                const auto color = ri->XTRANSFC(y + i, x + j);
                 whites[i][j] = (ri->get_white(color) - c_black[color]) * scale_mul[color] * clipLimit;
             }
         }
-        buildClipMaskXtrans(rawData, W, H, clipMask, whites);
+        buildClipMaskXtrans(rawArea, w, h, clipMask, whites);
         bool found = false;
         int i, j;
         for (i = 6; i < 12 && !found; ++i) {
             for (j = 6; j < 12 && !found; ++j) {
-                if (ri->XTRANSFC(i, j) == 1) {
-                    if (ri->XTRANSFC(i, j - 1) != ri->XTRANSFC(i, j + 1)) {
-                        if (ri->XTRANSFC(i - 1, j) != 1) {
-                            if (ri->XTRANSFC(i, j - 1) != 1) {
+                if (ri->XTRANSFC(y + i, x + j) == 1) {
+                    if (ri->XTRANSFC(y + i, x + j - 1) != ri->XTRANSFC(y + i, x + j + 1)) {
+                        if (ri->XTRANSFC(y + i - 1, x + j) != 1) {
+                            if (ri->XTRANSFC(y + i, x + j - 1) != 1) {
                                 found = true;
                                 break;
                             }
@@ -1064,15 +1106,15 @@ BENCHFUN
                 }
             }
         }
-        if (sharpeningParams.autoRadius) {
-            radius = std::min(calcRadiusXtrans(rawData, W, H, 1000.f, clipVal, i, j), maxSigma);
+        if (autoRadius) {
+            radius = std::min(calcRadiusXtrans(rawArea, w, h, 1000.f, clipVal, i, j), maxSigma);
         }
 
     } else if (ri->get_colors() == 1) {
-        buildClipMaskMono(rawData, W, H, clipMask, (ri->get_white(0) - c_black[0]) * scale_mul[0] * clipLimit);
-        if (sharpeningParams.autoRadius) {
+        buildClipMaskMono(rawArea, w, h, clipMask, (ri->get_white(0) - c_black[0]) * scale_mul[0] * clipLimit);
+        if (autoRadius) {
             const unsigned int fc[2] = {0, 0};
-            radius = std::min(calcRadiusBayer(rawData, W, H, 1000.f, clipVal, fc), maxSigma);
+            radius = std::min(calcRadiusBayer(rawArea, w, h, 1000.f, clipVal, fc), maxSigma);
         }
     }
 
@@ -1081,19 +1123,19 @@ BENCHFUN
     }
 
     if (showMask) {
-        array2D<float>& L = blue; // blue will be overridden anyway => we can use its buffer to store L
+        array2D<float>& L = blueArea; // blue will be overridden anyway => we can use its buffer to store L
 #ifdef _OPENMP
         #pragma omp parallel for
 #endif
 
-        for (int i = 0; i < H; ++i) {
-            Color::RGB2L(redVals[i], greenVals[i], blueVals[i], L[i], xyz_rgb, W);
+        for (int i = 0; i < h; ++i) {
+            Color::RGB2L(redVals[i], greenVals[i], blueVals[i], L[i], xyz_rgb, w);
         }
         if (plistener) {
             plistener->setProgress(0.1);
         }
 
-        buildBlendMask(L, clipMask, W, H, contrast, sharpeningParams.autoContrast, clipMask);
+        buildBlendMask(L, clipMask, w, h, contrast, autoContrast, clipMask);
         if (plistener) {
             plistener->setProgress(0.2);
         }
@@ -1101,9 +1143,9 @@ BENCHFUN
 #ifdef _OPENMP
         #pragma omp parallel for
 #endif
-        for (int i = 0; i < H; ++i) {
-            for (int j = 0; j < W; ++j) {
-                red[i][j] = green[i][j] = blue[i][j] = clipMask[i][j] * 16384.f;
+        for (int i = 0; i < h; ++i) {
+            for (int j = 0; j < w; ++j) {
+                redArea[i][j] = greenArea[i][j] = blueArea[i][j] = clipMask[i][j] * 16384.f;
             }
         }
         if (plistener) {
@@ -1114,40 +1156,46 @@ BENCHFUN
 
     std::unique_ptr<array2D<float>> Lbuffer;
     if (!redCache) {
-        Lbuffer.reset(new array2D<float>(W, H));
+        Lbuffer.reset(new array2D<float>(w, h));
     }
 
     std::unique_ptr<array2D<float>> YOldbuffer;
     if (!greenCache) {
-        YOldbuffer.reset(new array2D<float>(W, H));
+        YOldbuffer.reset(new array2D<float>(w, h));
     }
 
     std::unique_ptr<array2D<float>> YNewbuffer;
     if (!blueCache) {
-        YNewbuffer.reset(new array2D<float>(W, H));
+        YNewbuffer.reset(new array2D<float>(w, h));
     }
-    array2D<float>& L = Lbuffer.get() ? *Lbuffer.get() : red;
-    array2D<float>& YOld = YOldbuffer.get() ? *YOldbuffer.get() : green;
-    array2D<float>& YNew = YNewbuffer.get() ? *YNewbuffer.get() : blue;
+    array2D<float>& L = Lbuffer.get() ? *Lbuffer.get() : redArea;
+    array2D<float>& YOld = YOldbuffer.get() ? *YOldbuffer.get() : greenArea;
+    array2D<float>& YNew = YNewbuffer.get() ? *YNewbuffer.get() : blueArea;
 
 #ifdef _OPENMP
     #pragma omp parallel for schedule(dynamic, 16)
 #endif
-    for (int i = 0; i < H; ++i) {
-        Color::RGB2L(redVals[i], greenVals[i], blueVals[i], L[i], xyz_rgb, W);
-        Color::RGB2Y(redVals[i], greenVals[i], blueVals[i], YOld[i], YNew[i], W);
+    for (int i = 0; i < h; ++i) {
+        Color::RGB2L(redVals[i], greenVals[i], blueVals[i], L[i], xyz_rgb, w);
+        Color::RGB2Y(redVals[i], greenVals[i], blueVals[i], YOld[i], YNew[i], w);
     }
     if (plistener) {
         plistener->setProgress(0.1);
     }
 
     // calculate contrast based blend factors to reduce sharpening in regions with low contrast
-    buildBlendMask(L, clipMask, W, H, contrast, sharpeningParams.autoContrast, clipMask);
+    buildBlendMask(L, clipMask, w, h, contrast, autoContrast, clipMask);
     if (plistener) {
         plistener->setProgress(0.2);
     }
     conrastThreshold = contrast * 100.f;
-    CaptureDeconvSharpening(YNew, YOld, clipMask, W, H, radius, sharpeningParams.deconvradiusOffset, sharpeningParams.deconviter, sharpeningParams.deconvitercheck, plistener, 0.2, 0.9);
+
+    if (fullFrame) {
+        lastAutoSharpenContrast = sharpeningParams.autoContrast ? conrastThreshold : -1.0;
+        lastAutoSharpenRadius = sharpeningParams.autoRadius ? radius : -1.0;
+    }
+
+    CaptureDeconvSharpening(YNew, YOld, clipMask, w, h, x, y, W, H, radius, sharpeningParams.deconvradiusOffset, sharpeningParams.deconviter, sharpeningParams.deconvitercheck, plistener, 0.2, 0.9);
     if (plistener) {
         plistener->setProgress(0.9);
     }
@@ -1155,17 +1203,17 @@ BENCHFUN
 #ifdef _OPENMP
     #pragma omp parallel for schedule(dynamic, 16)
 #endif
-    for (int i = 0; i < H; ++i) {
+    for (int i = 0; i < h; ++i) {
 #if defined(__clang__)
         #pragma clang loop vectorize(assume_safety)
 #elif defined(__GNUC__)
         #pragma GCC ivdep
 #endif
-        for (int j = 0; j < W; ++j) {
+        for (int j = 0; j < w; ++j) {
             const float factor = YNew[i][j] / std::max(YOld[i][j], 0.00001f);
-            red[i][j] = redVals[i][j] * factor;
-            green[i][j] = greenVals[i][j] * factor;
-            blue[i][j] = blueVals[i][j] * factor;
+            redArea[i][j] = redVals[i][j] * factor;
+            greenArea[i][j] = greenVals[i][j] * factor;
+            blueArea[i][j] = blueVals[i][j] * factor;
         }
     }
 
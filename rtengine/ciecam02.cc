@@ -19,6 +19,7 @@
 #include "ciecam02.h"
 #include "rt_math.h"
 #include "curves.h"
+#include "LUT.h"
 #include <math.h>
 #include "sleef.h"
 
@@ -37,7 +38,49 @@
 #define Jzazbz_ni (16384.0/2610.0)
 #define Jzazbz_pi (32.0/4289.1)  //4289.1 = 2523 * 1.7
 
+namespace
+{
+
+// The post-adaptation nonlinearity and its inverse are tabulated for the usual range of the responses,
+// values above the range (very bright scenes, highlights) still use pow_F.
+constexpr float nonlinearRange = 4.f;
+constexpr float nonlinearScale = 65535.f / nonlinearRange;
+
+// x^0.42 indexed by sqrt(x) for x in [0;nonlinearRange^2], the square root keeps the steep start accurate
+const LUTf& getNonlinearLut()
+{
+    static LUTf lut(65536, LUT_CLIP_BELOW | LUT_CLIP_ABOVE);
+    static const bool initialized = []() -> bool
+        {
+            for (int i = 0; i < 65536; ++i) {
+                lut[i] = std::pow(i / static_cast<double>(nonlinearScale), 0.84);
+            }
+
+            return true;
+        }();
+    static_cast<void>(initialized);
+
+    return lut;
+}
 
+// x^(1/0.42) for x in [0;nonlinearRange]
+const LUTf& getInverseNonlinearLut()
+{
+    static LUTf lut(65536, LUT_CLIP_BELOW | LUT_CLIP_ABOVE);
+    static const bool initialized = []() -> bool
+        {
+            for (int i = 0; i < 65536; ++i) {
+                lut[i] = std::pow(i / static_cast<double>(nonlinearScale), 2.38095238);
+            }
+
+            return true;
+        }();
+    static_cast<void>(initialized);
+
+    return lut;
+}
+
+}
 
 namespace rtengine
 {
@@ -1083,13 +1126,12 @@ void Ciecam02::jch2xyz_ciecam02float ( vfloat &x, vfloat &y, vfloat &z, vfloat J
 
 float Ciecam02::nonlinear_adaptationfloat ( float c, float fl )
 {
-    float p;
+    const float x = (fl * fabsf ( c )) / 100.0f;
+    const float p = x <= SQR ( nonlinearRange ) ? getNonlinearLut()[sqrtf ( x ) * nonlinearScale] : pow_F ( x, 0.42f );
 
     if (c < 0.0f) {
-        p = pow_F ( (-1.0f * fl * c) / 100.0f, 0.42f );
         return ((-1.0f * 400.0f * p) / (27.13f + p)) + 0.1f;
     } else {
-        p = pow_F ( (fl * c) / 100.0f, 0.42f );
         return ((400.0f * p) / (27.13f + p)) + 0.1f;
     }
 }
@@ -1098,10 +1140,13 @@ float Ciecam02::nonlinear_adaptationfloat ( float c, float fl )
 vfloat Ciecam02::nonlinear_adaptationfloat ( vfloat c, vfloat fl )
 {
     vfloat c100 = F2V (100.f);
-    vfloat czd42 = F2V (0.42f);
     vfloat c400 = vmulsignf (F2V (400.f), c);
     fl = vmulsignf (fl, c);
-    vfloat p = pow_F ( (fl * c) / c100, czd42 );
+    vfloat x = (fl * c) / c100;
+    // false for NaN, which has to go through pow_F
+    vfloat p = _mm_movemask_ps ((vfloat)vmaskf_le (x, F2V (SQR (nonlinearRange)))) == 15
+               ? getNonlinearLut()[vsqrtf (x) * F2V (nonlinearScale)]
+               : pow_F (x, F2V (0.42f));
     vfloat c27d13 = F2V (27.13);
     vfloat czd1 = F2V (0.1f);
     return ((c400 * p) / (c27d13 + p)) + czd1;
@@ -1122,7 +1167,8 @@ float Ciecam02::inverse_nonlinear_adaptationfloat ( float c, float fl )
         c = 399.99f;
     }
 
-    return (100.0f / fl) * pow_F ( (27.13f * fabsf ( c )) / (400.0f - fabsf ( c )), 2.38095238f );
+    const float x = (27.13f * fabsf ( c )) / (400.0f - fabsf ( c ));
+    return (100.0f / fl) * (x <= nonlinearRange ? getInverseNonlinearLut()[x * nonlinearScale] : pow_F ( x, 2.38095238f ));
 }
 
 #ifdef __SSE2__
@@ -1132,7 +1178,12 @@ vfloat Ciecam02::inverse_nonlinear_adaptationfloat ( vfloat c, vfloat fl )
     fl = vmulsignf (fl, c);
     c = vabsf (c);
     c = vminf ( c, F2V (399.99f));
-    return (F2V (100.0f) / fl) * pow_F ( (F2V (27.13f) * c) / (F2V (400.0f) - c), F2V (2.38095238f) );
+    vfloat x = (F2V (27.13f) * c) / (F2V (400.0f) - c);
+    // false for NaN, which has to go through pow_F
+    vfloat p = _mm_movemask_ps ((vfloat)vmaskf_le (x, F2V (nonlinearRange))) == 15
+               ? getInverseNonlinearLut()[x * F2V (nonlinearScale)]
+               : pow_F (x, F2V (2.38095238f));
+    return (F2V (100.0f) / fl) * p;
 }
 #endif
 }
@@ -1,5 +1,13 @@
 #include <algorithm>
-
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <giomm/file.h>
+#include <glib/gstdio.h>
+#include <glibmm/checksum.h>
 #include <glibmm/fileutils.h>
 #include <glibmm/miscutils.h>
 
@@ -8,6 +16,7 @@
 #include "colortemp.h"
 #include "iccstore.h"
 #include "imagefloat.h"
+#include "myfile.h"
 #include "opthelper.h"
 #include "procparams.h"
 #include "rt_math.h"
@@ -18,6 +27,140 @@
 namespace
 {
 
+/* The decoded CLUTs are kept in the cache directory, a header followed by the RGBX nodes as native std::uint16_t,
+ * so that they are mapped instead of being decoded again when they are used the next time.
+ */
+struct CachedClutHeader {
+    char magic[8];
+    std::uint32_t byte_order;
+    std::uint32_t level;
+};
+
+constexpr char cached_clut_magic[8] = {'R', 'T', 'C', 'L', 'U', 'T', '1', '\0'};
+constexpr std::uint32_t cached_clut_byte_order = 0x01020304;
+
+static_assert(sizeof(CachedClutHeader) == 16, "the nodes have to stay aligned");
+
+// a decoded 144 level CLUT takes 24 MB, only the most recently decoded ones are kept
+constexpr std::size_t max_cached_cluts = 16;
+
+Glib::ustring getCachedClutFilename(const Glib::ustring& filename)
+{
+    try {
+        const auto info = Gio::File::create_for_path(filename)->query_info("standard::size,time::modified");
+
+        if (info) {
+            // name, size and modification time identify the CLUT
+            const auto identifier = Glib::ustring::compose("%1-%2-%3", filename, info->get_size(), info->get_attribute_uint64("time::modified"));
+            return Glib::build_filename(Options::cacheBaseDir, "cluts", Glib::Checksum::compute_checksum(Glib::Checksum::CHECKSUM_MD5, identifier) + ".rtclut");
+        }
+    } catch (Gio::Error&) {}
+
+    return {};
+}
+
+rtengine::IMFILE* openCachedClut(const Glib::ustring& cached_filename, unsigned int& clut_level)
+{
+    rtengine::IMFILE* const file = rtengine::fopen(cached_filename.c_str());
+
+    if (!file) {
+        return nullptr;
+    }
+
+    if (file->size >= static_cast<ssize_t>(sizeof(CachedClutHeader))) {
+        CachedClutHeader header;
+        std::memcpy(&header, file->data, sizeof(header));
+
+        if (
+            std::equal(header.magic, header.magic + 8, cached_clut_magic)
+            && header.byte_order == cached_clut_byte_order
+            && header.level > 1
+            && header.level <= 256
+        ) {
+            const std::size_t size = static_cast<std::size_t>(header.level) * header.level * header.level;
+
+            if (file->size == static_cast<ssize_t>(sizeof(header) + size * size * 4 * sizeof(std::uint16_t))) {
+                clut_level = header.level;
+                return file;
+            }
+        }
+    }
+
+    rtengine::fclose(file);
+    return nullptr;
+}
+
+void pruneCachedCluts(const Glib::ustring& dirname)
+{
+    std::vector<std::pair<std::uint64_t, std::string>> cluts;
+
+    try {
+        const auto enumerator = Gio::File::create_for_path(dirname)->enumerate_children("standard::name,time::modified");
+
+        while (const auto info = enumerator->next_file()) {
+            const std::string name = info->get_name();
+
+            if (name.size() > 7 && name.compare(name.size() - 7, 7, ".rtclut") == 0) {
+                cluts.emplace_back(info->get_attribute_uint64("time::modified"), name);
+            }
+        }
+    } catch (Glib::Error&) {
+        return;
+    }
+
+    if (cluts.size() <= max_cached_cluts) {
+        return;
+    }
+
+    // oldest first, files still mapped by another process may fail to be removed and are tried again next time
+    std::sort(cluts.begin(), cluts.end());
+
+    for (std::size_t i = 0; i < cluts.size() - max_cached_cluts; ++i) {
+        g_remove(Glib::build_filename(dirname, cluts[i].second).c_str());
+    }
+}
+
+void saveCachedClut(const Glib::ustring& cached_filename, const AlignedBuffer<std::uint16_t>& clut_image, unsigned int clut_level)
+{
+    const std::size_t size = static_cast<std::size_t>(clut_level) * clut_level * clut_level;
+
+    CachedClutHeader header;
+    std::copy(cached_clut_magic, cached_clut_magic + 8, header.magic);
+    header.byte_order = cached_clut_byte_order;
+    header.level = clut_level;
+
+    const Glib::ustring dirname = Glib::path_get_dirname(cached_filename);
+    g_mkdir_with_parents(dirname.c_str(), 511);
+
+    // written under a unique temporary name, another editor or process may map the file as soon as it exists
+    // and may be writing the same CLUT at the same time
+    std::string temp_filename = cached_filename + ".XXXXXX";
+    const int fd = g_mkstemp(&temp_filename[0]);
+
+    if (fd == -1) {
+        return;
+    }
+
+    FILE* const file = fdopen(fd, "wb");
+
+    if (!file) {
+        g_close(fd, nullptr);
+        g_remove(temp_filename.c_str());
+        return;
+    }
+
+    const bool written =
+        fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(clut_image.data, sizeof(std::uint16_t), size * size * 4, file) == size * size * 4;
+
+    if (fclose(file) == 0 && written && g_rename(temp_filename.c_str(), cached_filename.c_str()) == 0) {
+        pruneCachedCluts(dirname);
+        return;
+    }
+
+    g_remove(temp_filename.c_str());
+}
+
 bool loadFile(
     const Glib::ustring& filename,
     const Glib::ustring& working_color_space,
@@ -63,7 +206,7 @@ bool loadFile(
             img_src.convertColorSpace(img_float.get(), icm, curr_wb);
         }
 
-        AlignedBuffer<std::uint16_t> image(fw * fh * 4 + 4); // getClutValues() loads one pixel in advance
+        AlignedBuffer<std::uint16_t> image(fw * fh * 4);
 
         std::size_t index = 0;
 
@@ -85,37 +228,17 @@ bool loadFile(
 }
 
 #ifdef __SSE2__
-vfloat2 getClutValues(const AlignedBuffer<std::uint16_t>& clut_image, size_t index)
+vfloat getClutValue(const std::uint16_t* clut_data, std::size_t index)
 {
-    const vint v_values = _mm_loadu_si128(reinterpret_cast<const vint*>(clut_image.data + index));
-#ifdef __SSE4_1__
-    return {
-        _mm_cvtepi32_ps(_mm_cvtepu16_epi32(v_values)),
-        _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_srli_si128(v_values, 8)))
-    };
-#else
-    const vint v_mask = _mm_set1_epi32(0x0000FFFF);
-
-    vint v_low = _mm_shuffle_epi32(v_values, _MM_SHUFFLE(1, 0, 1, 0));
-    vint v_high = _mm_shuffle_epi32(v_values, _MM_SHUFFLE(3, 2, 3, 2));
-    v_low = _mm_shufflelo_epi16(v_low, _MM_SHUFFLE(1, 1, 0, 0));
-    v_high = _mm_shufflelo_epi16(v_high, _MM_SHUFFLE(1, 1, 0, 0));
-    v_low = _mm_shufflehi_epi16(v_low, _MM_SHUFFLE(3, 3, 2, 2));
-    v_high = _mm_shufflehi_epi16(v_high, _MM_SHUFFLE(3, 3, 2, 2));
-    v_low = vandm(v_low, v_mask);
-    v_high = vandm(v_high, v_mask);
-
-    return {
-        _mm_cvtepi32_ps(v_low),
-        _mm_cvtepi32_ps(v_high)
-    };
-#endif
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const vint*>(clut_data + index)), _mm_setzero_si128()));
 }
 #endif
 
 }
 
 rtengine::HaldCLUT::HaldCLUT() :
+    clut_file(nullptr),
+    clut_data(nullptr),
     clut_level(0),
     flevel_minus_one(0.0f),
     flevel_minus_two(0.0f),
@@ -125,27 +248,44 @@ rtengine::HaldCLUT::HaldCLUT() :
 
 rtengine::HaldCLUT::~HaldCLUT()
 {
+    if (clut_file) {
+        fclose(clut_file);
+    }
 }
 
 bool rtengine::HaldCLUT::load(const Glib::ustring& filename)
 {
-    if (loadFile(filename, "", clut_image, clut_level)) {
-        Glib::ustring name, ext;
-        splitClutFilename(filename, name, ext, clut_profile);
-
-        clut_filename = filename;
-        clut_level *= clut_level;
-        flevel_minus_one = static_cast<float>(clut_level - 1) / 65535.0f;
-        flevel_minus_two = static_cast<float>(clut_level - 2);
-        return true;
+    const Glib::ustring cached_filename = getCachedClutFilename(filename);
+
+    if (!cached_filename.empty()) {
+        clut_file = openCachedClut(cached_filename, clut_level);
     }
 
-    return false;
+    if (clut_file) {
+        clut_data = reinterpret_cast<const std::uint16_t*>(clut_file->data + sizeof(CachedClutHeader));
+    } else if (loadFile(filename, "", clut_image, clut_level)) {
+        clut_data = clut_image.data;
+
+        if (!cached_filename.empty()) {
+            saveCachedClut(cached_filename, clut_image, clut_level);
+        }
+    } else {
+        return false;
+    }
+
+    Glib::ustring name, ext;
+    splitClutFilename(filename, name, ext, clut_profile);
+
+    clut_filename = filename;
+    clut_level *= clut_level;
+    flevel_minus_one = static_cast<float>(clut_level - 1) / 65535.0f;
+    flevel_minus_two = static_cast<float>(clut_level - 2);
+    return true;
 }
 
 rtengine::HaldCLUT::operator bool() const
 {
-    return !clut_image.isEmpty();
+    return clut_data;
 }
 
 Glib::ustring rtengine::HaldCLUT::getFilename() const
@@ -171,6 +311,11 @@ void rtengine::HaldCLUT::getRGB(
 
     const unsigned int level_square = level * level;
 
+    // offsets of the neighbours of a node along the red, green and blue axes
+    const std::size_t stride_red = 4;
+    const std::size_t stride_green = level * 4;
+    const std::size_t stride_blue = level_square * 4;
+
 #ifdef __SSE2__
     const vfloat v_strength = F2V(strength);
 #endif
@@ -180,90 +325,85 @@ void rtengine::HaldCLUT::getRGB(
         const unsigned int green = std::min(flevel_minus_two, *g * flevel_minus_one);
         const unsigned int blue = std::min(flevel_minus_two, *b * flevel_minus_one);
 
-        const unsigned int color = red + green * level + blue * level_square;
-
-#ifndef __SSE2__
         const float re = *r * flevel_minus_one - red;
         const float gr = *g * flevel_minus_one - green;
         const float bl = *b * flevel_minus_one - blue;
 
-        size_t index = color * 4;
-
-        float tmp1[4] ALIGNED16;
-        tmp1[0] = intp<float>(re, clut_image.data[index + 4], clut_image.data[index]);
-        tmp1[1] = intp<float>(re, clut_image.data[index + 5], clut_image.data[index + 1]);
-        tmp1[2] = intp<float>(re, clut_image.data[index + 6], clut_image.data[index + 2]);
-
-        index = (color + level) * 4;
-
-        float tmp2[4] ALIGNED16;
-        tmp2[0] = intp<float>(re, clut_image.data[index + 4], clut_image.data[index]);
-        tmp2[1] = intp<float>(re, clut_image.data[index + 5], clut_image.data[index + 1]);
-        tmp2[2] = intp<float>(re, clut_image.data[index + 6], clut_image.data[index + 2]);
-
-        out_rgbx[0] = intp<float>(gr, tmp2[0], tmp1[0]);
-        out_rgbx[1] = intp<float>(gr, tmp2[1], tmp1[1]);
-        out_rgbx[2] = intp<float>(gr, tmp2[2], tmp1[2]);
-
-        index = (color + level_square) * 4;
-
-        tmp1[0] = intp<float>(re, clut_image.data[index + 4], clut_image.data[index]);
-        tmp1[1] = intp<float>(re, clut_image.data[index + 5], clut_image.data[index + 1]);
-        tmp1[2] = intp<float>(re, clut_image.data[index + 6], clut_image.data[index + 2]);
-
-        index = (color + level + level_square) * 4;
-
-        tmp2[0] = intp<float>(re, clut_image.data[index + 4], clut_image.data[index]);
-        tmp2[1] = intp<float>(re, clut_image.data[index + 5], clut_image.data[index + 1]);
-        tmp2[2] = intp<float>(re, clut_image.data[index + 6], clut_image.data[index + 2]);
+        // Tetrahedral interpolation: the order of the fractional parts selects one of the 6 tetrahedrons
+        // of the cube, whose 4 vertices are the first node, two steps along the axes and the opposite node.
+        std::size_t stride1, stride2;
+        float f1, f2, f3;
+
+        if (re >= gr) {
+            if (gr >= bl) {
+                stride1 = stride_red;
+                stride2 = stride_green;
+                f1 = re;
+                f2 = gr;
+                f3 = bl;
+            } else if (re >= bl) {
+                stride1 = stride_red;
+                stride2 = stride_blue;
+                f1 = re;
+                f2 = bl;
+                f3 = gr;
+            } else {
+                stride1 = stride_blue;
+                stride2 = stride_red;
+                f1 = bl;
+                f2 = re;
+                f3 = gr;
+            }
+        } else {
+            if (re >= bl) {
+                stride1 = stride_green;
+                stride2 = stride_red;
+                f1 = gr;
+                f2 = re;
+                f3 = bl;
+            } else if (gr >= bl) {
+                stride1 = stride_green;
+                stride2 = stride_blue;
+                f1 = gr;
+                f2 = bl;
+                f3 = re;
+            } else {
+                stride1 = stride_blue;
+                stride2 = stride_green;
+                f1 = bl;
+                f2 = gr;
+                f3 = re;
+            }
+        }
 
-        tmp1[0] = intp<float>(gr, tmp2[0], tmp1[0]);
-        tmp1[1] = intp<float>(gr, tmp2[1], tmp1[1]);
-        tmp1[2] = intp<float>(gr, tmp2[2], tmp1[2]);
+        const std::size_t index0 = (red + green * level + blue * level_square) * 4;
+        const std::size_t index1 = index0 + stride1;
+        const std::size_t index2 = index1 + stride2;
+        const std::size_t index3 = index0 + stride_red + stride_green + stride_blue;
 
-        out_rgbx[0] = intp<float>(bl, tmp1[0], out_rgbx[0]);
-        out_rgbx[1] = intp<float>(bl, tmp1[1], out_rgbx[1]);
-        out_rgbx[2] = intp<float>(bl, tmp1[2], out_rgbx[2]);
+        const float w0 = 1.f - f1;
+        const float w1 = f1 - f2;
+        const float w2 = f2 - f3;
+        const float w3 = f3;
 
-        out_rgbx[0] = intp<float>(strength, out_rgbx[0], *r);
-        out_rgbx[1] = intp<float>(strength, out_rgbx[1], *g);
-        out_rgbx[2] = intp<float>(strength, out_rgbx[2], *b);
+#ifndef __SSE2__
+        for (int c = 0; c < 3; ++c) {
+            const float value =
+                w0 * clut_data[index0 + c]
+                + w1 * clut_data[index1 + c]
+                + w2 * clut_data[index2 + c]
+                + w3 * clut_data[index3 + c];
+
+            out_rgbx[c] = intp<float>(strength, value, c == 0 ? *r : c == 1 ? *g : *b);
+        }
 #else
         const vfloat v_in = _mm_set_ps(0.0f, *b, *g, *r);
-        const vfloat v_tmp = v_in * F2V(flevel_minus_one);
-        const vfloat v_rgb = v_tmp - _mm_cvtepi32_ps(_mm_cvttps_epi32(vminf(v_tmp, F2V(flevel_minus_two))));
-
-        size_t index = color * 4;
-
-        const vfloat v_r = PERMUTEPS(v_rgb, _MM_SHUFFLE(0, 0, 0, 0));
-
-        vfloat2 v_clut_values = getClutValues(clut_image, index);
-        vfloat v_tmp1 = vintpf(v_r, v_clut_values.y, v_clut_values.x);
-
-        index = (color + level) * 4;
-
-        v_clut_values = getClutValues(clut_image, index);
-        vfloat v_tmp2 = vintpf(v_r, v_clut_values.y, v_clut_values.x);
-
-        const vfloat v_g = PERMUTEPS(v_rgb, _MM_SHUFFLE(1, 1, 1, 1));
-
-        vfloat v_out = vintpf(v_g, v_tmp2, v_tmp1);
-
-        index = (color + level_square) * 4;
-
-        v_clut_values = getClutValues(clut_image, index);
-        v_tmp1 = vintpf(v_r, v_clut_values.y, v_clut_values.x);
-
-        index = (color + level + level_square) * 4;
-
-        v_clut_values = getClutValues(clut_image, index);
-        v_tmp2 = vintpf(v_r, v_clut_values.y, v_clut_values.x);
-
-        v_tmp1 = vintpf(v_g, v_tmp2, v_tmp1);
-
-        const vfloat v_b = PERMUTEPS(v_rgb, _MM_SHUFFLE(2, 2, 2, 2));
 
-        v_out = vintpf(v_b, v_tmp1, v_out);
+        const vfloat v_out =
+            F2V(w0) * getClutValue(clut_data, index0)
+            + F2V(w1) * getClutValue(clut_data, index1)
+            + F2V(w2) * getClutValue(clut_data, index2)
+            + F2V(w3) * getClutValue(clut_data, index3);
 
         STVF(*out_rgbx, vintpf(v_strength, v_out, v_in));
 #endif
@@ -10,6 +10,8 @@
 namespace rtengine
 {
 
+struct IMFILE;
+
 class HaldCLUT final :
     public NonCopyable
 {
@@ -42,7 +44,9 @@ public:
     );
 
 private:
-    AlignedBuffer<std::uint16_t> clut_image;
+    AlignedBuffer<std::uint16_t> clut_image; // the decoded CLUT when it could not be mapped from the cache
+    IMFILE* clut_file; // the mapped CLUT of the cache
+    const std::uint16_t* clut_data; // RGBX nodes, red varying fastest
     unsigned int clut_level;
     float flevel_minus_one;
     float flevel_minus_two;
@@ -914,6 +914,23 @@ void Color::hsv2rgb (float h, float s, float v, int &r, int &g, int &b)
     b = (int)( b1 * 65535);
 }
 
+void Color::hsv2rgb (const float *h, const float *s, const float *v, float *r, float *g, float *b, int width)
+{
+    int i = 0;
+#ifdef __SSE2__
+    for (; i < width - 3; i += 4) {
+        vfloat rv, gv, bv;
+        hsv2rgb(LVFU(h[i]), LVFU(s[i]), LVFU(v[i]), rv, gv, bv);
+        STVFU(r[i], rv);
+        STVFU(g[i], gv);
+        STVFU(b[i], bv);
+    }
+#endif
+    for (; i < width; ++i) {
+        hsv2rgb(h[i], s[i], v[i], r[i], g[i], b[i]);
+    }
+}
+
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
 void Color::xyz2srgb (float x, float y, float z, float &r, float &g, float &b)
@@ -1634,6 +1651,19 @@ void Color::gammanf2lut (LUTf &gammacurve, float gamma, float divisor, float fac
 #endif
 }
 
+void Color::gamma_srgbclipped (const float *src, float *dst, int width)
+{
+    int i = 0;
+#ifdef __SSE2__
+    for (; i < width - 3; i += 4) {
+        STVFU(dst[i], gamma2curve[LVFU(src[i])]);
+    }
+#endif
+    for (; i < width; ++i) {
+        dst[i] = gamma2curve[src[i]];
+    }
+}
+
 float Color::L2Y(float L)
 {
     const float LL = L / 327.68f;
@@ -1662,7 +1692,7 @@ inline float Color::computeXYZ2Lab(float f)
     }
 }
 
-void Color::RGB2Lab(float *R, float *G, float *B, float *L, float *a, float *b, const float wp[3][3], int width)
+void Color::RGB2Lab(const float *R, const float *G, const float *B, float *L, float *a, float *b, const float wp[3][3], int width)
 {
 
 #ifdef __SSE2__
@@ -1765,6 +1795,35 @@ void Color::RGB2L(const float *R, const float *G, const float *B, float *L, cons
     }
 }
 
+void Color::Lab2RGB(const float *L, const float *a, const float *b, float *R, float *G, float *B, const float wp[3][3], int width)
+{
+
+    int i = 0;
+
+#ifdef __SSE2__
+    const vfloat wpv[3][3] = {
+                              {F2V(wp[0][0]), F2V(wp[0][1]), F2V(wp[0][2])},
+                              {F2V(wp[1][0]), F2V(wp[1][1]), F2V(wp[1][2])},
+                              {F2V(wp[2][0]), F2V(wp[2][1]), F2V(wp[2][2])}
+                             };
+
+    for(;i < width - 3; i+=4) {
+        vfloat Xv, Yv, Zv;
+        Lab2XYZ(LVFU(L[i]), LVFU(a[i]), LVFU(b[i]), Xv, Yv, Zv);
+        vfloat Rv, Gv, Bv;
+        xyz2rgb(Xv, Yv, Zv, Rv, Gv, Bv, wpv);
+        STVFU(R[i], Rv);
+        STVFU(G[i], Gv);
+        STVFU(B[i], Bv);
+    }
+#endif
+    for(;i < width; ++i) {
+        float X, Y, Z;
+        Lab2XYZ(L[i], a[i], b[i], X, Y, Z);
+        xyz2rgb(X, Y, Z, R[i], G[i], B[i], wp);
+    }
+}
+
 void Color::Lab2RGBLimit(float *L, float *a, float *b, float *R, float *G, float *B, const float wp[3][3], float limit, float afactor, float bfactor, int width)
 {
 
@@ -1827,6 +1886,73 @@ void Color::XYZ2Lab(float X, float Y, float Z, float &L, float &a, float &b)
     b = (200.0f * (fy - fz) );
 }
 
+#ifdef __SSE2__
+void Color::XYZ2Lab(vfloat X, vfloat Y, vfloat Z, vfloat &L, vfloat &a, vfloat &b)
+{
+    const vfloat x = X / F2V(D50x);
+    const vfloat z = Z / F2V(D50z);
+
+    if (_mm_movemask_ps((vfloat)vorm(vmaskf_gt(vmaxf(x, vmaxf(Y, z)), F2V(MAXVALF)), vmaskf_lt(vminf(x, vminf(Y, z)), ZEROV)))) {
+        // take slower code path for all 4 pixels if one of the values is out of the range of the luts
+        for(int k = 0; k < 4; ++k) {
+            const float fx = computeXYZ2Lab(x[k]);
+            const float fy = computeXYZ2Lab(Y[k]);
+            const float fz = computeXYZ2Lab(z[k]);
+
+            L[k] = computeXYZ2LabY(Y[k]);
+            a[k] = 500.f * (fx - fy);
+            b[k] = 200.f * (fy - fz);
+        }
+    } else {
+        const vfloat fx = cachef[x];
+        const vfloat fy = cachef[Y];
+        const vfloat fz = cachef[z];
+
+        L = cachefy[Y];
+        a = F2V(500.f) * (fx - fy);
+        b = F2V(200.f) * (fy - fz);
+    }
+}
+#endif
+
+void Color::XYZ2Lab(const float *X, const float *Y, const float *Z, float *L, float *a, float *b, int width)
+{
+
+    int i = 0;
+
+#ifdef __SSE2__
+    for(;i < width - 3; i+=4) {
+        vfloat Lv, av, bv;
+        XYZ2Lab(LVFU(X[i]), LVFU(Y[i]), LVFU(Z[i]), Lv, av, bv);
+        STVFU(L[i], Lv);
+        STVFU(a[i], av);
+        STVFU(b[i], bv);
+    }
+#endif
+    for(;i < width; ++i) {
+        XYZ2Lab(X[i], Y[i], Z[i], L[i], a[i], b[i]);
+    }
+}
+
+void Color::Lab2XYZ(const float *L, const float *a, const float *b, float *X, float *Y, float *Z, int width)
+{
+
+    int i = 0;
+
+#ifdef __SSE2__
+    for(;i < width - 3; i+=4) {
+        vfloat Xv, Yv, Zv;
+        Lab2XYZ(LVFU(L[i]), LVFU(a[i]), LVFU(b[i]), Xv, Yv, Zv);
+        STVFU(X[i], Xv);
+        STVFU(Y[i], Yv);
+        STVFU(Z[i], Zv);
+    }
+#endif
+    for(;i < width; ++i) {
+        Lab2XYZ(L[i], a[i], b[i], X[i], Y[i], Z[i]);
+    }
+}
+
 void Color::Lab2Yuv(float L, float a, float b, float &Y, float &u, float &v)
 {
     float fy = (c1By116 * L / 327.68) + c16By116; // (L+16)/116
@@ -1869,23 +1995,21 @@ void Color::Lab2Lch(float a, float b, float &c, float &h)
     h = xatan2f(b, a);
 }
 
-#ifdef __SSE2__
-void Color::Lab2Lch(float *a, float *b, float *c, float *h, int w)
+void Color::Lab2Lch(const float *a, const float *b, float *c, float *h, int w)
 {
     int i = 0;
-    vfloat c327d68v = F2V(327.68f);
+#ifdef __SSE2__
     for (; i < w - 3; i += 4) {
-        vfloat av = LVFU(a[i]);
-        vfloat bv = LVFU(b[i]);
-        STVFU(c[i], vsqrtf(SQRV(av) + SQRV(bv)) / c327d68v);
-        STVFU(h[i], xatan2f(bv, av));
+        vfloat cv, hv;
+        Lab2Lch(LVFU(a[i]), LVFU(b[i]), cv, hv);
+        STVFU(c[i], cv);
+        STVFU(h[i], hv);
     }
+#endif
     for (; i < w; ++i) {
-        c[i] = sqrtf(SQR(a[i]) + SQR(b[i])) / 327.68f;
-        h[i] = xatan2f(b[i], a[i]);
+        Lab2Lch(a[i], b[i], c[i], h[i]);
     }
 }
-#endif
 
 void Color::Lch2Lab(float c, float h, float &a, float &b)
 {
@@ -1894,6 +2018,22 @@ void Color::Lch2Lab(float c, float h, float &a, float &b)
     b = 327.68f * c * sincosval.x;
 }
 
+void Color::Lch2Lab(const float *c, const float *h, float *a, float *b, int w)
+{
+    int i = 0;
+#ifdef __SSE2__
+    for (; i < w - 3; i += 4) {
+        vfloat av, bv;
+        Lch2Lab(LVFU(c[i]), LVFU(h[i]), av, bv);
+        STVFU(a[i], av);
+        STVFU(b[i], bv);
+    }
+#endif
+    for (; i < w; ++i) {
+        Lch2Lab(c[i], h[i], a[i], b[i]);
+    }
+}
+
 void Color::Luv2Lch(float u, float v, float &c, float &h)
 {
     c = sqrtf(u * u + v * v);
@@ -365,6 +365,31 @@ public:
     * @param v value channel [0 ; 1] (return value)
     */
     static void rgb2hsv (float r, float g, float b, float &h, float &s, float &v);
+#ifdef __SSE2__
+    static inline void rgb2hsv (vfloat r, vfloat g, vfloat b, vfloat &h, vfloat &s, vfloat &v)
+    {
+        const vfloat c65535v = F2V(65535.f);
+        const vfloat var_R = r / c65535v;
+        const vfloat var_G = g / c65535v;
+        const vfloat var_B = b / c65535v;
+
+        const vfloat var_Min = vminf(var_R, vminf(var_G, var_B));
+        const vfloat var_Max = vmaxf(var_R, vmaxf(var_G, var_B));
+        const vfloat del_Max = var_Max - var_Min;
+
+        v = var_Max;
+
+        const vmask grey = vmaskf_lt(vabsf(del_Max), F2V(0.00001f));
+        vfloat hv = vself(vmaskf_eq(var_R, var_Max), (var_G - var_B) / del_Max,
+                          vself(vmaskf_eq(var_G, var_Max), F2V(2.f) + (var_B - var_R) / del_Max, F2V(4.f) + (var_R - var_G) / del_Max));
+        hv /= F2V(6.f);
+        hv += vselfzero(vmaskf_lt(hv, ZEROV), F2V(1.f));
+        hv -= vselfzero(vmaskf_gt(hv, F2V(1.f)), F2V(1.f));
+
+        h = vselfnotzero(grey, hv);
+        s = vselfnotzero(grey, del_Max / vself(vmaskf_eq(var_Max, ZEROV), F2V(1.f), var_Max));
+    }
+#endif
 
     /**
     * @brief Convert red green blue to hue saturation value
@@ -447,6 +472,25 @@ public:
         }
     }
 
+#ifdef __SSE2__
+    static inline void rgb2hsvtc(vfloat r, vfloat g, vfloat b, vfloat &h, vfloat &s, vfloat &v)
+    {
+        const vfloat var_Min = vminf(r, vminf(g, b));
+        const vfloat var_Max = vmaxf(r, vmaxf(g, b));
+        const vfloat del_Max = var_Max - var_Min;
+
+        v = var_Max / F2V(65535.f);
+
+        const vmask grey = vmaskf_lt(del_Max, F2V(0.00001f));
+        const vfloat hr = vself(vmaskf_lt(g, b), F2V(6.f), ZEROV) + (g - b) / del_Max;
+        const vfloat hg = F2V(2.f) + (b - r) / del_Max;
+        const vfloat hb = F2V(4.f) + (r - g) / del_Max;
+
+        h = vself(grey, ZEROV, vself(vmaskf_eq(r, var_Max), hr, vself(vmaskf_eq(g, var_Max), hg, hb)));
+        s = vself(grey, ZEROV, del_Max / var_Max);
+    }
+#endif
+
     /**
     * @brief Convert hue saturation value in red green blue
     * @param h hue channel [0 ; 1]
@@ -457,6 +501,33 @@ public:
     * @param b blue channel [0 ; 65535] (return value)
     */
     static void hsv2rgb (float h, float s, float v, float &r, float &g, float &b);
+#ifdef __SSE2__
+    static inline void hsv2rgb (vfloat h, vfloat s, vfloat v, vfloat &r, vfloat &g, vfloat &b)
+    {
+        const vfloat h1 = h * F2V(6.f); // sector 0 to 5
+        const vfloat sector = _mm_cvtepi32_ps(_mm_cvttps_epi32(h1));
+        const vfloat f = h1 - sector; // fractional part of h
+
+        const vfloat onev = F2V(1.f);
+        const vfloat c65535v = F2V(65535.f);
+        v *= c65535v;
+        const vfloat p = v * (onev - s);
+        const vfloat q = v * (onev - s * f);
+        const vfloat t = v * (onev - s * (onev - f));
+
+        const vmask sector1 = vmaskf_eq(sector, F2V(1.f));
+        const vmask sector2 = vmaskf_eq(sector, F2V(2.f));
+        const vmask sector3 = vmaskf_eq(sector, F2V(3.f));
+        const vmask sector4 = vmaskf_eq(sector, F2V(4.f));
+        const vmask sector5 = vmaskf_eq(sector, F2V(5.f));
+
+        r = vself(sector1, q, vself(vorm(sector2, sector3), p, vself(sector4, t, v)));
+        g = vself(vorm(sector1, sector2), v, vself(sector3, q, vself(vorm(sector4, sector5), p, t)));
+        b = vself(sector2, t, vself(vorm(sector3, sector4), v, vself(sector5, q, p)));
+    }
+#endif
+    // converts rows, vectorized when possible
+    static void hsv2rgb (const float *h, const float *s, const float *v, float *r, float *g, float *b, int width);
 
     static inline void hsv2rgbdcp (float h, float s, float v, float &r, float &g, float &b)
     {
@@ -508,6 +579,30 @@ public:
         }
     }
 
+#ifdef __SSE2__
+    static inline void hsv2rgbdcp (vfloat h, vfloat s, vfloat v, vfloat &r, vfloat &g, vfloat &b)
+    {
+        const vfloat sector = _mm_cvtepi32_ps(_mm_cvttps_epi32(h));
+        const vfloat f = h - sector;
+
+        v *= F2V(65535.f);
+        const vfloat vs = v * s;
+        const vfloat p = v - vs;
+        const vfloat q = v - f * vs;
+        const vfloat t = p + v - q;
+
+        const vmask sector1 = vmaskf_eq(sector, F2V(1.f));
+        const vmask sector2 = vmaskf_eq(sector, F2V(2.f));
+        const vmask sector3 = vmaskf_eq(sector, F2V(3.f));
+        const vmask sector4 = vmaskf_eq(sector, F2V(4.f));
+        const vmask sector5 = vmaskf_eq(sector, F2V(5.f));
+
+        r = vself(sector1, q, vself(vorm(sector2, sector3), p, vself(sector4, t, v)));
+        g = vself(vorm(sector1, sector2), v, vself(sector3, q, vself(vorm(sector4, sector5), p, t)));
+        b = vself(sector2, t, vself(vorm(sector3, sector4), v, vself(sector5, q, p)));
+    }
+#endif
+
     static void hsv2rgb (float h, float s, float v, int &r, int &g, int &b);
 
 
@@ -665,7 +760,18 @@ static inline void Lab2XYZ(vfloat L, vfloat a, vfloat b, vfloat &x, vfloat &y, v
     * @param b channel [-42000 ; +42000] ; can be more than 42000 (return value)
     */
     static void XYZ2Lab(float x, float y, float z, float &L, float &a, float &b);
-    static void RGB2Lab(float *X, float *Y, float *Z, float *L, float *a, float *b, const float wp[3][3], int width);
+#ifdef __SSE2__
+    static void XYZ2Lab(vfloat x, vfloat y, vfloat z, vfloat &L, vfloat &a, vfloat &b);
+#endif
+
+    /**
+    * @brief Convert rows of planar xyz, rgb or Lab data, vectorized when possible. The output rows may be the input rows.
+    * Ranges are the ones of the per pixel conversions, wp is the xyz to rgb matrix for Lab2RGB and the rgb to xyz matrix for RGB2Lab
+    */
+    static void XYZ2Lab(const float *X, const float *Y, const float *Z, float *L, float *a, float *b, int width);
+    static void Lab2XYZ(const float *L, const float *a, const float *b, float *X, float *Y, float *Z, int width);
+    static void Lab2RGB(const float *L, const float *a, const float *b, float *R, float *G, float *B, const float wp[3][3], int width);
+    static void RGB2Lab(const float *R, const float *G, const float *B, float *L, float *a, float *b, const float wp[3][3], int width);
     static void Lab2RGBLimit(float *L, float *a, float *b, float *R, float *G, float *B, const float wp[3][3], float limit, float afactor, float bfactor, int width);
     static void RGB2L(const float *R, const float *G, const float *B, float *L, const float wp[3][3], int width);
 
@@ -702,8 +808,13 @@ static inline void Lab2XYZ(vfloat L, vfloat a, vfloat b, vfloat &x, vfloat &y, v
     */
     static void Lab2Lch(float a, float b, float &c, float &h);
 #ifdef __SSE2__
-    static void Lab2Lch(float *a, float *b, float *c, float *h, int w);
+    static inline void Lab2Lch(vfloat a, vfloat b, vfloat &c, vfloat &h)
+    {
+        c = vsqrtf(SQRV(a) + SQRV(b)) / F2V(327.68f);
+        h = xatan2f(b, a);
+    }
 #endif
+    static void Lab2Lch(const float *a, const float *b, float *c, float *h, int w);
 
     /**
     * @brief Convert 'c' and 'h' channels of the Lch color space to the 'a' and 'b' channels of the L*a*b color space (channel 'L' is identical [0 ; 32768])
@@ -713,6 +824,16 @@ static inline void Lab2XYZ(vfloat L, vfloat a, vfloat b, vfloat &x, vfloat &y, v
     * @param b 'b' channel [-42000 ; +42000] ; can be more than 42000 (return value)
     */
     static void Lch2Lab(float c, float h, float &a, float &b);
+#ifdef __SSE2__
+    static inline void Lch2Lab(vfloat c, vfloat h, vfloat &a, vfloat &b)
+    {
+        const vfloat2 sincosval = xsincosf(h);
+        c *= F2V(327.68f);
+        a = c * sincosval.y;
+        b = c * sincosval.x;
+    }
+#endif
+    static void Lch2Lab(const float *c, const float *h, float *a, float *b, int w);
 
 
     /**
@@ -1387,6 +1508,14 @@ static inline void Lab2XYZ(vfloat L, vfloat a, vfloat b, vfloat &x, vfloat &y, v
     {
         return gamma2curve[x];
     }
+#ifdef __SSE2__
+    static inline vfloat gamma_srgbclipped       (vfloat x)
+    {
+        return gamma2curve[x];
+    }
+#endif
+    // gamma2curve of a row, vectorized when possible. dst may be src
+    static void gamma_srgbclipped (const float *src, float *dst, int width);
     static inline float  gamma            (float x)
     {
         return gammatab[x];
@@ -18,6 +18,8 @@
  *  2012 Emil Martinec <ejmartin@uchicago.edu>
  */
 
+#include <algorithm>
+
 #include "cplx_wavelet_dec.h"
 
 namespace rtengine
@@ -39,5 +41,55 @@ wavelet_decomposition::~wavelet_decomposition()
     }
 }
 
+wavelet_decomposition::wavelet_decomposition(const wavelet_decomposition& other) :
+    NonCopyable(),
+    lvltot(other.lvltot),
+    subsamp(other.subsamp),
+    m_w(other.m_w),
+    m_h(other.m_h),
+    wavfilt_len(other.wavfilt_len),
+    wavfilt_offset(other.wavfilt_offset),
+    wavfilt_anal(new float[2 * other.wavfilt_len]),
+    wavfilt_synth(new float[2 * other.wavfilt_len]),
+    coeff0(nullptr),
+    memoryAllocationFailed(false)
+{
+    std::copy_n(other.wavfilt_anal, 2 * wavfilt_len, wavfilt_anal);
+    std::copy_n(other.wavfilt_synth, 2 * wavfilt_len, wavfilt_synth);
+
+    for(int i = 0; i <= lvltot; i++) {
+        wavelet_decomp[i] = new wavelet_level<internal_type>(*other.wavelet_decomp[i]);
+
+        if(wavelet_decomp[i]->memoryAllocationFailed) {
+            memoryAllocationFailed = true;
+        }
+    }
+
+    // same size as the buffer allocated by the constructor
+    const int coeff0Size = (m_w / 2 + 1) * (m_h / 2 + 1);
+    coeff0 = new (std::nothrow) internal_type[coeff0Size];
+
+    if(coeff0 == nullptr) {
+        memoryAllocationFailed = true;
+    } else {
+        std::copy_n(other.coeff0, coeff0Size, coeff0);
+    }
+}
+
+std::unique_ptr<wavelet_decomposition> wavelet_decomposition::clone() const
+{
+    if(memoryAllocationFailed || !coeff0) {
+        return nullptr;
+    }
+
+    std::unique_ptr<wavelet_decomposition> result(new wavelet_decomposition(*this));
+
+    if(result->memory_allocation_failed()) {
+        result.reset();
+    }
+
+    return result;
+}
+
 }
 
@@ -21,6 +21,7 @@
 
 #include <cstddef>
 #include <cmath>
+#include <memory>
 
 #include "cplx_wavelet_level.h"
 #include "cplx_wavelet_filter_coeffs.h"
@@ -93,7 +94,12 @@ public:
     template<typename E>
     void reconstruct(E * dst, const float blend = 1.f);
 
+    // deep copy, used to keep a decomposition in WaveletDecompositionCache as reconstruct() consumes the coefficients
+    std::unique_ptr<wavelet_decomposition> clone() const;
+
 private:
+    wavelet_decomposition(const wavelet_decomposition& other);
+
     static const int maxlevels = 10; // should be greater than any conceivable order of decimation
 
     int lvltot;
@@ -20,6 +20,7 @@
 */
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
 #include "rt_math.h"
 #include "opthelper.h"
@@ -110,6 +111,21 @@ public:
 
     }
 
+    // deep copy of the coefficients of another level
+    explicit wavelet_level(const wavelet_level& other)
+        : lvl(other.lvl), subsamp_out(other.subsamp_out), numThreads(other.numThreads), skip(other.skip), bigBlockOfMemory(true), memoryAllocationFailed(false), wavcoeffs(nullptr), m_w(other.m_w), m_h(other.m_h), m_w2(other.m_w2), m_h2(other.m_h2)
+    {
+        wavcoeffs = create(m_w2 * m_h2);
+
+        if(!memoryAllocationFailed) {
+            for(int j = 1; j < 4; j++) {
+                std::copy_n(other.wavcoeffs[j], m_w2 * m_h2, wavcoeffs[j]);
+            }
+        }
+    }
+
+    wavelet_level& operator =(const wavelet_level&) = delete;
+
     ~wavelet_level()
     {
         destroy(wavcoeffs);
@@ -303,7 +319,40 @@ void wavelet_level<T>::AnalysisFilterSubsampHorizontal (T * RESTRICT srcbuffer,
      * Output is subsampled by two
      */
     // calculate coefficients
-    for(int i = 0; i < srcwidth; i += 2) {
+    int i = 0;
+#ifdef __SSE2__
+
+    for (; i <= skip * taps && i < srcwidth; i += 2) { //left border
+        float lo = 0.f, hi = 0.f;
+
+        for (int j = 0; j < taps; j++) {
+            int arg = max(0, min(i + skip * (offset - j), srcwidth - 1)); //clamped BC's
+            lo += filterLo[j] * srcbuffer[arg];//lopass channel
+            hi += filterHi[j] * srcbuffer[arg];//hipass channel
+        }
+
+        dstLo[row * dstwidth + ((i / 2))] = lo;
+        dstHi[row * dstwidth + ((i / 2))] = hi;
+    }
+
+    for (; i < srcwidth - skip * taps - 6; i += 8) { //bulk, 4 output pixels at a time
+        vfloat lov = ZEROV;
+        vfloat hiv = ZEROV;
+
+        for (int j = 0, l = -skip * offset; j < taps; j++, l += skip) {
+            // even source pixels i - l, i + 2 - l, i + 4 - l, i + 6 - l
+            const vfloat srcv = _mm_shuffle_ps(LVFU(srcbuffer[i - l]), LVFU(srcbuffer[i - l + 4]), _MM_SHUFFLE(2, 0, 2, 0));
+            lov += F2V(filterLo[j]) * srcv;//lopass channel
+            hiv += F2V(filterHi[j]) * srcv;//hipass channel
+        }
+
+        STVFU(dstLo[row * dstwidth + ((i / 2))], lov);
+        STVFU(dstHi[row * dstwidth + ((i / 2))], hiv);
+    }
+
+#endif
+
+    for(; i < srcwidth; i += 2) {
         float lo = 0.f, hi = 0.f;
 
         if (LIKELY(i > skip * taps && i < srcwidth - skip * taps)) { //bulk
@@ -453,6 +502,11 @@ template<typename T> void wavelet_level<T>::SynthesisFilterSubsampHorizontal (T
 
     // calculate coefficients
     int shift = skip * (taps - offset - 1); //align filter with data
+#ifdef __SSE2__
+    constexpr bool alignBulk = true;
+#else
+    constexpr bool alignBulk = false;
+#endif
 #ifdef _OPENMP
     #pragma omp parallel for num_threads(numThreads) if(numThreads>1)
 #endif
@@ -460,7 +514,8 @@ template<typename T> void wavelet_level<T>::SynthesisFilterSubsampHorizontal (T
     for (int k = 0; k < height; k++) {
         int i;
 
-        for(i = 0; i <= min(skip * taps, dstwidth); i++) {
+        // with SSE the border loop also takes the first bulk pixel if needed, so that the vectorized bulk starts at an even i + shift
+        for(i = 0; i <= min(skip * taps, dstwidth) || (alignBulk && i < dstwidth && ((i + shift) & 1)); i++) {
             float tot = 0.f;
             //TODO: this is correct only if skip=1; otherwise, want to work with cosets of length 'skip'
             int i_src = (i + shift) / 2;
@@ -474,6 +529,27 @@ template<typename T> void wavelet_level<T>::SynthesisFilterSubsampHorizontal (T
             dst[k * dstwidth + i] = tot;
         }
 
+#ifdef __SSE2__
+
+        for(; i < min(dstwidth - skip * taps, dstwidth) - 7; i += 8) {
+            // output pixels i + 2n use the even taps and i + 2n + 1 the odd taps of the same source pixel
+            const int i_src = (i + shift) / 2;
+            vfloat evenv = ZEROV;
+            vfloat oddv = ZEROV;
+
+            for (int j = 0, l = 0; j < taps; j += 2, l += skip) {
+                const vfloat srcLov = LVFU(srcLo[k * srcwidth + i_src - l]);
+                const vfloat srcHiv = LVFU(srcHi[k * srcwidth + i_src - l]);
+                evenv += ((F2V(filterLo[j]) * srcLov + F2V(filterHi[j]) * srcHiv));
+                oddv += ((F2V(filterLo[j + 1]) * srcLov + F2V(filterHi[j + 1]) * srcHiv));
+            }
+
+            STVFU(dst[k * dstwidth + i], _mm_unpacklo_ps(evenv, oddv));
+            STVFU(dst[k * dstwidth + i + 4], _mm_unpackhi_ps(evenv, oddv));
+        }
+
+#endif
+
         for(; i < min(dstwidth - skip * taps, dstwidth); i++) {
             float tot = 0.f;
             //TODO: this is correct only if skip=1; otherwise, want to work with cosets of length 'skip'
@@ -3782,4 +3782,116 @@ void PerceptualToneCurve::initApplyState(PerceptualToneCurveState & state, const
     }
 }
 
+void RGBCurveChain::add(const LUTf& curve)
+{
+    curves.push_back({{&curve, &curve, &curve}, false});
+}
+
+void RGBCurveChain::add(const LUTf& rCurve, const LUTf& gCurve, const LUTf& bCurve)
+{
+    curves.push_back({{rCurve ? &rCurve : nullptr, gCurve ? &gCurve : nullptr, bCurve ? &bCurve : nullptr}, true});
+}
+
+bool RGBCurveChain::compile()
+{
+    for (const auto& curve : curves) {
+        for (int c = 0; c < 3; ++c) {
+            const LUTf* const lut = curve.luts[c];
+
+            if (!lut) {
+                continue;
+            }
+
+            if (!*lut || lut->getSize() < 65536) {
+                return false;
+            }
+
+            for (int i = 0; i < 65536; ++i) {
+                // false for NaN
+                if (!((*lut)[i] >= 0.f && (*lut)[i] <= 65535.f)) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    for (int c = 0; c < 3; ++c) {
+        composed[c](65536, LUT_CLIP_BELOW | LUT_CLIP_ABOVE);
+
+        for (int i = 0; i < 65536; ++i) {
+            float value = i;
+
+            for (const auto& curve : curves) {
+                if (curve.luts[c]) {
+                    value = (*curve.luts[c])[value];
+                }
+            }
+
+            composed[c][i] = value;
+        }
+    }
+
+    return true;
+}
+
+void RGBCurveChain::applyCurves(float& r, float& g, float& b) const
+{
+    if (r >= 0.f && r <= 65535.f && g >= 0.f && g <= 65535.f && b >= 0.f && b <= 65535.f) {
+        r = composed[0][r];
+        g = composed[1][g];
+        b = composed[2][b];
+        return;
+    }
+
+    for (const auto& curve : curves) {
+        if (curve.perChannel) {
+            if (curve.luts[0]) {
+                setUnlessOOG(r, (*curve.luts[0])[r]);
+            }
+
+            if (curve.luts[1]) {
+                setUnlessOOG(g, (*curve.luts[1])[g]);
+            }
+
+            if (curve.luts[2]) {
+                setUnlessOOG(b, (*curve.luts[2])[b]);
+            }
+        } else {
+            const LUTf& lut = *curve.luts[0];
+            setUnlessOOG(r, g, b, lut[r], lut[g], lut[b]);
+        }
+    }
+}
+
+void RGBCurveChain::apply(float *r, float *g, float *b, int width) const
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    const vfloat c65535v = F2V(65535.f);
+
+    for (; i < width - 3; i += 4) {
+        const vfloat rv = LVFU(r[i]);
+        const vfloat gv = LVFU(g[i]);
+        const vfloat bv = LVFU(b[i]);
+        // false for NaN
+        const vmask inGamut = vandm(vandm(vandm(vmaskf_ge(rv, ZEROV), vmaskf_le(rv, c65535v)), vandm(vmaskf_ge(gv, ZEROV), vmaskf_le(gv, c65535v))), vandm(vmaskf_ge(bv, ZEROV), vmaskf_le(bv, c65535v)));
+
+        if (_mm_movemask_ps((vfloat)inGamut) == 15) {
+            STVFU(r[i], composed[0][rv]);
+            STVFU(g[i], composed[1][gv]);
+            STVFU(b[i], composed[2][bv]);
+        } else {
+            for (int k = i; k < i + 4; ++k) {
+                applyCurves(r[k], g[k], b[k]);
+            }
+        }
+    }
+#endif
+
+    for (; i < width; ++i) {
+        applyCurves(r[i], g[i], b[i]);
+    }
+}
+
 }
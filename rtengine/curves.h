@@ -1837,6 +1837,35 @@ public:
     void BatchApply(const size_t start, const size_t end, float *r, float *g, float *b, const PerceptualToneCurveState &state) const;
 };
 
+// Consecutive curves of rgbProc which are applied to the r, g and b channels independently (tone curve, custom tone
+// curves in standard mode, RGB curves in normal mode), composed into one lut per channel.
+// The composition is only valid if no curve maps a value of [0;65535] out of gamut, as the curves leave out of gamut
+// values untouched. Pixels with a channel out of [0;65535] go through the curves one after the other.
+class RGBCurveChain
+{
+public:
+    // curve applied to the three channels unless they are all out of gamut, like StandardToneCurve
+    void add(const LUTf& curve);
+    // curves applied to each channel unless it is out of gamut, like the RGB curves. Unallocated curves are skipped
+    void add(const LUTf& rCurve, const LUTf& gCurve, const LUTf& bCurve);
+
+    // builds the composed luts, returns false if the curves can't be composed
+    bool compile();
+
+    void apply(float *r, float *g, float *b, int width) const;
+
+private:
+    struct Curve {
+        const LUTf* luts[3];
+        bool perChannel;
+    };
+
+    void applyCurves(float& r, float& g, float& b) const;
+
+    std::vector<Curve> curves;
+    LUTf composed[3];
+};
+
 // Standard tone curve
 inline void StandardToneCurve::Apply(float& r, float& g, float& b) const
 {
@@ -1114,13 +1114,64 @@ void DCPProfile::apply(
             }
         }
 
+#ifdef __SSE2__
+        const vfloat sixv = F2V(6.f);
+        vfloat pro_photov[3][3];
+        vfloat workv[3][3];
+
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                pro_photov[i][j] = F2V(pro_photo[i][j]);
+                workv[i][j] = F2V(work[i][j]);
+            }
+        }
+#endif
+
         // Convert to ProPhoto and apply LUT
 #ifdef _OPENMP
         #pragma omp parallel for schedule(dynamic,16)
 #endif
 
         for (int y = 0; y < img->getHeight(); ++y) {
-            for (int x = 0; x < img->getWidth(); x++) {
+            int x = 0;
+
+#ifdef __SSE2__
+            for (; x < img->getWidth() - 3; x += 4) {
+                const vfloat r = LVFU(img->r(y, x));
+                const vfloat g = LVFU(img->g(y, x));
+                const vfloat b = LVFU(img->b(y, x));
+
+                vfloat newr = pro_photov[0][0] * r + pro_photov[0][1] * g + pro_photov[0][2] * b;
+                vfloat newg = pro_photov[1][0] * r + pro_photov[1][1] * g + pro_photov[1][2] * b;
+                vfloat newb = pro_photov[2][0] * r + pro_photov[2][1] * g + pro_photov[2][2] * b;
+
+                // If point is in negative area, just the matrix, but not the LUT, as in Color::rgb2hsvdcp
+                const vmask negative = vmaskf_lt(vminf(newr, vminf(newg, newb)), ZEROV);
+
+                if (_mm_movemask_ps((vfloat)negative) != 0xf) {
+                    vfloat h, s, v;
+                    Color::rgb2hsvtc(newr, newg, newb, h, s, v);
+
+                    hsdApply(delta_info, delta_base, h, s, v);
+
+                    // RT range correction
+                    h = vself(vmaskf_lt(h, ZEROV), h + sixv, vself(vmaskf_ge(h, sixv), h - sixv, h));
+
+                    vfloat lutr, lutg, lutb;
+                    Color::hsv2rgbdcp(h, s, v, lutr, lutg, lutb);
+
+                    newr = vself(negative, newr, lutr);
+                    newg = vself(negative, newg, lutg);
+                    newb = vself(negative, newb, lutb);
+                }
+
+                STVFU(img->r(y, x), workv[0][0] * newr + workv[0][1] * newg + workv[0][2] * newb);
+                STVFU(img->g(y, x), workv[1][0] * newr + workv[1][1] * newg + workv[1][2] * newb);
+                STVFU(img->b(y, x), workv[2][0] * newr + workv[2][1] * newg + workv[2][2] * newb);
+            }
+#endif
+
+            for (; x < img->getWidth(); x++) {
                 float newr = pro_photo[0][0] * img->r(y, x) + pro_photo[0][1] * img->g(y, x) + pro_photo[0][2] * img->b(y, x);
                 float newg = pro_photo[1][0] * img->r(y, x) + pro_photo[1][1] * img->g(y, x) + pro_photo[1][2] * img->b(y, x);
                 float newb = pro_photo[2][0] * img->r(y, x) + pro_photo[2][1] * img->g(y, x) + pro_photo[2][2] * img->b(y, x);
@@ -1225,39 +1276,107 @@ void DCPProfile::step2ApplyTile(float* rc, float* gc, float* bc, int width, int
             }
         }
     } else {
+        const bool already_pro_photo = as_in.data->already_pro_photo;
+        const bool apply_look_table = as_in.data->apply_look_table;
+        const float (&pro_photo)[3][3] = as_in.data->pro_photo;
+        const float (&work)[3][3] = as_in.data->work;
+
+#ifdef __SSE2__
+        const vfloat exp_scalev = F2V(exp_scale);
+        const vfloat fclipv = F2V(65535.5f);
+        const vfloat onev = F2V(1.f);
+        const vfloat sixv = F2V(6.f);
+        vfloat pro_photov[3][3];
+        vfloat workv[3][3];
+
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                pro_photov[i][j] = F2V(pro_photo[i][j]);
+                workv[i][j] = F2V(work[i][j]);
+            }
+        }
+#endif
+
         for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                float r = rc[y * tile_width + x];
-                float g = gc[y * tile_width + x];
-                float b = bc[y * tile_width + x];
+            float* const rl = rc + y * tile_width;
+            float* const gl = gc + y * tile_width;
+            float* const bl = bc + y * tile_width;
 
-                r *= exp_scale;
-                g *= exp_scale;
-                b *= exp_scale;
+            // convert to ProPhoto and apply the look table, the tone curve is applied to the whole row
+            int x = 0;
 
-                float newr, newg, newb;
+#ifdef __SSE2__
+            for (; x < width - 3; x += 4) {
+                const vfloat r = LVFU(rl[x]) * exp_scalev;
+                const vfloat g = LVFU(gl[x]) * exp_scalev;
+                const vfloat b = LVFU(bl[x]) * exp_scalev;
 
-                if (as_in.data->already_pro_photo) {
+                vfloat newr, newg, newb;
+
+                if (already_pro_photo) {
                     newr = r;
                     newg = g;
                     newb = b;
                 } else {
-                    newr = as_in.data->pro_photo[0][0] * r + as_in.data->pro_photo[0][1] * g + as_in.data->pro_photo[0][2] * b;
-                    newg = as_in.data->pro_photo[1][0] * r + as_in.data->pro_photo[1][1] * g + as_in.data->pro_photo[1][2] * b;
-                    newb = as_in.data->pro_photo[2][0] * r + as_in.data->pro_photo[2][1] * g + as_in.data->pro_photo[2][2] * b;
+                    newr = pro_photov[0][0] * r + pro_photov[0][1] * g + pro_photov[0][2] * b;
+                    newg = pro_photov[1][0] * r + pro_photov[1][1] * g + pro_photov[1][2] * b;
+                    newb = pro_photov[2][0] * r + pro_photov[2][1] * g + pro_photov[2][2] * b;
                 }
 
                 // with looktable and tonecurve we need to clip
-                if (as_in.data->apply_look_table || as_in.data->use_tone_curve) {
-                    newr = max(newr, 0.f);
-                    newg = max(newg, 0.f);
-                    newb = max(newb, 0.f);
+                newr = vmaxf(newr, ZEROV);
+                newg = vmaxf(newg, ZEROV);
+                newb = vmaxf(newb, ZEROV);
+
+                if (apply_look_table) {
+                    vfloat cnewr = vminf(newr, fclipv);
+                    vfloat cnewg = vminf(newg, fclipv);
+                    vfloat cnewb = vminf(newb, fclipv);
+
+                    vfloat h, s, v;
+                    Color::rgb2hsvtc(cnewr, cnewg, cnewb, h, s, v);
+
+                    hsdApply(look_info, look_table, h, s, v);
+                    s = vclampf(s, ZEROV, onev);
+                    v = vclampf(v, ZEROV, onev);
+
+                    // RT range correction
+                    h = vself(vmaskf_lt(h, ZEROV), h + sixv, vself(vmaskf_ge(h, sixv), h - sixv, h));
+
+                    Color::hsv2rgbdcp(h, s, v, cnewr, cnewg, cnewb);
+
+                    setUnlessOOG(newr, newg, newb, cnewr, cnewg, cnewb);
                 }
-                // newr = FCLIP(newr);
-                // newg = FCLIP(newg);
-                // newb = FCLIP(newb);
 
-                if (as_in.data->apply_look_table) {
+                STVFU(rl[x], newr);
+                STVFU(gl[x], newg);
+                STVFU(bl[x], newb);
+            }
+#endif
+
+            for (; x < width; x++) {
+                const float r = rl[x] * exp_scale;
+                const float g = gl[x] * exp_scale;
+                const float b = bl[x] * exp_scale;
+
+                float newr, newg, newb;
+
+                if (already_pro_photo) {
+                    newr = r;
+                    newg = g;
+                    newb = b;
+                } else {
+                    newr = pro_photo[0][0] * r + pro_photo[0][1] * g + pro_photo[0][2] * b;
+                    newg = pro_photo[1][0] * r + pro_photo[1][1] * g + pro_photo[1][2] * b;
+                    newb = pro_photo[2][0] * r + pro_photo[2][1] * g + pro_photo[2][2] * b;
+                }
+
+                // with looktable and tonecurve we need to clip
+                newr = max(newr, 0.f);
+                newg = max(newg, 0.f);
+                newb = max(newb, 0.f);
+
+                if (apply_look_table) {
                     float cnewr = FCLIP(newr);
                     float cnewg = FCLIP(newg);
                     float cnewb = FCLIP(newb);
@@ -1281,18 +1400,36 @@ void DCPProfile::step2ApplyTile(float* rc, float* gc, float* bc, int width, int
                     setUnlessOOG(newr, newg, newb, cnewr, cnewg, cnewb);
                 }
 
-                if (as_in.data->use_tone_curve) {
-                    tone_curve.Apply(newr, newg, newb);
+                rl[x] = newr;
+                gl[x] = newg;
+                bl[x] = newb;
+            }
+
+            if (as_in.data->use_tone_curve) {
+                tone_curve.BatchApply(0, width, rl, gl, bl);
+            }
+
+            if (!already_pro_photo) {
+                x = 0;
+
+#ifdef __SSE2__
+                for (; x < width - 3; x += 4) {
+                    const vfloat newr = LVFU(rl[x]);
+                    const vfloat newg = LVFU(gl[x]);
+                    const vfloat newb = LVFU(bl[x]);
+                    STVFU(rl[x], workv[0][0] * newr + workv[0][1] * newg + workv[0][2] * newb);
+                    STVFU(gl[x], workv[1][0] * newr + workv[1][1] * newg + workv[1][2] * newb);
+                    STVFU(bl[x], workv[2][0] * newr + workv[2][1] * newg + workv[2][2] * newb);
                 }
+#endif
 
-                if (as_in.data->already_pro_photo) {
-                    rc[y * tile_width + x] = newr;
-                    gc[y * tile_width + x] = newg;
-                    bc[y * tile_width + x] = newb;
-                } else {
-                    rc[y * tile_width + x] = as_in.data->work[0][0] * newr + as_in.data->work[0][1] * newg + as_in.data->work[0][2] * newb;
-                    gc[y * tile_width + x] = as_in.data->work[1][0] * newr + as_in.data->work[1][1] * newg + as_in.data->work[1][2] * newb;
-                    bc[y * tile_width + x] = as_in.data->work[2][0] * newr + as_in.data->work[2][1] * newg + as_in.data->work[2][2] * newb;
+                for (; x < width; x++) {
+                    const float newr = rl[x];
+                    const float newg = gl[x];
+                    const float newb = bl[x];
+                    rl[x] = work[0][0] * newr + work[0][1] * newg + work[0][2] * newb;
+                    gl[x] = work[1][0] * newr + work[1][1] * newg + work[1][2] * newb;
+                    bl[x] = work[2][0] * newr + work[2][1] * newg + work[2][2] * newb;
                 }
             }
         }
@@ -1768,6 +1905,85 @@ inline void DCPProfile::hsdApply(const HsdTableInfo& table_info, const std::vect
     }
 }
 
+#ifdef __SSE2__
+inline void DCPProfile::hsdApply(const HsdTableInfo& table_info, const std::vector<HsbModify>& table_base, vfloat& h, vfloat& s, vfloat& v) const
+{
+    // Same as the scalar version for 4 pixels. Indices and weights are computed in vectors, then each pixel interpolates
+    // its table entries as (hue_shift, sat_scale, val_scale, pad) vectors, which are transposed back to 4 pixel vectors.
+    const bool three_d = table_info.val_divisions >= 2;
+
+    const vfloat h_scaled = h * F2V(table_info.pc.h_scale);
+    const vfloat s_scaled = s * F2V(table_info.pc.s_scale);
+
+    // vclampf maps NaN to the lower bound, truncating the clamped value gives the same indices as the scalar version
+    const vfloat h_index0 = vminf(_mm_cvtepi32_ps(_mm_cvttps_epi32(vmaxf(h_scaled, ZEROV))), F2V(table_info.pc.max_hue_index0));
+    const vfloat s_index0 = _mm_cvtepi32_ps(_mm_cvttps_epi32(vclampf(s_scaled, ZEROV, F2V(table_info.pc.max_sat_index0))));
+    const vmask hue_wrap = vmaskf_ge(h_index0, F2V(table_info.pc.max_hue_index0));
+
+    float h_fract1[4] ALIGNED16;
+    float s_fract1[4] ALIGNED16;
+    float v_fract1[4] ALIGNED16;
+    int e00_index[4] ALIGNED16;
+    int e01_index[4] ALIGNED16;
+
+    STVF(h_fract1[0], h_scaled - h_index0);
+    STVF(s_fract1[0], s_scaled - s_index0);
+
+    const vfloat hue_stepv = F2V(table_info.pc.hue_step);
+    vfloat e00 = h_index0 * hue_stepv + s_index0;
+    vfloat v_encoded = v;
+
+    if (three_d) {
+        if (table_info.srgb_gamma) {
+            // gammatab_srgb1 doesn't clip, operator() extrapolates like the scalar lookup for v > 1
+            v_encoded = Color::gammatab_srgb1(v * F2V(65535.f));
+        }
+
+        const vfloat v_scaled = v_encoded * F2V(table_info.pc.v_scale);
+        const vfloat v_index0 = _mm_cvtepi32_ps(_mm_cvttps_epi32(vclampf(v_scaled, ZEROV, F2V(table_info.pc.max_val_index0))));
+        STVF(v_fract1[0], v_scaled - v_index0);
+        e00 += v_index0 * F2V(table_info.pc.val_step);
+    }
+
+    _mm_store_si128(reinterpret_cast<__m128i*>(e00_index), _mm_cvtps_epi32(e00));
+    _mm_store_si128(reinterpret_cast<__m128i*>(e01_index), _mm_cvtps_epi32(vself(hue_wrap, e00 - h_index0 * hue_stepv, e00 + hue_stepv)));
+
+    vfloat modify[4];
+
+    for (int k = 0; k < 4; ++k) {
+        const vfloat h_fract1v = F2V(h_fract1[k]);
+        const vfloat h_fract0v = F2V(1.f) - h_fract1v;
+        const HsbModify* const e00_entry = &table_base[e00_index[k]];
+        const HsbModify* const e01_entry = &table_base[e01_index[k]];
+
+        vfloat modify0 = h_fract0v * LVFU(e00_entry[0].hue_shift) + h_fract1v * LVFU(e01_entry[0].hue_shift);
+        vfloat modify1 = h_fract0v * LVFU(e00_entry[1].hue_shift) + h_fract1v * LVFU(e01_entry[1].hue_shift);
+
+        if (three_d) {
+            const int val_step = table_info.pc.val_step;
+            const vfloat v_fract1v = F2V(v_fract1[k]);
+            const vfloat v_fract0v = F2V(1.f) - v_fract1v;
+            modify0 = v_fract0v * modify0 + v_fract1v * (h_fract0v * LVFU(e00_entry[val_step].hue_shift) + h_fract1v * LVFU(e01_entry[val_step].hue_shift));
+            modify1 = v_fract0v * modify1 + v_fract1v * (h_fract0v * LVFU(e00_entry[val_step + 1].hue_shift) + h_fract1v * LVFU(e01_entry[val_step + 1].hue_shift));
+        }
+
+        const vfloat s_fract1v = F2V(s_fract1[k]);
+        modify[k] = (F2V(1.f) - s_fract1v) * modify0 + s_fract1v * modify1;
+    }
+
+    _MM_TRANSPOSE4_PS(modify[0], modify[1], modify[2], modify[3]);
+
+    h += modify[0] * F2V(6.0f / 360.0f); // Convert to internal hue range.
+    s *= modify[1]; // No clipping here, we are RT float :-)
+
+    if (table_info.srgb_gamma) {
+        v = Color::igammatab_srgb1(v_encoded * modify[2] * F2V(65535.f));
+    } else {
+        v *= modify[2];
+    }
+}
+#endif
+
 bool DCPProfile::isValid() const
 {
     return valid;
@@ -82,6 +82,7 @@ private:
         float hue_shift;
         float sat_scale;
         float val_scale;
+        float pad; // 0, makes an entry one SSE vector
     };
 
     struct HsdTableInfo {
@@ -109,6 +110,9 @@ private:
     Matrix makeXyzCam(const ColorTemp& white_balance, const Triple& pre_mul, const Matrix& cam_wb_matrix, int preferred_illuminant) const;
     std::vector<HsbModify> makeHueSatMap(const ColorTemp& white_balance, int preferred_illuminant) const;
     void hsdApply(const HsdTableInfo& table_info, const std::vector<HsbModify>& table_base, float& h, float& s, float& v) const;
+#ifdef __SSE2__
+    void hsdApply(const HsdTableInfo& table_info, const std::vector<HsbModify>& table_base, vfloat& h, vfloat& s, vfloat& v) const;
+#endif
 
     Matrix color_matrix_1;
     Matrix color_matrix_2;
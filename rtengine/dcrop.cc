@@ -23,6 +23,7 @@
 #include "curves.h"
 #include "dcp.h"
 #include "dcrop.h"
+#include "denoiseinfocache.h"
 #include "guidedfilter.h"
 #include "image8.h"
 #include "imagefloat.h"
@@ -427,67 +428,93 @@ void Crop::update(int todo)
             float gam, gamthresh, gamslope;
             parent->ipf.RGB_denoise_infoGamCurve(params.dirpyrDenoise, parent->imgsrc->isRAW(), gamcurve, gam, gamthresh, gamslope);
             int Nb[9];
+
+            DenoiseInfoCache::Zones zones;
+            const DenoiseInfoCache::Key zonesKey(parent->imgsrc, params, parent->currWB, tr, widIm, heiIm, crW, crH);
+
+            if (!DenoiseInfoCache::getInstance().get(zonesKey, zones)) {
+                // the zones are read at full size, so a deferred demosaic is finished here and not from the parallel region
+                parent->imgsrc->finishDeferredDemosaic();
+
 #ifdef _OPENMP
-            #pragma omp parallel
+                #pragma omp parallel
 #endif
-            {
-                Imagefloat *origCropPart = new Imagefloat(crW, crH); //allocate memory
-                Imagefloat *provicalc = new Imagefloat((crW + 1) / 2, (crH + 1) / 2);  //for denoise curves
-
-                int  coordW[3];//coordinate of part of image to measure noise
-                int  coordH[3];
-                int begW = 50;
-                int begH = 50;
-                coordW[0] = begW;
-                coordW[1] = widIm / 2 - crW / 2;
-                coordW[2] = widIm - crW - begW;
-                coordH[0] = begH;
-                coordH[1] = heiIm / 2 - crH / 2;
-                coordH[2] = heiIm - crH - begH;
+                {
+                    Imagefloat *origCropPart = new Imagefloat(crW, crH); //allocate memory
+                    Imagefloat *provicalc = new Imagefloat((crW + 1) / 2, (crH + 1) / 2);  //for denoise curves
+
+                    int  coordW[3];//coordinate of part of image to measure noise
+                    int  coordH[3];
+                    int begW = 50;
+                    int begH = 50;
+                    coordW[0] = begW;
+                    coordW[1] = widIm / 2 - crW / 2;
+                    coordW[2] = widIm - crW - begW;
+                    coordH[0] = begH;
+                    coordH[1] = heiIm / 2 - crH / 2;
+                    coordH[2] = heiIm - crH - begH;
 #ifdef _OPENMP
-                #pragma omp for schedule(dynamic) collapse(2) nowait
+                    #pragma omp for schedule(dynamic) collapse(2) nowait
 #endif
 
-                for (int wcr = 0; wcr <= 2; wcr++) {
-                    for (int hcr = 0; hcr <= 2; hcr++) {
-                        PreviewProps ppP(coordW[wcr], coordH[hcr], crW, crH, 1);
-                        parent->imgsrc->getImage(parent->currWB, tr, origCropPart, ppP, params.toneCurve, params.raw);
-
-                        // we only need image reduced to 1/4 here
-                        for (int ii = 0; ii < crH; ii += 2) {
-                            for (int jj = 0; jj < crW; jj += 2) {
-                                provicalc->r(ii >> 1, jj >> 1) = origCropPart->r(ii, jj);
-                                provicalc->g(ii >> 1, jj >> 1) = origCropPart->g(ii, jj);
-                                provicalc->b(ii >> 1, jj >> 1) = origCropPart->b(ii, jj);
+                    for (int wcr = 0; wcr <= 2; wcr++) {
+                        for (int hcr = 0; hcr <= 2; hcr++) {
+                            PreviewProps ppP(coordW[wcr], coordH[hcr], crW, crH, 1);
+                            parent->imgsrc->getImage(parent->currWB, tr, origCropPart, ppP, params.toneCurve, params.raw);
+
+                            // we only need image reduced to 1/4 here
+                            for (int ii = 0; ii < crH; ii += 2) {
+                                for (int jj = 0; jj < crW; jj += 2) {
+                                    provicalc->r(ii >> 1, jj >> 1) = origCropPart->r(ii, jj);
+                                    provicalc->g(ii >> 1, jj >> 1) = origCropPart->g(ii, jj);
+                                    provicalc->b(ii >> 1, jj >> 1) = origCropPart->b(ii, jj);
+                                }
                             }
-                        }
 
-                        parent->imgsrc->convertColorSpace(provicalc, params.icm, parent->currWB);  //for denoise luminance curve
-
-                        float pondcorrec = 1.0f;
-                        float chaut = 0.f, redaut = 0.f, blueaut = 0.f, maxredaut = 0.f, maxblueaut = 0.f, minredaut = 0.f, minblueaut = 0.f, chromina = 0.f, sigma = 0.f, lumema = 0.f, sigma_L = 0.f, redyel = 0.f, skinc = 0.f, nsknc = 0.f;
-                        int nb = 0;
-                        parent->ipf.RGB_denoise_info(origCropPart, provicalc, parent->imgsrc->isRAW(), gamcurve, gam, gamthresh, gamslope, params.dirpyrDenoise, parent->imgsrc->getDirPyrDenoiseExpComp(), chaut, nb, redaut, blueaut, maxredaut, maxblueaut, minredaut, minblueaut, chromina, sigma, lumema, sigma_L, redyel, skinc, nsknc);
-
-                        //printf("DCROP skip=%d cha=%f red=%f bl=%f redM=%f bluM=%f chrom=%f sigm=%f lum=%f\n",skip, chaut,redaut,blueaut, maxredaut, maxblueaut, chromina, sigma, lumema);
-                        Nb[hcr * 3 + wcr] = nb;
-                        parent->denoiseInfoStore.ch_M[hcr * 3 + wcr] = pondcorrec * chaut;
-                        parent->denoiseInfoStore.max_r[hcr * 3 + wcr] = pondcorrec * maxredaut;
-                        parent->denoiseInfoStore.max_b[hcr * 3 + wcr] = pondcorrec * maxblueaut;
-                        min_r[hcr * 3 + wcr] = pondcorrec * minredaut;
-                        min_b[hcr * 3 + wcr] = pondcorrec * minblueaut;
-                        lumL[hcr * 3 + wcr] = lumema;
-                        chromC[hcr * 3 + wcr] = chromina;
-                        ry[hcr * 3 + wcr] = redyel;
-                        sk[hcr * 3 + wcr] = skinc;
-                        pcsk[hcr * 3 + wcr] = nsknc;
+                            parent->imgsrc->convertColorSpace(provicalc, params.icm, parent->currWB);  //for denoise luminance curve
+
+                            float pondcorrec = 1.0f;
+                            float chaut = 0.f, redaut = 0.f, blueaut = 0.f, maxredaut = 0.f, maxblueaut = 0.f, minredaut = 0.f, minblueaut = 0.f, chromina = 0.f, sigma = 0.f, lumema = 0.f, sigma_L = 0.f, redyel = 0.f, skinc = 0.f, nsknc = 0.f;
+                            int nb = 0;
+                            parent->ipf.RGB_denoise_info(origCropPart, provicalc, parent->imgsrc->isRAW(), gamcurve, gam, gamthresh, gamslope, params.dirpyrDenoise, parent->imgsrc->getDirPyrDenoiseExpComp(), chaut, nb, redaut, blueaut, maxredaut, maxblueaut, minredaut, minblueaut, chromina, sigma, lumema, sigma_L, redyel, skinc, nsknc);
+
+                            //printf("DCROP skip=%d cha=%f red=%f bl=%f redM=%f bluM=%f chrom=%f sigm=%f lum=%f\n",skip, chaut,redaut,blueaut, maxredaut, maxblueaut, chromina, sigma, lumema);
+                            zones.Nb[hcr * 3 + wcr] = nb;
+                            zones.ch_M[hcr * 3 + wcr] = pondcorrec * chaut;
+                            zones.max_r[hcr * 3 + wcr] = pondcorrec * maxredaut;
+                            zones.max_b[hcr * 3 + wcr] = pondcorrec * maxblueaut;
+                            zones.min_r[hcr * 3 + wcr] = pondcorrec * minredaut;
+                            zones.min_b[hcr * 3 + wcr] = pondcorrec * minblueaut;
+                            zones.lumL[hcr * 3 + wcr] = lumema;
+                            zones.chromC[hcr * 3 + wcr] = chromina;
+                            zones.ry[hcr * 3 + wcr] = redyel;
+                            zones.sk[hcr * 3 + wcr] = skinc;
+                            zones.pcsk[hcr * 3 + wcr] = nsknc;
 
+                        }
                     }
+
+                    delete provicalc;
+                    delete origCropPart;
                 }
 
-                delete provicalc;
-                delete origCropPart;
+                DenoiseInfoCache::getInstance().put(zonesKey, zones);
+            }
+
+            for (int k = 0; k < 9; k++) {
+                Nb[k] = zones.Nb[k];
+                parent->denoiseInfoStore.ch_M[k] = zones.ch_M[k];
+                parent->denoiseInfoStore.max_r[k] = zones.max_r[k];
+                parent->denoiseInfoStore.max_b[k] = zones.max_b[k];
+                min_r[k] = zones.min_r[k];
+                min_b[k] = zones.min_b[k];
+                lumL[k] = zones.lumL[k];
+                chromC[k] = zones.chromC[k];
+                ry[k] = zones.ry[k];
+                sk[k] = zones.sk[k];
+                pcsk[k] = zones.pcsk[k];
             }
+
             float chM = 0.f;
             float MaxR = 0.f;
             float MaxB = 0.f;
@@ -2014,6 +2041,21 @@ int Crop::get_skip()
     return skip;
 }
 
+bool Crop::getSourceArea(int &x, int &y, int &w, int &h)
+{
+    MyMutex::MyLock lock(cropMutex);
+
+    if (!cropAllocated || trafw <= 0 || trafh <= 0) {
+        return false;
+    }
+
+    x = trafx;
+    y = trafy;
+    w = trafw * skip;
+    h = trafh * skip;
+    return true;
+}
+
 int Crop::getLeftBorder()
 {
     MyMutex::MyLock lock(cropMutex);
@@ -91,6 +91,10 @@ public:
     void setListener    (DetailedCropListener* il) override;
     void destroy        () override;
     int get_skip();
+    /** @brief Area of the image source used by the last update, in PreviewProps coordinates at skip 1
+     * @return false if the crop hasn't been processed yet
+     */
+    bool getSourceArea(int &x, int &y, int &w, int &h);
     int getLeftBorder();
     int getUpperBorder();
 };
@@ -0,0 +1,126 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "colortemp.h"
+#include "denoiseinfocache.h"
+#include "imagesource.h"
+
+namespace
+{
+
+// enough for the images of the file browser selection being reprocessed
+constexpr std::size_t maxEntries = 32;
+
+}
+
+namespace rtengine
+{
+
+DenoiseInfoCache::Key::Key(ImageSource* imgsrc, const procparams::ProcParams& params, const ColorTemp& currWB, int tr, int width, int height, int crW, int crH) :
+    fileName(imgsrc->getFileName()),
+    iso(imgsrc->getMetaData() ? imgsrc->getMetaData()->getISOSpeed() : 0),
+    tr(tr),
+    width(width),
+    height(height),
+    crW(crW),
+    crH(crH),
+    temp(currWB.getTemp()),
+    green(currWB.getGreen()),
+    equal(currWB.getEqual()),
+    expcomp(imgsrc->getDirPyrDenoiseExpComp()),
+    hrenabled(params.toneCurve.hrenabled),
+    hrmethod(params.toneCurve.method),
+    hlbl(params.toneCurve.hlbl),
+    clampOOG(params.toneCurve.clampOOG),
+    dmethod(params.dirpyrDenoise.dmethod),
+    smethod(params.dirpyrDenoise.smethod),
+    gamma(params.dirpyrDenoise.gamma),
+    raw(params.raw),
+    icm(params.icm),
+    lensProf(params.lensProf),
+    pdsharpening(params.pdsharpening),
+    retinex(params.retinex)
+{
+}
+
+bool DenoiseInfoCache::Key::operator ==(const Key& other) const
+{
+    return
+        fileName == other.fileName
+        && iso == other.iso
+        && tr == other.tr
+        && width == other.width
+        && height == other.height
+        && crW == other.crW
+        && crH == other.crH
+        && temp == other.temp
+        && green == other.green
+        && equal == other.equal
+        && expcomp == other.expcomp
+        && hrenabled == other.hrenabled
+        && hrmethod == other.hrmethod
+        && hlbl == other.hlbl
+        && clampOOG == other.clampOOG
+        && dmethod == other.dmethod
+        && smethod == other.smethod
+        && gamma == other.gamma
+        && raw == other.raw
+        && icm == other.icm
+        && lensProf == other.lensProf
+        && pdsharpening == other.pdsharpening
+        && retinex == other.retinex;
+}
+
+DenoiseInfoCache& DenoiseInfoCache::getInstance()
+{
+    static DenoiseInfoCache instance;
+    return instance;
+}
+
+bool DenoiseInfoCache::get(const Key& key, Zones& zones)
+{
+    MyMutex::MyLock lock(mutex);
+
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if (it->first == key) {
+            zones = it->second;
+            entries.splice(entries.begin(), entries, it);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void DenoiseInfoCache::put(const Key& key, const Zones& zones)
+{
+    MyMutex::MyLock lock(mutex);
+
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if (it->first == key) {
+            entries.erase(it);
+            break;
+        }
+    }
+
+    entries.emplace_front(key, zones);
+
+    if (entries.size() > maxEntries) {
+        entries.pop_back();
+    }
+}
+
+}
@@ -0,0 +1,103 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <list>
+
+#include <glibmm/ustring.h>
+
+#include "noncopyable.h"
+#include "procparams.h"
+
+#include "../rtgui/threadutils.h"
+
+namespace rtengine
+{
+
+class ColorTemp;
+class ImageSource;
+
+/* Cache for the noise measurements of the "Automatic global" chroma noise reduction.
+ * The measurement of the 9 zones only depends on the raw file and the parameters of the raw stage, vignetting correction,
+ * highlight reconstruction, clipping, capture sharpening and retinex, so it is kept per image and ISO and reused by the preview
+ * and by the batch queue.
+ */
+class DenoiseInfoCache final :
+    public NonCopyable
+{
+public:
+    // raw results of RGB_denoise_info for the 9 zones, before calcautodn_info
+    struct Zones {
+        int Nb[9];
+        float ch_M[9];
+        float max_r[9];
+        float max_b[9];
+        float min_r[9];
+        float min_b[9];
+        float lumL[9];
+        float chromC[9];
+        float ry[9];
+        float sk[9];
+        float pcsk[9];
+    };
+
+    class Key
+    {
+    public:
+        Key(ImageSource* imgsrc, const procparams::ProcParams& params, const ColorTemp& currWB, int tr, int width, int height, int crW, int crH);
+
+        bool operator ==(const Key& other) const;
+
+    private:
+        Glib::ustring fileName;
+        int iso;
+        int tr;
+        int width;
+        int height;
+        int crW;
+        int crH;
+        double temp;
+        double green;
+        double equal;
+        double expcomp;
+        bool hrenabled;
+        Glib::ustring hrmethod;
+        int hlbl;
+        bool clampOOG;
+        Glib::ustring dmethod;
+        Glib::ustring smethod;
+        double gamma;
+        procparams::RAWParams raw;
+        procparams::ColorManagementParams icm;
+        procparams::LensProfParams lensProf;
+        procparams::CaptureSharpeningParams pdsharpening;
+        procparams::RetinexParams retinex;
+    };
+
+    static DenoiseInfoCache& getInstance();
+
+    bool get(const Key& key, Zones& zones);
+    void put(const Key& key, const Zones& zones);
+
+private:
+    DenoiseInfoCache() = default;
+
+    std::list<std::pair<Key, Zones>> entries; // most recently used first
+    MyMutex mutex;
+};
+
+}
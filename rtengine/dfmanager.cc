@@ -17,13 +17,17 @@
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
+#include <deque>
 #include <iostream>
 #include <list>
 #include <map>
+#include <set>
 #include <sstream>
 
+#include <glib/gstdio.h>
 #include <giomm.h>
 #include <glibmm/ustring.h>
 
@@ -37,6 +41,7 @@
 #include "utils.h"
 
 #include "../rtgui/options.h"
+#include "../rtgui/threadutils.h"
 
 namespace
 {
@@ -46,6 +51,33 @@ std::string toUppercase(const std::string& string)
     return Glib::ustring(string).uppercase();
 }
 
+// the hot/dead pixels detected for a camera body are applied without detection once they were seen in this many images
+constexpr unsigned int detectedMinImages = 3;
+// run the detection again after the stored pixels were applied to this many other files, to catch new defects
+constexpr unsigned int detectedRecheckInterval = 16;
+// number of recently scanned file names remembered per camera body
+constexpr std::size_t detectedMaxFiles = 64;
+
+std::string detectedKey(const std::string& mak, const std::string& mod, const std::string& serial, int width, int height, int iso, double shutter, int thresh, bool hot, bool dead)
+{
+    // hot pixels depend on gain and exposure time, so images are grouped in buckets of one stop of ISO and of exposure time
+    const int isoBucket = iso > 0 ? std::lround(std::log2(iso / 100.0)) : 0;
+    const int shutterBucket = shutter > 0.0 ? std::lround(std::log2(shutter)) : 0;
+
+    std::ostringstream s;
+    s << mak << " " << mod << " " << serial << " " << width << "x" << height << " iso" << isoBucket << " t" << shutterBucket << " " << thresh << (hot ? "h" : "") << (dead ? "d" : "");
+    std::string key = s.str();
+
+    // the key is also used as file name
+    for (auto &c : key) {
+        if (c == '/' || c == '\\' || c == ':' || c == '*' || c == '?' || c == '"' || c == '<' || c == '>' || c == '|') {
+            c = '_';
+        }
+    }
+
+    return key;
+}
+
 class dfInfo final
 {
 public:
@@ -311,17 +343,33 @@ public:
     const std::vector<badPix>* getHotPixels(const std::string& mak, const std::string& mod, int iso, double shut, time_t t);
     const std::vector<badPix>* getHotPixels(const Glib::ustring& filename);
     const std::vector<badPix>* getBadPixels(const std::string& mak, const std::string& mod, const std::string& serial) const;
+    bool getDetectedPixels(const std::string& key, const std::string& filename, std::vector<badPix>& bp);
+    void addDetectedPixels(const std::string& key, const std::string& filename, const std::vector<badPix>& bp);
 
 private:
+    struct DetectedPixels {
+        bool loaded = false;
+        unsigned int images = 0; // number of images the detection ran on
+        std::deque<std::string> scanned; // most recent files the detection ran on, at most detectedMaxFiles
+        std::set<std::string> applied; // files the confirmed pixels were applied to since the last detection
+        std::map<uint32_t, unsigned int> hits; // how often a pixel was detected, key is (y << 16) | x
+        std::vector<badPix> confirmed; // pixels detected in at least half of the images
+    };
     typedef std::multimap<std::string, dfInfo> dfList_t;
     typedef std::map<std::string, std::vector<badPix> > bpList_t;
+    typedef std::map<std::string, DetectedPixels> detectedList_t;
     dfList_t dfList;
     bpList_t bpList;
+    detectedList_t detectedList;
+    MyMutex detectedMutex;
     bool initialized;
     Glib::ustring currentPath;
     dfInfo* addFileInfo(const Glib::ustring &filename, bool pool = true);
     dfInfo* find(const std::string &mak, const std::string &mod, int isospeed, double shut, time_t t);
     int scanBadPixelsFile(const Glib::ustring &filename);
+    DetectedPixels& getDetectedEntry(const std::string &key);
+    static void updateConfirmed(DetectedPixels &entry);
+    static Glib::ustring getDetectedFilename(const std::string &key);
 };
 
 
@@ -527,6 +575,145 @@ const std::vector<rtengine::badPix>* rtengine::DFManager::Implementation::getBad
     }
 }
 
+bool rtengine::DFManager::Implementation::getDetectedPixels(const std::string& key, const std::string& filename, std::vector<badPix>& bp)
+{
+    MyMutex::MyLock lock(detectedMutex);
+
+    DetectedPixels &entry = getDetectedEntry(key);
+
+    if (entry.images < detectedMinImages) {
+        return false;
+    }
+
+    // processing the same file again doesn't count as a use
+    if (std::find(entry.scanned.begin(), entry.scanned.end(), filename) == entry.scanned.end() && entry.applied.insert(filename).second && entry.applied.size() >= detectedRecheckInterval) {
+        return false;
+    }
+
+    bp = entry.confirmed;
+    return true;
+}
+
+void rtengine::DFManager::Implementation::addDetectedPixels(const std::string& key, const std::string& filename, const std::vector<badPix>& bp)
+{
+    MyMutex::MyLock lock(detectedMutex);
+
+    DetectedPixels &entry = getDetectedEntry(key);
+
+    if (std::find(entry.scanned.begin(), entry.scanned.end(), filename) != entry.scanned.end()) {
+        // the file was counted already, counting it again would weight its pixels twice
+        return;
+    }
+
+    entry.scanned.push_back(filename);
+
+    if (entry.scanned.size() > detectedMaxFiles) {
+        entry.scanned.pop_front();
+    }
+
+    ++entry.images;
+    entry.applied.clear();
+
+    for (const auto &pix : bp) {
+        ++entry.hits[(static_cast<uint32_t>(pix.y) << 16) | pix.x];
+    }
+
+    if (entry.images > detectedMinImages) {
+        // forget pixels which were detected only occasionally, they are most likely image content
+        for (auto iter = entry.hits.begin(); iter != entry.hits.end();) {
+            if (iter->second * 4 < entry.images) {
+                iter = entry.hits.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+    }
+
+    updateConfirmed(entry);
+
+    const Glib::ustring dirname = Glib::build_filename(Options::cacheBaseDir, "hotpixels");
+    g_mkdir_with_parents(dirname.c_str(), 511);
+
+    FILE *file = ::fopen(getDetectedFilename(key).c_str(), "w");
+
+    if (!file) {
+        return;
+    }
+
+    fprintf(file, "%u\n", entry.images);
+
+    for (const auto &name : entry.scanned) {
+        fprintf(file, "f %s\n", name.c_str());
+    }
+
+    for (const auto &hit : entry.hits) {
+        fprintf(file, "%u %u %u\n", hit.first & 0xffff, hit.first >> 16, hit.second);
+    }
+
+    fclose(file);
+
+    if (settings->verbose) {
+        printf("%s: %u images, %zu confirmed hot/dead pixels\n", key.c_str(), entry.images, entry.confirmed.size());
+    }
+}
+
+rtengine::DFManager::Implementation::DetectedPixels& rtengine::DFManager::Implementation::getDetectedEntry(const std::string& key)
+{
+    DetectedPixels &entry = detectedList[key];
+
+    if (!entry.loaded) {
+        entry.loaded = true;
+        FILE *file = ::fopen(getDetectedFilename(key).c_str(), "r");
+
+        if (file) {
+            char line[4096];
+
+            if (fgets(line, sizeof(line), file) && sscanf(line, "%u", &entry.images) == 1) {
+                unsigned int x, y, hits;
+
+                while (fgets(line, sizeof(line), file)) {
+                    if (line[0] == 'f' && line[1] == ' ') {
+                        std::string name(line + 2);
+
+                        if (!name.empty() && name.back() == '\n') {
+                            name.pop_back();
+                        }
+
+                        entry.scanned.push_back(name);
+
+                        if (entry.scanned.size() > detectedMaxFiles) {
+                            entry.scanned.pop_front();
+                        }
+                    } else if (sscanf(line, "%u %u %u", &x, &y, &hits) == 3 && x < 65536 && y < 65536) {
+                        entry.hits[(y << 16) | x] = hits;
+                    }
+                }
+            }
+
+            fclose(file);
+            updateConfirmed(entry);
+        }
+    }
+
+    return entry;
+}
+
+void rtengine::DFManager::Implementation::updateConfirmed(DetectedPixels& entry)
+{
+    entry.confirmed.clear();
+
+    for (const auto &hit : entry.hits) {
+        if (hit.second * 2 >= entry.images) {
+            entry.confirmed.emplace_back(hit.first & 0xffff, hit.first >> 16);
+        }
+    }
+}
+
+Glib::ustring rtengine::DFManager::Implementation::getDetectedFilename(const std::string& key)
+{
+    return Glib::build_filename(Options::cacheBaseDir, "hotpixels", key + ".hotdeadpixels");
+}
+
 dfInfo* rtengine::DFManager::Implementation::addFileInfo(const Glib::ustring& filename, bool pool)
 {
     const auto ext = getFileExtension(filename);
@@ -736,6 +923,16 @@ const std::vector<rtengine::badPix>* rtengine::DFManager::getBadPixels(const std
     return implementation->getBadPixels(mak, mod, serial);
 }
 
+bool rtengine::DFManager::getDetectedPixels(const std::string& mak, const std::string& mod, const std::string& serial, int width, int height, int iso, double shutter, int thresh, bool hot, bool dead, const Glib::ustring& filename, std::vector<badPix>& bp)
+{
+    return implementation->getDetectedPixels(detectedKey(mak, mod, serial, width, height, iso, shutter, thresh, hot, dead), filename, bp);
+}
+
+void rtengine::DFManager::addDetectedPixels(const std::string& mak, const std::string& mod, const std::string& serial, int width, int height, int iso, double shutter, int thresh, bool hot, bool dead, const Glib::ustring& filename, const std::vector<badPix>& bp)
+{
+    implementation->addDetectedPixels(detectedKey(mak, mod, serial, width, height, iso, shutter, thresh, hot, dead), filename, bp);
+}
+
 rtengine::DFManager::DFManager() :
     implementation(new Implementation)
 {
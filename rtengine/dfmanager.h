@@ -44,6 +44,9 @@ public:
     const std::vector<badPix>* getHotPixels(const std::string& mak, const std::string& mod, int iso, double shut, time_t t);
     const std::vector<badPix>* getHotPixels(const Glib::ustring& filename);
     const std::vector<badPix>* getBadPixels(const std::string& mak, const std::string& mod, const std::string& serial) const;
+    // hot/dead pixels found by the detection in images of a camera body, returns false if the image in filename has to be scanned
+    bool getDetectedPixels(const std::string& mak, const std::string& mod, const std::string& serial, int width, int height, int iso, double shutter, int thresh, bool hot, bool dead, const Glib::ustring& filename, std::vector<badPix>& bp);
+    void addDetectedPixels(const std::string& mak, const std::string& mod, const std::string& serial, int width, int height, int iso, double shutter, int thresh, bool hot, bool dead, const Glib::ustring& filename, const std::vector<badPix>& bp);
 
 private:
     DFManager();
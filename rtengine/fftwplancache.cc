@@ -0,0 +1,169 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cstdio>
+
+#include <glibmm/miscutils.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "fftwplancache.h"
+#include "settings.h"
+
+#include "../rtgui/options.h"
+
+namespace
+{
+
+// the plans of the local adjustments depend on the spot size, so the cache is limited
+constexpr std::size_t maxPlans = 64;
+
+Glib::ustring getWisdomFilename()
+{
+    return Glib::build_filename(Options::cacheBaseDir, "fftwf.wisdom");
+}
+
+}
+
+namespace rtengine
+{
+
+extern const Settings* settings;
+
+FFTWPlanCache& FFTWPlanCache::getInstance()
+{
+    static FFTWPlanCache instance;
+    return instance;
+}
+
+FFTWPlanCache::FFTWPlanCache() :
+    useCounter(0),
+    wisdomLoaded(false)
+{
+#ifdef RT_FFTW3F_OMP
+    fftwf_init_threads();
+#endif
+}
+
+FFTWPlanCache::~FFTWPlanCache()
+{
+    cleanup();
+}
+
+FFTWPlanCache::Plan FFTWPlanCache::getPlan(int n0, int n1, int howmany, int dist, fftw_r2r_kind kind, unsigned int flags, float* in, float* out, bool multiThread)
+{
+    const bool inPlace = in && in == out;
+
+    if ((in && fftwf_alignment_of(in) != 0) || (out && fftwf_alignment_of(out) != 0)) {
+        // the plan is created on buffers allocated by fftwf_malloc, so it can't be used on buffers with a different alignment
+        flags |= FFTW_UNALIGNED;
+    }
+
+    int threads = 1;
+#if defined(RT_FFTW3F_OMP) && defined(_OPENMP)
+    if (multiThread) {
+        threads = omp_get_max_threads();
+    }
+#endif
+
+    const Key key(n0, n1, howmany, dist, kind, flags, inPlace, threads);
+
+    Plan evicted; // has to be destroyed after releasing the lock, because destroying a plan locks the mutex
+    MyMutex::MyLock lock(mutex);
+
+    auto iter = plans.find(key);
+
+    if (iter != plans.end()) {
+        iter->second.second = ++useCounter;
+        return iter->second.first;
+    }
+
+    if (!wisdomLoaded) {
+        wisdomLoaded = true;
+
+        if (fftwf_import_wisdom_from_filename(getWisdomFilename().c_str()) && settings->verbose) {
+            printf("Loaded fftw wisdom from %s\n", getWisdomFilename().c_str());
+        }
+    }
+
+    if (plans.size() >= maxPlans) {
+        auto oldest = plans.begin();
+
+        for (auto it = plans.begin(); it != plans.end(); ++it) {
+            if (it->second.second < oldest->second.second) {
+                oldest = it;
+            }
+        }
+
+        evicted = std::move(oldest->second.first);
+        plans.erase(oldest);
+    }
+
+    // planning with FFTW_MEASURE overwrites the buffers, so plan on temporary ones
+    float* const planIn = static_cast<float*>(fftwf_malloc(sizeof(float) * howmany * dist));
+    float* const planOut = inPlace ? planIn : static_cast<float*>(fftwf_malloc(sizeof(float) * howmany * dist));
+
+    if (!planIn || !planOut) {
+        fftwf_free(planIn);
+        if (planOut != planIn) {
+            fftwf_free(planOut);
+        }
+        return Plan();
+    }
+
+#ifdef RT_FFTW3F_OMP
+    fftwf_plan_with_nthreads(threads);
+#endif
+
+    const int n[2] = {n0, n1};
+    const fftw_r2r_kind kinds[2] = {kind, kind};
+    const fftwf_plan plan = fftwf_plan_many_r2r(2, n, howmany, planIn, nullptr, 1, dist, planOut, nullptr, 1, dist, kinds, flags);
+
+    if (planOut != planIn) {
+        fftwf_free(planOut);
+    }
+    fftwf_free(planIn);
+
+    if (!plan) {
+        return Plan();
+    }
+
+    if (!(flags & FFTW_ESTIMATE) && !fftwf_export_wisdom_to_filename(getWisdomFilename().c_str()) && settings->verbose) {
+        printf("Could not save fftw wisdom to %s\n", getWisdomFilename().c_str());
+    }
+
+    const Plan result(plan, [this](fftwf_plan p) {
+        MyMutex::MyLock lock(mutex);
+        fftwf_destroy_plan(p);
+    });
+
+    plans[key] = std::make_pair(result, ++useCounter);
+    return result;
+}
+
+void FFTWPlanCache::cleanup()
+{
+    std::map<Key, std::pair<Plan, unsigned long>> oldPlans;
+    {
+        MyMutex::MyLock lock(mutex);
+        oldPlans.swap(plans);
+    }
+    // plans are destroyed here, outside of the lock
+}
+
+}
@@ -0,0 +1,69 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <map>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+
+#include <fftw3.h>
+
+#include "noncopyable.h"
+
+#include "../rtgui/threadutils.h"
+
+namespace rtengine
+{
+
+/* Cache for the fftw plans used in the pipeline.
+ * The fftw planner is not thread safe and planning with FFTW_MEASURE is slow, so plans are created once per
+ * transform shape and kept. The wisdom of measured plans is stored in the cache directory and reused at next start.
+ * Plans are executed with the new-array execute functions (fftwf_execute_r2r), which are thread safe.
+ */
+class FFTWPlanCache final :
+    public NonCopyable
+{
+public:
+    using Plan = std::shared_ptr<std::remove_pointer<fftwf_plan>::type>;
+
+    static FFTWPlanCache& getInstance();
+
+    // plan for howmany 2D real to real transforms of n0 x n1 values each, dist values apart.
+    // in and out are only used to check alignment and whether the transform is in-place, nullptr means an out-of-place transform on buffers allocated by fftwf_malloc
+    Plan getPlan(int n0, int n1, int howmany, int dist, fftw_r2r_kind kind, unsigned int flags, float* in = nullptr, float* out = nullptr, bool multiThread = false);
+    Plan getPlan(int n0, int n1, fftw_r2r_kind kind, unsigned int flags, float* in = nullptr, float* out = nullptr, bool multiThread = false)
+    {
+        return getPlan(n0, n1, 1, n0 * n1, kind, flags, in, out, multiThread);
+    }
+
+    // frees all cached plans, has to be called before fftwf_cleanup
+    void cleanup();
+
+private:
+    FFTWPlanCache();
+    ~FFTWPlanCache();
+
+    using Key = std::tuple<int, int, int, int, int, unsigned int, bool, int>; // n0, n1, howmany, dist, kind, flags, in-place, threads
+
+    std::map<Key, std::pair<Plan, unsigned long>> plans; // plan and its last use
+    unsigned long useCounter;
+    bool wisdomLoaded;
+    MyMutex mutex;
+};
+
+}
@@ -23,79 +23,65 @@
  * also distributed under the GPL V3+
  */
 
+#include <algorithm>
 #include <iostream>
 
 #include "gamutwarning.h"
 #include "iccstore.h"
+#include "icctransform.h"
 #include "image8.h"
+#include "rtengine.h"
 
 namespace rtengine
 {
 
-GamutWarning::GamutWarning(cmsHPROFILE iprof, cmsHPROFILE gamutprof, RenderingIntent intent, bool gamutbpc):
-    lab2ref(nullptr),
-    lab2softproof(nullptr),
-    softproof2ref(nullptr)
+GamutWarning::GamutWarning(cmsHPROFILE iprof, cmsHPROFILE gamutprof, RenderingIntent intent, bool gamutbpc)
 {
-    if (cmsIsMatrixShaper(gamutprof) && !cmsIsCLUT(gamutprof, intent, LCMS_USED_AS_OUTPUT)) {
-        cmsHPROFILE aces = ICCStore::getInstance()->workingSpace("ACESp0");
+    ICCStore* const iccStore = ICCStore::getInstance();
+    bool matrixShaper;
+
+    {
+        MyMutex::MyLock lcmsLock(*lcmsMutex);
+        matrixShaper = cmsIsMatrixShaper(gamutprof) && !cmsIsCLUT(gamutprof, intent, LCMS_USED_AS_OUTPUT);
+    }
+
+    if (matrixShaper) {
+        cmsHPROFILE aces = iccStore->workingSpace("ACESp0");
         if (aces) {
-            lab2ref = cmsCreateTransform(iprof, TYPE_Lab_FLT, aces, TYPE_RGB_FLT, INTENT_ABSOLUTE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
-            lab2softproof = cmsCreateTransform(iprof, TYPE_Lab_FLT, gamutprof, TYPE_RGB_FLT, INTENT_ABSOLUTE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
-            softproof2ref = cmsCreateTransform(gamutprof, TYPE_RGB_FLT, aces, TYPE_RGB_FLT, INTENT_ABSOLUTE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE | (gamutbpc ? cmsFLAGS_BLACKPOINTCOMPENSATION : 0));
+            lab2ref = iccStore->getTransform(iprof, TYPE_Lab_FLT, aces, TYPE_RGB_FLT, INTENT_ABSOLUTE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
+            lab2softproof = iccStore->getTransform(iprof, TYPE_Lab_FLT, gamutprof, TYPE_RGB_FLT, INTENT_ABSOLUTE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
+            softproof2ref = iccStore->getTransform(gamutprof, TYPE_RGB_FLT, aces, TYPE_RGB_FLT, INTENT_ABSOLUTE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE | (gamutbpc ? cmsFLAGS_BLACKPOINTCOMPENSATION : 0));
         }
     } else {
-        lab2ref = nullptr;
-        lab2softproof = cmsCreateTransform(iprof, TYPE_Lab_FLT, gamutprof, TYPE_RGB_FLT, INTENT_ABSOLUTE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
-        softproof2ref = cmsCreateTransform(gamutprof, TYPE_RGB_FLT, iprof, TYPE_Lab_FLT, INTENT_ABSOLUTE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE | (gamutbpc ? cmsFLAGS_BLACKPOINTCOMPENSATION : 0));
+        lab2softproof = iccStore->getTransform(iprof, TYPE_Lab_FLT, gamutprof, TYPE_RGB_FLT, INTENT_ABSOLUTE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
+        softproof2ref = iccStore->getTransform(gamutprof, TYPE_RGB_FLT, iprof, TYPE_Lab_FLT, INTENT_ABSOLUTE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE | (gamutbpc ? cmsFLAGS_BLACKPOINTCOMPENSATION : 0));
     }
 
     if (!softproof2ref) {
-        if (lab2softproof) {
-            cmsDeleteTransform(lab2softproof);
-            lab2softproof = nullptr;
-        }
+        lab2softproof.reset();
     } else if (!lab2softproof) {
-        if (softproof2ref) {
-            cmsDeleteTransform(softproof2ref);
-            softproof2ref = nullptr;
-        }
-    }
-}
-
-
-GamutWarning::~GamutWarning()
-{
-    if (softproof2ref) {
-        cmsDeleteTransform(softproof2ref);
-    }
-    if (lab2ref) {
-        cmsDeleteTransform(lab2ref);
-    }
-    if (lab2softproof) {
-        cmsDeleteTransform(lab2softproof);
+        softproof2ref.reset();
     }
 }
 
 
-void GamutWarning::markLine(Image8 *image, int y, float *srcbuf, float *buf1, float *buf2)
+template<typename Mark>
+void GamutWarning::check(float *srcbuf, float *buf1, float *buf2, int width, Mark mark) const
 {
     if (softproof2ref) {
-        const int width = image->getWidth();
-        
         float delta_max = lab2ref ? 0.0001f : 4.9999f;
-        cmsDoTransform(lab2softproof, srcbuf, buf2, width);
+        lab2softproof->transform(srcbuf, buf2, width);
         // since we are checking for out-of-gamut, we do want to clamp here!
         for (int i = 0; i < width * 3; ++i) {
             buf2[i] = LIM01(buf2[i]);
         }
-        cmsDoTransform(softproof2ref, buf2, buf1, width);
+        softproof2ref->transform(buf2, buf1, width);
         
         float *proofdata = buf1;
         float *refdata = srcbuf;
         
         if (lab2ref) {
-            cmsDoTransform(lab2ref, srcbuf, buf2, width);
+            lab2ref->transform(srcbuf, buf2, width);
             refdata = buf2;
 
             int iy = 0;
@@ -104,7 +90,7 @@ void GamutWarning::markLine(Image8 *image, int y, float *srcbuf, float *buf1, fl
                 iy += 3;
 
                 if (delta > delta_max) {
-                    mark(image, y, j);
+                    mark(j);
                 }
             }
         } else {
@@ -115,7 +101,7 @@ void GamutWarning::markLine(Image8 *image, int y, float *srcbuf, float *buf1, fl
                 iy += 3;
                 float delta = cmsDeltaE(&lab1, &lab2);
                 if (delta > delta_max) {
-                    mark(image, y, j);
+                    mark(j);
                 }
             }
         }
@@ -123,6 +109,41 @@ void GamutWarning::markLine(Image8 *image, int y, float *srcbuf, float *buf1, fl
 }
 
 
+void GamutWarning::markLine(Image8 *image, int y, float *srcbuf, float *buf1, float *buf2)
+{
+    check(srcbuf, buf1, buf2, image->getWidth(),
+        [this, image, y](int j) -> void
+        {
+            mark(image, y, j);
+        }
+    );
+}
+
+
+void GamutWarning::markPixels(Image8 *image, int y, const int *columns, float *srcbuf, float *buf1, float *buf2, int count)
+{
+    check(srcbuf, buf1, buf2, count,
+        [this, image, y, columns](int k) -> void
+        {
+            mark(image, y, columns[k]);
+        }
+    );
+}
+
+
+void GamutWarning::check(float *srcbuf, float *buf1, float *buf2, int count, std::uint8_t *outOfGamut) const
+{
+    std::fill(outOfGamut, outOfGamut + count, 0);
+
+    check(srcbuf, buf1, buf2, count,
+        [outOfGamut](int k) -> void
+        {
+            outOfGamut[k] = 1;
+        }
+    );
+}
+
+
 inline void GamutWarning::mark(Image8 *image, int y, int x)
 {
     image->r(y, x) = 0;
@@ -25,6 +25,9 @@
 
 #pragma once
 
+#include <cstdint>
+#include <memory>
+
 #include <lcms2.h>
 
 #include "noncopyable.h"
@@ -32,6 +35,7 @@
 namespace rtengine
 {
 
+class ICCTransform;
 class Image8;
 
 enum RenderingIntent : int;
@@ -39,15 +43,20 @@ enum RenderingIntent : int;
 class GamutWarning: public NonCopyable {
 public:
     GamutWarning(cmsHPROFILE iprof, cmsHPROFILE gamutprof, RenderingIntent intent, bool bpc);
-    ~GamutWarning();
     void markLine(Image8 *image, int y, float *srcbuf, float *buf1, float *buf2);
+    // same as markLine() for count pixels of line y, srcbuf holds the Lab values of the pixels at the given columns
+    void markPixels(Image8 *image, int y, const int *columns, float *srcbuf, float *buf1, float *buf2, int count);
+    // outOfGamut is set to 1 for the out of gamut colours of the count Lab values of srcbuf, to 0 for the others
+    void check(float *srcbuf, float *buf1, float *buf2, int count, std::uint8_t *outOfGamut) const;
     
 private:
+    template<typename Mark>
+    void check(float *srcbuf, float *buf1, float *buf2, int width, Mark mark) const;
     void mark(Image8 *image, int i, int j);
     
-    cmsHTRANSFORM lab2ref;
-    cmsHTRANSFORM lab2softproof;
-    cmsHTRANSFORM softproof2ref;
+    std::shared_ptr<const ICCTransform> lab2ref;
+    std::shared_ptr<const ICCTransform> lab2softproof;
+    std::shared_ptr<const ICCTransform> softproof2ref;
 };
 
 } // namespace rtengine
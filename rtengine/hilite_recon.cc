@@ -27,6 +27,7 @@
 #include <cassert>
 #include <cmath>
 #include <cstddef>
+#include <vector>
 
 #include "array2D.h"
 #include "opthelper.h"
@@ -291,6 +292,26 @@ void boxblur_resamp(const float* const* src, float** dst, float** temp, int H, i
     }
 }
 
+struct HLRegion {
+    int minx;
+    int miny;
+    int maxx;
+    int maxy;
+
+    void merge(const HLRegion &other)
+    {
+        minx = std::min(minx, other.minx);
+        miny = std::min(miny, other.miny);
+        maxx = std::max(maxx, other.maxx);
+        maxy = std::max(maxy, other.maxy);
+    }
+
+    bool isNear(const HLRegion &other, int distance) const
+    {
+        return minx - distance <= other.maxx && other.minx - distance <= maxx && miny - distance <= other.maxy && other.miny - distance <= maxy;
+    }
+};
+
 }
 
 namespace rtengine
@@ -302,36 +323,19 @@ using namespace procparams;
 void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue, int blur)
 {  
   //  BENCHFUN
-    double progress = 0.0;
-
     if (plistener) {
         plistener->setProgressStr("PROGRESSBAR_HLREC");
-        plistener->setProgress(progress);
+        plistener->setProgress(0.0);
     }
 
     const int height = H;
     const int width = W;
 
-    constexpr int range = 2;
-    constexpr int pitch = 4;
-
     constexpr float threshpct = 0.25f;
     constexpr float maxpct = 0.95f;
-    constexpr float epsilon = 0.00001f;
 
     //for blend algorithm:
     constexpr float blendthresh = 1.0;
-    // Transform matrixes rgb>lab and back
-    constexpr float trans[3][3] = {
-        {1.f, 1.f, 1.f},
-        {1.7320508f, -1.7320508f, 0.f},
-        {-1.f, -1.f, 2.f}
-    };
-    constexpr float itrans[3][3] = {
-        {1.f, 0.8660254f, -0.5f},
-        {1.f, -0.8660254f, -0.5f},
-        {1.f, 0.f, 1.f}
-    };
 
     if (settings->verbose) {
         for (int c = 0; c < 3; ++c) {
@@ -401,34 +405,126 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
         medFactor[c] = max(1.0f, max_f[c] / medpt) / -blendpt;
     }
 
-    int minx = width - 1;
-    int maxx = 0;
-    int miny = height - 1;
-    int maxy = 0;
+    // build a sparse index of the clipped pixels: a coarse grid of tiles, each with the bounding box of its clipped pixels.
+    // Separate clipped areas are reconstructed independently, so unclipped parts of the frame between them are skipped.
+    constexpr int blurBorder = 256;
+    constexpr int tileSize = 64;
+    const int tilesW = (width + tileSize - 1) / tileSize;
+    const int tilesH = (height + tileSize - 1) / tileSize;
+    std::vector<HLRegion> tiles(tilesW * tilesH, {width, height, -1, -1});
 
 #ifdef _OPENMP
-    #pragma omp parallel for reduction(min:minx,miny) reduction(max:maxx,maxy) schedule(dynamic, 16)
+    #pragma omp parallel for schedule(dynamic)
 #endif
-    for (int i = 0; i < height; ++i) {
-        for (int j = 0; j< width; ++j) {
-            if (red[i][j] >= max_f[0] || green[i][j] >= max_f[1] || blue[i][j] >= max_f[2]) {
-                minx = std::min(minx, j);
-                maxx = std::max(maxx, j);
-                miny = std::min(miny, i);
-                maxy = std::max(maxy, i);
+    for (int ty = 0; ty < tilesH; ++ty) {
+        for (int i = ty * tileSize; i < std::min(height, (ty + 1) * tileSize); ++i) {
+            for (int j = 0; j < width; ++j) {
+                if (red[i][j] >= max_f[0] || green[i][j] >= max_f[1] || blue[i][j] >= max_f[2]) {
+                    HLRegion &tile = tiles[ty * tilesW + j / tileSize];
+                    tile.minx = std::min(tile.minx, j);
+                    tile.maxx = std::max(tile.maxx, j);
+                    tile.miny = std::min(tile.miny, i);
+                    tile.maxy = std::max(tile.maxy, i);
+                }
+            }
+        }
+    }
+
+    // group clipped tiles which are near enough to share their surroundings
+    constexpr int tileReach = (2 * blurBorder + tileSize - 1) / tileSize;
+    std::vector<HLRegion> regions;
+    std::vector<bool> visited(tiles.size(), false);
+    std::vector<int> tileStack;
+
+    for (int t = 0; t < tilesW * tilesH; ++t) {
+        if (visited[t] || tiles[t].maxx < 0) {
+            continue;
+        }
+
+        HLRegion region = tiles[t];
+        visited[t] = true;
+        tileStack.push_back(t);
+
+        while (!tileStack.empty()) {
+            const int tile = tileStack.back();
+            tileStack.pop_back();
+            const int tx = tile % tilesW;
+            const int ty = tile / tilesW;
+
+            for (int y = std::max(ty - tileReach, 0); y <= std::min(ty + tileReach, tilesH - 1); ++y) {
+                for (int x = std::max(tx - tileReach, 0); x <= std::min(tx + tileReach, tilesW - 1); ++x) {
+                    const int neighbour = y * tilesW + x;
+
+                    if (!visited[neighbour] && tiles[neighbour].maxx >= 0) {
+                        visited[neighbour] = true;
+                        region.merge(tiles[neighbour]);
+                        tileStack.push_back(neighbour);
+                    }
+                }
             }
         }
+
+        regions.push_back(region);
     }
 
-    if (minx > maxx || miny > maxy) { // nothing to reconstruct
+    if (regions.empty()) { // nothing to reconstruct
         return;
     }
 
-    constexpr int blurBorder = 256;
-    minx = std::max(0, minx - blurBorder);
-    miny = std::max(0, miny - blurBorder);
-    maxx = std::min(width - 1, maxx + blurBorder);
-    maxy = std::min(height - 1, maxy + blurBorder);
+    // the bounding boxes of different groups may still come close, merge them until their surroundings don't overlap anymore
+    for (bool merged = true; merged;) {
+        merged = false;
+
+        for (size_t r1 = 0; r1 < regions.size() && !merged; ++r1) {
+            for (size_t r2 = r1 + 1; r2 < regions.size(); ++r2) {
+                if (regions[r1].isNear(regions[r2], 2 * blurBorder)) {
+                    regions[r1].merge(regions[r2]);
+                    regions.erase(regions.begin() + r2);
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (settings->verbose) {
+        printf("HLRecovery_inpaint : %zu clipped region(s)\n", regions.size());
+    }
+
+    for (size_t r = 0; r < regions.size(); ++r) {
+        const int minx = std::max(0, regions[r].minx - blurBorder);
+        const int miny = std::max(0, regions[r].miny - blurBorder);
+        const int maxx = std::min(width - 1, regions[r].maxx + blurBorder);
+        const int maxy = std::min(height - 1, regions[r].maxy + blurBorder);
+        HLRecovery_inpaintRegion(red, green, blue, blur, minx, miny, maxx, maxy, max_f, thresh, whitept, clippt, blendpt, medFactor, static_cast<double>(r) / regions.size(), 1.0 / regions.size());
+    }
+
+    if (plistener) {
+        plistener->setProgress(1.00);
+    }
+}
+
+void RawImageSource::HLRecovery_inpaintRegion(float** red, float** green, float** blue, int blur, int minx, int miny, int maxx, int maxy, const float max_f[3], const float thresh[3], float whitept, float clippt, float blendpt, const float medFactor[3], double progressStart, double progressScale)
+{
+    double progress = 0.0;
+
+    constexpr int range = 2;
+    constexpr int pitch = 4;
+
+    constexpr float epsilon = 0.00001f;
+
+    // Transform matrixes rgb>lab and back
+    constexpr float trans[3][3] = {
+        {1.f, 1.f, 1.f},
+        {1.7320508f, -1.7320508f, 0.f},
+        {-1.f, -1.f, 2.f}
+    };
+    constexpr float itrans[3][3] = {
+        {1.f, 0.8660254f, -0.5f},
+        {1.f, -0.8660254f, -0.5f},
+        {1.f, 0.f, 1.f}
+    };
+
     const int blurWidth = maxx - minx + 1;
     const int blurHeight = maxy - miny + 1;
     const int bufferWidth = blurWidth + ((16 - (blurWidth % 16)) & 15);
@@ -443,7 +539,7 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
  
     if (plistener) {
         progress += 0.07;
-        plistener->setProgress(progress);
+        plistener->setProgress(progressStart + progressScale * progress);
     }
 
     // reduce channel blur to one array
@@ -462,14 +558,14 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
 
     if (plistener) {
         progress += 0.05;
-        plistener->setProgress(progress);
+        plistener->setProgress(progressStart + progressScale * progress);
     }
 
     multi_array2D<float, 4> hilite_full(bufferWidth, blurHeight, ARRAY2D_CLEAR_DATA, 32);
 
     if (plistener) {
         progress += 0.05;
-        plistener->setProgress(progress);
+        plistener->setProgress(progressStart + progressScale * progress);
     }
 
     double hipass_sum = 0.0;
@@ -507,7 +603,7 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
 
     if (plistener) {
         progress += 0.05;
-        plistener->setProgress(progress);
+        plistener->setProgress(progressStart + progressScale * progress);
     }
 
     array2D<float> hilite_full4(bufferWidth, blurHeight);
@@ -519,7 +615,7 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
 
     if (plistener) {
         progress += 0.07;
-        plistener->setProgress(progress);
+        plistener->setProgress(progressStart + progressScale * progress);
     }
 
 #ifdef _OPENMP
@@ -556,7 +652,7 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
 
         if (plistener) {
             progress += 0.05;
-            plistener->setProgress(progress);
+            plistener->setProgress(progressStart + progressScale * progress);
         }
     }
 
@@ -573,7 +669,7 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
 
     if (plistener) {
         progress += 0.05;
-        plistener->setProgress(progress);
+        plistener->setProgress(progressStart + progressScale * progress);
     }
 
     //fill gaps in highlight map by directional extension
@@ -697,7 +793,7 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
     }
     if (plistener) {
         progress += 0.05;
-        plistener->setProgress(progress);
+        plistener->setProgress(progressStart + progressScale * progress);
     }
 
 #ifdef _OPENMP
@@ -769,7 +865,7 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
     }
     if (plistener) {
         progress += 0.05;
-        plistener->setProgress(progress);
+        plistener->setProgress(progressStart + progressScale * progress);
     }
 
 #ifdef _OPENMP
@@ -817,7 +913,7 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
 
     if (plistener) {
         progress += 0.05;
-        plistener->setProgress(progress);
+        plistener->setProgress(progressStart + progressScale * progress);
     }
 
 #ifdef _OPENMP
@@ -839,7 +935,7 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
 
     if (plistener) {
         progress += 0.05;
-        plistener->setProgress(progress);
+        plistener->setProgress(progressStart + progressScale * progress);
     }
 
     //fill in edges
@@ -910,7 +1006,7 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
 
     if (plistener) {
         progress += 0.05;
-        plistener->setProgress(progress);
+        plistener->setProgress(progressStart + progressScale * progress);
     }
 
     //free up some memory
@@ -1164,7 +1260,7 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
     if (blur > 0) {
         if (plistener) {
             progress += 0.05;
-            plistener->setProgress(progress);
+            plistener->setProgress(progressStart + progressScale * progress);
         }
         blur = rtengine::LIM(blur - 1, 0, 3);
 
@@ -1182,23 +1278,23 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
         guidedFilter(guide, mask, mask, rad1, th, true, 1);
         if (plistener) {
             progress += 0.03;
-            plistener->setProgress(progress);
+            plistener->setProgress(progressStart + progressScale * progress);
         }
         if (blur > 0) { //no use of 2nd guidedFilter if Blur = 0 (slider to 1)..speed-up and very small differences.
             guidedFilter(guide, rbuf, rbuf, rad2, 0.01f * 65535.f, true, 1);
             if (plistener) {
                 progress += 0.03;
-                plistener->setProgress(progress);
+                plistener->setProgress(progressStart + progressScale * progress);
             }
             guidedFilter(guide, gbuf, gbuf, rad2, 0.01f * 65535.f, true, 1);
             if (plistener) {
                 progress += 0.03;
-                plistener->setProgress(progress);
+                plistener->setProgress(progressStart + progressScale * progress);
             }
             guidedFilter(guide, bbuf, bbuf, rad2, 0.01f * 65535.f, true, 1);
             if (plistener) {
                 progress += 0.03;
-                plistener->setProgress(progress);
+                plistener->setProgress(progressStart + progressScale * progress);
             }
         }
 #ifdef _OPENMP
@@ -1220,10 +1316,6 @@ void RawImageSource::HLRecovery_inpaint(float** red, float** green, float** blue
         }
     }
 
-    if (plistener) {
-        plistener->setProgress(1.00);
-    }
-
 }// end of HLReconstruction
 
 }
@@ -30,10 +30,13 @@
 #endif
 
 #include <iostream>
+#include <list>
 
 #include "iccstore.h"
 
 #include "iccmatrices.h"
+#include "icctransform.h"
+#include "rtengine.h"
 #include "utils.h"
 
 #include "../rtgui/options.h"
@@ -739,7 +742,110 @@ public:
         return res;
     }
 
+    std::shared_ptr<const ICCTransform> getTransform(cmsHPROFILE input, cmsUInt32Number inputFormat, cmsHPROFILE output, cmsUInt32Number outputFormat, cmsUInt32Number intent, cmsUInt32Number flags)
+    {
+        TransformKey key;
+
+        {
+            MyMutex::MyLock lcmsLock(*lcmsMutex);
+            key.input = getProfileHash(input);
+            key.output = getProfileHash(output);
+        }
+
+        key.inputFormat = inputFormat;
+        key.outputFormat = outputFormat;
+        key.intent = intent;
+        key.flags = flags;
+
+        {
+            MyMutex::MyLock lock(transformsMutex);
+
+            for (auto it = transforms.begin(); it != transforms.end(); ++it) {
+                if (it->first == key) {
+                    transforms.splice(transforms.begin(), transforms, it);
+                    return it->second;
+                }
+            }
+        }
+
+        std::shared_ptr<const ICCTransform> transform;
+
+        {
+            MyMutex::MyLock lcmsLock(*lcmsMutex);
+            transform.reset(new ICCTransform(input, inputFormat, output, outputFormat, intent, flags));
+        }
+
+        if (!transform->isValid()) {
+            return nullptr;
+        }
+
+        if (settings->verbose) {
+            std::cout << "ICCStore: created " << (transform->isMatrixShaper() ? "matrix-shaper" : "lcms") << " transform" << std::endl;
+        }
+
+        MyMutex::MyLock lock(transformsMutex);
+
+        // another thread may have created the same transform in the meantime
+        for (auto it = transforms.begin(); it != transforms.end(); ++it) {
+            if (it->first == key) {
+                return it->second;
+            }
+        }
+
+        transforms.emplace_front(key, transform);
+
+        if (transforms.size() > maxTransforms) {
+            transforms.pop_back();
+        }
+
+        return transform;
+    }
+
 private:
+    struct ProfileHash {
+        std::size_t hash;
+        std::size_t size;
+
+        bool operator ==(const ProfileHash& other) const
+        {
+            return hash == other.hash && size == other.size;
+        }
+    };
+
+    struct TransformKey {
+        ProfileHash input;
+        cmsUInt32Number inputFormat;
+        ProfileHash output;
+        cmsUInt32Number outputFormat;
+        cmsUInt32Number intent;
+        cmsUInt32Number flags;
+
+        bool operator ==(const TransformKey& other) const
+        {
+            return
+                input == other.input
+                && inputFormat == other.inputFormat
+                && output == other.output
+                && outputFormat == other.outputFormat
+                && intent == other.intent
+                && flags == other.flags;
+        }
+    };
+
+    // the profiles are identified by their content, as the embedded and the generated ones don't live as long as the transforms
+    static ProfileHash getProfileHash(cmsHPROFILE profile)
+    {
+        if (!profile) {
+            return {0, 0};
+        }
+
+        const std::string& data = ProfileContent(profile).getData();
+        return {std::hash<std::string>()(data), data.size()};
+    }
+
+    // enough for the output, working and monitor profiles in use at the same time
+    static constexpr std::size_t maxTransforms = 32;
+
     using CVector = std::array<double, 3>;
     using CMatrix = std::array<CVector, 3>;
     struct PMatrix {
@@ -1024,6 +1130,9 @@ parse_error:
     const cmsHPROFILE srgb;
 
     mutable MyMutex mutex;
+
+    std::list<std::pair<TransformKey, std::shared_ptr<const ICCTransform>>> transforms; // most recently used first
+    MyMutex transformsMutex;
 };
 
 rtengine::ICCStore* rtengine::ICCStore::getInstance()
@@ -1151,6 +1260,11 @@ std::vector<Glib::ustring> rtengine::ICCStore::getWorkingProfiles()
     return implementation->getWorkingProfiles();
 }
 
+std::shared_ptr<const rtengine::ICCTransform> rtengine::ICCStore::getTransform(cmsHPROFILE input, cmsUInt32Number inputFormat, cmsHPROFILE output, cmsUInt32Number outputFormat, cmsUInt32Number intent, cmsUInt32Number flags)
+{
+    return implementation->getTransform(input, inputFormat, output, outputFormat, intent, flags);
+}
+
 cmsHPROFILE rtengine::ICCStore::createFromMatrix(const double matrix[3][3], bool gamma, const Glib::ustring& name)
 {
 
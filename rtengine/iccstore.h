@@ -39,6 +39,8 @@ namespace procparams
 
 typedef const double(*TMatrix)[3];
 
+class ICCTransform;
+
 class ProfileContent final
 {
 public:
@@ -96,6 +98,10 @@ public:
 
     /*static*/ std::vector<Glib::ustring> getWorkingProfiles();
 
+    // Returns a shared transform, created on the first request for these profiles (compared by content), formats, intent and flags.
+    // Returns nullptr if lcms can't create the transform. Must not be called with lcmsMutex locked.
+    std::shared_ptr<const ICCTransform> getTransform(cmsHPROFILE input, cmsUInt32Number inputFormat, cmsHPROFILE output, cmsUInt32Number outputFormat, cmsUInt32Number intent, cmsUInt32Number flags);
+
     static cmsHPROFILE createFromMatrix(const double matrix[3][3], bool gamma = false, const Glib::ustring& name = Glib::ustring());
 
 private:
@@ -0,0 +1,457 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "icctransform.h"
+#include "rt_math.h"
+#include "sleef.h"
+
+namespace
+{
+
+using namespace rtengine;
+
+// below this value the lut can't follow the slope of the inverse gamma curves, the exact curve is used
+constexpr float shaperLow = 1.f / 1024.f;
+constexpr int shaperSize = 65536;
+
+// white point of the PCS, as used by lcms
+constexpr float d50x = 0.9642f;
+constexpr float d50z = 0.8249f;
+
+bool isLab(cmsHPROFILE profile, cmsUInt32Number format)
+{
+    return !profile && format == TYPE_Lab_FLT;
+}
+
+bool isMatrixShaperRGB(cmsHPROFILE profile, cmsUInt32Number format)
+{
+    if (!profile || format != TYPE_RGB_FLT || cmsGetColorSpace(profile) != cmsSigRgbData || !cmsIsMatrixShaper(profile)) {
+        return false;
+    }
+
+    const cmsProfileClassSignature deviceClass = cmsGetDeviceClass(profile);
+
+    if (deviceClass == cmsSigLinkClass || deviceClass == cmsSigAbstractClass) {
+        return false;
+    }
+
+    // lcms prefers the LUT tags to the matrix and the TRCs when a profile has both
+    constexpr cmsTagSignature lutTags[] = {
+        cmsSigAToB0Tag, cmsSigAToB1Tag, cmsSigAToB2Tag,
+        cmsSigBToA0Tag, cmsSigBToA1Tag, cmsSigBToA2Tag,
+        cmsSigDToB0Tag, cmsSigDToB1Tag, cmsSigDToB2Tag, cmsSigDToB3Tag,
+        cmsSigBToD0Tag, cmsSigBToD1Tag, cmsSigBToD2Tag, cmsSigBToD3Tag
+    };
+
+    for (const auto tag : lutTags) {
+        if (cmsIsTag(profile, tag)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool hasBlackPoint(cmsHPROFILE profile, cmsUInt32Number intent, bool output)
+{
+    cmsCIEXYZ blackPoint;
+
+    if (!(output ? cmsDetectDestinationBlackPoint(&blackPoint, profile, intent, 0) : cmsDetectBlackPoint(&blackPoint, profile, intent, 0))) {
+        return false;
+    }
+
+    constexpr double epsilon = 1e-6;
+    return std::fabs(blackPoint.X) > epsilon || std::fabs(blackPoint.Y) > epsilon || std::fabs(blackPoint.Z) > epsilon;
+}
+
+// lcms enables black point compensation by itself for V4 profiles in perceptual and saturation intents
+bool forcesBPC(cmsHPROFILE profile, cmsUInt32Number intent)
+{
+    return profile && (intent == INTENT_PERCEPTUAL || intent == INTENT_SATURATION) && cmsGetEncodedICCversion(profile) >= 0x4000000;
+}
+
+std::array<std::array<double, 3>, 3> getColorants(cmsHPROFILE profile)
+{
+    const cmsCIEXYZ* const red = static_cast<const cmsCIEXYZ*>(cmsReadTag(profile, cmsSigRedColorantTag));
+    const cmsCIEXYZ* const green = static_cast<const cmsCIEXYZ*>(cmsReadTag(profile, cmsSigGreenColorantTag));
+    const cmsCIEXYZ* const blue = static_cast<const cmsCIEXYZ*>(cmsReadTag(profile, cmsSigBlueColorantTag));
+
+    return {{
+        {red->X, green->X, blue->X},
+        {red->Y, green->Y, blue->Y},
+        {red->Z, green->Z, blue->Z}
+    }};
+}
+
+float lab2xyzf(float f)
+{
+    constexpr float threshold = 6.f / 29.f;
+    return f > threshold ? f * f * f : 108.f / 841.f * (f - 16.f / 116.f);
+}
+
+float xyz2labf(float t)
+{
+    constexpr float threshold = 216.f / 24389.f;
+    return t > threshold ? xcbrtf(t) : 841.f / 108.f * t + 16.f / 116.f;
+}
+
+#ifdef __SSE2__
+vfloat lab2xyzf(vfloat f)
+{
+    const vfloat thresholdv = F2V(6.f / 29.f);
+    return vself(vmaskf_gt(f, thresholdv), f * f * f, F2V(108.f / 841.f) * (f - F2V(16.f / 116.f)));
+}
+#endif
+
+}
+
+namespace rtengine
+{
+
+ICCTransform::Shaper::Shaper() :
+    curve(nullptr)
+{
+}
+
+ICCTransform::Shaper::~Shaper()
+{
+    if (curve) {
+        cmsFreeToneCurve(curve);
+    }
+}
+
+void ICCTransform::Shaper::init(cmsToneCurve* curve)
+{
+    this->curve = curve;
+    lut(shaperSize, LUT_CLIP_BELOW | LUT_CLIP_ABOVE);
+
+    for (int i = 0; i < shaperSize; ++i) {
+        lut[i] = cmsEvalToneCurveFloat(curve, static_cast<float>(i) / (shaperSize - 1));
+    }
+}
+
+float ICCTransform::Shaper::operator ()(float value) const
+{
+    return value >= shaperLow && value <= 1.f ? lut[value * (shaperSize - 1)] : cmsEvalToneCurveFloat(curve, value);
+}
+
+#ifdef __SSE2__
+vfloat ICCTransform::Shaper::operator ()(vfloat value) const
+{
+    vfloat result = lut[value * F2V(shaperSize - 1)];
+
+    if (_mm_movemask_ps((vfloat)vorm(vmaskf_lt(value, F2V(shaperLow)), vmaskf_gt(value, F2V(1.f))))) {
+        float values[4] ALIGNED16;
+        float results[4] ALIGNED16;
+        STVF(values[0], value);
+        STVF(results[0], result);
+
+        for (int i = 0; i < 4; ++i) {
+            results[i] = (*this)(values[i]);
+        }
+
+        result = LVF(results[0]);
+    }
+
+    return result;
+}
+#endif
+
+ICCTransform::ICCTransform(cmsHPROFILE input, cmsUInt32Number inputFormat, cmsHPROFILE output, cmsUInt32Number outputFormat, cmsUInt32Number intent, cmsUInt32Number flags) :
+    cmsTransform(nullptr),
+    matrixShaper(false),
+    labInput(false),
+    labOutput(false),
+    matrix{}
+{
+    if (compile(input, inputFormat, output, outputFormat, intent, flags)) {
+        matrixShaper = true;
+        return;
+    }
+
+    cmsHPROFILE lab = nullptr;
+
+    if (!input) {
+        lab = cmsCreateLab4Profile(nullptr);
+        input = lab;
+    }
+
+    cmsTransform = cmsCreateTransform(input, inputFormat, output, outputFormat, intent, flags);
+
+    if (lab) {
+        cmsCloseProfile(lab);
+    }
+}
+
+ICCTransform::~ICCTransform()
+{
+    if (cmsTransform) {
+        cmsDeleteTransform(cmsTransform);
+    }
+}
+
+bool ICCTransform::isValid() const
+{
+    return matrixShaper || cmsTransform;
+}
+
+bool ICCTransform::isMatrixShaper() const
+{
+    return matrixShaper;
+}
+
+bool ICCTransform::compile(cmsHPROFILE input, cmsUInt32Number inputFormat, cmsHPROFILE output, cmsUInt32Number outputFormat, cmsUInt32Number intent, cmsUInt32Number flags)
+{
+    constexpr cmsUInt32Number supportedFlags = cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE | cmsFLAGS_BLACKPOINTCOMPENSATION;
+
+    if ((flags & ~supportedFlags) || intent == INTENT_ABSOLUTE_COLORIMETRIC || intent > INTENT_SATURATION) {
+        return false;
+    }
+
+    labInput = isLab(input, inputFormat);
+    labOutput = isLab(output, outputFormat);
+
+    if (!labInput && !isMatrixShaperRGB(input, inputFormat)) {
+        return false;
+    }
+
+    if (!labOutput && !isMatrixShaperRGB(output, outputFormat)) {
+        return false;
+    }
+
+    // the black point compensation is a no-op when both black points are 0, which is the usual case for matrix-shaper profiles
+    if ((flags & cmsFLAGS_BLACKPOINTCOMPENSATION) || forcesBPC(input, intent) || forcesBPC(output, intent)) {
+        if ((!labInput && hasBlackPoint(input, intent, false)) || (!labOutput && hasBlackPoint(output, intent, true))) {
+            return false;
+        }
+    }
+
+    std::array<std::array<double, 3>, 3> toXYZ = {{{1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}}};
+    std::array<std::array<double, 3>, 3> fromXYZ = toXYZ;
+
+    if (!labInput) {
+        toXYZ = getColorants(input);
+    }
+
+    if (!labOutput && !invertMatrix(getColorants(output), fromXYZ)) {
+        return false;
+    }
+
+    const auto product = dotProduct(fromXYZ, toXYZ);
+
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            matrix[i][j] = product[i][j];
+        }
+    }
+
+    constexpr cmsTagSignature trcTags[3] = {cmsSigRedTRCTag, cmsSigGreenTRCTag, cmsSigBlueTRCTag};
+    cmsToneCurve* inputCurves[3] = {};
+    cmsToneCurve* outputCurves[3] = {};
+    bool curvesOk = true;
+
+    for (int c = 0; c < 3; ++c) {
+        if (!labInput) {
+            inputCurves[c] = cmsDupToneCurve(static_cast<const cmsToneCurve*>(cmsReadTag(input, trcTags[c])));
+            curvesOk = curvesOk && inputCurves[c];
+        }
+
+        if (!labOutput) {
+            outputCurves[c] = cmsReverseToneCurve(static_cast<const cmsToneCurve*>(cmsReadTag(output, trcTags[c])));
+            curvesOk = curvesOk && outputCurves[c];
+        }
+    }
+
+    for (int c = 0; c < 3; ++c) {
+        if (!curvesOk) {
+            if (inputCurves[c]) {
+                cmsFreeToneCurve(inputCurves[c]);
+            }
+
+            if (outputCurves[c]) {
+                cmsFreeToneCurve(outputCurves[c]);
+            }
+        } else {
+            if (inputCurves[c]) {
+                inputShapers[c].init(inputCurves[c]);
+            }
+
+            if (outputCurves[c]) {
+                outputShapers[c].init(outputCurves[c]);
+            }
+        }
+    }
+
+    return curvesOk;
+}
+
+void ICCTransform::transformPixel(float in0, float in1, float in2, float& out0, float& out1, float& out2) const
+{
+    float x, y, z;
+
+    if (labInput) {
+        const float fy = (in0 + 16.f) / 116.f;
+        x = d50x * lab2xyzf(fy + 0.002f * in1);
+        y = lab2xyzf(fy);
+        z = d50z * lab2xyzf(fy - 0.005f * in2);
+    } else {
+        x = inputShapers[0](in0);
+        y = inputShapers[1](in1);
+        z = inputShapers[2](in2);
+    }
+
+    const float r = matrix[0][0] * x + matrix[0][1] * y + matrix[0][2] * z;
+    const float g = matrix[1][0] * x + matrix[1][1] * y + matrix[1][2] * z;
+    const float b = matrix[2][0] * x + matrix[2][1] * y + matrix[2][2] * z;
+
+    if (labOutput) {
+        const float fx = xyz2labf(r / d50x);
+        const float fy = xyz2labf(g);
+        const float fz = xyz2labf(b / d50z);
+        out0 = 116.f * fy - 16.f;
+        out1 = 500.f * (fx - fy);
+        out2 = 200.f * (fy - fz);
+    } else {
+        out0 = outputShapers[0](r);
+        out1 = outputShapers[1](g);
+        out2 = outputShapers[2](b);
+    }
+}
+
+#ifdef __SSE2__
+void ICCTransform::transformLabToRGB(vfloat L, vfloat a, vfloat b, const vfloat matrixv[3][3], vfloat& r, vfloat& g, vfloat& bl) const
+{
+    const vfloat fy = F2V(1.f / 116.f) * L + F2V(16.f / 116.f);
+    const vfloat x = F2V(d50x) * lab2xyzf(fy + F2V(0.002f) * a);
+    const vfloat y = lab2xyzf(fy);
+    const vfloat z = F2V(d50z) * lab2xyzf(fy - F2V(0.005f) * b);
+
+    r = outputShapers[0](matrixv[0][0] * x + matrixv[0][1] * y + matrixv[0][2] * z);
+    g = outputShapers[1](matrixv[1][0] * x + matrixv[1][1] * y + matrixv[1][2] * z);
+    bl = outputShapers[2](matrixv[2][0] * x + matrixv[2][1] * y + matrixv[2][2] * z);
+}
+#endif
+
+void ICCTransform::transform(const float* in, float* out, int count) const
+{
+    if (!matrixShaper) {
+        cmsDoTransform(cmsTransform, in, out, count);
+        return;
+    }
+
+    int i = 0;
+
+#ifdef __SSE2__
+    if (labInput && !labOutput) {
+        // the Lab to output RGB path of the previews and of the exports
+        vfloat matrixv[3][3];
+
+        for (int k = 0; k < 3; ++k) {
+            for (int l = 0; l < 3; ++l) {
+                matrixv[k][l] = F2V(matrix[k][l]);
+            }
+        }
+
+        for (; i < count - 3; i += 4) {
+            const float* const p = in + 3 * i;
+            vfloat result[3];
+            transformLabToRGB(_mm_setr_ps(p[0], p[3], p[6], p[9]), _mm_setr_ps(p[1], p[4], p[7], p[10]), _mm_setr_ps(p[2], p[5], p[8], p[11]), matrixv, result[0], result[1], result[2]);
+
+            float results[3][4] ALIGNED16;
+
+            for (int c = 0; c < 3; ++c) {
+                STVF(results[c][0], result[c]);
+            }
+
+            float* const q = out + 3 * i;
+
+            for (int k = 0; k < 4; ++k) {
+                q[3 * k] = results[0][k];
+                q[3 * k + 1] = results[1][k];
+                q[3 * k + 2] = results[2][k];
+            }
+        }
+    }
+#endif
+
+    for (; i < count; ++i) {
+        const float* const p = in + 3 * i;
+        float* const q = out + 3 * i;
+        transformPixel(p[0], p[1], p[2], q[0], q[1], q[2]);
+    }
+}
+
+void ICCTransform::transform(const float* in0, const float* in1, const float* in2, float scale, float* out0, float* out1, float* out2, int count) const
+{
+    if (!matrixShaper) {
+        // lcms only handles interleaved float pixels in parallel, go through a small buffer
+        constexpr int chunkSize = 256;
+        float buffer[3 * chunkSize];
+
+        for (int i = 0; i < count; i += chunkSize) {
+            const int n = std::min(chunkSize, count - i);
+
+            for (int j = 0; j < n; ++j) {
+                buffer[3 * j] = scale * in0[i + j];
+                buffer[3 * j + 1] = scale * in1[i + j];
+                buffer[3 * j + 2] = scale * in2[i + j];
+            }
+
+            cmsDoTransform(cmsTransform, buffer, buffer, n);
+
+            for (int j = 0; j < n; ++j) {
+                out0[i + j] = buffer[3 * j];
+                out1[i + j] = buffer[3 * j + 1];
+                out2[i + j] = buffer[3 * j + 2];
+            }
+        }
+
+        return;
+    }
+
+    int i = 0;
+
+#ifdef __SSE2__
+    if (labInput && !labOutput) {
+        const vfloat scalev = F2V(scale);
+        vfloat matrixv[3][3];
+
+        for (int k = 0; k < 3; ++k) {
+            for (int l = 0; l < 3; ++l) {
+                matrixv[k][l] = F2V(matrix[k][l]);
+            }
+        }
+
+        for (; i < count - 3; i += 4) {
+            vfloat r, g, b;
+            transformLabToRGB(scalev * LVFU(in0[i]), scalev * LVFU(in1[i]), scalev * LVFU(in2[i]), matrixv, r, g, b);
+            STVFU(out0[i], r);
+            STVFU(out1[i], g);
+            STVFU(out2[i], b);
+        }
+    }
+#endif
+
+    for (; i < count; ++i) {
+        transformPixel(scale * in0[i], scale * in1[i], scale * in2[i], out0[i], out1[i], out2[i]);
+    }
+}
+
+}
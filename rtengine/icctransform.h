@@ -0,0 +1,87 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <lcms2.h>
+
+#include "LUT.h"
+#include "noncopyable.h"
+
+namespace rtengine
+{
+
+/* Immutable transform between two profiles of interleaved float pixels (TYPE_RGB_FLT or TYPE_Lab_FLT),
+ * which can be used by several threads at the same time. Use ICCStore::getTransform() to get a cached one.
+ *
+ * When both sides are matrix-shaper RGB profiles or Lab and the rendering intent reduces to the colorimetric
+ * conversion through the PCS, the transform is compiled to TRC lookups around a single 3x3 matrix instead of
+ * running the lcms pipeline. Everything else (LUT based profiles, absolute colorimetric intent, black point
+ * compensation with a non zero black point, soft proofing...) is done by lcms.
+ *
+ * A null input profile with TYPE_Lab_FLT stands for Lab D50, a null output profile is the PCS of the input profile.
+ * The profiles can be closed once the transform is created.
+ */
+class ICCTransform final :
+    public NonCopyable
+{
+public:
+    // has to be called with lcmsMutex locked
+    ICCTransform(cmsHPROFILE input, cmsUInt32Number inputFormat, cmsHPROFILE output, cmsUInt32Number outputFormat, cmsUInt32Number intent, cmsUInt32Number flags);
+    ~ICCTransform();
+
+    bool isValid() const;
+    bool isMatrixShaper() const;
+
+    // converts count pixels, in and out may be the same buffer
+    void transform(const float* in, float* out, int count) const;
+    // converts count pixels of planar data multiplied by scale, e.g. the rows of a LabImage with scale = 1 / 327.68.
+    // The output planes may be the input planes.
+    void transform(const float* in0, const float* in1, const float* in2, float scale, float* out0, float* out1, float* out2, int count) const;
+
+private:
+    struct Shaper {
+        Shaper();
+        ~Shaper();
+
+        void init(cmsToneCurve* curve);
+        float operator ()(float value) const;
+#ifdef __SSE2__
+        vfloat operator ()(vfloat value) const;
+#endif
+
+        cmsToneCurve* curve; // owned, the exact curve used out of the range of the LUT
+        LUTf lut;
+    };
+
+    void transformPixel(float in0, float in1, float in2, float& out0, float& out1, float& out2) const;
+#ifdef __SSE2__
+    void transformLabToRGB(vfloat L, vfloat a, vfloat b, const vfloat matrixv[3][3], vfloat& r, vfloat& g, vfloat& bl) const;
+#endif
+    bool compile(cmsHPROFILE input, cmsUInt32Number inputFormat, cmsHPROFILE output, cmsUInt32Number outputFormat, cmsUInt32Number intent, cmsUInt32Number flags);
+
+    cmsHTRANSFORM cmsTransform;
+
+    // compiled transform: Lab -> XYZ or input TRC, matrix, XYZ -> Lab or inverse output TRC
+    bool matrixShaper;
+    bool labInput;
+    bool labOutput;
+    Shaper inputShapers[3];
+    float matrix[3][3];
+    Shaper outputShapers[3];
+};
+
+}
@@ -26,6 +26,7 @@
 #include <cstring>
 #include "rtengine.h"
 #include "iccstore.h"
+#include "icctransform.h"
 #include "alignedbuffer.h"
 #include "rt_math.h"
 #include "color.h"
@@ -402,7 +403,7 @@ void Imagefloat::normalizeFloatTo65535()
 }
 
 // Parallelized transformation; create transform with cmsFLAGS_NOCACHE!
-void Imagefloat::ExecCMSTransform(cmsHTRANSFORM hTransform)
+void Imagefloat::ExecCMSTransform(const ICCTransform &transform)
 {
 
     // LittleCMS cannot parallelize planar setups -- Hombre: LCMS2.4 can! But it we use this new feature, memory allocation
@@ -427,7 +428,7 @@ void Imagefloat::ExecCMSTransform(cmsHTRANSFORM hTransform)
                 *(p++) = *(pB++);
             }
 
-            cmsDoTransform (hTransform, pBuf.data, pBuf.data, width);
+            transform.transform(pBuf.data, pBuf.data, width);
 
             p = pBuf.data;
             pR = r(y);
@@ -443,50 +444,14 @@ void Imagefloat::ExecCMSTransform(cmsHTRANSFORM hTransform)
     }
 }
 
-// Parallelized transformation; create transform with cmsFLAGS_NOCACHE!
-void Imagefloat::ExecCMSTransform(cmsHTRANSFORM hTransform, const LabImage &labImage, int cx, int cy)
+// Parallelized transformation
+void Imagefloat::ExecCMSTransform(const ICCTransform &transform, const LabImage &labImage, int cx, int cy)
 {
-    // LittleCMS cannot parallelize planar Lab float images
-    // so build temporary buffers to allow multi processor execution
 #ifdef _OPENMP
-    #pragma omp parallel
+    #pragma omp parallel for schedule(static)
 #endif
-    {
-        AlignedBuffer<float> bufferLab(width * 3);
-        AlignedBuffer<float> bufferRGB(width * 3);
-
-#ifdef _OPENMP
-        #pragma omp for schedule(static)
-#endif
-
-        for (int y = cy; y < cy + height; y++)
-        {
-            float *pRGB, *pR, *pG, *pB;
-            float *pLab, *pL, *pa, *pb;
-
-            pLab= bufferLab.data;
-            pL = labImage.L[y] + cx;
-            pa = labImage.a[y] + cx;
-            pb = labImage.b[y] + cx;
 
-            for (int x = 0; x < width; x++) {
-                *(pLab++) = *(pL++)  / 327.68f;
-                *(pLab++) = *(pa++)  / 327.68f;
-                *(pLab++) = *(pb++)  / 327.68f;
-            }
-
-            cmsDoTransform (hTransform, bufferLab.data, bufferRGB.data, width);
-
-            pRGB = bufferRGB.data;
-            pR = r(y - cy);
-            pG = g(y - cy);
-            pB = b(y - cy);
-
-            for (int x = 0; x < width; x++) {
-                *(pR++) = *(pRGB++);
-                *(pG++) = *(pRGB++);
-                *(pB++) = *(pRGB++);
-            }
-        } // End of parallelization
+    for (int y = cy; y < cy + height; y++) {
+        transform.transform(labImage.L[y] + cx, labImage.a[y] + cx, labImage.b[y] + cx, 1.f / 327.68f, r(y - cy), g(y - cy), b(y - cy), width);
     }
 }
@@ -27,6 +27,7 @@ namespace rtengine
 {
 using namespace procparams;
 
+class ICCTransform;
 class Image8;
 class Image16;
 class LabImage;
@@ -210,8 +211,8 @@ public:
     void                 normalizeFloat(float srcMinVal, float srcMaxVal) override;
     void                 normalizeFloatTo1();
     void                 normalizeFloatTo65535();
-    void                 ExecCMSTransform(cmsHTRANSFORM hTransform);
-    void                 ExecCMSTransform(cmsHTRANSFORM hTransform, const LabImage &labImage, int cx, int cy);
+    void                 ExecCMSTransform(const ICCTransform &transform);
+    void                 ExecCMSTransform(const ICCTransform &transform, const LabImage &labImage, int cx, int cy);
 };
 
 }
@@ -93,6 +93,13 @@ public:
     virtual int         load        (const Glib::ustring &fname) = 0;
     virtual void        preprocess  (const procparams::RAWParams &raw, const procparams::LensProfParams &lensProf, const procparams::CoarseTransformParams& coarse, bool prepareDenoise = true) {};
     virtual void        demosaic    (const procparams::RAWParams &raw, bool autoContrast, double &contrastThreshold, bool cache = false) {};
+    // skip demosaicing and let getImage bin the raw data for sub-sampled previews, returns false if not supported.
+    // With autoContrast, the contrast threshold of the dual demosaic computed once the demosaic runs is passed to autoContrastListener.
+    virtual bool        deferDemosaic (const procparams::RAWParams &raw, bool autoContrast, AutoContrastListener* autoContrastListener, bool cache = false) { return false; }
+    // like deferDemosaic, but the given areas are demosaiced at full quality right away, returns false if not supported
+    virtual bool        demosaicArea (const procparams::RAWParams &raw, bool autoContrast, AutoContrastListener* autoContrastListener, const std::vector<PreviewProps> &areas, int tran, bool cache = false) { return false; }
+    // demosaics the rest of the frame if demosaic is deferred, call it before using getImage from a parallel region
+    virtual void        finishDeferredDemosaic () {}
     virtual void        retinex       (const procparams::ColorManagementParams& cmp, const procparams::RetinexParams &deh, const procparams::ToneCurveParams& Tc, LUTf & cdcurve, LUTf & mapcurve, const RetinextransmissionCurve & dehatransmissionCurve, const RetinexgaintransmissionCurve & dehagaintransmissionCurve, multi_array2D<float, 4> &conversionBuffer, bool dehacontlutili, bool mapcontlutili, bool useHsl, float &minCD, float &maxCD, float &mini, float &maxi, float &Tmean, float &Tsigma, float &Tmin, float &Tmax, LUTu &histLRETI) {};
     virtual void        retinexPrepareCurves       (const procparams::RetinexParams &retinexParams, LUTf &cdcurve, LUTf &mapcurve, RetinextransmissionCurve &retinextransmissionCurve, RetinexgaintransmissionCurve &retinexgaintransmissionCurve, bool &retinexcontlutili, bool &mapcontlutili, bool &useHsl, LUTu & lhist16RETI, LUTu & histLRETI) {};
     virtual void        retinexPrepareBuffers      (const procparams::ColorManagementParams& cmp, const procparams::RetinexParams &retinexParams, multi_array2D<float, 4> &conversionBuffer, LUTu &lhist16RETI) {};
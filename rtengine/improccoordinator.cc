@@ -38,7 +38,9 @@
 #include "procparams.h"
 #include "tweakoperator.h"
 #include "refreshmap.h"
+#include "rgbproclut.h"
 #include "utils.h"
+#include "waveletdecompositioncache.h"
 
 #include "../rtgui/options.h"
 
@@ -243,6 +245,7 @@ ImProcCoordinator::ImProcCoordinator() :
     locallcieMask(0),
     retistrsav(nullptr)
 {
+    ipf.setRgbProcLUT(true);
 }
 
 ImProcCoordinator::~ImProcCoordinator()
@@ -264,6 +267,10 @@ ImProcCoordinator::~ImProcCoordinator()
         fattal_11_dcrop_cache = nullptr;
     }
 
+    // releases the memory of the decompositions cached for this editor
+    WaveletDecompositionCache::getInstance().clear();
+    RGBProcLUTCache::getInstance().clear();
+
     std::vector<Crop*> toDel = crops;
 
     for (size_t i = 0; i < toDel.size(); i++) {
@@ -433,15 +440,41 @@ void ImProcCoordinator::updatePreviewImage(int todo, bool panningRelatedChange)
                 imgsrc->setBorder(params->raw.xtranssensor.border);
             }
 
-            bool autoContrast = imgsrc->getSensorType() == ST_BAYER ? params->raw.bayersensor.dualDemosaicAutoContrast : params->raw.xtranssensor.dualDemosaicAutoContrast;
-            double contrastThreshold = imgsrc->getSensorType() == ST_BAYER ? params->raw.bayersensor.dualDemosaicContrast : params->raw.xtranssensor.dualDemosaicContrast;
-            imgsrc->demosaic(rp, autoContrast, contrastThreshold, params->pdsharpening.enabled);
+            // Below 100% the preview can be binned directly from the raw data, the demosaic then only runs
+            // when a full resolution image is requested. If only detail crops need 100%, just their area
+            // is demosaiced. Tools working on the demosaiced planes need the full frame right away.
+            const bool deferrable = !sharpMask && !params->retinex.enabled
+                                    && !(params->toneCurve.hrenabled && params->toneCurve.method == "Color")
+                                    && params->wb.method != "autitcgreen";
+            std::vector<PreviewProps> detailAreas;
 
-            if (imgsrc->getSensorType() == ST_BAYER && bayerAutoContrastListener && autoContrast) {
-                bayerAutoContrastListener->autoContrastChanged(contrastThreshold);
-            } else if (imgsrc->getSensorType() == ST_FUJI_XTRANS && xtransAutoContrastListener && autoContrast) {
+            if (deferrable && highDetailNeeded && options.prevdemo != PD_Sidecar && !(todo & M_HIGHQUAL)) {
+                for (const auto crop : crops) {
+                    int x, y, w, h;
 
-                xtransAutoContrastListener->autoContrastChanged(contrastThreshold);
+                    if (crop->get_skip() == 1 && crop->hasListener() && crop->getSourceArea(x, y, w, h)) {
+                        detailAreas.emplace_back(x, y, w, h, 1);
+                    }
+                }
+            }
+
+            const bool autoContrast = imgsrc->getSensorType() == ST_BAYER ? params->raw.bayersensor.dualDemosaicAutoContrast : params->raw.xtranssensor.dualDemosaicAutoContrast;
+            // a deferred demosaic reports the auto contrast when it runs
+            AutoContrastListener* const autoContrastListener = imgsrc->getSensorType() == ST_BAYER ? bayerAutoContrastListener : imgsrc->getSensorType() == ST_FUJI_XTRANS ? xtransAutoContrastListener : nullptr;
+            const bool deferred = deferrable
+                                  && ((!highDetailNeeded && scale > 1 && imgsrc->deferDemosaic(rp, autoContrast, autoContrastListener, params->pdsharpening.enabled))
+                                      || (!detailAreas.empty() && imgsrc->demosaicArea(rp, autoContrast, autoContrastListener, detailAreas, getCoarseBitMask(params->coarse), params->pdsharpening.enabled)));
+
+            if (!deferred) {
+                double contrastThreshold = imgsrc->getSensorType() == ST_BAYER ? params->raw.bayersensor.dualDemosaicContrast : params->raw.xtranssensor.dualDemosaicContrast;
+                imgsrc->demosaic(rp, autoContrast, contrastThreshold, params->pdsharpening.enabled);
+
+                if (imgsrc->getSensorType() == ST_BAYER && bayerAutoContrastListener && autoContrast) {
+                    bayerAutoContrastListener->autoContrastChanged(contrastThreshold);
+                } else if (imgsrc->getSensorType() == ST_FUJI_XTRANS && xtransAutoContrastListener && autoContrast) {
+
+                    xtransAutoContrastListener->autoContrastChanged(contrastThreshold);
+                }
             }
 
             // if a demosaic happened we should also call getimage later, so we need to set the M_INIT flag
@@ -986,7 +1019,55 @@ void ImProcCoordinator::updatePreviewImage(int todo, bool panningRelatedChange)
             float *fabrefp = nullptr;
             fabrefp = new float[sizespot];
 
+            locallabSpotCache.resize(sizespot);
+
             for (int sp = 0; sp < (int)params->locallab.spots.size(); sp++) {
+                // Skip the spot when neither its parameters nor its input changed since the last update
+                const LocallabSpotFootprint footprint = getLocallabSpotFootprint(params->locallab.spots.at(sp), pW, pH);
+                const LocallabSpotCache::Key cacheKey(*params, sp, scale, footprint, nprevl, reserv.get(), true);
+                LocallabSpotCache::Results cached;
+
+                if (locallabSpotCache.get(sp, cacheKey, nprevl, cached)) {
+                    huerefblurs[sp] = cached.huerefblur;
+                    chromarefblurs[sp] = cached.chromarefblur;
+                    lumarefblurs[sp] = cached.lumarefblur;
+                    huerefs[sp] = cached.hueref;
+                    chromarefs[sp] = cached.chromaref;
+                    lumarefs[sp] = cached.lumaref;
+                    sobelrefs[sp] = cached.sobelref;
+                    avgs[sp] = cached.avg;
+                    meantms[sp] = cached.meantm;
+                    stdtms[sp] = cached.stdtm;
+                    meanretis[sp] = cached.meanreti;
+                    stdretis[sp] = cached.stdreti;
+                    huerefp[sp] = cached.huerefp;
+                    chromarefp[sp] = cached.chromarefp;
+                    lumarefp[sp] = cached.lumarefp;
+                    fabrefp[sp] = cached.fab;
+
+                    if (params->locallab.spots.at(sp).equiltm  && params->locallab.spots.at(sp).exptonemap) {
+                        params->locallab.spots.at(sp).noiselumc = cached.noiselumc;
+                        params->locallab.spots.at(sp).softradiustm = cached.softradiustm;
+                    }
+
+                    if (params->locallab.spots.at(sp).equilret  && params->locallab.spots.at(sp).expreti) {
+                        params->locallab.spots.at(sp).sensihs = cached.sensihs;
+                        params->locallab.spots.at(sp).sensiv = cached.sensiv;
+                    }
+
+                    if (sp + 1u < params->locallab.spots.size()) {
+                        lastorigimp->CopyFrom(nprevl);
+                    }
+
+                    locallretiminmax.push_back(cached.retiMinMax);
+
+                    if (locallListener) {
+                        locallListener->refChanged2(huerefp, chromarefp, lumarefp, fabrefp, params->locallab.selspot);
+                        locallListener->minmaxChanged(locallretiminmax, params->locallab.selspot);
+                    }
+
+                    continue;
+                }
 
                 if (params->locallab.spots.at(sp).equiltm  && params->locallab.spots.at(sp).exptonemap) {
                     savenormtm.reset(new LabImage(*oprevl, true));
@@ -1309,6 +1390,29 @@ void ImProcCoordinator::updatePreviewImage(int todo, bool panningRelatedChange)
             //    spotref.fab = fab;
             //    locallref.at(sp).fab = fab;
 
+                cached.huerefblur = huerefblurs[sp];
+                cached.chromarefblur = chromarefblurs[sp];
+                cached.lumarefblur = lumarefblurs[sp];
+                cached.hueref = huerefs[sp];
+                cached.chromaref = chromarefs[sp];
+                cached.lumaref = lumarefs[sp];
+                cached.sobelref = sobelrefs[sp];
+                cached.avg = avgs[sp];
+                cached.meantm = meantms[sp];
+                cached.stdtm = stdtms[sp];
+                cached.meanreti = meanretis[sp];
+                cached.stdreti = stdretis[sp];
+                cached.huerefp = huerefp[sp];
+                cached.chromarefp = chromarefp[sp];
+                cached.lumarefp = lumarefp[sp];
+                cached.fab = fabrefp[sp];
+                cached.retiMinMax = retiMinMax;
+                cached.noiselumc = params->locallab.spots.at(sp).noiselumc;
+                cached.softradiustm = params->locallab.spots.at(sp).softradiustm;
+                cached.sensihs = params->locallab.spots.at(sp).sensihs;
+                cached.sensiv = params->locallab.spots.at(sp).sensiv;
+                locallabSpotCache.put(sp, cacheKey, footprint, nprevl, cached);
+
             //    locallref.push_back(spotref);
             if (locallListener) {
               //  locallListener->refChanged(locallref, params->locallab.selspot);
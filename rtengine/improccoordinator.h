@@ -26,6 +26,7 @@
 #include "dcrop.h"
 #include "imagesource.h"
 #include "improcfun.h"
+#include "locallabspotcache.h"
 #include "LUT.h"
 #include "rtengine.h"
 
@@ -364,6 +365,7 @@ protected:
     std::vector<float> stdtms;
     std::vector<float> meanretis;
     std::vector<float> stdretis;
+    LocallabSpotCache locallabSpotCache;
     bool lastspotdup;
     bool previewDeltaE;
     int locallColorMask;
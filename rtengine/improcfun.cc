@@ -16,6 +16,7 @@
  *  You should have received a copy of the GNU General Public License
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
  */
+#include <algorithm>
 #include <cmath>
 
 #include <glib.h>
@@ -37,15 +38,18 @@
 #include "EdgePreservingDecomposition.h"
 #include "iccmatrices.h"
 #include "iccstore.h"
+#include "icctransform.h"
 #include "imagesource.h"
 #include "improcfun.h"
 #include "labimage.h"
 #include "pipettebuffer.h"
 #include "procparams.h"
+#include "rgbproclut.h"
 #include "rt_math.h"
 #include "rtengine.h"
 #include "rtthumbnail.h"
 #include "satandvalueblendingcurve.h"
+#include "softprooflut.h"
 #include "StopWatch.h"
 #include "utils.h"
 
@@ -180,24 +184,20 @@ void proPhotoBlue(float *rtemp, float *gtemp, float *btemp, int istart, int tH,
 #ifdef __SSE2__
 
         for (; j < tW - 3; j += 4, tj += 4) {
-            vfloat rv = LVF(rtemp[ti * tileSize + tj]);
-            vfloat gv = LVF(gtemp[ti * tileSize + tj]);
-            vmask zeromask = vorm(vmaskf_eq(rv, ZEROV), vmaskf_eq(gv, ZEROV));
-
-            if (_mm_movemask_ps((vfloat)zeromask)) {
-                for (int k = 0; k < 4; ++k) {
-                    float r = rtemp[ti * tileSize + tj + k];
-                    float g = gtemp[ti * tileSize + tj + k];
-
-                    float b = btemp[ti * tileSize + tj + k];
-
-                    if ((r == 0.0f || g == 0.0f) && rtengine::min(r, g, b) >= 0.f) {
-                        float h, s, v;
-                        Color::rgb2hsv(r, g, b, h, s, v);
-                        s *= 0.99f;
-                        Color::hsv2rgb(h, s, v, rtemp[ti * tileSize + tj + k], gtemp[ti * tileSize + tj + k], btemp[ti * tileSize + tj + k]);
-                    }
-                }
+            const vfloat rv = LVF(rtemp[ti * tileSize + tj]);
+            const vfloat gv = LVF(gtemp[ti * tileSize + tj]);
+            const vfloat bv = LVF(btemp[ti * tileSize + tj]);
+            const vmask fixmask = vandm(vorm(vmaskf_eq(rv, ZEROV), vmaskf_eq(gv, ZEROV)), vmaskf_ge(vminf(rv, vminf(gv, bv)), ZEROV));
+
+            if (_mm_movemask_ps((vfloat)fixmask)) {
+                vfloat h, s, v;
+                Color::rgb2hsv(rv, gv, bv, h, s, v);
+                s *= F2V(0.99f);
+                vfloat r, g, b;
+                Color::hsv2rgb(h, s, v, r, g, b);
+                STVF(rtemp[ti * tileSize + tj], vself(fixmask, r, rv));
+                STVF(gtemp[ti * tileSize + tj], vself(fixmask, g, gv));
+                STVF(btemp[ti * tileSize + tj], vself(fixmask, b, bv));
             }
         }
 
@@ -289,6 +289,11 @@ void ImProcFunctions::setScale(double iscale)
     scale = iscale;
 }
 
+void ImProcFunctions::setRgbProcLUT(bool use)
+{
+    useRgbProcLUT = use;
+}
+
 
 void ImProcFunctions::updateColorProfiles(const Glib::ustring& monitorProfile, RenderingIntent monitorIntent, bool softProof, bool gamutCheck)
 {
@@ -298,6 +303,7 @@ void ImProcFunctions::updateColorProfiles(const Glib::ustring& monitorProfile, R
     }
 
     gamutWarning.reset(nullptr);
+    monitorLut = nullptr;
 
     monitorTransform = nullptr;
 
@@ -317,10 +323,14 @@ void ImProcFunctions::updateColorProfiles(const Glib::ustring& monitorProfile, R
         cmsUInt32Number flags;
         cmsHPROFILE iprof  = cmsCreateLab4Profile(nullptr);
         cmsHPROFILE gamutprof = nullptr;
+        Glib::ustring gamutprofName;
         cmsUInt32Number gamutbpc = 0;
         RenderingIntent gamutintent = RI_RELATIVE;
 
         bool softProofCreated = false;
+        cmsHPROFILE proofprof = nullptr;
+        Glib::ustring proofprofName;
+        RenderingIntent proofIntent = RI_RELATIVE;
 
         if (softProof) {
             cmsHPROFILE oprof = nullptr;
@@ -330,6 +340,7 @@ void ImProcFunctions::updateColorProfiles(const Glib::ustring& monitorProfile, R
 
             if (!settings->printerProfile.empty()) {
                 oprof = ICCStore::getInstance()->getProfile(settings->printerProfile);
+                proofprofName = settings->printerProfile;
 
                 if (settings->printerBPC) {
                     flags |= cmsFLAGS_BLACKPOINTCOMPENSATION;
@@ -337,6 +348,7 @@ void ImProcFunctions::updateColorProfiles(const Glib::ustring& monitorProfile, R
                 outIntent = RenderingIntent(settings->printerIntent);
             } else {
                 oprof = ICCStore::getInstance()->getProfile(params->icm.outputProfile);
+                proofprofName = params->icm.outputProfile;
                 if (params->icm.outputBPC) {
                     flags |= cmsFLAGS_BLACKPOINTCOMPENSATION;
                 }
@@ -386,10 +398,13 @@ void ImProcFunctions::updateColorProfiles(const Glib::ustring& monitorProfile, R
 
                 if (monitorTransform) {
                     softProofCreated = true;
+                    proofprof = oprof;
+                    proofIntent = outIntent;
                 }
 
                 if (gamutCheck) {
                     gamutprof = oprof;
+                    gamutprofName = proofprofName;
 
                     if (params->icm.outputBPC) {
                         gamutbpc = cmsFLAGS_BLACKPOINTCOMPENSATION;
@@ -410,6 +425,7 @@ void ImProcFunctions::updateColorProfiles(const Glib::ustring& monitorProfile, R
             //     softProofCreated = true;
             // }
             gamutprof = monitor;
+            gamutprofName = monitorProfile;
 
             if (settings->monitorBPC) {
                 gamutbpc = cmsFLAGS_BLACKPOINTCOMPENSATION;
@@ -428,10 +444,39 @@ void ImProcFunctions::updateColorProfiles(const Glib::ustring& monitorProfile, R
             monitorTransform = cmsCreateTransform(iprof, TYPE_Lab_FLT, monitor, TYPE_RGB_FLT, monitorIntent, flags);
         }
 
+        // the transforms of the gamut warning and of the soft proofing come from the ICCStore, which locks lcmsMutex by itself
+        lcmsLock.release();
+
         if (gamutCheck && gamutprof) {
             gamutWarning.reset(new GamutWarning(iprof, gamutprof, gamutintent, gamutbpc));
         }
 
+        // soft proofing and the gamut warning are baked in a lut, the plain monitor transform is cheap enough
+        if (monitorTransform && (softProofCreated || gamutWarning)) {
+            const SoftProofLUTCache::Key key(
+                monitorProfile, monitorIntent, flags,
+                softProofCreated ? proofprofName : Glib::ustring(), proofIntent,
+                gamutWarning ? gamutprofName : Glib::ustring(), gamutintent, gamutbpc
+            );
+            monitorLut = SoftProofLUTCache::getInstance().get(key);
+
+            if (!monitorLut) {
+                std::shared_ptr<const ICCTransform> lab2proof;
+
+                if (proofprof) {
+                    lab2proof = ICCStore::getInstance()->getTransform(iprof, TYPE_Lab_FLT, proofprof, TYPE_RGB_FLT, proofIntent, cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE | (flags & cmsFLAGS_BLACKPOINTCOMPENSATION));
+                }
+
+                monitorLut = std::make_shared<const SoftProofLUT>(monitorTransform, monitor, lab2proof.get(), gamutWarning.get(), multiThread);
+
+                if (monitorLut->isValid()) {
+                    SoftProofLUTCache::getInstance().put(key, monitorLut);
+                } else {
+                    monitorLut = nullptr;
+                }
+            }
+        }
+
         cmsCloseProfile(iprof);
     }
 }
@@ -1518,12 +1563,13 @@ void ImProcFunctions::ciecam_02float(CieImage* ncie, float adap, int pW, int pwb
                     STVF(zbuffer[k], z * c655d35);
                 }
 
-                // XYZ2Lab uses a lookup table. The function behind that lut is a cube root.
-                // SSE can't beat the speed of that lut, so it doesn't make sense to use SSE
+                //convert xyz=>lab, in place
+                Color::XYZ2Lab(xbuffer, ybuffer, zbuffer, xbuffer, ybuffer, zbuffer, width);
+
                 for (int j = 0; j < width; j++) {
-                    float Ll, aa, bb;
-                    //convert xyz=>lab
-                    Color::XYZ2Lab(xbuffer[j], ybuffer[j], zbuffer[j], Ll, aa, bb);
+                    const float Ll = xbuffer[j];
+                    const float aa = ybuffer[j];
+                    const float bb = zbuffer[j];
 
                     // gamut control in Lab mode; I must study how to do with cIECAM only
                     if (gamu == 1) {
@@ -1826,12 +1872,13 @@ void ImProcFunctions::ciecam_02float(CieImage* ncie, float adap, int pW, int pwb
                         STVF(zbuffer[k], z);
                     }
 
-                    // XYZ2Lab uses a lookup table. The function behind that lut is a cube root.
-                    // SSE can't beat the speed of that lut, so it doesn't make sense to use SSE
+                    //convert xyz=>lab, in place
+                    Color::XYZ2Lab(xbuffer, ybuffer, zbuffer, xbuffer, ybuffer, zbuffer, width);
+
                     for (int j = 0; j < width; j++) {
-                        float Ll, aa, bb;
-                        //convert xyz=>lab
-                        Color::XYZ2Lab(xbuffer[j], ybuffer[j], zbuffer[j], Ll, aa, bb);
+                        const float Ll = xbuffer[j];
+                        const float aa = ybuffer[j];
+                        const float bb = zbuffer[j];
 
                         if (gamu == 1) {
                             float Lprov1, Chprov1;
@@ -2242,6 +2289,204 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
     }
     bool hasgammabw = gammabwr != 1.f || gammabwg != 1.f || gammabwb != 1.f;
 
+    // the stages before the tone curve, their output is the one of the tone curve histogram
+    const auto preToneCurve =
+        [&](float* rtemp, float* gtemp, float* btemp, int istart, int tH, int jstart, int tW, int tileSize) -> void
+        {
+            highlightToneCurve(hltonecurve, rtemp, gtemp, btemp, istart, tH, jstart, tW, tileSize, exp_scale, comp, hlrange);
+            if (params->toneCurve.black != 0.0) {
+                shadowToneCurve(shtonecurve, rtemp, gtemp, btemp, istart, tH, jstart, tW, tileSize);
+            }
+
+            if (dcpProf) {
+                dcpProf->step2ApplyTile(rtemp, gtemp, btemp, tW - jstart, tH - istart, tileSize, asIn);
+            }
+
+            if (params->toneCurve.clampOOG) {
+                for (int i = istart, ti = 0; i < tH; i++, ti++) {
+                    for (int j = jstart, tj = 0; j < tW; j++, tj++) {
+                        // clip out of gamut colors, without distorting colour too bad
+                        float r = std::max(rtemp[ti * tileSize + tj], 0.f);
+                        float g = std::max(gtemp[ti * tileSize + tj], 0.f);
+                        float b = std::max(btemp[ti * tileSize + tj], 0.f);
+
+                        if (OOG(r) || OOG(g) || OOG(b)) {
+                            filmlike_clip(&r, &g, &b);
+                        }
+
+                        rtemp[ti * tileSize + tj] = r;
+                        gtemp[ti * tileSize + tj] = g;
+                        btemp[ti * tileSize + tj] = b;
+                    }
+                }
+            }
+        };
+
+    // Everything below is a function of the colour of each pixel, except for the black & white channel mixer and the pipette.
+    // The preview can then use a 3D lut of the whole processing, made by this function for the lattice points.
+    if (useRgbProcLUT && settings->previewcolorlut && !blackwhite && editID == EUID_None) {
+        const int W = working->getWidth();
+        const int H = working->getHeight();
+        const RGBProcLUTCache::Key key(*params, expcomp, hlcompr, hlcomprthresh, dcpProf, sat, satLimit, satLimitOpacity, opautili, {
+            &hltonecurve, &shtonecurve, &tonecurve, &rCurve, &gCurve, &bCurve, &clToningcurve, &cl2Toningcurve,
+            &ctColorCurve.lut1, &ctColorCurve.lut2, &ctColorCurve.lut3, &ctOpacityCurve.lutOpacityCurve,
+            &customToneCurve1.lutToneCurve, &customToneCurve2.lutToneCurve, &customToneCurvebw1.lutToneCurve, &customToneCurvebw2.lutToneCurve
+        });
+        std::shared_ptr<const RGBProcLUT> lut = RGBProcLUTCache::getInstance().get(key);
+
+        const auto exactRgbProc =
+            [&](Imagefloat* src, LabImage* dst, LUTu& hist) -> void
+            {
+                ImProcFunctions ipf(params, multiThread);
+                std::copy(lumimul, lumimul + 3, ipf.lumimul);
+                ipf.rgbProc(src, dst, nullptr, hltonecurve, shtonecurve, tonecurve, sat, rCurve, gCurve, bCurve, satLimit, satLimitOpacity, ctColorCurve, ctOpacityCurve, opautili,
+                            clToningcurve, cl2Toningcurve, customToneCurve1, customToneCurve2, customToneCurvebw1, customToneCurvebw2, rrm, ggm, bbm, autor, autog, autob,
+                            expcomp, hlcompr, hlcomprthresh, dcpProf, asIn, hist, chunkSize, false);
+            };
+
+        // baking costs about as much as processing an image of the size of the lattice
+        if (!lut && static_cast<long>(W) * H >= RGBProcLUT::latticeSize) {
+            const std::unique_ptr<Imagefloat> lattice = RGBProcLUT::createLattice();
+            const int latticeW = lattice->getWidth();
+            const int latticeH = lattice->getHeight();
+            LabImage latticeLab(latticeW, latticeH);
+            LUTu noHistogram;
+            exactRgbProc(lattice.get(), &latticeLab, noHistogram);
+
+            std::vector<float> histLuminance(RGBProcLUT::latticeSize);
+
+#ifdef _OPENMP
+            #pragma omp parallel if (multiThread)
+#endif
+            {
+                AlignedBuffer<float> rbuffer(latticeW);
+                AlignedBuffer<float> gbuffer(latticeW);
+                AlignedBuffer<float> bbuffer(latticeW);
+
+#ifdef _OPENMP
+                #pragma omp for
+#endif
+                for (int i = 0; i < latticeH; ++i) {
+                    std::copy(lattice->r(i), lattice->r(i) + latticeW, rbuffer.data);
+                    std::copy(lattice->g(i), lattice->g(i) + latticeW, gbuffer.data);
+                    std::copy(lattice->b(i), lattice->b(i) + latticeW, bbuffer.data);
+                    preToneCurve(rbuffer.data, gbuffer.data, bbuffer.data, 0, 1, 0, latticeW, latticeW);
+                    Color::gamma_srgbclipped(rbuffer.data, rbuffer.data, latticeW);
+                    Color::gamma_srgbclipped(gbuffer.data, gbuffer.data, latticeW);
+                    Color::gamma_srgbclipped(bbuffer.data, bbuffer.data, latticeW);
+
+                    for (int j = 0; j < latticeW; ++j) {
+                        histLuminance[i * latticeW + j] = CLIP<int>(lumimul[0] * rbuffer.data[j] + lumimul[1] * gbuffer.data[j] + lumimul[2] * bbuffer.data[j]);
+                    }
+                }
+            }
+
+            lut = std::make_shared<const RGBProcLUT>(latticeLab, histLuminance.data());
+
+            if (lut->isValid()) {
+                RGBProcLUTCache::getInstance().put(key, lut);
+            } else {
+                lut = nullptr;
+            }
+        }
+
+        if (lut) {
+            const int histSize = histToneCurve ? histToneCurve.getSize() : 0;
+            const int histCompression = histSize > 0 ? log2(65536 / histSize) : 0;
+
+            if (histSize > 0) {
+                histToneCurve.clear();
+            }
+
+            std::vector<std::pair<int, int>> outOfRange; // row, column
+
+#ifdef _OPENMP
+            #pragma omp parallel if (multiThread)
+#endif
+            {
+                std::vector<float> histLuminance(W);
+                std::vector<int> rowOutOfRange;
+                std::vector<std::pair<int, int>> threadOutOfRange;
+                LUTu histThr;
+
+                if (histSize > 0) {
+                    histThr(histSize);
+                    histThr.clear();
+                }
+
+#ifdef _OPENMP
+                #pragma omp for schedule(dynamic, 16) nowait
+#endif
+                for (int i = 0; i < H; ++i) {
+                    rowOutOfRange.clear();
+                    lut->apply(working->r(i), working->g(i), working->b(i), lab->L[i], lab->a[i], lab->b[i], histLuminance.data(), W, rowOutOfRange);
+
+                    for (const auto j : rowOutOfRange) {
+                        threadOutOfRange.emplace_back(i, j);
+                    }
+
+                    if (histThr) {
+                        for (int j = 0; j < W; ++j) {
+                            if (histLuminance[j] >= 0.f) {
+                                histThr[static_cast<int>(histLuminance[j]) >> histCompression]++;
+                            }
+                        }
+                    }
+                }
+
+#ifdef _OPENMP
+                #pragma omp critical
+#endif
+                {
+                    outOfRange.insert(outOfRange.end(), threadOutOfRange.begin(), threadOutOfRange.end());
+
+                    if (histThr) {
+                        histToneCurve += histThr;
+                    }
+                }
+            }
+
+            // the pixels out of the lattice, usually a few highlights, and the pixels of the cells which can't be interpolated
+            // go through the exact processing
+            if (!outOfRange.empty()) {
+                const int count = outOfRange.size();
+                Imagefloat pixels(count, 1);
+                LabImage pixelsLab(count, 1);
+
+                for (int k = 0; k < count; ++k) {
+                    pixels.r(0, k) = working->r(outOfRange[k].first, outOfRange[k].second);
+                    pixels.g(0, k) = working->g(outOfRange[k].first, outOfRange[k].second);
+                    pixels.b(0, k) = working->b(outOfRange[k].first, outOfRange[k].second);
+                }
+
+                LUTu hist;
+
+                if (histSize > 0) {
+                    hist(histSize);
+                }
+
+                exactRgbProc(&pixels, &pixelsLab, hist);
+
+                for (int k = 0; k < count; ++k) {
+                    lab->L[outOfRange[k].first][outOfRange[k].second] = pixelsLab.L[0][k];
+                    lab->a[outOfRange[k].first][outOfRange[k].second] = pixelsLab.a[0][k];
+                    lab->b[outOfRange[k].first][outOfRange[k].second] = pixelsLab.b[0][k];
+                }
+
+                if (hist) {
+                    histToneCurve += hist;
+                }
+            }
+
+            delete hCurve;
+            delete sCurve;
+            delete vCurve;
+            delete bwlCurve;
+
+            return;
+        }
+    }
+
     if (hasColorToning || blackwhite || (params->dirpyrequalizer.cbdlMethod == "bef" && params->dirpyrequalizer.enabled)) {
         tmpImage = new Imagefloat(working->getWidth(), working->getHeight());
     }
@@ -2258,6 +2503,66 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
     // For tonecurve histogram
     const float lumimulf[3] = {static_cast<float>(lumimul[0]), static_cast<float>(lumimul[1]), static_cast<float>(lumimul[2])};
 
+    // The tone curve, the custom tone curves in standard mode and the RGB curves in normal mode are applied to each
+    // channel on its own. A run of at least two of them, which is neither interrupted by another kind of curve nor by
+    // the filling of a pipette buffer, is composed into one lut per channel, applied in place of the first curve.
+    enum CurveStep {TONE_CURVE, TONE_CURVE_1, TONE_CURVE_2, RGB_CURVES, CURVE_STEPS};
+    const bool hasRGBCurves = params->rgbCurves.enabled && (rCurve || gCurve || bCurve);
+    const bool curveUsed[CURVE_STEPS] = {true, hasToneCurve1, hasToneCurve2, hasRGBCurves};
+    const bool curveComposable[CURVE_STEPS] = {toneCurveHistSize == 0, curveMode == ToneCurveMode::STD, curveMode2 == ToneCurveMode::STD, !params->rgbCurves.lumamode};
+    const bool pipetteBefore[CURVE_STEPS] = {false, editID == EUID_ToneCurve1, editID == EUID_ToneCurve2, editID == EUID_RGB_R || editID == EUID_RGB_G || editID == EUID_RGB_B};
+    bool curveComposed[CURVE_STEPS] = {};
+    int firstComposedCurve = CURVE_STEPS;
+    RGBCurveChain curveChain;
+
+    for (int step = 0, runStart = 0; step <= CURVE_STEPS; ++step) {
+        if (step == CURVE_STEPS || pipetteBefore[step] || (curveUsed[step] && !curveComposable[step])) {
+            int runLength = 0;
+
+            for (int k = runStart; k < step; ++k) {
+                runLength += curveUsed[k];
+            }
+
+            if (runLength >= 2) {
+                for (int k = runStart; k < step; ++k) {
+                    curveComposed[k] = curveUsed[k];
+                }
+
+                break;
+            }
+
+            runStart = step < CURVE_STEPS && curveUsed[step] && !curveComposable[step] ? step + 1 : step;
+        }
+    }
+
+    if (curveComposed[TONE_CURVE]) {
+        curveChain.add(tonecurve);
+    }
+
+    if (curveComposed[TONE_CURVE_1]) {
+        curveChain.add(customToneCurve1.lutToneCurve);
+    }
+
+    if (curveComposed[TONE_CURVE_2]) {
+        curveChain.add(customToneCurve2.lutToneCurve);
+    }
+
+    if (curveComposed[RGB_CURVES]) {
+        curveChain.add(rCurve, gCurve, bCurve);
+    }
+
+    for (int step = 0; step < CURVE_STEPS; ++step) {
+        if (curveComposed[step]) {
+            firstComposedCurve = step;
+            break;
+        }
+    }
+
+    if (firstComposedCurve < CURVE_STEPS && !curveChain.compile()) {
+        std::fill(curveComposed, curveComposed + CURVE_STEPS, false);
+        firstComposedCurve = CURVE_STEPS;
+    }
+
 
 #define TS 112
 
@@ -2277,6 +2582,14 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
         int tW;
         int tH;
 
+        const auto applyCurveChain =
+            [&]() -> void
+            {
+                for (int i = istart, ti = 0; i < tH; i++, ti++) {
+                    curveChain.apply(&rtemp[ti * TS], &gtemp[ti * TS], &btemp[ti * TS], tW - jstart);
+                }
+            };
+
         // zero out the buffers
         memset(rtemp, 0, 3 * perChannelSizeBytes);
 
@@ -2350,38 +2663,41 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
                     }
                 }
 
-                highlightToneCurve(hltonecurve, rtemp, gtemp, btemp, istart, tH, jstart, tW, TS, exp_scale, comp, hlrange);
-                if (params->toneCurve.black != 0.0) {
-                    shadowToneCurve(shtonecurve, rtemp, gtemp, btemp, istart, tH, jstart, tW, TS);
-                }
+                preToneCurve(rtemp, gtemp, btemp, istart, tH, jstart, tW, TS);
 
-                if (dcpProf) {
-                    dcpProf->step2ApplyTile(rtemp, gtemp, btemp, tW - jstart, tH - istart, TS, asIn);
-                }
-
-                if (params->toneCurve.clampOOG) {
+                if (firstComposedCurve == TONE_CURVE) {
+                    applyCurveChain();
+                } else if (histToneCurveThr) {
                     for (int i = istart, ti = 0; i < tH; i++, ti++) {
-                        for (int j = jstart, tj = 0; j < tW; j++, tj++) {
-                            // clip out of gamut colors, without distorting colour too bad
-                            float r = std::max(rtemp[ti * TS + tj], 0.f);
-                            float g = std::max(gtemp[ti * TS + tj], 0.f);
-                            float b = std::max(btemp[ti * TS + tj], 0.f);
+                        int j = jstart, tj = 0;
+#ifdef __SSE2__
+                        float tmpr[4] ALIGNED16;
+                        float tmpg[4] ALIGNED16;
+                        float tmpb[4] ALIGNED16;
+                        float tmpy[4] ALIGNED16;
+                        const vfloat maxvalv = F2V(MAXVALF);
+                        const vfloat lumimulv[3] = {F2V(lumimulf[0]), F2V(lumimulf[1]), F2V(lumimulf[2])};
 
-                            if (OOG(r) || OOG(g) || OOG(b)) {
-                                filmlike_clip(&r, &g, &b);
-                            }
+                        for (; j < tW - 3; j += 4, tj += 4) {
+                            const vfloat rv = LVF(rtemp[ti * TS + tj]);
+                            const vfloat gv = LVF(gtemp[ti * TS + tj]);
+                            const vfloat bv = LVF(btemp[ti * TS + tj]);
+
+                            //brightness/contrast
+                            STVF(tmpr[0], tonecurve[vclampf(rv, ZEROV, maxvalv)]);
+                            STVF(tmpg[0], tonecurve[vclampf(gv, ZEROV, maxvalv)]);
+                            STVF(tmpb[0], tonecurve[vclampf(bv, ZEROV, maxvalv)]);
+                            STVF(tmpy[0], lumimulv[0] * Color::gamma_srgbclipped(rv) + lumimulv[1] * Color::gamma_srgbclipped(gv) + lumimulv[2] * Color::gamma_srgbclipped(bv));
 
-                            rtemp[ti * TS + tj] = r;
-                            gtemp[ti * TS + tj] = g;
-                            btemp[ti * TS + tj] = b;
+                            for (int k = 0; k < 4; ++k) {
+                                histToneCurveThr[CLIP<int>(tmpy[k]) >> histToneCurveCompression]++;
+                                setUnlessOOG(rtemp[ti * TS + tj + k], gtemp[ti * TS + tj + k], btemp[ti * TS + tj + k], tmpr[k], tmpg[k], tmpb[k]);
+                            }
                         }
-                    }
 
-                }
+#endif
 
-                if (histToneCurveThr) {
-                    for (int i = istart, ti = 0; i < tH; i++, ti++) {
-                        for (int j = jstart, tj = 0; j < tW; j++, tj++) {
+                        for (; j < tW; j++, tj++) {
 
                             //brightness/contrast
                             float r = tonecurve[ CLIP(rtemp[ti * TS + tj]) ];
@@ -2426,7 +2742,9 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
                     fillEditFloat(editIFloatTmpR, editIFloatTmpG, editIFloatTmpB, rtemp, gtemp, btemp, istart, tH, jstart, tW, TS);
                 }
 
-                if (hasToneCurve1) {
+                if (firstComposedCurve == TONE_CURVE_1) {
+                    applyCurveChain();
+                } else if (hasToneCurve1 && !curveComposed[TONE_CURVE_1]) {
                     customToneCurve(customToneCurve1, curveMode, rtemp, gtemp, btemp, istart, tH, jstart, tW, TS, ptc1ApplyState);
                 }
 
@@ -2434,7 +2752,9 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
                     fillEditFloat(editIFloatTmpR, editIFloatTmpG, editIFloatTmpB, rtemp, gtemp, btemp, istart, tH, jstart, tW, TS);
                 }
 
-                if (hasToneCurve2) {
+                if (firstComposedCurve == TONE_CURVE_2) {
+                    applyCurveChain();
+                } else if (hasToneCurve2 && !curveComposed[TONE_CURVE_2]) {
                     customToneCurve(customToneCurve2, curveMode2, rtemp, gtemp, btemp, istart, tH, jstart, tW, TS, ptc2ApplyState);
                 }
 
@@ -2458,7 +2778,7 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
                     }
                 }
 
-                if (params->rgbCurves.enabled && (rCurve || gCurve || bCurve)) { // if any of the RGB curves is engaged
+                if (hasRGBCurves && !curveComposed[RGB_CURVES]) { // if any of the RGB curves is engaged
                     if (!params->rgbCurves.lumamode) { // normal RGB mode
 
                         for (int i = istart, ti = 0; i < tH; i++, ti++) {
@@ -2566,12 +2886,34 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
 
                 if (sat != 0 || hCurveEnabled || sCurveEnabled || vCurveEnabled) {
                     const float satby100 = sat / 100.f;
+                    float hbuffer[TS] ALIGNED16;
+                    float sbuffer[TS] ALIGNED16;
+                    float vbuffer[TS] ALIGNED16;
 
                     for (int i = istart, ti = 0; i < tH; i++, ti++) {
-                        for (int j = jstart, tj = 0; j < tW; j++, tj++) {
-                            float h, s, v;
-                            Color::rgb2hsvtc(rtemp[ti * TS + tj], gtemp[ti * TS + tj], btemp[ti * TS + tj], h, s, v);
-                            h /= 6.f;
+                        float* const rrow = &rtemp[ti * TS];
+                        float* const grow = &gtemp[ti * TS];
+                        float* const brow = &btemp[ti * TS];
+                        const int width = tW - jstart;
+                        int j = 0;
+#ifdef __SSE2__
+                        for (; j < width - 3; j += 4) {
+                            vfloat h, s, v;
+                            Color::rgb2hsvtc(LVF(rrow[j]), LVF(grow[j]), LVF(brow[j]), h, s, v);
+                            STVF(hbuffer[j], h / F2V(6.f));
+                            STVF(sbuffer[j], s);
+                            STVF(vbuffer[j], v);
+                        }
+#endif
+                        for (; j < width; ++j) {
+                            Color::rgb2hsvtc(rrow[j], grow[j], brow[j], hbuffer[j], sbuffer[j], vbuffer[j]);
+                            hbuffer[j] /= 6.f;
+                        }
+
+                        for (j = 0; j < width; ++j) {
+                            float &h = hbuffer[j];
+                            float &s = sbuffer[j];
+                            float &v = vbuffer[j];
 
                             if (sat > 0) {
                                 s = std::max(0.f, intp(satby100, 1.f - SQR(SQR(1.f - std::min(s, 1.0f))), s));
@@ -2628,9 +2970,9 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
                                 }
 
                             }
-
-                            Color::hsv2rgbdcp(h * 6.f, s, v, rtemp[ti * TS + tj], gtemp[ti * TS + tj], btemp[ti * TS + tj]);
                         }
+
+                        Color::hsv2rgb(hbuffer, sbuffer, vbuffer, rrow, grow, brow, width);
                     }
                 }
 
@@ -5584,12 +5926,7 @@ void ImProcFunctions::rgb2lab(const Imagefloat &src, LabImage &dst, const Glib::
 #endif
 
     for (int i = 0; i < H; i++) {
-        for (int j = 0; j < W; j++) {
-            float X, Y, Z;
-            Color::rgbxyz(src.r(i, j), src.g(i, j), src.b(i, j), X, Y, Z, wp);
-            //convert Lab
-            Color::XYZ2Lab(X, Y, Z, dst.L[i][j], dst.a[i][j], dst.b[i][j]);
-        }
+        Color::RGB2Lab(src.r(i), src.g(i), src.b(i), dst.L[i], dst.a[i], dst.b[i], wp, W);
     }
 }
 
@@ -5686,18 +6023,29 @@ void ImProcFunctions::rgb2lab(const Image8 &src, int x, int y, int w, int h, flo
         constexpr float rgb_factor = 65355.f / 255.f;
 
 #ifdef _OPENMP
-        #pragma omp parallel for schedule(dynamic,16) if (multiThread)
+        #pragma omp parallel if (multiThread)
+#endif
+        {
+            AlignedBuffer<float> rgbBuf(3 * w);
+            float *rbuffer = rgbBuf.data;
+            float *gbuffer = rbuffer + w;
+            float *bbuffer = gbuffer + w;
+            // lab2rgb uses gamma2curve, which is gammatab_srgb.
+            const auto& igamma = Color::igammatab_srgb;
+
+#ifdef _OPENMP
+            #pragma omp for schedule(dynamic,16)
 #endif
 
-        for (int i = y; i < y2; i++) {
-            int offset = (i - y) * w;
-            for (int j = x; j < x2; j++) {
-                float X, Y, Z;
-                // lab2rgb uses gamma2curve, which is gammatab_srgb.
-                const auto& igamma = Color::igammatab_srgb;
-                Color::rgbxyz(igamma[rgb_factor * src.r(i, j)], igamma[rgb_factor * src.g(i, j)], igamma[rgb_factor * src.b(i, j)], X, Y, Z, wp);
-                Color::XYZ2Lab(X, Y, Z, L[offset], a[offset], b[offset]);
-                offset++;
+            for (int i = y; i < y2; i++) {
+                for (int j = x; j < x2; j++) {
+                    rbuffer[j - x] = igamma[rgb_factor * src.r(i, j)];
+                    gbuffer[j - x] = igamma[rgb_factor * src.g(i, j)];
+                    bbuffer[j - x] = igamma[rgb_factor * src.b(i, j)];
+                }
+
+                const int offset = (i - y) * w;
+                Color::RGB2Lab(rbuffer, gbuffer, bbuffer, L + offset, a + offset, b + offset, wp, w);
             }
         }
     }
@@ -5714,42 +6062,13 @@ void ImProcFunctions::lab2rgb(const LabImage &src, Imagefloat &dst, const Glib::
 
     const int W = dst.getWidth();
     const int H = dst.getHeight();
-#ifdef __SSE2__
-    vfloat wipv[3][3];
-
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 3; j++) {
-            wipv[i][j] = F2V(wiprof[i][j]);
-        }
-    }
-
-#endif
 
 #ifdef _OPENMP
     #pragma omp parallel for schedule(dynamic,16)
 #endif
 
     for (int i = 0; i < H; i++) {
-        int j = 0;
-#ifdef __SSE2__
-
-        for (; j < W - 3; j += 4) {
-            vfloat X, Y, Z;
-            vfloat R, G, B;
-            Color::Lab2XYZ(LVFU(src.L[i][j]), LVFU(src.a[i][j]), LVFU(src.b[i][j]), X, Y, Z);
-            Color::xyz2rgb(X, Y, Z, R, G, B, wipv);
-            STVFU(dst.r(i, j), R);
-            STVFU(dst.g(i, j), G);
-            STVFU(dst.b(i, j), B);
-        }
-
-#endif
-
-        for (; j < W; j++) {
-            float X, Y, Z;
-            Color::Lab2XYZ(src.L[i][j], src.a[i][j], src.b[i][j], X, Y, Z);
-            Color::xyz2rgb(X, Y, Z, dst.r(i, j), dst.g(i, j), dst.b(i, j), wip);
-        }
+        Color::Lab2RGB(src.L[i], src.a[i], src.b[i], dst.r(i), dst.g(i), dst.b(i), wip, W);
     }
 }
 
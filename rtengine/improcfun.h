@@ -65,6 +65,7 @@ class LocHHCurve;
 class NoiseCurve;
 class OpacityCurve;
 class PipetteBuffer;
+class SoftProofLUT;
 class ToneCurve;
 class WavCurve;
 class Wavblcurve;
@@ -109,11 +110,13 @@ class ImProcFunctions
 {
     cmsHTRANSFORM monitorTransform;
     std::unique_ptr<GamutWarning> gamutWarning;
+    std::shared_ptr<const SoftProofLUT> monitorLut; // the monitorTransform and the gamutWarning baked in a lut
     Cairo::RefPtr<Cairo::ImageSurface> locImage;
 
     const procparams::ProcParams* params;
     double scale;
     bool multiThread;
+    bool useRgbProcLUT;
 
     void calcVignettingParams(int oW, int oH, const procparams::VignettingParams& vignetting, double &w2, double &h2, double& maxRadius, double &v, double &b, double &mul);
 
@@ -149,13 +152,15 @@ enum class BlurType {
     double lumimul[3];
 
     explicit ImProcFunctions(const procparams::ProcParams* iparams, bool imultiThread = true)
-        : monitorTransform(nullptr), params(iparams), scale(1), multiThread(imultiThread), lumimul{} {}
+        : monitorTransform(nullptr), params(iparams), scale(1), multiThread(imultiThread), useRgbProcLUT(false), lumimul{} {}
     ~ImProcFunctions();
     bool needsLuminanceOnly() const
     {
         return !(needsCA() || needsDistortion() || needsRotation() || needsPerspective() || needsLCP() || needsLensfun()) && (needsVignetting() || needsPCVignetting() || needsGradient());
     }
     void setScale(double iscale);
+    // lets rgbProc use a baked 3D lut of its colour pipeline when it can, for the preview and the detail windows
+    void setRgbProcLUT(bool use);
 
     bool needsTransform(int oW, int oH, int rawRotationDeg, const FramesMetaData *metadata) const;
     bool needsPCVignetting() const;
@@ -267,9 +272,7 @@ enum class BlurType {
     void NLMeans(float **img, int strength, int detail_thresh, int patch, int radius, float gam, int bfw, int bfh, float scale, bool multithread);
     void loccont(int bfw, int bfh, LabImage* tmp1, float rad, float stren, int sk);
 
-    void rex_poisson_dct(float * data, size_t nx, size_t ny, double m);
     void mean_dt(const float * data, size_t size, double& mean_p, double& dt_p);
-    float *cos_table(size_t size);
 
     void normalize_mean_dt(float *data, const float *ref, size_t size, float mod, float sigm, float mdef, float sdef, float mdef2, float sdef2);
     void retinex_pde(const float *datain, float * dataout, int bfw, int bfh, float thresh, float multy, float *dE, int show, int dEenable, int normalize);
@@ -29,6 +29,7 @@
 #include "improccoordinator.h"
 #include "dfmanager.h"
 #include "ffmanager.h"
+#include "fftwplancache.h"
 #include "rtthumbnail.h"
 #include "profilestore.h"
 #include "../rtgui/threadutils.h"
@@ -41,7 +42,6 @@ namespace rtengine
 const Settings* settings;
 
 MyMutex* lcmsMutex = nullptr;
-MyMutex *fftwMutex = nullptr;
 
 int init (const Settings* s, const Glib::ustring& baseDir, const Glib::ustring& userSettingsDir, bool loadAll)
 {
@@ -115,7 +115,6 @@ int init (const Settings* s, const Glib::ustring& baseDir, const Glib::ustring&
     Color::init ();
     delete lcmsMutex;
     lcmsMutex = new MyMutex;
-    fftwMutex = new MyMutex;
     return 0;
 }
 
@@ -124,6 +123,7 @@ void cleanup ()
     ProcParams::cleanup ();
     Color::cleanup ();
     RawImageSource::cleanup ();
+    FFTWPlanCache::getInstance().cleanup();
 
 #ifdef RT_FFTW3F_OMP
     fftwf_cleanup_threads();
@@ -16,12 +16,15 @@
  *  You should have received a copy of the GNU General Public License
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
  */
+#include <vector>
+
 #include <glibmm/ustring.h>
 
 #include "alignedbuffer.h"
 #include "color.h"
 #include "iccmatrices.h"
 #include "iccstore.h"
+#include "icctransform.h"
 #include "image8.h"
 #include "imagefloat.h"
 #include "improcfun.h"
@@ -29,6 +32,7 @@
 #include "procparams.h"
 #include "rtengine.h"
 #include "settings.h"
+#include "softprooflut.h"
 #include "utils.h"
 
 namespace rtengine
@@ -44,6 +48,16 @@ inline void copyAndClampLine(const float *src, unsigned char *dst, const int W)
 }
 
 
+inline void copyAndClampLine(const float *r, const float *g, const float *b, unsigned char *dst, const int W)
+{
+    for (int j = 0; j < W; ++j) {
+        dst[3 * j] = uint16ToUint8Rounded(CLIP(r[j] * MAXVALF));
+        dst[3 * j + 1] = uint16ToUint8Rounded(CLIP(g[j] * MAXVALF));
+        dst[3 * j + 2] = uint16ToUint8Rounded(CLIP(b[j] * MAXVALF));
+    }
+}
+
+
 inline void copyAndClamp(const LabImage *src, unsigned char *dst, const double rgb_xyz[3][3], bool multiThread)
 {
     const int W = src->W;
@@ -139,7 +153,8 @@ vfloat gammalog(vfloat x, vfloat p, vfloat s, vfloat g3, vfloat g4)
 //         Crop::update                           (rtengine/dcrop.cc)
 //         Thumbnail::processImage                (rtengine/rtthumbnail.cc)
 //
-// If monitorTransform, divide by 327.68 then apply monitorTransform (which can integrate soft-proofing)
+// If monitorTransform, divide by 327.68 then apply monitorTransform (which can integrate soft-proofing),
+// through monitorLut when soft-proofing or the gamut warning are on
 // otherwise divide by 327.68, convert to xyz and apply the sRGB transform, before converting with gamma2curve
 void ImProcFunctions::lab2monitorRgb(LabImage* lab, Image8* image)
 {
@@ -169,6 +184,8 @@ void ImProcFunctions::lab2monitorRgb(LabImage* lab, Image8* image)
             float *buffer = pBuf.data;
             float *outbuffer = gamutWarning ? mBuf.data : pBuf.data; // make in place transformations when gamutWarning is not needed
 
+            std::vector<int> exact; // the pixels of the row which monitorLut leaves to the transforms
+
 #ifdef _OPENMP
             #pragma omp for schedule(dynamic,16)
 #endif
@@ -182,17 +199,42 @@ void ImProcFunctions::lab2monitorRgb(LabImage* lab, Image8* image)
                 float* ra = lab->a[i];
                 float* rb = lab->b[i];
 
-                for (int j = 0; j < W; j++) {
-                    buffer[iy++] = rL[j] / 327.68f;
-                    buffer[iy++] = ra[j] / 327.68f;
-                    buffer[iy++] = rb[j] / 327.68f;
-                }
+                if (monitorLut) {
+                    exact.clear();
+                    monitorLut->apply(rL, ra, rb, data + ix, W, exact);
+
+                    const int count = exact.size();
+
+                    for (int k = 0; k < count; k++) {
+                        buffer[iy++] = rL[exact[k]] / 327.68f;
+                        buffer[iy++] = ra[exact[k]] / 327.68f;
+                        buffer[iy++] = rb[exact[k]] / 327.68f;
+                    }
+
+                    if (count > 0) {
+                        cmsDoTransform(monitorTransform, buffer, outbuffer, count);
 
-                cmsDoTransform(monitorTransform, buffer, outbuffer, W);
-                copyAndClampLine(outbuffer, data + ix, W);
+                        for (int k = 0; k < count; k++) {
+                            copyAndClampLine(outbuffer + 3 * k, data + ix + 3 * exact[k], 1);
+                        }
 
-                if (gamutWarning) {
-                    gamutWarning->markLine(image, i, buffer, gwBuf1.data, gwBuf2.data);
+                        if (gamutWarning) {
+                            gamutWarning->markPixels(image, i, exact.data(), buffer, gwBuf1.data, gwBuf2.data, count);
+                        }
+                    }
+                } else {
+                    for (int j = 0; j < W; j++) {
+                        buffer[iy++] = rL[j] / 327.68f;
+                        buffer[iy++] = ra[j] / 327.68f;
+                        buffer[iy++] = rb[j] / 327.68f;
+                    }
+
+                    cmsDoTransform(monitorTransform, buffer, outbuffer, W);
+                    copyAndClampLine(outbuffer, data + ix, W);
+
+                    if (gamutWarning) {
+                        gamutWarning->markLine(image, i, buffer, gwBuf1.data, gwBuf2.data);
+                    }
                 }
             }
         } // End of parallelization
@@ -245,52 +287,33 @@ Image8* ImProcFunctions::lab2rgb(LabImage* lab, int cx, int cy, int cw, int ch,
         oprof = ICCStore::getInstance()->getProfile(profile);
     }
 
+    std::shared_ptr<const ICCTransform> transform;
+
     if (oprof) {
         const cmsUInt32Number flags = cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE | (icm.outputBPC ? cmsFLAGS_BLACKPOINTCOMPENSATION : 0); // NOCACHE is important for thread safety
+        transform = ICCStore::getInstance()->getTransform(nullptr, TYPE_Lab_FLT, oprof, TYPE_RGB_FLT, icm.outputIntent, flags);
+    }
 
-        lcmsMutex->lock();
-        cmsHPROFILE LabIProf  = cmsCreateLab4Profile(nullptr);
-        cmsHTRANSFORM hTransform = cmsCreateTransform (LabIProf, TYPE_Lab_DBL, oprof, TYPE_RGB_FLT, icm.outputIntent, flags);
-        cmsCloseProfile(LabIProf);
-        lcmsMutex->unlock();
-
+    if (transform) {
         unsigned char *data = image->data;
 
-        // cmsDoTransform is relatively expensive
 #ifdef _OPENMP
-        #pragma omp parallel
+        #pragma omp parallel if (multiThread)
 #endif
         {
-            AlignedBuffer<double> pBuf(3 * cw);
-            AlignedBuffer<float> oBuf(3 * cw);
-            double *buffer = pBuf.data;
-            float *outbuffer = oBuf.data;
-            int condition = cy + ch;
+            AlignedBuffer<float> rBuf(cw);
+            AlignedBuffer<float> gBuf(cw);
+            AlignedBuffer<float> bBuf(cw);
 
 #ifdef _OPENMP
-            #pragma omp for firstprivate(lab) schedule(dynamic,16)
+            #pragma omp for schedule(dynamic,16)
 #endif
 
-            for (int i = cy; i < condition; i++) {
-                const int ix = i * 3 * cw;
-                int iy = 0;
-                float* rL = lab->L[i];
-                float* ra = lab->a[i];
-                float* rb = lab->b[i];
-
-                for (int j = cx; j < cx + cw; j++) {
-                    buffer[iy++] = rL[j] / 327.68f;
-                    buffer[iy++] = ra[j] / 327.68f;
-                    buffer[iy++] = rb[j] / 327.68f;
-                }
-
-                cmsDoTransform (hTransform, buffer, outbuffer, cw);
-                copyAndClampLine(outbuffer, data + ix, cw);
+            for (int i = cy; i < cy + ch; i++) {
+                transform->transform(lab->L[i] + cx, lab->a[i] + cx, lab->b[i] + cx, 1.f / 327.68f, rBuf.data, gBuf.data, bBuf.data, cw);
+                copyAndClampLine(rBuf.data, gBuf.data, bBuf.data, data + (i - cy) * 3 * cw, cw);
             }
         } // End of parallelization
-
-        cmsDeleteTransform(hTransform);
-
     } else {
         const auto xyz_rgb = ICCStore::getInstance()->workingSpaceInverseMatrix(profile);
         copyAndClamp(lab, image->data, xyz_rgb, multiThread);
@@ -337,6 +360,8 @@ Imagefloat* ImProcFunctions::lab2rgbOut(LabImage* lab, int cx, int cy, int cw, i
     Imagefloat* image = new Imagefloat(cw, ch);
     cmsHPROFILE oprof = ICCStore::getInstance()->getProfile(icm.outputProfile);
 
+    std::shared_ptr<const ICCTransform> transform;
+
     if (oprof) {
         cmsUInt32Number flags = cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE;
 
@@ -344,43 +369,61 @@ Imagefloat* ImProcFunctions::lab2rgbOut(LabImage* lab, int cx, int cy, int cw, i
             flags |= cmsFLAGS_BLACKPOINTCOMPENSATION;
         }
 
-        lcmsMutex->lock();
-        cmsHPROFILE iprof = cmsCreateLab4Profile(nullptr);
-        cmsHTRANSFORM hTransform = cmsCreateTransform(iprof, TYPE_Lab_FLT, oprof, TYPE_RGB_FLT, icm.outputIntent, flags);
-        lcmsMutex->unlock();
+        transform = ICCStore::getInstance()->getTransform(nullptr, TYPE_Lab_FLT, oprof, TYPE_RGB_FLT, icm.outputIntent, flags);
+    }
 
-        image->ExecCMSTransform(hTransform, *lab, cx, cy);
-        cmsDeleteTransform(hTransform);
+    if (transform) {
+        image->ExecCMSTransform(*transform, *lab, cx, cy);
         image->normalizeFloatTo65535();
     } else {
-        
+#ifdef __SSE2__
+        vfloat sRGB_xyzv[3][3];
+
+        for (int k = 0; k < 3; ++k) {
+            for (int l = 0; l < 3; ++l) {
+                sRGB_xyzv[k][l] = F2V(sRGB_xyz[k][l]);
+            }
+        }
+
+        const vfloat zerov = ZEROV;
+        const vfloat maxvalv = F2V(MAXVALF);
+#endif
+
 #ifdef _OPENMP
         #pragma omp parallel for schedule(dynamic,16) if (multiThread)
 #endif
 
         for (int i = cy; i < cy + ch; i++) {
-            float R, G, B;
-            float* rL = lab->L[i];
-            float* ra = lab->a[i];
-            float* rb = lab->b[i];
-
-            for (int j = cx; j < cx + cw; j++) {
-
-                float fy = (Color::c1By116 * rL[j]) / 327.68f + Color::c16By116; // (L+16)/116
-                float fx = (0.002f * ra[j]) / 327.68f + fy;
-                float fz = fy - (0.005f * rb[j]) / 327.68f;
-                float LL = rL[j] / 327.68f;
+            const float* rL = lab->L[i];
+            const float* ra = lab->a[i];
+            const float* rb = lab->b[i];
+            float* rR = image->r(i - cy);
+            float* rG = image->g(i - cy);
+            float* rB = image->b(i - cy);
+            int j = cx;
 
-                float x_ = 65535.0f * Color::f2xyz(fx) * Color::D50x;
-                //float y_ = 65535.0 * Color::f2xyz(fy);
-                float z_ = 65535.0f * Color::f2xyz(fz) * Color::D50z;
-                float y_ = (LL > (float)Color::epskap) ? 65535.0f * fy * fy * fy : 65535.0f * LL / (float)Color::kappa;
+#ifdef __SSE2__
+            for (; j < cx + cw - 3; j += 4) {
+                vfloat x_, y_, z_;
+                vfloat R, G, B;
+                Color::Lab2XYZ(LVFU(rL[j]), LVFU(ra[j]), LVFU(rb[j]), x_, y_, z_);
+                Color::xyz2rgb(x_, y_, z_, R, G, B, sRGB_xyzv);
+
+                STVFU(rR[j - cx], Color::gamma2curve[vclampf(R, zerov, maxvalv)]);
+                STVFU(rG[j - cx], Color::gamma2curve[vclampf(G, zerov, maxvalv)]);
+                STVFU(rB[j - cx], Color::gamma2curve[vclampf(B, zerov, maxvalv)]);
+            }
+#endif
 
+            for (; j < cx + cw; j++) {
+                float x_, y_, z_;
+                float R, G, B;
+                Color::Lab2XYZ(rL[j], ra[j], rb[j], x_, y_, z_);
                 Color::xyz2srgb(x_, y_, z_, R, G, B);
 
-                image->r(i - cy, j - cx) = Color::gamma2curve[CLIP(R)];
-                image->g(i - cy, j - cx) = Color::gamma2curve[CLIP(G)];
-                image->b(i - cy, j - cx) = Color::gamma2curve[CLIP(B)];
+                rR[j - cx] = Color::gamma2curve[CLIP(R)];
+                rG[j - cx] = Color::gamma2curve[CLIP(G)];
+                rB[j - cx] = Color::gamma2curve[CLIP(B)];
             }
         }
     }
@@ -26,10 +26,12 @@
 #include "improcfun.h"
 #include "colortemp.h"
 #include "curves.h"
+#include "fftwplancache.h"
 #include "gauss.h"
 #include "iccstore.h"
 #include "imagefloat.h"
 #include "labimage.h"
+#include "poissonsolver.h"
 #include "color.h"
 #include "rt_math.h"
 #include "jaggedarray.h"
@@ -439,12 +441,31 @@ vfloat gammalog(vfloat x, vfloat p, vfloat s, vfloat g3, vfloat g4)
     
 }
 #endif
+
+bool getBlockPlans(int ts, int max_numblox_W, int min_numblox_W, rtengine::FFTWPlanCache::Plan plan_forward_blox[2], rtengine::FFTWPlanCache::Plan plan_backward_blox[2])
+{
+    // the plans are cached, creating them with FFTW_MEASURE instead of FFTW_ESTIMATE speeds up the execute a bit
+    // if measuring fails, retry with FFTW_ESTIMATE before giving up
+    rtengine::FFTWPlanCache &planCache = rtengine::FFTWPlanCache::getInstance();
+
+    for (unsigned int flags : {FFTW_MEASURE | FFTW_DESTROY_INPUT, FFTW_ESTIMATE | FFTW_DESTROY_INPUT}) {
+        plan_forward_blox[0]  = planCache.getPlan(ts, ts, max_numblox_W, ts * ts, FFTW_REDFT10, flags);
+        plan_backward_blox[0] = planCache.getPlan(ts, ts, max_numblox_W, ts * ts, FFTW_REDFT01, flags);
+        plan_forward_blox[1]  = planCache.getPlan(ts, ts, min_numblox_W, ts * ts, FFTW_REDFT10, flags);
+        plan_backward_blox[1] = planCache.getPlan(ts, ts, min_numblox_W, ts * ts, FFTW_REDFT01, flags);
+
+        if (plan_forward_blox[0] && plan_backward_blox[0] && plan_forward_blox[1] && plan_backward_blox[1]) {
+            return true;
+        }
+    }
+
+    return false;
+}
 }
 
 namespace rtengine
 
 {
-extern MyMutex *fftwMutex;
 
 using namespace procparams;
 
@@ -1860,6 +1881,73 @@ static void calcTransition(const float lox, const float loy, const float ach, co
     }
 }
 
+// Bounding box of the spot (selection and transition zone) in the coordinates of an image of size W x H at position cx, cy.
+// calcTransition() and calcTransitionrect() return zone 0 for every pixel outside of it, so the tools which blend
+// into the full image only have to allocate and process this rectangle.
+struct SpotRect {
+    int xstart;
+    int ystart;
+    int xend;
+    int yend;
+
+    int width() const
+    {
+        return xend - xstart;
+    }
+
+    int height() const
+    {
+        return yend - ystart;
+    }
+};
+
+static SpotRect calcSpotRect(const local_params& lp, int cx, int cy, int W, int H, int margin = 0)
+{
+    SpotRect rect;
+    rect.xstart = rtengine::max(static_cast<int>(std::floor(lp.xc - lp.lxL)) - cx - margin, 0);
+    rect.ystart = rtengine::max(static_cast<int>(std::floor(lp.yc - lp.lyT)) - cy - margin, 0);
+    rect.xend = rtengine::LIM(static_cast<int>(std::ceil(lp.xc + lp.lx)) - cx + margin, rect.xstart, W);
+    rect.yend = rtengine::LIM(static_cast<int>(std::ceil(lp.yc + lp.ly)) - cy + margin, rect.ystart, H);
+    return rect;
+}
+
+// blurs the part of src inside rect into dst, which has the size of rect
+static void gaussianBlurRect(const LabImage* src, LabImage* dst, const SpotRect& rect, float radius, bool multiThread)
+{
+    const int bfw = rect.width();
+    const int bfh = rect.height();
+
+    if (bfw <= 0 || bfh <= 0) {
+        return;
+    }
+
+    const std::unique_ptr<float*[]> rows(new float*[3 * bfh]);
+    float** const srcL = rows.get();
+    float** const srca = srcL + bfh;
+    float** const srcb = srca + bfh;
+
+    for (int y = 0; y < bfh; ++y) {
+        srcL[y] = src->L[rect.ystart + y] + rect.xstart;
+        srca[y] = src->a[rect.ystart + y] + rect.xstart;
+        srcb[y] = src->b[rect.ystart + y] + rect.xstart;
+    }
+
+#ifdef _OPENMP
+    #pragma omp parallel if (multiThread)
+#endif
+    {
+        gaussianBlur(srcL, dst->L, bfw, bfh, radius);
+        gaussianBlur(srca, dst->a, bfw, bfh, radius);
+        gaussianBlur(srcb, dst->b, bfw, bfh, radius);
+    }
+}
+
+// margin around the spot for the blurred copies used by deltaE, so that the border of the blur does not reach the spot
+static int blurMargin(float radius)
+{
+    return static_cast<int>(std::ceil(3.f * radius));
+}
+
 // Copyright 2018 Alberto Griggio <alberto.griggio@gmail.com>
 
 float find_gray(float source_gray, float target_gray)
@@ -3830,6 +3918,7 @@ if(mocam == 0 || mocam == 1  || call == 1  || call == 2 || call == 10) {//call=2
             // vectorized conversion from Lab to jchqms
                 int k;
                 vfloat c655d35 = F2V(655.35f);
+                const vfloat c65535 = F2V(65535.f);
 
                 for (k = 0; k < width - 3; k += 4) {
                     vfloat x, y, z;
@@ -4094,26 +4183,13 @@ if(mocam == 0 || mocam == 1  || call == 1  || call == 2 || call == 10) {//call=2
                                                 LVF(Jbuffer[k]), LVF(Cbuffer[k]), LVF(hbuffer[k]),
                                                 F2V(xw2), F2V(yw2), F2V(zw2),
                                                 F2V(nc2), F2V(pow1n), F2V(nbbj), F2V(ncbj), F2V(flj), F2V(dj), F2V(awj), F2V(reccmcz), c16, F2V(plum));
-                    STVF(xbuffer[k], x * c655d35);
-                    STVF(ybuffer[k], y * c655d35);
-                    STVF(zbuffer[k], z * c655d35);
+                    STVF(xbuffer[k], vclampf(x * c655d35, ZEROV, c65535));
+                    STVF(ybuffer[k], vclampf(y * c655d35, ZEROV, c65535));
+                    STVF(zbuffer[k], vclampf(z * c655d35, ZEROV, c65535));
                 }
 
-                // XYZ2Lab uses a lookup table. The function behind that lut is a cube root.
-                // SSE can't beat the speed of that lut, so it doesn't make sense to use SSE
-                for (int j = 0; j < width; j++) {
-                    float Ll, aa, bb;
-                    //convert xyz=>lab
-                    xbuffer[j] = CLIP(xbuffer[j]);
-                    ybuffer[j] = CLIP(ybuffer[j]);
-                    zbuffer[j] = CLIP(zbuffer[j]);
-                   
-                    Color::XYZ2Lab(xbuffer[j], ybuffer[j], zbuffer[j], Ll, aa, bb);
-
-                    lab->L[i][j] = Ll;
-                    lab->a[i][j] = aa;
-                    lab->b[i][j] = bb;
-                }
+                //convert xyz=>lab
+                Color::XYZ2Lab(xbuffer, ybuffer, zbuffer, lab->L[i], lab->a[i], lab->b[i], width);
 
 #endif
             }
@@ -4610,7 +4686,6 @@ void ImProcFunctions::exlabLocal(local_params& lp, float strlap, int bfh, int bf
                 }
             }
 
-            MyMutex::MyLock lock(*fftwMutex);
             ImProcFunctions::retinex_pde(datain.get(), dataout.get(), bfwr, bfhr, lap, 1.f, dE.get(), 0, 1, 1);//350 arbitrary value about 45% strength Laplacian
 #ifdef _OPENMP
         #pragma omp parallel for schedule(dynamic,16) if (multiThread)
@@ -4760,28 +4835,11 @@ void ImProcFunctions::DeNoise_Local(int call, const struct local_params& lp, Lab
     const bool blshow = lp.showmaskblmet == 1 || lp.showmaskblmet == 2;
     const bool previewbl = lp.showmaskblmet == 4;
 
-    const std::unique_ptr<LabImage> origblur(new LabImage(GW, GH));
     const float radius = 3.f / sk;
-
-    if (usemaskbl) {
-#ifdef _OPENMP
-        #pragma omp parallel if (multiThread)
-#endif
-        {
-            gaussianBlur(originalmask->L, origblur->L, GW, GH, radius);
-            gaussianBlur(originalmask->a, origblur->a, GW, GH, radius);
-            gaussianBlur(originalmask->b, origblur->b, GW, GH, radius);
-        }
-    } else {
-#ifdef _OPENMP
-        #pragma omp parallel if (multiThread)
-#endif
-        {
-            gaussianBlur(original->L, origblur->L, GW, GH, radius);
-            gaussianBlur(original->a, origblur->a, GW, GH, radius);
-            gaussianBlur(original->b, origblur->b, GW, GH, radius);
-        }
-    }
+    const SpotRect spot = calcSpotRect(lp, cx, cy, GW, GH);
+    const SpotRect blurRect = calcSpotRect(lp, cx, cy, GW, GH, blurMargin(radius));
+    const std::unique_ptr<LabImage> origblur(new LabImage(blurRect.width(), blurRect.height()));
+    gaussianBlurRect(usemaskbl ? originalmask : original, origblur.get(), blurRect, radius, multiThread);
 
     const int begx = lp.xc - lp.lxL;
     const int begy = lp.yc - lp.lyT;
@@ -4800,15 +4858,12 @@ void ImProcFunctions::DeNoise_Local(int call, const struct local_params& lp, Lab
 #ifdef _OPENMP
         #pragma omp for schedule(dynamic,16)
 #endif
-        for (int y = 0; y < transformed->H; y++) {
+        for (int y = spot.ystart; y < spot.yend; y++) {
             const int loy = cy + y;
-            const bool isZone0 = loy > lp.yc + lp.ly || loy < lp.yc - lp.lyT; // whole line is zone 0 => we can skip a lot of processing
-
-            if (isZone0) { // outside selection and outside transition zone => no effect, keep original values
-                continue;
-            }
+            const int by = y - blurRect.ystart;
 
-            for (int x = 0, lox = cx + x; x < transformed->W; x++, lox++) {
+            for (int x = spot.xstart, lox = cx + x; x < spot.xend; x++, lox++) {
+                const int bx = x - blurRect.xstart;
                 int zone;
                 float localFactor = 1.f;
 
@@ -4827,9 +4882,9 @@ void ImProcFunctions::DeNoise_Local(int call, const struct local_params& lp, Lab
                 float reducdEb = 1.f;
 
                 if (levred == 7) {
-                    const float dEL = std::sqrt(0.9f * SQR(refa - maskptr->a[y][x]) + 0.9f * SQR(refb - maskptr->b[y][x]) + 1.2f * SQR(lumaref - maskptr->L[y][x])) * r327d68;
-                    const float dEa = std::sqrt(1.2f * SQR(refa - maskptr->a[y][x]) + 1.f * SQR(refb - maskptr->b[y][x]) + 0.8f * SQR(lumaref - maskptr->L[y][x])) * r327d68;
-                    const float dEb = std::sqrt(1.f * SQR(refa - maskptr->a[y][x]) + 1.2f * SQR(refb - maskptr->b[y][x]) + 0.8f * SQR(lumaref - maskptr->L[y][x])) * r327d68;
+                    const float dEL = std::sqrt(0.9f * SQR(refa - maskptr->a[by][bx]) + 0.9f * SQR(refb - maskptr->b[by][bx]) + 1.2f * SQR(lumaref - maskptr->L[by][bx])) * r327d68;
+                    const float dEa = std::sqrt(1.2f * SQR(refa - maskptr->a[by][bx]) + 1.f * SQR(refb - maskptr->b[by][bx]) + 0.8f * SQR(lumaref - maskptr->L[by][bx])) * r327d68;
+                    const float dEb = std::sqrt(1.f * SQR(refa - maskptr->a[by][bx]) + 1.2f * SQR(refb - maskptr->b[by][bx]) + 0.8f * SQR(lumaref - maskptr->L[by][bx])) * r327d68;
                     reducdEL = SQR(calcreducdE(dEL, maxdE, mindE, maxdElim, mindElim, lp.iterat, limscope, lp.sensden));
                     reducdEa = SQR(calcreducdE(dEa, maxdE, mindE, maxdElim, mindElim, lp.iterat, limscope, lp.sensden));
                     reducdEb = SQR(calcreducdE(dEb, maxdE, mindE, maxdElim, mindElim, lp.iterat, limscope, lp.sensden));
@@ -4914,28 +4969,10 @@ void ImProcFunctions::DeNoise_Local2(const struct local_params& lp, LabImage* or
     const bool blshow = lp.showmaskblmet == 1 || lp.showmaskblmet == 2;
     const bool previewbl = lp.showmaskblmet == 4;
 
-    const std::unique_ptr<LabImage> origblur(new LabImage(GW, GH));
     const float radius = 3.f / sk;
-
-    if (usemaskbl) {
-#ifdef _OPENMP
-        #pragma omp parallel if (multiThread)
-#endif
-        {
-            gaussianBlur(originalmask->L, origblur->L, GW, GH, radius);
-            gaussianBlur(originalmask->a, origblur->a, GW, GH, radius);
-            gaussianBlur(originalmask->b, origblur->b, GW, GH, radius);
-        }
-    } else {
-#ifdef _OPENMP
-        #pragma omp parallel if (multiThread)
-#endif
-        {
-            gaussianBlur(original->L, origblur->L, GW, GH, radius);
-            gaussianBlur(original->a, origblur->a, GW, GH, radius);
-            gaussianBlur(original->b, origblur->b, GW, GH, radius);
-        }
-    }
+    const SpotRect blurRect = calcSpotRect(lp, cx, cy, GW, GH, blurMargin(radius));
+    const std::unique_ptr<LabImage> origblur(new LabImage(blurRect.width(), blurRect.height()));
+    gaussianBlurRect(usemaskbl ? originalmask : original, origblur.get(), blurRect, radius, multiThread);
 
  //   const int begx = lp.xc - lp.lxL;
  //   const int begy = lp.yc - lp.lyT;
@@ -4957,6 +4994,7 @@ void ImProcFunctions::DeNoise_Local2(const struct local_params& lp, LabImage* or
 
         for (int y = ystart; y < yend; y++) {
             const int loy = cy + y;
+            const int by = y - blurRect.ystart;
 //            const bool isZone0 = loy > lp.yc + lp.ly || loy < lp.yc - lp.lyT; // whole line is zone 0 => we can skip a lot of processing
 
 //            if (isZone0) { // outside selection and outside transition zone => no effect, keep original values
@@ -4964,6 +5002,7 @@ void ImProcFunctions::DeNoise_Local2(const struct local_params& lp, LabImage* or
  //           }
 
             for (int x = xstart, lox = cx + x; x < xend; x++, lox++) {
+                const int bx = x - blurRect.xstart;
                 int zone;
                 float localFactor = 1.f;
 
@@ -4982,9 +5021,9 @@ void ImProcFunctions::DeNoise_Local2(const struct local_params& lp, LabImage* or
                 float reducdEb = 1.f;
 
                 if (levred == 7) {
-                    const float dEL = std::sqrt(0.9f * SQR(refa - maskptr->a[y][x]) + 0.9f * SQR(refb - maskptr->b[y][x]) + 1.2f * SQR(lumaref - maskptr->L[y][x])) * r327d68;
-                    const float dEa = std::sqrt(1.2f * SQR(refa - maskptr->a[y][x]) + 1.f * SQR(refb - maskptr->b[y][x]) + 0.8f * SQR(lumaref - maskptr->L[y][x])) * r327d68;
-                    const float dEb = std::sqrt(1.f * SQR(refa - maskptr->a[y][x]) + 1.2f * SQR(refb - maskptr->b[y][x]) + 0.8f * SQR(lumaref - maskptr->L[y][x])) * r327d68;
+                    const float dEL = std::sqrt(0.9f * SQR(refa - maskptr->a[by][bx]) + 0.9f * SQR(refb - maskptr->b[by][bx]) + 1.2f * SQR(lumaref - maskptr->L[by][bx])) * r327d68;
+                    const float dEa = std::sqrt(1.2f * SQR(refa - maskptr->a[by][bx]) + 1.f * SQR(refb - maskptr->b[by][bx]) + 0.8f * SQR(lumaref - maskptr->L[by][bx])) * r327d68;
+                    const float dEb = std::sqrt(1.f * SQR(refa - maskptr->a[by][bx]) + 1.2f * SQR(refb - maskptr->b[by][bx]) + 0.8f * SQR(lumaref - maskptr->L[by][bx])) * r327d68;
                     reducdEL = SQR(calcreducdE(dEL, maxdE, mindE, maxdElim, mindElim, lp.iterat, limscope, lp.sensden));
                     reducdEa = SQR(calcreducdE(dEa, maxdE, mindE, maxdElim, mindElim, lp.iterat, limscope, lp.sensden));
                     reducdEb = SQR(calcreducdE(dEb, maxdE, mindE, maxdElim, mindElim, lp.iterat, limscope, lp.sensden));
@@ -5835,80 +5874,6 @@ void ImProcFunctions::discrete_laplacian_threshold(float * data_out, const float
 
 }
 
-float *ImProcFunctions::cos_table(size_t size)
-{
-    float *table = NULL;
-
-    /* allocate the cosinus table */
-    if (NULL == (table = (float *) malloc(sizeof(*table) * size))) {
-        fprintf(stderr, "allocation error\n");
-        abort();
-    }
-
-    /*
-     * fill the cosinus table,
-     * table[i] = cos(i Pi / n) for i in [0..n[
-     */
-    const double pi_size = rtengine::RT_PI / size;
-
-    for (size_t i = 0; i < size; i++) {
-        table[i] = 1.0 - std::cos(pi_size * i);
-    }
-
-    return table;
-}
-
-
-void ImProcFunctions::rex_poisson_dct(float * data, size_t nx, size_t ny, double m)
-{
-    /*
-     * Copyright 2009-2011 IPOL Image Processing On Line http://www.ipol.im/
-     *
-
-     * @file retinex_pde_lib.c discrete Poisson equation
-     * @brief laplacian, DFT and Poisson routines
-     *
-     * @author Nicolas Limare <nicolas.limare@cmla.ens-cachan.fr>
-     * some adaptations for Rawtherapee
-     */
-   // BENCHFUN
-
-    /*
-     * get the cosinus tables
-     * cosx[i] = cos(i Pi / nx) for i in [0..nx[
-     * cosy[i] = cos(i Pi / ny) for i in [0..ny[
-     */
-
-    float* cosx = cos_table(nx);
-    float* cosy = cos_table(ny);
-
-    /*
-     * we will now multiply data[i, j] by
-     * m / (4 - 2 * cosx[i] - 2 * cosy[j]))
-     * and set data[0, 0] to 0
-     */
-    float m2 = m / 2.;
-    /*
-     * after that, by construction, we always have
-     * cosx[] + cosy[] != 2.
-    */
-
-#ifdef _OPENMP
-    #pragma omp parallel for if (multiThread)
-#endif
-    for (size_t i = 0; i < ny; ++i) {
-        for (size_t j = 0; j < nx; ++j) {
-            data[i * nx + j] *= m2 / (cosx[j] + cosy[i]);
-        }
-    }
-    // handle the first value, data[0, 0] = 0
-    data[0] = 0.f;
-
-    free(cosx);
-    free(cosy);
-
-}
-
 void ImProcFunctions::mean_dt(const float* data, size_t size, double& mean_p, double& dt_p)
 {
 
@@ -5998,13 +5963,6 @@ void ImProcFunctions::retinex_pde(const float * datain, float * dataout, int bfw
 
    // BENCHFUN
    
-#ifdef RT_FFTW3F_OMP
-    if (multiThread) {
-        fftwf_init_threads();
-        fftwf_plan_with_nthreads(omp_get_max_threads());
-    }
-#endif
-
     float *datashow = nullptr;
     if (show != 0) {
         datashow = (float *) fftwf_malloc(sizeof(float) * bfw * bfh);
@@ -6023,12 +5981,6 @@ void ImProcFunctions::retinex_pde(const float * datain, float * dataout, int bfw
     //first call to laplacian with plein strength
     discrete_laplacian_threshold(data_tmp, datain, bfw, bfh, thresh);
 
-    float *data_fft = (float *) fftwf_malloc(sizeof(float) * bfw * bfh);
-    if (!data_fft) {
-        fprintf(stderr, "allocation error\n");
-        abort();
-    }
-
     if (show == 1) {
         for (int y = 0; y < bfh ; y++) {
             for (int x = 0; x < bfw; x++) {
@@ -6037,75 +5989,88 @@ void ImProcFunctions::retinex_pde(const float * datain, float * dataout, int bfw
         }
     }
 
-    //execute first
-    const auto dct_fw = fftwf_plan_r2r_2d(bfh, bfw, data_tmp, data_fft, FFTW_REDFT10, FFTW_REDFT10, FFTW_ESTIMATE | FFTW_DESTROY_INPUT);
-    fftwf_execute(dct_fw);
-    fftwf_destroy_plan(dct_fw);
+    /* solve the Poisson PDE, 4 keeps the scale of the IPOL code: 1 / (bfw * bfh) with the unnormalized DCT */
+    const PoissonSolver solver(bfw, bfh, PoissonSolver::Boundary::HALF_SAMPLE, multiThread);
+    bool solved = true;
 
-    //execute second
-    if (dEenable == 1) {
-        float* data_fft04 = (float *)fftwf_malloc(sizeof(float) * bfw * bfh);
-        float* data_tmp04 = (float *)fftwf_malloc(sizeof(float) * bfw * bfh);
-        if (!data_fft04 || !data_tmp04) {
+    if (dEenable != 1 && show != 2 && show != 3) {
+        solved = solver.solve(data_tmp, 4.);
+    } else {
+        float *data_fft = (float *) fftwf_malloc(sizeof(float) * bfw * bfh);
+        if (!data_fft) {
             fprintf(stderr, "allocation error\n");
             abort();
         }
-        //second call to laplacian with 40% strength ==> reduce effect if we are far from ref (deltaE)
-        discrete_laplacian_threshold(data_tmp04, datain, bfw, bfh, 0.4f * thresh);
-        const auto dct_fw04 = fftwf_plan_r2r_2d(bfh, bfw, data_tmp04, data_fft04, FFTW_REDFT10, FFTW_REDFT10, FFTW_ESTIMATE | FFTW_DESTROY_INPUT);
-        fftwf_execute(dct_fw04);
-        fftwf_destroy_plan(dct_fw04);
-        constexpr float exponent = 4.5f;
+
+        //execute first
+        solved = solver.forward(data_tmp, data_fft);
+
+        //execute second
+        if (dEenable == 1) {
+            float* data_fft04 = (float *)fftwf_malloc(sizeof(float) * bfw * bfh);
+            float* data_tmp04 = (float *)fftwf_malloc(sizeof(float) * bfw * bfh);
+            if (!data_fft04 || !data_tmp04) {
+                fprintf(stderr, "allocation error\n");
+                abort();
+            }
+            //second call to laplacian with 40% strength ==> reduce effect if we are far from ref (deltaE)
+            discrete_laplacian_threshold(data_tmp04, datain, bfw, bfh, 0.4f * thresh);
+            solved = solver.forward(data_tmp04, data_fft04) && solved;
+            constexpr float exponent = 4.5f;
 
 #ifdef _OPENMP
-        #pragma omp parallel if (multiThread)
+            #pragma omp parallel if (multiThread)
 #endif
-        {
+            {
 #ifdef __SSE2__
-            const vfloat exponentv = F2V(exponent);
+                const vfloat exponentv = F2V(exponent);
 #endif
 #ifdef _OPENMP
-            #pragma omp for
+                #pragma omp for
 #endif
-            for (int y = 0; y < bfh ; y++) {//mix two fftw Laplacian : plein if dE near ref
-                int x = 0;
+                for (int y = 0; y < bfh ; y++) {//mix two fftw Laplacian : plein if dE near ref
+                    int x = 0;
 #ifdef __SSE2__
-                for (; x < bfw - 3; x += 4) {
-                    STVFU(data_fft[y * bfw + x], intp(pow_F(LVFU(dE[y * bfw + x]), exponentv), LVFU(data_fft[y * bfw + x]), LVFU(data_fft04[y * bfw + x])));
-                }
+                    for (; x < bfw - 3; x += 4) {
+                        STVFU(data_fft[y * bfw + x], intp(pow_F(LVFU(dE[y * bfw + x]), exponentv), LVFU(data_fft[y * bfw + x]), LVFU(data_fft04[y * bfw + x])));
+                    }
 #endif
-                for (; x < bfw; x++) {
-                    data_fft[y * bfw + x] = intp(pow_F(dE[y * bfw + x], exponent), data_fft[y * bfw + x], data_fft04[y * bfw + x]);
+                    for (; x < bfw; x++) {
+                        data_fft[y * bfw + x] = intp(pow_F(dE[y * bfw + x], exponent), data_fft[y * bfw + x], data_fft04[y * bfw + x]);
+                    }
                 }
             }
+            fftwf_free(data_fft04);
+            fftwf_free(data_tmp04);
         }
-        fftwf_free(data_fft04);
-        fftwf_free(data_tmp04);
-    }
-    if (show == 2) {
-        for (int y = 0; y < bfh ; y++) {
-            for (int x = 0; x < bfw; x++) {
-                datashow[y * bfw + x] = data_fft[y * bfw + x];
+        if (show == 2) {
+            for (int y = 0; y < bfh ; y++) {
+                for (int x = 0; x < bfw; x++) {
+                    datashow[y * bfw + x] = data_fft[y * bfw + x];
+                }
             }
         }
-    }
 
-    /* solve the Poisson PDE in Fourier space */
-    /* 1. / (float) (bfw * bfh)) is the DCT normalisation term, see libfftw */
-    rex_poisson_dct(data_fft, bfw, bfh, 1. / (double)(bfw * bfh));
+        /* solve the Poisson PDE in Fourier space */
+        solver.divide(data_fft, 4.);
 
-    if (show == 3) {
-        for (int y = 0; y < bfh ; y++) {
-            for (int x = 0; x < bfw; x++) {
-                datashow[y * bfw + x] = data_fft[y * bfw + x];
+        if (show == 3) {
+            for (int y = 0; y < bfh ; y++) {
+                for (int x = 0; x < bfw; x++) {
+                    datashow[y * bfw + x] = data_fft[y * bfw + x];
+                }
             }
         }
+
+        solved = solved && solver.backward(data_fft, data_tmp);
+        fftwf_free(data_fft);
     }
 
-    const auto dct_bw = fftwf_plan_r2r_2d(bfh, bfw, data_fft, data_tmp, FFTW_REDFT01, FFTW_REDFT01, FFTW_ESTIMATE | FFTW_DESTROY_INPUT);
-    fftwf_execute(dct_bw);
-    fftwf_destroy_plan(dct_bw);
-    fftwf_free(data_fft);
+    if (!solved) {
+        // no fftw plan for this size, the Laplacian is left out
+        fprintf(stderr, "retinex_pde: fftw planning failed for %d x %d\n", bfw, bfh);
+        std::copy(datain, datain + bfw * bfh, data_tmp);
+    }
 
     if (show != 4 && normalize == 1) {
         normalize_mean_dt(data_tmp, datain, bfw * bfh, 1.f, 1.f, 0.f, 0.f, 0.f, 0.f);
@@ -6133,13 +6098,6 @@ void ImProcFunctions::retinex_pde(const float * datain, float * dataout, int bfw
     if (datashow) {
         fftwf_free(datashow);
     }
-    fftwf_cleanup();
-
-#ifdef RT_FFTW3F_OMP
-    if (multiThread) {
-        fftwf_cleanup_threads();
-    }
-#endif
 }
 
 void ImProcFunctions::maskcalccol(bool invmask, bool pde, int bfw, int bfh, int xstart, int ystart, int sk, int cx, int cy, LabImage* bufcolorig, LabImage* bufmaskblurcol, LabImage* originalmaskcol, LabImage* original, LabImage* reserved, int inv, struct local_params & lp,
@@ -7028,20 +6986,15 @@ void ImProcFunctions::Sharp_Local(int call, float **loctemp, int senstype, const
     const int GW = transformed->W;
     const int GH = transformed->H;
 
-    const std::unique_ptr<LabImage> origblur(new LabImage(GW, GH));
     const float refa = chromaref * cos(hueref) * 327.68f;
     const float refb = chromaref * sin(hueref) * 327.68f;
     const float refL = lumaref * 327.68f;
     const float radius = 3.f / sk;
 
-#ifdef _OPENMP
-    #pragma omp parallel if (multiThread)
-#endif
-    {
-        gaussianBlur(original->L, origblur->L, GW, GH, radius);
-        gaussianBlur(original->a, origblur->a, GW, GH, radius);
-        gaussianBlur(original->b, origblur->b, GW, GH, radius);
-    }
+    const SpotRect spot = calcSpotRect(lp, cx, cy, GW, GH);
+    const SpotRect blurRect = calcSpotRect(lp, cx, cy, GW, GH, blurMargin(radius));
+    const std::unique_ptr<LabImage> origblur(new LabImage(blurRect.width(), blurRect.height()));
+    gaussianBlurRect(original, origblur.get(), blurRect, radius, multiThread);
 
 #ifdef _OPENMP
     #pragma omp parallel if (multiThread)
@@ -7056,16 +7009,13 @@ void ImProcFunctions::Sharp_Local(int call, float **loctemp, int senstype, const
 #ifdef _OPENMP
         #pragma omp for schedule(dynamic,16)
 #endif
-        for (int y = 0; y < transformed->H; y++) {
+        for (int y = spot.ystart; y < spot.yend; y++) {
             const int loy = cy + y;
-            const bool isZone0 = loy > lp.yc + lp.ly || loy < lp.yc - lp.lyT; // whole line is zone 0 => we can skip a lot of processing
-
-            if (isZone0) { // outside selection and outside transition zone => no effect, keep original values
-                continue;
-            }
+            const int by = y - blurRect.ystart;
 
-            for (int x = 0; x < transformed->W; x++) {
+            for (int x = spot.xstart; x < spot.xend; x++) {
                 const int lox = cx + x;
+                const int bx = x - blurRect.xstart;
                 int zone;
                 float localFactor = 1.f;
 
@@ -7080,10 +7030,10 @@ void ImProcFunctions::Sharp_Local(int call, float **loctemp, int senstype, const
                 }
 
                 //deltaE
-                const float abdelta2 = SQR(refa - origblur->a[y][x]) + SQR(refb - origblur->b[y][x]);
-                const float chrodelta2 = SQR(std::sqrt(SQR(origblur->a[y][x]) + SQR(origblur->b[y][x])) - (chromaref * 327.68f));
+                const float abdelta2 = SQR(refa - origblur->a[by][bx]) + SQR(refb - origblur->b[by][bx]);
+                const float chrodelta2 = SQR(std::sqrt(SQR(origblur->a[by][bx]) + SQR(origblur->b[by][bx])) - (chromaref * 327.68f));
                 const float huedelta2 = abdelta2 - chrodelta2;
-                const float dE = std::sqrt(kab * (kch * chrodelta2 + kH * huedelta2) + kL * SQR(refL - origblur->L[y][x]));
+                const float dE = std::sqrt(kab * (kch * chrodelta2 + kH * huedelta2) + kL * SQR(refL - origblur->L[by][bx]));
 
                 float reducdE = calcreducdE(dE, maxdE, mindE, maxdElim, mindElim, lp.iterat, limscope, varsens);
                 const float reducview = reducdE;
@@ -7153,21 +7103,16 @@ void ImProcFunctions::Exclude_Local(float **deltaso, float hueref, float chromar
 
         sobelref = log1p(sobelref);
 
-        const std::unique_ptr<LabImage> origblur(new LabImage(GW, GH));
-
         const float radius = 3.f / sk;
+        const SpotRect blurRect = calcSpotRect(lp, cx, cy, GW, GH, blurMargin(radius));
+        const std::unique_ptr<LabImage> origblur(new LabImage(blurRect.width(), blurRect.height()));
+        gaussianBlurRect(reserv, origblur.get(), blurRect, radius, multiThread);
 
 #ifdef _OPENMP
         #pragma omp parallel if (multiThread)
 #endif
         {
-            gaussianBlur(reserv->L, origblur->L, GW, GH, radius);
-            gaussianBlur(reserv->a, origblur->a, GW, GH, radius);
-            gaussianBlur(reserv->b, origblur->b, GW, GH, radius);
-
-
 #ifdef _OPENMP
-            #pragma omp barrier
             #pragma omp for schedule(dynamic,16)
 #endif
             for (int y = 0; y < transformed->H; y++)
@@ -7233,11 +7178,13 @@ void ImProcFunctions::Exclude_Local(float **deltaso, float hueref, float chromar
                         }
                     }
 
-                    float abdelta2 = SQR(refa - origblur->a[y][x]) + SQR(refb - origblur->b[y][x]);
-                    float chrodelta2 = SQR(std::sqrt(SQR(origblur->a[y][x]) + SQR(origblur->b[y][x])) - (chromaref * 327.68f));
+                    const int by = y - blurRect.ystart;
+                    const int bx = x - blurRect.xstart;
+                    float abdelta2 = SQR(refa - origblur->a[by][bx]) + SQR(refb - origblur->b[by][bx]);
+                    float chrodelta2 = SQR(std::sqrt(SQR(origblur->a[by][bx]) + SQR(origblur->b[by][bx])) - (chromaref * 327.68f));
                     float huedelta2 = abdelta2 - chrodelta2;
-                    const float dE = std::sqrt(kab * (kch * chrodelta2 + kH * huedelta2) + kL * SQR(refL - origblur->L[y][x]));
-                    const float rL = origblur->L[y][x];
+                    const float dE = std::sqrt(kab * (kch * chrodelta2 + kH * huedelta2) + kL * SQR(refL - origblur->L[by][bx]));
+                    const float rL = origblur->L[by][bx];
                     const float reducdE = calcreducdE(dE, maxdE, mindE, maxdElim, mindElim, lp.iterat, limscope, varsens);
 
                     if (rL > 32.768f) { //to avoid crash with very low gamut in rare cases ex : L=0.01 a=0.5 b=-0.9
@@ -7308,8 +7255,9 @@ void ImProcFunctions::transit_shapedetect_retinex(int call, int senstype, LabIma
 */
         const bool showmas = lp.showmaskretimet == 3 ;
 
-        const std::unique_ptr<LabImage> origblur(new LabImage(GW, GH));
         const float radius = 3.f / sk;
+        const SpotRect blurRect = calcSpotRect(lp, cx, cy, GW, GH, blurMargin(radius));
+        const std::unique_ptr<LabImage> origblur(new LabImage(blurRect.width(), blurRect.height()));
         const bool usemaskreti = lp.enaretiMask && senstype == 4 && !lp.enaretiMasktmap;
         float strcli = 0.03f * lp.str;
 
@@ -7317,14 +7265,7 @@ void ImProcFunctions::transit_shapedetect_retinex(int call, int senstype, LabIma
             strcli = 0.015f * lp.str;
         }
 
-#ifdef _OPENMP
-        #pragma omp parallel
-#endif
-        {
-            gaussianBlur(original->L, origblur->L, GW, GH, radius);
-            gaussianBlur(original->a, origblur->a, GW, GH, radius);
-            gaussianBlur(original->b, origblur->b, GW, GH, radius);
-        }
+        gaussianBlurRect(original, origblur.get(), blurRect, radius, multiThread);
 
 
 #ifdef _OPENMP
@@ -7360,17 +7301,19 @@ void ImProcFunctions::transit_shapedetect_retinex(int call, int senstype, LabIma
                         continue;
                     }
 
-                    float rL = origblur->L[y][x] / 327.68f;
+                    const int by = y - blurRect.ystart;
+                    const int bx = x - blurRect.xstart;
+                    float rL = origblur->L[by][bx] / 327.68f;
                     float dE;
                     float abdelta2 = 0.f;
                     float chrodelta2 = 0.f;
                     float huedelta2 = 0.f;
 
                     if (!usemaskreti) {
-                        abdelta2 = SQR(refa - origblur->a[y][x]) + SQR(refb - origblur->b[y][x]);
-                        chrodelta2 = SQR(std::sqrt(SQR(origblur->a[y][x]) + SQR(origblur->b[y][x])) - (chromaref * 327.68f));
+                        abdelta2 = SQR(refa - origblur->a[by][bx]) + SQR(refb - origblur->b[by][bx]);
+                        chrodelta2 = SQR(std::sqrt(SQR(origblur->a[by][bx]) + SQR(origblur->b[by][bx])) - (chromaref * 327.68f));
                         huedelta2 = abdelta2 - chrodelta2;
-                        dE = std::sqrt(kab * (kch * chrodelta2 + kH * huedelta2) + kL * SQR(refL - origblur->L[y][x]));
+                        dE = std::sqrt(kab * (kch * chrodelta2 + kH * huedelta2) + kL * SQR(refL - origblur->L[by][bx]));
                     } else {
                         if (call == 2) {
                             abdelta2 = SQR(refa - buforigmas->a[y - ystart][x - xstart]) + SQR(refb - buforigmas->b[y - ystart][x - xstart]);
@@ -8202,7 +8145,7 @@ void ImProcFunctions::calc_ref(int sp, LabImage * original, LabImage * transform
                     aveLblur += static_cast<double>(blurorig->L[y][x]);
                     aveAblur += static_cast<double>(blurorig->a[y][x]);
                     aveBblur += static_cast<double>(blurorig->b[y][x]);
-                    aveChroblur += static_cast<double>(std::sqrt(SQR(blurorig->b[y - cy][x - cx]) + SQR(blurorig->a[y - cy][x - cx])));
+                    aveChroblur += static_cast<double>(std::sqrt(SQR(blurorig->b[y][x]) + SQR(blurorig->a[y][x])));
                     nsb++;
 
                 }
@@ -8476,37 +8419,15 @@ void ImProcFunctions::BlurNoise_Local(LabImage *tmp1, LabImage * originalmask, c
     const bool usemaskbl = lp.showmaskblmet == 2 || lp.enablMask || lp.showmaskblmet == 4;
     const bool usemaskall = usemaskbl;
     const float radius = 3.f / sk;
-    std::unique_ptr<LabImage> origblurmask;
-
-    const std::unique_ptr<LabImage> origblur(new LabImage(GW, GH));
-
-    if (usemaskall) {
-        origblurmask.reset(new LabImage(GW, GH));
-
-#ifdef _OPENMP
-        #pragma omp parallel if (multiThread)
-#endif
-        {
-            gaussianBlur(originalmask->L, origblurmask->L, GW, GH, radius);
-            gaussianBlur(originalmask->a, origblurmask->a, GW, GH, radius);
-            gaussianBlur(originalmask->b, origblurmask->b, GW, GH, radius);
-        }
-    }
-
-#ifdef _OPENMP
-    #pragma omp parallel if (multiThread)
-#endif
-    {
-        gaussianBlur(original->L, origblur->L, GW, GH, radius);
-        gaussianBlur(original->a, origblur->a, GW, GH, radius);
-        gaussianBlur(original->b, origblur->b, GW, GH, radius);
-    }
+    const SpotRect blurRect = calcSpotRect(lp, cx, cy, GW, GH, blurMargin(radius));
+    const std::unique_ptr<LabImage> origblur(new LabImage(blurRect.width(), blurRect.height()));
+    gaussianBlurRect(usemaskall ? originalmask : original, origblur.get(), blurRect, radius, multiThread);
 
 #ifdef _OPENMP
     #pragma omp parallel if (multiThread)
 #endif
     {
-        const LabImage *maskptr = usemaskall ? origblurmask.get() : origblur.get();
+        const LabImage *maskptr = origblur.get();
         const float mindE = 4.f + MINSCOPE * lp.sensbn * lp.thr;//best usage ?? with blurnoise
         const float maxdE = 5.f + MAXSCOPE * lp.sensbn * (1 + 0.1f * lp.thr);
         const float mindElim = 2.f + MINSCOPE * limscope * lp.thr;
@@ -8517,8 +8438,10 @@ void ImProcFunctions::BlurNoise_Local(LabImage *tmp1, LabImage * originalmask, c
 #endif
         for (int y = ystart; y < yend; y++) {
             const int loy = cy + y;
+            const int by = y - blurRect.ystart;
 
             for (int x = xstart, lox = cx + x; x < xend; x++, lox++) {
+                const int bx = x - blurRect.xstart;
                 int zone;
                 float localFactor = 1.f;
 
@@ -8532,10 +8455,10 @@ void ImProcFunctions::BlurNoise_Local(LabImage *tmp1, LabImage * originalmask, c
                     continue;
                 }
 
-                const float abdelta2 = SQR(refa - maskptr->a[y][x]) + SQR(refb - maskptr->b[y][x]);
-                const float chrodelta2 = SQR(std::sqrt(SQR(maskptr->a[y][x]) + SQR(maskptr->b[y][x])) - chromaref * 327.68f);
+                const float abdelta2 = SQR(refa - maskptr->a[by][bx]) + SQR(refb - maskptr->b[by][bx]);
+                const float chrodelta2 = SQR(std::sqrt(SQR(maskptr->a[by][bx]) + SQR(maskptr->b[by][bx])) - chromaref * 327.68f);
                 const float huedelta2 = abdelta2 - chrodelta2;
-                const float dE = std::sqrt(kab * (kch * chrodelta2 + kH * huedelta2) + kL * SQR(refL - maskptr->L[y][x]));
+                const float dE = std::sqrt(kab * (kch * chrodelta2 + kH * huedelta2) + kL * SQR(refL - maskptr->L[by][bx]));
                 const float reducdE = calcreducdE(dE, maxdE, mindE, maxdElim, mindElim, lp.iterat, limscope, lp.sensbn);
 
                 float difL = (tmp1->L[y - ystart][x - xstart] - original->L[y][x]) * localFactor * reducdE;
@@ -8979,53 +8902,23 @@ void ImProcFunctions::exposure_pde(float * dataor, float * datain, float * datao
 {
 
     //BENCHFUN
-#ifdef RT_FFTW3F_OMP
-    if (multiThread) {
-        fftwf_init_threads();
-        fftwf_plan_with_nthreads(omp_get_max_threads());
-    }
-
-#endif
-    float *data_fft, *data_tmp, *data;
-
-    if (NULL == (data_tmp = (float *) fftwf_malloc(sizeof(float) * bfw * bfh))) {
-        fprintf(stderr, "allocation error\n");
-        abort();
-    }
-
-    ImProcFunctions::discrete_laplacian_threshold(data_tmp, datain, bfw, bfh, thresh);
-
-    if (NULL == (data_fft = (float *) fftwf_malloc(sizeof(float) * bfw * bfh))) {
-        fprintf(stderr, "allocation error\n");
-        abort();
-    }
+    float *data;
 
     if (NULL == (data = (float *) fftwf_malloc(sizeof(float) * bfw * bfh))) {
         fprintf(stderr, "allocation error\n");
         abort();
     }
 
-    const auto dct_fw = fftwf_plan_r2r_2d(bfh, bfw, data_tmp, data_fft, FFTW_REDFT10, FFTW_REDFT10, FFTW_ESTIMATE | FFTW_DESTROY_INPUT);
-    fftwf_execute(dct_fw);
-
-    fftwf_free(data_tmp);
+    ImProcFunctions::discrete_laplacian_threshold(data, datain, bfw, bfh, thresh);
 
-    /* solve the Poisson PDE in Fourier space */
-    /* 1. / (float) (bfw * bfh)) is the DCT normalisation term, see libfftw */
-    ImProcFunctions::rex_poisson_dct(data_fft, bfw, bfh, 1. / (double)(bfw * bfh));
+    /* solve the Poisson PDE, 4 keeps the scale of the IPOL code: 1 / (bfw * bfh) with the unnormalized DCT */
+    const PoissonSolver solver(bfw, bfh, PoissonSolver::Boundary::HALF_SAMPLE, multiThread);
 
-    const auto dct_bw = fftwf_plan_r2r_2d(bfh, bfw, data_fft, data, FFTW_REDFT01, FFTW_REDFT01, FFTW_ESTIMATE | FFTW_DESTROY_INPUT);
-    fftwf_execute(dct_bw);
-    fftwf_destroy_plan(dct_fw);
-    fftwf_destroy_plan(dct_bw);
-    fftwf_free(data_fft);
-    fftwf_cleanup();
-
-#ifdef RT_FFTW3F_OMP
-    if (multiThread) {
-        fftwf_cleanup_threads();
+    if (!solver.solve(data, 4.)) {
+        // no fftw plan for this size, the Laplacian is left out
+        fprintf(stderr, "exposure_pde: fftw planning failed for %d x %d\n", bfw, bfh);
+        std::copy(datain, datain + bfw * bfh, data);
     }
-#endif
 
     normalize_mean_dt(data, dataor, bfw * bfh, mod, 1.f, 0.f, 0.f, 0.f, 0.f);
     {
@@ -9065,19 +8958,11 @@ void ImProcFunctions::fftw_convol_blur(float * input, float * output, int bfw, i
     */
     //BENCHFUN
 
-#ifdef RT_FFTW3F_OMP
-    if (multiThread) {
-        fftwf_init_threads();
-        fftwf_plan_with_nthreads(omp_get_max_threads());
-    }
-#endif
-
-
     float *out; //for FFT data
     float *kern = nullptr;//for kernel gauss
     float *outkern = nullptr;//for FFT kernel
-    fftwf_plan p;
-    fftwf_plan pkern;//plan for FFT
+    FFTWPlanCache::Plan p;
+    FFTWPlanCache::Plan pkern;//plan for FFT
     int image_size, image_sizechange;
     float n_x = 1.f;
     float n_y = 1.f;//relative coordinates for kernel Gauss
@@ -9091,12 +8976,29 @@ void ImProcFunctions::fftw_convol_blur(float * input, float * output, int bfw, i
         outkern = (float*) fftwf_malloc(sizeof(float) * (bfw * bfh));//allocate real data for FFT
     }
 
-    /*compute the Fourier transform of the input data*/
+    p = FFTWPlanCache::getInstance().getPlan(bfh, bfw, FFTW_REDFT10, FFTW_ESTIMATE, input, out, multiThread);//FFT 2 dimensions forward  FFTW_MEASURE FFTW_ESTIMATE
+    const FFTWPlanCache::Plan pback = FFTWPlanCache::getInstance().getPlan(bfh, bfw, FFTW_REDFT01, FFTW_ESTIMATE, out, output, multiThread);//FFT 2 dimensions backward
+
+    if (fftkern == 1) {
+        pkern = FFTWPlanCache::getInstance().getPlan(bfh, bfw, FFTW_REDFT10, FFTW_ESTIMATE, kern, outkern, multiThread); //FFT 2 dimensions forward
+    }
 
-    p = fftwf_plan_r2r_2d(bfh, bfw, input, out, FFTW_REDFT10, FFTW_REDFT10,  FFTW_ESTIMATE);//FFT 2 dimensions forward  FFTW_MEASURE FFTW_ESTIMATE
+    if (!p || !pback || (fftkern == 1 && !pkern)) {
+        fprintf(stderr, "fftw_convol_blur: fftw planning failed for %d x %d, the data is not blurred\n", bfw, bfh);
+
+        if (output != input) {
+            std::copy(input, input + bfw * bfh, output);
+        }
+
+        fftwf_free(outkern);
+        fftwf_free(kern);
+        fftwf_free(out);
+        return;
+    }
+
+    /*compute the Fourier transform of the input data*/
 
-    fftwf_execute(p);
-    fftwf_destroy_plan(p);
+    fftwf_execute_r2r(p.get(), input, out);
 
     /*define the gaussian constants for the convolution kernel*/
     if (algo == 0) {
@@ -9130,9 +9032,7 @@ void ImProcFunctions::fftw_convol_blur(float * input, float * output, int bfw, i
         }
 
         /*compute the Fourier transform of the kernel data*/
-        pkern = fftwf_plan_r2r_2d(bfh, bfw, kern, outkern, FFTW_REDFT10, FFTW_REDFT10, FFTW_ESTIMATE); //FFT 2 dimensions forward
-        fftwf_execute(pkern);
-        fftwf_destroy_plan(pkern);
+        fftwf_execute_r2r(pkern.get(), kern, outkern);
 
 #ifdef _OPENMP
         #pragma omp parallel for if (multiThread)
@@ -9176,8 +9076,7 @@ void ImProcFunctions::fftw_convol_blur(float * input, float * output, int bfw, i
         }
     }
 
-    p = fftwf_plan_r2r_2d(bfh, bfw, out, output, FFTW_REDFT01, FFTW_REDFT01, FFTW_ESTIMATE);//FFT 2 dimensions backward
-    fftwf_execute(p);
+    fftwf_execute_r2r(pback.get(), out, output);
 
 #ifdef _OPENMP
     #pragma omp parallel for if (multiThread)
@@ -9186,19 +9085,11 @@ void ImProcFunctions::fftw_convol_blur(float * input, float * output, int bfw, i
         output[index] /= image_sizechange;
     }
 
-    fftwf_destroy_plan(p);
     fftwf_free(out);
-
-#ifdef RT_FFTW3F_OMP
-    if (multiThread) {
-        fftwf_cleanup_threads();
-    }
-#endif
 }
 
 void ImProcFunctions::fftw_convol_blur2(float **input2, float **output2, int bfw, int bfh, float radius, int fftkern, int algo)
 {
-    MyMutex::MyLock lock(*fftwMutex);
 
     float *input = nullptr;
 
@@ -9243,28 +9134,17 @@ void ImProcFunctions::fftw_tile_blur(int GW, int GH, int tilssize, int max_numbl
 {
     //BENCHFUN
     float epsil = 0.001f / (tilssize * tilssize);
-    fftwf_plan plan_forward_blox[2];
-    fftwf_plan plan_backward_blox[2];
+    FFTWPlanCache::Plan plan_forward_blox[2];
+    FFTWPlanCache::Plan plan_backward_blox[2];
 
     array2D<float> tilemask_in(tilssize, tilssize);
     array2D<float> tilemask_out(tilssize, tilssize);
 
-    float *Lbloxtmp  = reinterpret_cast<float*>(fftwf_malloc(max_numblox_W * tilssize * tilssize * sizeof(float)));
-    float *fLbloxtmp = reinterpret_cast<float*>(fftwf_malloc(max_numblox_W * tilssize * tilssize * sizeof(float)));
-
-    int nfwd[2] = {tilssize, tilssize};
-
-    //for DCT:
-    fftw_r2r_kind fwdkind[2] = {FFTW_REDFT10, FFTW_REDFT10};
-    fftw_r2r_kind bwdkind[2] = {FFTW_REDFT01, FFTW_REDFT01};
+    if (!getBlockPlans(tilssize, max_numblox_W, min_numblox_W, plan_forward_blox, plan_backward_blox)) {
+        fprintf(stderr, "fftw_tile_blur: fftw planning failed, the data is not blurred\n");
+        return;
+    }
 
-    // Creating the plans with FFTW_MEASURE instead of FFTW_ESTIMATE speeds up the execute a bit
-    plan_forward_blox[0]  = fftwf_plan_many_r2r(2, nfwd, max_numblox_W, Lbloxtmp, nullptr, 1, tilssize * tilssize, fLbloxtmp, nullptr, 1, tilssize * tilssize, fwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-    plan_backward_blox[0] = fftwf_plan_many_r2r(2, nfwd, max_numblox_W, fLbloxtmp, nullptr, 1, tilssize * tilssize, Lbloxtmp, nullptr, 1, tilssize * tilssize, bwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-    plan_forward_blox[1]  = fftwf_plan_many_r2r(2, nfwd, min_numblox_W, Lbloxtmp, nullptr, 1, tilssize * tilssize, fLbloxtmp, nullptr, 1, tilssize * tilssize, fwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-    plan_backward_blox[1] = fftwf_plan_many_r2r(2, nfwd, min_numblox_W, fLbloxtmp, nullptr, 1, tilssize * tilssize, Lbloxtmp, nullptr, 1, tilssize * tilssize, bwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-    fftwf_free(Lbloxtmp);
-    fftwf_free(fLbloxtmp);
     const int border = rtengine::max(2, tilssize / 16);
 
     for (int i = 0; i < tilssize; ++i) {
@@ -9370,9 +9250,9 @@ void ImProcFunctions::fftw_tile_blur(int GW, int GH, int tilssize, int max_numbl
 
             //fftwf_print_plan (plan_forward_blox);
             if (numblox_W == max_numblox_W) {
-                fftwf_execute_r2r(plan_forward_blox[0], Lblox, fLblox);    // DCT an entire row of tiles
+                fftwf_execute_r2r(plan_forward_blox[0].get(), Lblox, fLblox);    // DCT an entire row of tiles
             } else {
-                fftwf_execute_r2r(plan_forward_blox[1], Lblox, fLblox);    // DCT an entire row of tiles
+                fftwf_execute_r2r(plan_forward_blox[1].get(), Lblox, fLblox);    // DCT an entire row of tiles
             }
 
             const float n_xy = rtengine::SQR(rtengine::RT_PI / tilssize);
@@ -9392,9 +9272,9 @@ void ImProcFunctions::fftw_tile_blur(int GW, int GH, int tilssize, int max_numbl
 
             //now perform inverse FT of an entire row of blocks
             if (numblox_W == max_numblox_W) {
-                fftwf_execute_r2r(plan_backward_blox[0], fLblox, Lblox);    //for DCT
+                fftwf_execute_r2r(plan_backward_blox[0].get(), fLblox, Lblox);    //for DCT
             } else {
-                fftwf_execute_r2r(plan_backward_blox[1], fLblox, Lblox);    //for DCT
+                fftwf_execute_r2r(plan_backward_blox[1].get(), fLblox, Lblox);    //for DCT
             }
 
             int topproc = (vblk - 1) * offset;
@@ -9436,11 +9316,6 @@ void ImProcFunctions::fftw_tile_blur(int GW, int GH, int tilssize, int max_numbl
         fftwf_free(fLbloxArray[i]);
     }
 
-    fftwf_destroy_plan(plan_forward_blox[0]);
-    fftwf_destroy_plan(plan_backward_blox[0]);
-    fftwf_destroy_plan(plan_forward_blox[1]);
-    fftwf_destroy_plan(plan_backward_blox[1]);
-    fftwf_cleanup();
 }
 
 void ImProcFunctions::wavcbd(wavelet_decomposition &wdspot, int level_bl, int maxlvl,
@@ -10612,29 +10487,18 @@ void ImProcFunctions::fftw_denoise(int sk, int GW, int GH, int max_numblox_W, in
 {
    // BENCHFUN
 
-    fftwf_plan plan_forward_blox[2];
-    fftwf_plan plan_backward_blox[2];
+    FFTWPlanCache::Plan plan_forward_blox[2];
+    FFTWPlanCache::Plan plan_backward_blox[2];
 
     array2D<float> tilemask_in(TS, TS);
     array2D<float> tilemask_out(TS, TS);
-
-    float *Lbloxtmp  = reinterpret_cast<float*>(fftwf_malloc(max_numblox_W * TS * TS * sizeof(float)));
-    float *fLbloxtmp = reinterpret_cast<float*>(fftwf_malloc(max_numblox_W * TS * TS * sizeof(float)));
     float params_Ldetail = 0.f;
 
-    int nfwd[2] = {TS, TS};
-
-    //for DCT:
-    fftw_r2r_kind fwdkind[2] = {FFTW_REDFT10, FFTW_REDFT10};
-    fftw_r2r_kind bwdkind[2] = {FFTW_REDFT01, FFTW_REDFT01};
+    if (!getBlockPlans(TS, max_numblox_W, min_numblox_W, plan_forward_blox, plan_backward_blox)) {
+        fprintf(stderr, "fftw_denoise: fftw planning failed, the data is not denoised\n");
+        return;
+    }
 
-    // Creating the plans with FFTW_MEASURE instead of FFTW_ESTIMATE speeds up the execute a bit
-    plan_forward_blox[0]  = fftwf_plan_many_r2r(2, nfwd, max_numblox_W, Lbloxtmp, nullptr, 1, TS * TS, fLbloxtmp, nullptr, 1, TS * TS, fwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-    plan_backward_blox[0] = fftwf_plan_many_r2r(2, nfwd, max_numblox_W, fLbloxtmp, nullptr, 1, TS * TS, Lbloxtmp, nullptr, 1, TS * TS, bwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-    plan_forward_blox[1]  = fftwf_plan_many_r2r(2, nfwd, min_numblox_W, Lbloxtmp, nullptr, 1, TS * TS, fLbloxtmp, nullptr, 1, TS * TS, fwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-    plan_backward_blox[1] = fftwf_plan_many_r2r(2, nfwd, min_numblox_W, fLbloxtmp, nullptr, 1, TS * TS, Lbloxtmp, nullptr, 1, TS * TS, bwdkind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
-    fftwf_free(Lbloxtmp);
-    fftwf_free(fLbloxtmp);
     const int border = rtengine::max(2, TS / 16);
 
     for (int i = 0; i < TS; ++i) {
@@ -10749,9 +10613,9 @@ void ImProcFunctions::fftw_denoise(int sk, int GW, int GH, int max_numblox_W, in
 
             //fftwf_print_plan (plan_forward_blox);
             if (numblox_W == max_numblox_W) {
-                fftwf_execute_r2r(plan_forward_blox[0], Lblox, fLblox);    // DCT an entire row of tiles
+                fftwf_execute_r2r(plan_forward_blox[0].get(), Lblox, fLblox);    // DCT an entire row of tiles
             } else {
-                fftwf_execute_r2r(plan_forward_blox[1], Lblox, fLblox);    // DCT an entire row of tiles
+                fftwf_execute_r2r(plan_forward_blox[1].get(), Lblox, fLblox);    // DCT an entire row of tiles
             }
 
             // now process the vblk row of blocks for noise reduction
@@ -10773,9 +10637,9 @@ void ImProcFunctions::fftw_denoise(int sk, int GW, int GH, int max_numblox_W, in
 
             //now perform inverse FT of an entire row of blocks
             if (numblox_W == max_numblox_W) {
-                fftwf_execute_r2r(plan_backward_blox[0], fLblox, Lblox);    //for DCT
+                fftwf_execute_r2r(plan_backward_blox[0].get(), fLblox, Lblox);    //for DCT
             } else {
-                fftwf_execute_r2r(plan_backward_blox[1], fLblox, Lblox);    //for DCT
+                fftwf_execute_r2r(plan_backward_blox[1].get(), fLblox, Lblox);    //for DCT
             }
 
             int topproc = (vblk - 1) * offset;
@@ -10863,11 +10727,6 @@ void ImProcFunctions::fftw_denoise(int sk, int GW, int GH, int max_numblox_W, in
         fftwf_free(fLbloxArray[i]);
     }
 
-    fftwf_destroy_plan(plan_forward_blox[0]);
-    fftwf_destroy_plan(plan_backward_blox[0]);
-    fftwf_destroy_plan(plan_forward_blox[1]);
-    fftwf_destroy_plan(plan_backward_blox[1]);
-    fftwf_cleanup();
 
 
 }
@@ -10896,10 +10755,6 @@ void ImProcFunctions::DeNoise(int call, float * slidL, float * slida, float * sl
 
         StopWatch Stop1("locallab Denoise called");
 
-        if (aut == 0) {
-            MyMutex::MyLock lock(*fftwMutex);
-        }
-
         if (lp.noisecf >= 0.01f || lp.noisecc >= 0.01f || aut == 1 || aut == 2) {
             noiscfactiv = false;
             levred = 7;
@@ -12970,6 +12825,8 @@ void ImProcFunctions::NLMeans(float **img, int strength, int detail_thresh, int
 
     const int search_radius = int(std::ceil(float(max_search_radius) / scale));
     const int patch_radius = int(std::ceil(float(max_patch_radius) / scale));
+    // the offsets beyond inner_radius are searched at half resolution, settings->nlmeansquality (1...100) sets the trade-off between speed and quality
+    const int inner_radius = int(std::ceil(search_radius * LIM(settings->nlmeansquality, 1, 100) / 100.f));
 
     // the strength parameter controls the scaling of the weights
     // (called h^2 in the papers)
@@ -13088,76 +12945,123 @@ void ImProcFunctions::NLMeans(float **img, int strength, int detail_thresh, int
         const int TW = end_x - start_x;
 
         const auto Yf = [=](int y) -> int { return LIM(y+start_y, 0, HH-1); };
-        const auto Xf = [=](int x) -> int { return LIM(x+start_x, 0, WW-1); };
-
-        const auto score =
-            [&](int tx, int ty, int zx, int zy) -> float
-            {
-                return SQR(src[Yf(zy)][Xf(zx)] - src[Yf(zy + ty)][Xf(zx + tx)]);
-            };
 
         array2D<float> St(TW, TH);//, ARRAY2D_ALIGNED);
         array2D<float> SW(TW, TH, ARRAY2D_CLEAR_DATA);//, ARRAY2D_ALIGNED|ARRAY2D_CLEAR_DATA);
 
-        for (int ty = -search_radius; ty <= search_radius; ++ty) {
-            for (int tx = -search_radius; tx <= search_radius; ++tx) {
-                // Step 1 — Compute the integral image St
-                St[0][0] = 0.f;
-                for (int xx = 1; xx < TW; ++xx) {
-                    St[0][xx] = St[0][xx-1] + score(tx, ty, xx, 0);
-                }
-                for (int yy = 1; yy < TH; ++yy) {
-                    St[yy][0] = St[yy-1][0] + score(tx, ty, 0, yy);
-                }
-                for (int yy = 1; yy < TH; ++yy) {
-                    for (int xx = 1; xx < TW; ++xx) {
-                        // operation grouping tuned for performance (empirically)
-                        St[yy][xx] = (St[yy][xx-1] + St[yy-1][xx]) - (St[yy-1][xx-1] - score(tx, ty, xx, yy));
+        // Step 1 — Compute the integral image St of the squared differences between the tile and the tile shifted by t
+        const auto integral =
+            [&](int tx, int ty) -> void
+            {
+                // range of xx where start_x + xx + tx is inside src
+                const int xlo = LIM(-start_x - tx, 0, TW);
+                const int xhi = LIM(WW - start_x - tx, xlo, TW);
+
+                for (int yy = 0; yy < TH; ++yy) {
+                    const float* const row = src[Yf(yy)] + start_x;
+                    const float* const srow = src[Yf(yy + ty)];
+                    float* const strow = St[yy];
+                    float sum = 0.f;
+                    int xx = 0;
+
+                    for (; xx < xlo; ++xx) {
+                        sum += SQR(row[xx] - srow[0]);
+                        strow[xx] = sum;
+                    }
+
+                    for (; xx < xhi; ++xx) {
+                        sum += SQR(row[xx] - srow[start_x + xx + tx]);
+                        strow[xx] = sum;
+                    }
+
+                    for (; xx < TW; ++xx) {
+                        sum += SQR(row[xx] - srow[WW - 1]);
+                        strow[xx] = sum;
+                    }
+
+                    if (yy > 0) {
+                        const float* const prev = St[yy - 1];
+                        xx = 0;
+#ifdef __SSE2__
+                        for (; xx < TW - 3; xx += 4) {
+                            STVFU(strow[xx], LVFU(strow[xx]) + LVFU(prev[xx]));
+                        }
+#endif
+                        for (; xx < TW; ++xx) {
+                            strow[xx] += prev[xx];
+                        }
                     }
                 }
-                // Step 2 — Compute weight and estimate for patches
-                // V(x), V(y) with y = x + t
+            };
+
+        // Step 2 — Compute weight and estimate for patches
+        // V(x), V(y) with y = x + t and y = x - t: the distance between the patches of x and x - t
+        // is the one between the patches of x - t and x, read in St at x - t
+        const auto accumulate =
+            [&](int tx, int ty, float wscale) -> void
+            {
+#ifdef __SSE2__
+                const vfloat wscalev = F2V(wscale);
+#endif
                 for (int yy = start_y+border; yy < end_y-border; ++yy) {
                     int y = yy - border;
+                    int sty = yy - start_y;
                     int xx = start_x+border;
 #ifdef __SSE2__
                     for (; xx < end_x-border-3; xx += 4) {
                         int x = xx - border;
-                        int sx = xx + tx;
-                        int sy = yy + ty;
-
-                        int sty = yy - start_y;
                         int stx = xx - start_x;
-                    
+
                         vfloat dist2 = LVFU(St[sty + patch_radius][stx + patch_radius]) + LVFU(St[sty - patch_radius][stx - patch_radius]) - LVFU(St[sty + patch_radius][stx - patch_radius]) - LVFU(St[sty - patch_radius][stx + patch_radius]);
-                        dist2 = vmaxf(dist2, zerov);
-                        vfloat d = dist2 * LVFU(mask[y][x]);
-                        vfloat weight = explut[d];
-                        STVFU(SW[y-start_y][x-start_x], LVFU(SW[y-start_y][x-start_x]) + weight);
-                        vfloat Y = weight * LVFU(src[sy][sx]);
+                        vfloat dist2m = LVFU(St[sty - ty + patch_radius][stx - tx + patch_radius]) + LVFU(St[sty - ty - patch_radius][stx - tx - patch_radius]) - LVFU(St[sty - ty + patch_radius][stx - tx - patch_radius]) - LVFU(St[sty - ty - patch_radius][stx - tx + patch_radius]);
+                        const vfloat maskv = LVFU(mask[y][x]);
+                        vfloat weight = wscalev * explut[vmaxf(dist2, zerov) * maskv];
+                        vfloat weightm = wscalev * explut[vmaxf(dist2m, zerov) * maskv];
+                        STVFU(SW[y-start_y][x-start_x], LVFU(SW[y-start_y][x-start_x]) + (weight + weightm));
+                        vfloat Y = weight * LVFU(src[yy + ty][xx + tx]) + weightm * LVFU(src[yy - ty][xx - tx]);
                         STVFU(dst[y][x], LVFU(dst[y][x]) + Y);
                     }
 #endif
                     for (; xx < end_x-border; ++xx) {
                         int x = xx - border;
-                        int sx = xx + tx;
-                        int sy = yy + ty;
-
-                        int sty = yy - start_y;
                         int stx = xx - start_x;
-                    
+
                         float dist2 = St[sty + patch_radius][stx + patch_radius] + St[sty - patch_radius][stx - patch_radius] - St[sty + patch_radius][stx - patch_radius] - St[sty - patch_radius][stx + patch_radius];
-                        dist2 = std::max(dist2, 0.f);
-                        float d = dist2 * mask[y][x];
-                        float weight = explut[d];
-                        SW[y-start_y][x-start_x] += weight;
-                        float Y = weight * src[sy][sx];
+                        float dist2m = St[sty - ty + patch_radius][stx - tx + patch_radius] + St[sty - ty - patch_radius][stx - tx - patch_radius] - St[sty - ty + patch_radius][stx - tx - patch_radius] - St[sty - ty - patch_radius][stx - tx + patch_radius];
+                        float weight = wscale * explut[std::max(dist2, 0.f) * mask[y][x]];
+                        float weightm = wscale * explut[std::max(dist2m, 0.f) * mask[y][x]];
+                        SW[y-start_y][x-start_x] += weight + weightm;
+                        float Y = weight * src[yy + ty][xx + tx] + weightm * src[yy - ty][xx - tx];
                         dst[y][x] += Y;
 
                         assert(!xisinff(dst[y][x]));
                         assert(!xisnanf(dst[y][x]));
                     }
                 }
+            };
+
+        // t = 0, the distance is 0 and the weight 1
+        for (int yy = start_y+border; yy < end_y-border; ++yy) {
+            int y = yy - border;
+            for (int xx = start_x+border; xx < end_x-border; ++xx) {
+                int x = xx - border;
+                SW[y-start_y][x-start_x] += 1.f;
+                dst[y][x] += src[yy][xx];
+            }
+        }
+
+        // half of the search window, the other half is accumulated with the same integral images
+        for (int ty = 0; ty <= search_radius; ++ty) {
+            for (int tx = ty == 0 ? 1 : -search_radius; tx <= search_radius; ++tx) {
+                const bool outer = std::max(std::abs(tx), ty) > inner_radius;
+
+                if (outer && ((tx | ty) & 1)) {
+                    // the outer part of the window is searched at half resolution, each offset stands for 4
+                    continue;
+                }
+
+                integral(tx, ty);
+                accumulate(tx, ty, outer ? 4.f : 1.f);
             }
         }
 //    printf("E\n");
@@ -16226,7 +16130,6 @@ void ImProcFunctions::Lab_Local(
                 }
 
                 const int showorig = lp.showmasksoftmet >= 5 ? 0 : lp.showmasksoftmet;
-                MyMutex::MyLock lock(*fftwMutex);
                 ImProcFunctions::retinex_pde(datain.get(), dataout.get(), bfwr, bfhr, 8.f * lp.strng, 1.f, dE.get(), showorig, 1, 1);
 #ifdef _OPENMP
                 #pragma omp parallel for schedule(dynamic,16) if (multiThread)
@@ -17288,7 +17191,6 @@ void ImProcFunctions::Lab_Local(
 
                         if (lp.laplacexp > 0.1f) {
 
-                            MyMutex::MyLock lock(*fftwMutex);
                             std::unique_ptr<float[]> datain(new float[bfwr * bfhr]);
                             std::unique_ptr<float[]> dataout(new float[bfwr * bfhr]);
                             const float gam = params->locallab.spots.at(sp).gamm;
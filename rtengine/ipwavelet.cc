@@ -50,6 +50,7 @@
 #endif
 
 #include "cplx_wavelet_dec.h"
+#include "waveletdecompositioncache.h"
 #define BENCHMARK
 #include "StopWatch.h"
 
@@ -719,6 +720,9 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
     int overlap = (int) tilesize * 0.125f;
     int numtiles_W, numtiles_H, tilewidth, tileheight, tileWskip, tileHskip;
 
+    // the decompositions are cached for the preview and the detail windows, not for the queue (kall == 2)
+    const bool cacheDecompositions = kall != 2;
+
     if (params->wavelet.Tilesmethod == "full") {
         kall = 0;
     }
@@ -1016,6 +1020,27 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
 
                 int datalen = labco->W * labco->H;
 
+                const auto decompose =
+                    [&](float* src, int levels) -> std::unique_ptr<wavelet_decomposition>
+                    {
+                        if (!cacheDecompositions || numtiles != 1) {
+                            return std::unique_ptr<wavelet_decomposition>(new wavelet_decomposition(src, labco->W, labco->H, levels, 1, skip, rtengine::max(1, wavNestedLevels), DaubLen));
+                        }
+
+                        const WaveletDecompositionCache::Key key(src, labco->W, labco->H, levels, skip, DaubLen, rtengine::max(1, wavNestedLevels));
+                        std::unique_ptr<wavelet_decomposition> decomp = WaveletDecompositionCache::getInstance().get(key);
+
+                        if (!decomp) {
+                            decomp.reset(new wavelet_decomposition(src, labco->W, labco->H, levels, 1, skip, rtengine::max(1, wavNestedLevels), DaubLen));
+
+                            if (!decomp->memory_allocation_failed()) {
+                                WaveletDecompositionCache::getInstance().put(key, *decomp);
+                            }
+                        }
+
+                        return decomp;
+                    };
+
                 levwavL = levwav;
                 bool ref0 = false;
 
@@ -1089,7 +1114,7 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
                 }
 
                 if (levwavL > 0) {
-                    const std::unique_ptr<wavelet_decomposition> Ldecomp(new wavelet_decomposition(labco->data, labco->W, labco->H, levwavL, 1, skip, rtengine::max(1, wavNestedLevels), DaubLen));
+                    const std::unique_ptr<wavelet_decomposition> Ldecomp(decompose(labco->data, levwavL));
                  //   const std::unique_ptr<wavelet_decomposition> Ldecomp2(new wavelet_decomposition(labco->data, labco->W, labco->H, levwavL, 1, skip, rtengine::max(1, wavNestedLevels), DaubLen));
 
                     if (!Ldecomp->memory_allocation_failed()) {
@@ -1176,7 +1201,7 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
                             vari[4] = rtengine::max(0.000001f, kr4 * vari[4]);
                             vari[5] = rtengine::max(0.000001f, kr4 * vari[5]);
                             
-                            const std::unique_ptr<wavelet_decomposition> Ldecomp2(new wavelet_decomposition(labco->data, labco->W, labco->H, levwavL, 1, skip, rtengine::max(1, wavNestedLevels), DaubLen));
+                            const std::unique_ptr<wavelet_decomposition> Ldecomp2(decompose(labco->data, levwavL));
                             if(!Ldecomp2->memory_allocation_failed()){
                                 if (settings->verbose) {
                                     printf("LUM var0=%f var1=%f var2=%f var3=%f var4=%f\n", vari[0], vari[1], vari[2], vari[3], vari[4]);
@@ -1751,7 +1776,7 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
                             }
 
                             if (levwava > 0) {
-                                const std::unique_ptr<wavelet_decomposition> adecomp(new wavelet_decomposition(labco->data + datalen, labco->W, labco->H, levwava, 1, skip, rtengine::max(1, wavNestedLevels), DaubLen));
+                                const std::unique_ptr<wavelet_decomposition> adecomp(decompose(labco->data + datalen, levwava));
                                 if (!adecomp->memory_allocation_failed()) {
                                     if(levwava == 6) {
                                         edge = 1;
@@ -1806,7 +1831,7 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
                             }
 
                             if (levwavb > 0) {
-                                const std::unique_ptr<wavelet_decomposition> bdecomp(new wavelet_decomposition(labco->data + 2 * datalen, labco->W, labco->H, levwavb, 1, skip, rtengine::max(1, wavNestedLevels), DaubLen));
+                                const std::unique_ptr<wavelet_decomposition> bdecomp(decompose(labco->data + 2 * datalen, levwavb));
                                 if(levwavb == 6) {
                                     edge = 1;
                                 }
@@ -1843,8 +1868,8 @@ void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const
                             }
 
                             if (levwavab > 0) {
-                                const std::unique_ptr<wavelet_decomposition> adecomp(new wavelet_decomposition(labco->data + datalen, labco->W, labco->H, levwavab, 1, skip, rtengine::max(1, wavNestedLevels), DaubLen));
-                                const std::unique_ptr<wavelet_decomposition> bdecomp(new wavelet_decomposition(labco->data + 2 * datalen, labco->W, labco->H, levwavab, 1, skip, rtengine::max(1, wavNestedLevels), DaubLen));
+                                const std::unique_ptr<wavelet_decomposition> adecomp(decompose(labco->data + datalen, levwavab));
+                                const std::unique_ptr<wavelet_decomposition> bdecomp(decompose(labco->data + 2 * datalen, levwavab));
 
                                 if (!adecomp->memory_allocation_failed() && !bdecomp->memory_allocation_failed()) {
                                     if (cp.noiseena && ((cp.chromfi > 0.f || cp.chromco > 0.f) && cp.quamet == 0 && isdenoisL)) {
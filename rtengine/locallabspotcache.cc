@@ -0,0 +1,215 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "labimage.h"
+#include "locallabspotcache.h"
+#include "rt_math.h"
+
+namespace
+{
+
+using namespace rtengine;
+
+// the cached footprints may not use more memory than this number of images
+constexpr std::size_t maxCachedImages = 4;
+
+std::uint64_t hashValues(std::uint64_t hash, const float* values, int count)
+{
+    // FNV-1a on the bit patterns of the floats
+    for (int i = 0; i < count; ++i) {
+        std::uint32_t bits;
+        std::memcpy(&bits, values + i, sizeof(bits));
+        hash = (hash ^ bits) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+std::uint64_t hashFootprint(const LabImage* image, const LocallabSpotFootprint& footprint, bool multiThread)
+{
+    std::vector<std::uint64_t> rowHashes(footprint.height());
+
+#ifdef _OPENMP
+    #pragma omp parallel for if (multiThread)
+#endif
+    for (int y = 0; y < footprint.height(); ++y) {
+        std::uint64_t hash = 14695981039346656037ULL;
+        hash = hashValues(hash, image->L[footprint.ystart + y] + footprint.xstart, footprint.width());
+        hash = hashValues(hash, image->a[footprint.ystart + y] + footprint.xstart, footprint.width());
+        rowHashes[y] = hashValues(hash, image->b[footprint.ystart + y] + footprint.xstart, footprint.width());
+    }
+
+    std::uint64_t hash = 14695981039346656037ULL;
+
+    for (const auto rowHash : rowHashes) {
+        hash = (hash ^ rowHash) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+}
+
+namespace rtengine
+{
+
+void LocallabSpotFootprint::copyFrom(const LabImage* src, LabImage* dst) const
+{
+    for (int y = 0; y < height(); ++y) {
+        std::copy_n(src->L[ystart + y] + xstart, width(), dst->L[y]);
+        std::copy_n(src->a[ystart + y] + xstart, width(), dst->a[y]);
+        std::copy_n(src->b[ystart + y] + xstart, width(), dst->b[y]);
+    }
+}
+
+void LocallabSpotFootprint::copyTo(const LabImage* src, LabImage* dst) const
+{
+    for (int y = 0; y < height(); ++y) {
+        std::copy_n(src->L[y], width(), dst->L[ystart + y] + xstart);
+        std::copy_n(src->a[y], width(), dst->a[ystart + y] + xstart);
+        std::copy_n(src->b[y], width(), dst->b[ystart + y] + xstart);
+    }
+}
+
+LocallabSpotFootprint getLocallabSpotFootprint(const procparams::LocallabParams::LocallabSpot& spot, int W, int H)
+{
+    // avoid color shift (guided filter), recursive references and the inverse tools use the whole image
+    if (spot.spotMethod != "norm" || spot.avoid || spot.recurs || spot.invers || spot.inversex || spot.inverssh || spot.invbl || spot.inversret || spot.inverssha) {
+        return {0, 0, W, H};
+    }
+
+    // keeps the blurs near the border of the spot away from the other spots
+    constexpr int margin = 64;
+
+    const double xc = W * (spot.centerX / 2000.0 + 0.5);
+    const double yc = H * (spot.centerY / 2000.0 + 0.5);
+    LocallabSpotFootprint footprint;
+    footprint.xstart = LIM(static_cast<int>(std::floor(xc - W * spot.loc.at(1) / 2000.0)) - margin, 0, W);
+    footprint.ystart = LIM(static_cast<int>(std::floor(yc - H * spot.loc.at(3) / 2000.0)) - margin, 0, H);
+    footprint.xend = LIM(static_cast<int>(std::ceil(xc + W * spot.loc.at(0) / 2000.0)) + margin, footprint.xstart, W);
+    footprint.yend = LIM(static_cast<int>(std::ceil(yc + H * spot.loc.at(2) / 2000.0)) + margin, footprint.ystart, H);
+    return footprint;
+}
+
+LocallabSpotCache::Key::Key(const procparams::ProcParams& params, int sp, int scale, const LocallabSpotFootprint& footprint, const LabImage* input, const LabImage* original, bool multiThread) :
+    spot(params.locallab.spots.at(sp)),
+    sp(sp),
+    scale(scale),
+    width(input->W),
+    height(input->H),
+    footprint(footprint),
+    inputHash(hashFootprint(input, footprint, multiThread)),
+    originalHash(input == original ? inputHash : hashFootprint(original, footprint, multiThread)),
+    toneCurve(params.toneCurve),
+    wb(params.wb),
+    raw(params.raw),
+    icm(params.icm),
+    epdEnabled(params.epd.enabled),
+    gamut(params.colorappearance.gamut)
+{
+}
+
+bool LocallabSpotCache::Key::operator ==(const Key& other) const
+{
+    return
+        sp == other.sp
+        && scale == other.scale
+        && width == other.width
+        && height == other.height
+        && footprint.xstart == other.footprint.xstart
+        && footprint.ystart == other.footprint.ystart
+        && footprint.xend == other.footprint.xend
+        && footprint.yend == other.footprint.yend
+        && inputHash == other.inputHash
+        && originalHash == other.originalHash
+        && epdEnabled == other.epdEnabled
+        && gamut == other.gamut
+        && spot == other.spot
+        && toneCurve == other.toneCurve
+        && wb == other.wb
+        && raw == other.raw
+        && icm == other.icm;
+}
+
+struct LocallabSpotCache::Entry {
+    Entry(const Key& key, const LocallabSpotFootprint& footprint, const Results& results) :
+        key(key),
+        footprint(footprint),
+        output(footprint.width(), footprint.height()),
+        results(results)
+    {
+    }
+
+    Key key;
+    LocallabSpotFootprint footprint;
+    LabImage output;
+    Results results;
+};
+
+LocallabSpotCache::LocallabSpotCache() = default;
+
+LocallabSpotCache::~LocallabSpotCache() = default;
+
+bool LocallabSpotCache::get(int sp, const Key& key, LabImage* image, Results& results) const
+{
+    if (sp >= static_cast<int>(entries.size()) || !entries[sp] || !(entries[sp]->key == key)) {
+        return false;
+    }
+
+    entries[sp]->footprint.copyTo(&entries[sp]->output, image);
+    results = entries[sp]->results;
+    return true;
+}
+
+void LocallabSpotCache::put(int sp, const Key& key, const LocallabSpotFootprint& footprint, const LabImage* image, const Results& results)
+{
+    if (sp >= static_cast<int>(entries.size())) {
+        entries.resize(sp + 1);
+    }
+
+    entries[sp].reset();
+
+    std::size_t cachedPixels = static_cast<std::size_t>(footprint.width()) * footprint.height();
+
+    for (const auto& entry : entries) {
+        if (entry) {
+            cachedPixels += static_cast<std::size_t>(entry->footprint.width()) * entry->footprint.height();
+        }
+    }
+
+    if (cachedPixels > maxCachedImages * image->W * image->H) {
+        return;
+    }
+
+    entries[sp].reset(new Entry(key, footprint, results));
+    footprint.copyFrom(image, &entries[sp]->output);
+}
+
+void LocallabSpotCache::resize(std::size_t spots)
+{
+    entries.resize(spots);
+}
+
+void LocallabSpotCache::clear()
+{
+    entries.clear();
+}
+
+}
@@ -0,0 +1,135 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "noncopyable.h"
+#include "procparams.h"
+#include "rtengine.h"
+
+namespace rtengine
+{
+
+class LabImage;
+
+// Part of the image read and modified by a locallab spot: the rectangle of the spot with its transition zone
+// and a margin, or the whole image for the spots whose tools work outside of the spot
+struct LocallabSpotFootprint {
+    int xstart;
+    int ystart;
+    int xend;
+    int yend;
+
+    int width() const
+    {
+        return xend - xstart;
+    }
+
+    int height() const
+    {
+        return yend - ystart;
+    }
+
+    bool intersects(const LocallabSpotFootprint& other) const
+    {
+        return xstart < other.xend && other.xstart < xend && ystart < other.yend && other.ystart < yend;
+    }
+
+    void copyFrom(const LabImage* src, LabImage* dst) const;
+    void copyTo(const LabImage* src, LabImage* dst) const;
+};
+
+LocallabSpotFootprint getLocallabSpotFootprint(const procparams::LocallabParams::LocallabSpot& spot, int W, int H);
+
+/* Cache of the results of the locallab spots of the preview.
+ * A spot is skipped when its parameters, the parameters read by Lab_Local outside of the spot and the image
+ * in its footprint did not change since the last update: the footprint of the output image and the references
+ * reported to the GUI are restored instead of running calc_ref, the masks and the tools of the spot again.
+ */
+class LocallabSpotCache final :
+    public NonCopyable
+{
+public:
+    // values computed for a spot besides its output image
+    struct Results {
+        double huerefblur;
+        double chromarefblur;
+        double lumarefblur;
+        double hueref;
+        double chromaref;
+        double lumaref;
+        double sobelref;
+        float avg;
+        float meantm;
+        float stdtm;
+        float meanreti;
+        float stdreti;
+        float huerefp;
+        float chromarefp;
+        float lumarefp;
+        float fab;
+        LocallabListener::locallabRetiMinMax retiMinMax;
+        // mean and sigma of the normalization, stored in unused parameters of the spot
+        double noiselumc;
+        double softradiustm;
+        int sensihs;
+        int sensiv;
+    };
+
+    class Key
+    {
+    public:
+        Key(const procparams::ProcParams& params, int sp, int scale, const LocallabSpotFootprint& footprint, const LabImage* input, const LabImage* original, bool multiThread);
+
+        bool operator ==(const Key& other) const;
+
+    private:
+        procparams::LocallabParams::LocallabSpot spot;
+        int sp;
+        int scale;
+        int width;
+        int height;
+        LocallabSpotFootprint footprint;
+        std::uint64_t inputHash;
+        std::uint64_t originalHash;
+        procparams::ToneCurveParams toneCurve;
+        procparams::WBParams wb;
+        procparams::RAWParams raw;
+        procparams::ColorManagementParams icm;
+        bool epdEnabled;
+        bool gamut;
+    };
+
+    LocallabSpotCache();
+    ~LocallabSpotCache();
+
+    // on a hit the cached footprint is copied into image
+    bool get(int sp, const Key& key, LabImage* image, Results& results) const;
+    void put(int sp, const Key& key, const LocallabSpotFootprint& footprint, const LabImage* image, const Results& results);
+    void resize(std::size_t spots);
+    void clear();
+
+private:
+    struct Entry;
+
+    std::vector<std::unique_ptr<Entry>> entries;
+};
+
+}
@@ -22,6 +22,7 @@
 
 #include <cmath>
 #include <stack>
+#include <vector>
 
 #include "array2D.h"
 #include "gauss.h"
@@ -75,6 +76,39 @@ float nonGreenDiffCross(float right, float left, float top, float bottom, float
     return std::min(hDiff, vDiff) - stddev;
 }
 
+#ifdef __SSE2__
+vfloat greenDiff(vfloat a, vfloat b, vfloat stddevFactor, vfloat eperIso, vfloat nreadIso, vfloat prnu)
+{
+    // calculate the difference between two green samples
+    vfloat gDiff = a - b;
+    gDiff *= eperIso;
+    gDiff *= gDiff;
+    vfloat avg = (a + b) * F2V(0.5f);
+    avg *= eperIso;
+    prnu *= avg;
+    vfloat stddev = stddevFactor * (avg + nreadIso + prnu * prnu);
+    return gDiff - stddev;
+}
+
+vfloat nonGreenDiffCross(vfloat right, vfloat left, vfloat top, vfloat bottom, vfloat centre, vfloat clippedVal, vfloat stddevFactor, vfloat eperIso, vfloat nreadIso, vfloat prnu)
+{
+    const vmask clippedMask = vmaskf_gt(vmaxf(vmaxf(vmaxf(right, left), vmaxf(top, bottom)), centre), clippedVal);
+
+    // check non green cross
+    vfloat hDiff = (right + left) * F2V(0.5f) - centre;
+    hDiff *= eperIso;
+    hDiff *= hDiff;
+    vfloat vDiff = (top + bottom) * F2V(0.5f) - centre;
+    vDiff *= eperIso;
+    vDiff *= vDiff;
+    vfloat avg = ((right + left) + (top + bottom)) * F2V(0.25f);
+    avg *= eperIso;
+    prnu *= avg;
+    vfloat stddev = stddevFactor * (avg + nreadIso + prnu * prnu);
+    return vself(clippedMask, ZEROV, vminf(hDiff, vDiff) - stddev);
+}
+#endif
+
 void paintMotionMask(int index, bool showMotion, float *maskDest, float *nonMaskDest0, float *nonMaskDest1)
 {
     if(showMotion) {
@@ -811,49 +845,106 @@ BENCHFUN
 
 
 #ifdef _OPENMP
-        #pragma omp parallel for schedule(dynamic,16)
+        #pragma omp parallel
+#endif
+        {
+            // the two green samples of each pixel of the current row, gathered once so the checks below can run branch free
+            std::vector<float> greenRow0(winw + 4);
+            std::vector<float> greenRow1(winw + 4);
+#ifdef __SSE2__
+            const vfloat noMotionv = F2V(noMotion);
+            const vfloat greenWeightv = F2V(greenWeight);
+            const vfloat redBlueWeightv = F2V(redBlueWeight);
+            const vfloat stddevFactorGreenv = F2V(stddevFactorGreen);
+            const vfloat stddevFactorRedv = F2V(stddevFactorRed);
+            const vfloat stddevFactorBluev = F2V(stddevFactorBlue);
+            const vfloat eperIsoGreenv = F2V(eperIsoGreen);
+            const vfloat eperIsoRedv = F2V(eperIsoRed);
+            const vfloat eperIsoBluev = F2V(eperIsoBlue);
+            const vfloat clippedRedv = F2V(clippedRed);
+            const vfloat clippedBluev = F2V(clippedBlue);
+            const vfloat nReadv = F2V(nRead);
+            const vfloat prnuv = F2V(prnu);
+#endif
+#ifdef _OPENMP
+            #pragma omp for schedule(dynamic,16)
 #endif
 
-        for(int i = winy + border - offsY; i < winh - (border + offsY); ++i) {
-            // offset to keep the code short. It changes its value between 0 and 1 for each iteration of the loop
-            unsigned int offset = fc(cfarray, i, winx + border - offsX) & 1;
-
-            for(int j = winx + border - offsX; j < winw - (border + offsX); ++j, offset ^= 1) {
-                psMask[i][j] = noMotion;
+            for(int i = winy + border - offsY; i < winh - (border + offsY); ++i) {
+                const int jStart = winx + border - offsX;
+                const int jEnd = winw - (border + offsX);
 
                 if(checkGreen) {
-                    if(greenDiff((*rawDataFrames[1 - offset])[i - offset + 1][j] * greenBrightness[1 - offset], (*rawDataFrames[3 - offset])[i + offset][j + 1] * greenBrightness[3 - offset], stddevFactorGreen, eperIsoGreen, nRead, prnu) > 0.f) {
-                        psMask[i][j] = greenWeight;
-                        // do not set the motion pixel values. They have already been set by demosaicer
-                        continue;
+                    // offset to keep the code short. It changes its value between 0 and 1 for each iteration of the loop
+                    unsigned int offset = fc(cfarray, i, jStart) & 1;
+
+                    for(int j = jStart; j < jEnd; ++j, offset ^= 1) {
+                        greenRow0[j] = (*rawDataFrames[1 - offset])[i - offset + 1][j] * greenBrightness[1 - offset];
+                        greenRow1[j] = (*rawDataFrames[3 - offset])[i + offset][j + 1] * greenBrightness[3 - offset];
                     }
                 }
 
-                if(checkNonGreenCross) {
-                    // check red cross
-                    float redTop    = psRed[i - 1][j];
-                    float redLeft   = psRed[i][j - 1];
-                    float redCentre = psRed[i][j];
-                    float redRight  = psRed[i][j + 1];
-                    float redBottom = psRed[i + 1][j];
-                    float redDiff   = nonGreenDiffCross(redRight, redLeft, redTop, redBottom, redCentre, clippedRed, stddevFactorRed, eperIsoRed, nRead, prnu);
-
-                    if(redDiff > 0.f) {
-                        psMask[i][j] = redBlueWeight;
-                        continue;
+                int j = jStart;
+#ifdef __SSE2__
+
+                for(; j < jEnd - 3; j += 4) {
+                    vfloat maskv = noMotionv;
+
+                    if(checkNonGreenCross) {
+                        // check red and blue cross
+                        const vfloat redDiffv = nonGreenDiffCross(LVFU(psRed[i][j + 1]), LVFU(psRed[i][j - 1]), LVFU(psRed[i - 1][j]), LVFU(psRed[i + 1][j]), LVFU(psRed[i][j]), clippedRedv, stddevFactorRedv, eperIsoRedv, nReadv, prnuv);
+                        const vfloat blueDiffv = nonGreenDiffCross(LVFU(psBlue[i][j + 1]), LVFU(psBlue[i][j - 1]), LVFU(psBlue[i - 1][j]), LVFU(psBlue[i + 1][j]), LVFU(psBlue[i][j]), clippedBluev, stddevFactorBluev, eperIsoBluev, nReadv, prnuv);
+                        maskv = vself(vorm(vmaskf_gt(redDiffv, ZEROV), vmaskf_gt(blueDiffv, ZEROV)), redBlueWeightv, maskv);
                     }
 
-                    // check blue cross
-                    float blueTop    = psBlue[i - 1][j];
-                    float blueLeft   = psBlue[i][j - 1];
-                    float blueCentre = psBlue[i][j];
-                    float blueRight  = psBlue[i][j + 1];
-                    float blueBottom = psBlue[i + 1][j];
-                    float blueDiff   = nonGreenDiffCross(blueRight, blueLeft, blueTop, blueBottom, blueCentre, clippedBlue, stddevFactorBlue, eperIsoBlue, nRead, prnu);
-
-                    if(blueDiff > 0.f) {
-                        psMask[i][j] = redBlueWeight;
-                        continue;
+                    if(checkGreen) {
+                        // green motion has priority over red and blue motion
+                        const vfloat greenDiffv = greenDiff(LVFU(greenRow0[j]), LVFU(greenRow1[j]), stddevFactorGreenv, eperIsoGreenv, nReadv, prnuv);
+                        maskv = vself(vmaskf_gt(greenDiffv, ZEROV), greenWeightv, maskv);
+                    }
+
+                    STVFU(psMask[i][j], maskv);
+                }
+
+#endif
+
+                for(; j < jEnd; ++j) {
+                    psMask[i][j] = noMotion;
+
+                    if(checkGreen) {
+                        if(greenDiff(greenRow0[j], greenRow1[j], stddevFactorGreen, eperIsoGreen, nRead, prnu) > 0.f) {
+                            psMask[i][j] = greenWeight;
+                            // do not set the motion pixel values. They have already been set by demosaicer
+                            continue;
+                        }
+                    }
+
+                    if(checkNonGreenCross) {
+                        // check red cross
+                        float redTop    = psRed[i - 1][j];
+                        float redLeft   = psRed[i][j - 1];
+                        float redCentre = psRed[i][j];
+                        float redRight  = psRed[i][j + 1];
+                        float redBottom = psRed[i + 1][j];
+                        float redDiff   = nonGreenDiffCross(redRight, redLeft, redTop, redBottom, redCentre, clippedRed, stddevFactorRed, eperIsoRed, nRead, prnu);
+
+                        if(redDiff > 0.f) {
+                            psMask[i][j] = redBlueWeight;
+                            continue;
+                        }
+
+                        // check blue cross
+                        float blueTop    = psBlue[i - 1][j];
+                        float blueLeft   = psBlue[i][j - 1];
+                        float blueCentre = psBlue[i][j];
+                        float blueRight  = psBlue[i][j + 1];
+                        float blueBottom = psBlue[i + 1][j];
+                        float blueDiff   = nonGreenDiffCross(blueRight, blueLeft, blueTop, blueBottom, blueCentre, clippedBlue, stddevFactorBlue, eperIsoBlue, nRead, prnu);
+
+                        if(blueDiff > 0.f) {
+                            psMask[i][j] = redBlueWeight;
+                            continue;
+                        }
                     }
                 }
             }
@@ -0,0 +1,155 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+#include "fftwplancache.h"
+#include "poissonsolver.h"
+#include "rt_math.h"
+
+#include "../rtgui/threadutils.h"
+
+namespace
+{
+
+using namespace rtengine;
+
+// enough for the spots of the local adjustments and the sizes of the Fattal pyramid
+constexpr std::size_t maxTables = 64;
+
+// table[i] = 1 - cos(i pi / n) for i in [0..size[
+std::shared_ptr<const std::vector<float>> getCosineTable(int size, int n)
+{
+    static std::map<std::pair<int, int>, std::shared_ptr<const std::vector<float>>> tables;
+    static MyMutex mutex;
+
+    MyMutex::MyLock lock(mutex);
+
+    const auto key = std::make_pair(size, n);
+    const auto iter = tables.find(key);
+
+    if (iter != tables.end()) {
+        return iter->second;
+    }
+
+    if (tables.size() >= maxTables) {
+        tables.clear();
+    }
+
+    const std::shared_ptr<std::vector<float>> table = std::make_shared<std::vector<float>>(size);
+    const double pi_n = RT_PI / n;
+
+    for (int i = 0; i < size; ++i) {
+        (*table)[i] = 1.0 - std::cos(pi_n * i);
+    }
+
+    tables[key] = table;
+    return table;
+}
+
+}
+
+namespace rtengine
+{
+
+PoissonSolver::PoissonSolver(int W, int H, Boundary boundary, bool multiThread) :
+    W(W),
+    H(H),
+    boundary(boundary),
+    multiThread(multiThread),
+    tableX(getCosineTable(W, boundary == Boundary::HALF_SAMPLE ? W : std::max(W - 1, 1))),
+    tableY(getCosineTable(H, boundary == Boundary::HALF_SAMPLE ? H : std::max(H - 1, 1)))
+{
+}
+
+bool PoissonSolver::forward(float* in, float* out) const
+{
+    const auto plan = FFTWPlanCache::getInstance().getPlan(H, W, boundary == Boundary::HALF_SAMPLE ? FFTW_REDFT10 : FFTW_REDFT00, FFTW_ESTIMATE | FFTW_DESTROY_INPUT, in, out, multiThread);
+
+    if (!plan) {
+        return false;
+    }
+
+    fftwf_execute_r2r(plan.get(), in, out);
+    return true;
+}
+
+bool PoissonSolver::backward(float* in, float* out) const
+{
+    const auto plan = FFTWPlanCache::getInstance().getPlan(H, W, boundary == Boundary::HALF_SAMPLE ? FFTW_REDFT01 : FFTW_REDFT00, FFTW_ESTIMATE | FFTW_DESTROY_INPUT, in, out, multiThread);
+
+    if (!plan) {
+        return false;
+    }
+
+    fftwf_execute_r2r(plan.get(), in, out);
+    return true;
+}
+
+void PoissonSolver::divide(float* spectrum, double scale, float screen) const
+{
+    // the eigenvalues of L are 2 * (tableX[x] + tableY[y]), forward and backward transforms multiply by 4 * nx * ny
+    const double norm = boundary == Boundary::HALF_SAMPLE ? 4.0 * W * H : 4.0 * std::max(W - 1, 1) * std::max(H - 1, 1);
+    const float* const cosx = tableX->data();
+    const float* const cosy = tableY->data();
+
+    if (screen == 0.f) {
+        const float m2 = scale / norm / 2.0;
+
+#ifdef _OPENMP
+        #pragma omp parallel for if (multiThread)
+#endif
+        for (int y = 0; y < H; ++y) {
+            for (int x = 0; x < W; ++x) {
+                spectrum[y * W + x] *= m2 / (cosx[x] + cosy[y]);
+            }
+        }
+
+        // the constant term, any value only adds a constant to the solution
+        spectrum[0] = 0.f;
+    } else {
+        const float m = scale / norm;
+
+#ifdef _OPENMP
+        #pragma omp parallel for if (multiThread)
+#endif
+        for (int y = 0; y < H; ++y) {
+            for (int x = 0; x < W; ++x) {
+                spectrum[y * W + x] *= m / (2.f * (cosx[x] + cosy[y]) + screen);
+            }
+        }
+    }
+}
+
+bool PoissonSolver::solve(float* data, double scale, float screen) const
+{
+    // in-place transforms, no spectrum buffer needed
+    const auto forwardPlan = FFTWPlanCache::getInstance().getPlan(H, W, boundary == Boundary::HALF_SAMPLE ? FFTW_REDFT10 : FFTW_REDFT00, FFTW_ESTIMATE | FFTW_DESTROY_INPUT, data, data, multiThread);
+    const auto backwardPlan = FFTWPlanCache::getInstance().getPlan(H, W, boundary == Boundary::HALF_SAMPLE ? FFTW_REDFT01 : FFTW_REDFT00, FFTW_ESTIMATE | FFTW_DESTROY_INPUT, data, data, multiThread);
+
+    if (!forwardPlan || !backwardPlan) {
+        return false;
+    }
+
+    fftwf_execute_r2r(forwardPlan.get(), data, data);
+    divide(data, scale, screen);
+    fftwf_execute_r2r(backwardPlan.get(), data, data);
+    return true;
+}
+
+}
@@ -0,0 +1,66 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "noncopyable.h"
+
+namespace rtengine
+{
+
+/* Solver of the Poisson equation L u = f and of the screened Poisson equation (L + screen) u = f on a W x H grid,
+ * where L is minus the 5 points discrete Laplacian with Neumann boundary conditions.
+ * The equation is solved in the basis of the discrete cosine transform matching the boundary conditions:
+ * - HALF_SAMPLE: u(-1) = u(0), DCT-II and DCT-III, used by the Retinex and exposure PDE (IPOL)
+ * - WHOLE_SAMPLE: u(-1) = u(1), DCT-I, used by the Fattal tone mapping
+ * The cosine tables are cached by size and the fftw plans by FFTWPlanCache, so a solver is cheap to construct.
+ * For the Poisson equation the constant term of the solution is 0.
+ */
+class PoissonSolver final :
+    public NonCopyable
+{
+public:
+    enum class Boundary {
+        HALF_SAMPLE,
+        WHOLE_SAMPLE
+    };
+
+    PoissonSolver(int W, int H, Boundary boundary, bool multiThread);
+
+    // unnormalized transforms of W x H values, in and out have to be allocated by fftwf_malloc.
+    // Like solve(), they return false and leave out untouched if fftw can't provide a plan.
+    bool forward(float* in, float* out) const;
+    bool backward(float* in, float* out) const;
+
+    // multiplies the transform of f by scale / (eigenvalues of L + screen), normalized so that the backward transform gives scale * (L + screen)^-1 f
+    void divide(float* spectrum, double scale, float screen = 0.f) const;
+
+    // replaces f by scale * (L + screen)^-1 f, data has to be allocated by fftwf_malloc
+    bool solve(float* data, double scale, float screen = 0.f) const;
+
+private:
+    const int W;
+    const int H;
+    const Boundary boundary;
+    const bool multiThread;
+    std::shared_ptr<const std::vector<float>> tableX; // 1 - cos(i pi / n)
+    std::shared_ptr<const std::vector<float>> tableY;
+};
+
+}
@@ -28,6 +28,7 @@
 #include "ffmanager.h"
 #include "iccmatrices.h"
 #include "iccstore.h"
+#include "icctransform.h"
 #include "imagefloat.h"
 #include "improcfun.h"
 #include "jaggedarray.h"
@@ -464,6 +465,18 @@ RawImageSource::RawImageSource ()
     , redCache(nullptr)
     , blueCache(nullptr)
     , rawDirty(true)
+    , demosaicDeferred(false)
+    , deferredCache(false)
+    , deferredAutoContrast(false)
+    , deferredAutoContrastListener(nullptr)
+    , deferredSharpening(false)
+    , deferredShowMask(false)
+    , demosaicWindowX(0)
+    , demosaicWindowY(0)
+    , demosaicWindowW(0)
+    , demosaicWindowH(0)
+    , lastAutoSharpenContrast(-1.0)
+    , lastAutoSharpenRadius(-1.0)
     , histMatchingParams(new procparams::ColorManagementParams)
 {
     embProfile = nullptr;
@@ -790,6 +803,30 @@ void RawImageSource::getImage (const ColorTemp &ctemp, int tran, Imagefloat* ima
 
     int maxx = this->W, maxy = this->H, skip = pp.getSkip();
 
+    // while demosaic is deferred, sub-sampled previews are binned directly from the cfa data.
+    // The lock is held until the image is read, so no other thread can demosaic the planes meanwhile.
+    MyMutex::MyLock deferredLock(deferredMutex);
+    const bool inArea = demosaicDeferred && isDemosaicedArea(sx1, sy1, std::min(sx1 + imwidth * skip, maxx), std::min(sy1 + imheight * skip, maxy));
+    const bool binned = demosaicDeferred && !inArea && canBin(skip);
+
+    if (demosaicDeferred && !inArea && !binned) {
+        finishDeferredDemosaicLocked();
+    }
+
+    // colour of each cfa site, 24 is a multiple of both the bayer (8x2) and the x-trans (6x6) period
+    unsigned char cfa[24][24];
+
+    if (binned) {
+        const bool xtrans = ri->getSensorType() == ST_FUJI_XTRANS;
+
+        for (int row = 0; row < 24; ++row) {
+            for (int col = 0; col < 24; ++col) {
+                const unsigned c = xtrans ? ri->XTRANSFC(row, col) : FC(row, col);
+                cfa[row][col] = c == 3 ? 1 : c;
+            }
+        }
+    }
+
     // raw clip levels after white balance
     hlmax[0] = clmax[0] * rm;
     hlmax[1] = clmax[1] * gm;
@@ -824,7 +861,39 @@ void RawImageSource::getImage (const ColorTemp &ctemp, int tran, Imagefloat* ima
             int i = sy1 + skip * ix;
             i = std::min(i, maxy - skip); // avoid trouble
 
-            if (ri->getSensorType() == ST_BAYER || ri->getSensorType() == ST_FUJI_XTRANS || ri->get_colors() == 1 || ri->get_colors() == 3) {
+            if (binned) {
+                for (int j = 0, jx = sx1; j < imwidth; j++, jx += skip) {
+                    jx = std::min(jx, maxx - skip); // avoid trouble
+
+                    float tot[3] = {};
+                    int count[3] = {};
+
+                    for (int m = 0; m < skip; m++) {
+                        const unsigned char* const cfarow = cfa[(i + m) % 24];
+
+                        for (int n = 0; n < skip; n++) {
+                            const unsigned c = cfarow[(jx + n) % 24];
+                            tot[c] += rawData[i + m][jx + n];
+                            ++count[c];
+                        }
+                    }
+
+                    // normalize the per colour sums to the full block area, rm, gm and bm already include 1 / area
+                    float rtot = tot[0] * (area / std::max(count[0], 1)) * rm;
+                    float gtot = tot[1] * (area / std::max(count[1], 1)) * gm;
+                    float btot = tot[2] * (area / std::max(count[2], 1)) * bm;
+
+                    if (doClip) {
+                        rtot = CLIP(rtot);
+                        gtot = CLIP(gtot);
+                        btot = CLIP(btot);
+                    }
+
+                    line_red[j] = rtot;
+                    line_grn[j] = gtot;
+                    line_blue[j] = btot;
+                }
+            } else if (ri->getSensorType() == ST_BAYER || ri->getSensorType() == ST_FUJI_XTRANS || ri->get_colors() == 1 || ri->get_colors() == 3) {
                 for (int j = 0, jx = sx1; j < imwidth; j++, jx += skip) {
                     jx = std::min(jx, maxx - skip); // avoid trouble
 
@@ -1476,11 +1545,28 @@ void RawImageSource::preprocess  (const RAWParams &raw, const LensProfParams &le
             bitmapBads.reset(new PixelsMap(W, H));
         }
 
-        int nFound = findHotDeadPixels(*bitmapBads, raw.hotdeadpix_thresh, raw.hotPixelFilter, raw.deadPixelFilter);
-        totBP += nFound;
+        // optionally the hot/dead pixels of a camera body are stored per serial number, ISO and exposure time, once known they are applied without scanning the image
+        const std::string serial = settings->storehotdeadpixels ? idata->getSerialNumber() : std::string();
+        std::vector<badPix> detected;
+
+        if (!serial.empty() && DFManager::getInstance().getDetectedPixels(ri->get_maker(), ri->get_model(), serial, W, H, idata->getISOSpeed(), idata->getShutterSpeed(), raw.hotdeadpix_thresh, raw.hotPixelFilter, raw.deadPixelFilter, fileName, detected)) {
+            const int nFound = bitmapBads->set(detected);
+            totBP += nFound;
+
+            if (settings->verbose) {
+                printf("Correcting %d known hot/dead pixels of camera %s\n", nFound, serial.c_str());
+            }
+        } else {
+            const int nFound = findHotDeadPixels(*bitmapBads, raw.hotdeadpix_thresh, raw.hotPixelFilter, raw.deadPixelFilter, serial.empty() ? nullptr : &detected);
+            totBP += nFound;
+
+            if (!serial.empty()) {
+                DFManager::getInstance().addDetectedPixels(ri->get_maker(), ri->get_model(), serial, W, H, idata->getISOSpeed(), idata->getShutterSpeed(), raw.hotdeadpix_thresh, raw.hotPixelFilter, raw.deadPixelFilter, fileName, detected);
+            }
 
-        if (settings->verbose && nFound > 0) {
-            printf("Correcting %d hot/dead pixels found inside image\n", nFound);
+            if (settings->verbose && nFound > 0) {
+                printf("Correcting %d hot/dead pixels found inside image\n", nFound);
+            }
         }
     }
 
@@ -1621,7 +1707,181 @@ void RawImageSource::preprocess  (const RAWParams &raw, const LensProfParams &le
 }
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
+bool RawImageSource::deferDemosaic(const RAWParams &raw, bool autoContrast, AutoContrastListener* autoContrastListener, bool cache)
+{
+    bool supported = false;
+
+    if (ri->getSensorType() == ST_BAYER) {
+        supported = raw.bayersensor.method != RAWParams::BayerSensor::getMethodString(RAWParams::BayerSensor::Method::NONE)
+                    && raw.bayersensor.method != RAWParams::BayerSensor::getMethodString(RAWParams::BayerSensor::Method::MONO)
+                    && raw.bayersensor.method != RAWParams::BayerSensor::getMethodString(RAWParams::BayerSensor::Method::PIXELSHIFT);
+    } else if (ri->getSensorType() == ST_FUJI_XTRANS) {
+        supported = raw.xtranssensor.method != RAWParams::XTransSensor::getMethodString(RAWParams::XTransSensor::Method::NONE)
+                    && raw.xtranssensor.method != RAWParams::XTransSensor::getMethodString(RAWParams::XTransSensor::Method::MONO);
+    }
+
+    if (!supported || ri->get_colors() != 3 || fuji || d1x) {
+        return false;
+    }
+
+    MyMutex::MyLock lock(deferredMutex);
+    demosaicDeferred = true;
+    deferredRaw = raw;
+    deferredCache = cache;
+    deferredAutoContrast = autoContrast;
+    deferredAutoContrastListener = autoContrastListener;
+    deferredSharpening = false;
+    demosaicWindowW = demosaicWindowH = 0;
+    rgbSourceModified = false;
+
+    if (settings->verbose) {
+        printf("Demosaic deferred, binning raw data for sub-sampled preview\n");
+    }
+
+    return true;
+}
+
+bool RawImageSource::demosaicArea(const RAWParams &raw, bool autoContrast, AutoContrastListener* autoContrastListener, const std::vector<PreviewProps> &areas, int tran, bool cache)
+{
+    // AMaZE is the only demosaicer working on a window of the frame
+    if (areas.empty() || ri->getSensorType() != ST_BAYER || raw.bayersensor.method != RAWParams::BayerSensor::getMethodString(RAWParams::BayerSensor::Method::AMAZE) || fuji || d1x) {
+        return false;
+    }
+
+    tran = defTransform(tran);
+    int x1 = W, y1 = H, x2 = 0, y2 = 0;
+
+    for (const auto &pp : areas) {
+        int sx1, sy1, width, height, fw;
+        transformRect(pp, tran, sx1, sy1, width, height, fw);
+        x1 = std::min(x1, sx1);
+        y1 = std::min(y1, sy1);
+        x2 = std::max(x2, sx1 + width * pp.getSkip());
+        y2 = std::max(y2, sy1 + height * pp.getSkip());
+    }
+
+    // The outer pixels of the window differ from a full frame demosaic, so the window gets a margin.
+    // It's aligned to 32 pixels to match the AMaZE cfa phase and the tiles of capture sharpening.
+    constexpr int margin = 32;
+    const int winx = std::max(x1 - margin, 0) / 32 * 32;
+    const int winy = std::max(y1 - margin, 0) / 32 * 32;
+    const int winw = std::min((x2 + margin + 31) / 32 * 32, W) - winx;
+    const int winh = std::min((y2 + margin + 31) / 32 * 32, H) - winy;
+
+    if (winw < 2 * margin || winh < 2 * margin || winw * winh > W * H / 2 || !deferDemosaic(raw, autoContrast, autoContrastListener, cache)) {
+        return false;
+    }
+
+    // the window is demosaiced under the lock, so a getImage of another thread can't finish the demosaic meanwhile
+    MyMutex::MyLock lock(deferredMutex);
+
+    if (!demosaicDeferred) {
+        // the full frame has been demosaiced since deferDemosaic()
+        return true;
+    }
+
+    MyTime t1, t2;
+    t1.set();
+
+    amaze_demosaic_RT(winx, winy, winw, winh, rawData, red, green, blue, options.chunkSizeAMAZE, options.measure);
+
+    if (cache) {
+        if (!redCache) {
+            redCache = new array2D<float>(W, H);
+            greenCache = new array2D<float>(W, H);
+            blueCache = new array2D<float>(W, H);
+        }
+
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for (int i = winy; i < winy + winh; ++i) {
+            for (int j = winx; j < winx + winw; ++j) {
+                (*redCache)[i][j] = red[i][j];
+                (*greenCache)[i][j] = green[i][j];
+                (*blueCache)[i][j] = blue[i][j];
+            }
+        }
+    }
+
+    demosaicWindowX = winx;
+    demosaicWindowY = winy;
+    demosaicWindowW = winw;
+    demosaicWindowH = winh;
+
+    t2.set();
+
+    if (settings->verbose) {
+        printf("Demosaicing Bayer data: %s - area %dx%d - %d usec\n", raw.bayersensor.method.c_str(), winw, winh, t2.etime(t1));
+    }
+
+    return true;
+}
+
+bool RawImageSource::isDemosaicedArea(int x1, int y1, int x2, int y2) const
+{
+    if (demosaicWindowW == 0) {
+        return false;
+    }
+
+    // the margin of the window only counts where it touches the frame border
+    constexpr int margin = 32;
+    const int ax1 = demosaicWindowX == 0 ? 0 : demosaicWindowX + margin;
+    const int ay1 = demosaicWindowY == 0 ? 0 : demosaicWindowY + margin;
+    const int ax2 = demosaicWindowX + demosaicWindowW == W ? W : demosaicWindowX + demosaicWindowW - margin;
+    const int ay2 = demosaicWindowY + demosaicWindowH == H ? H : demosaicWindowY + demosaicWindowH - margin;
+
+    return x1 >= ax1 && y1 >= ay1 && x2 <= ax2 && y2 <= ay2;
+}
+
+bool RawImageSource::canBin(int skip) const
+{
+    // every 2x2 bayer block and every 3x3 x-trans block contains all three colours
+    return skip >= (ri->getSensorType() == ST_FUJI_XTRANS ? 3 : 2);
+}
+
+void RawImageSource::finishDeferredDemosaic()
+{
+    MyMutex::MyLock lock(deferredMutex);
+    finishDeferredDemosaicLocked();
+}
+
+void RawImageSource::finishDeferredDemosaicLocked()
+{
+    if (!demosaicDeferred) {
+        return;
+    }
+
+    double contrastThreshold = ri->getSensorType() == ST_BAYER ? deferredRaw.bayersensor.dualDemosaicContrast : deferredRaw.xtranssensor.dualDemosaicContrast;
+    demosaicFrame(deferredRaw, deferredAutoContrast, contrastThreshold, deferredCache);
+
+    if (deferredAutoContrast && deferredAutoContrastListener) {
+        deferredAutoContrastListener->autoContrastChanged(contrastThreshold);
+    }
+
+    if (deferredSharpening) {
+        double sharpenContrastThreshold = deferredSharpeningParams.contrast;
+        double sharpenRadius = deferredSharpeningParams.deconvradius;
+        captureSharpeningArea(deferredSharpeningParams, deferredShowMask, sharpenContrastThreshold, sharpenRadius, 0, 0, W, H);
+    }
+
+    // cleared only now, the planes aren't complete before
+    demosaicDeferred = false;
+    deferredSharpening = false;
+    demosaicWindowW = demosaicWindowH = 0;
+}
+
 void RawImageSource::demosaic(const RAWParams &raw, bool autoContrast, double &contrastThreshold, bool cache)
+{
+    MyMutex::MyLock lock(deferredMutex);
+    demosaicFrame(raw, autoContrast, contrastThreshold, cache);
+
+    demosaicDeferred = false;
+    deferredSharpening = false;
+    demosaicWindowW = demosaicWindowH = 0;
+}
+
+void RawImageSource::demosaicFrame(const RAWParams &raw, bool autoContrast, double &contrastThreshold, bool cache)
 {
     MyTime t1, t2;
     t1.set();
@@ -1754,6 +2014,8 @@ void RawImageSource::demosaic(const RAWParams &raw, bool autoContrast, double &c
 //void RawImageSource::retinexPrepareBuffers(ColorManagementParams cmp, RetinexParams retinexParams, multi_array2D<float, 3> &conversionBuffer, LUTu &lhist16RETI)
 void RawImageSource::retinexPrepareBuffers(const ColorManagementParams& cmp, const RetinexParams &retinexParams, multi_array2D<float, 4> &conversionBuffer, LUTu &lhist16RETI)
 {
+    finishDeferredDemosaic();
+
     bool useHsl = (retinexParams.retinexcolorspace == "HSLLOG" || retinexParams.retinexcolorspace == "HSLLIN");
     conversionBuffer[0] (W - 2 * border, H - 2 * border);
     conversionBuffer[1] (W - 2 * border, H - 2 * border);
@@ -2024,6 +2286,8 @@ void RawImageSource::retinex(const ColorManagementParams& cmp, const RetinexPara
     MyTime t4, t5;
     t4.set();
 
+    finishDeferredDemosaic();
+
     if (settings->verbose) {
         printf ("Applying Retinex\n");
     }
@@ -2443,6 +2707,8 @@ void RawImageSource::flush()
 void RawImageSource::HLRecovery_Global(const ToneCurveParams &hrp)
 {
     if (hrp.hrenabled && hrp.method == "Color") {
+        finishDeferredDemosaic();
+
         if (!rgbSourceModified) {
             if (settings->verbose) {
                 printf ("Applying Highlight Recovery: Color propagation...\n");
@@ -3144,7 +3410,7 @@ void RawImageSource::colorSpaceConversion_ (Imagefloat* im, const ColorManagemen
         }
 
         // Initialize transform
-        cmsHTRANSFORM hTransform;
+        std::shared_ptr<const ICCTransform> transform;
         cmsHPROFILE prophoto = ICCStore::getInstance()->workingSpace("ProPhoto"); // We always use Prophoto to apply the ICC profile to minimize problems with clipping in LUT conversion.
         bool transform_via_pcs_lab = false;
         bool separate_pcs_lab_highlights = false;
@@ -3174,8 +3440,6 @@ void RawImageSource::colorSpaceConversion_ (Imagefloat* im, const ColorManagemen
                 }
             }
         }
-        
-        lcmsMutex->lock ();
 
         switch (camera_icc_type) {
             case CAMERA_ICC_TYPE_PHASE_ONE:
@@ -3184,7 +3448,7 @@ void RawImageSource::colorSpaceConversion_ (Imagefloat* im, const ColorManagemen
                 transform_via_pcs_lab = true;
                 separate_pcs_lab_highlights = true;
                 // We transform to Lab because we can and that we avoid getting an unnecessary unmatched gamma conversion which we would need to revert.
-                hTransform = cmsCreateTransform (in, TYPE_RGB_FLT, nullptr, TYPE_Lab_FLT, INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
+                transform = ICCStore::getInstance()->getTransform(in, TYPE_RGB_FLT, nullptr, TYPE_Lab_FLT, INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
 
                 for (int i = 0; i < 3; i++) {
                     for (int j = 0; j < 3; j++) {
@@ -3202,17 +3466,18 @@ void RawImageSource::colorSpaceConversion_ (Imagefloat* im, const ColorManagemen
             case CAMERA_ICC_TYPE_NIKON:
             case CAMERA_ICC_TYPE_GENERIC:
             default:
-                hTransform = cmsCreateTransform (in, TYPE_RGB_FLT, prophoto, TYPE_RGB_FLT, INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);  // NOCACHE is important for thread safety
+                transform = ICCStore::getInstance()->getTransform(in, TYPE_RGB_FLT, prophoto, TYPE_RGB_FLT, INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);  // NOCACHE is important for thread safety
                 break;
         }
 
-        lcmsMutex->unlock ();
-
-        if (hTransform == nullptr) {
+        if (!transform) {
             // Fallback: create transform from camera profile. Should not happen normally.
-            lcmsMutex->lock ();
-            hTransform = cmsCreateTransform (camprofile, TYPE_RGB_FLT, prophoto, TYPE_RGB_FLT, INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
-            lcmsMutex->unlock ();
+            transform = ICCStore::getInstance()->getTransform(camprofile, TYPE_RGB_FLT, prophoto, TYPE_RGB_FLT, INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
+        }
+
+        if (!transform) {
+            printf("Could not create the transform of the input profile\n");
+            return;
         }
 
         TMatrix toxyz = {}, torgb = {};
@@ -3308,10 +3573,10 @@ void RawImageSource::colorSpaceConversion_ (Imagefloat* im, const ColorManagemen
                 }
 
                 // Run icc transform
-                cmsDoTransform (hTransform, buffer.data, buffer.data, im->getWidth());
+                transform->transform(buffer.data, buffer.data, im->getWidth());
 
                 if (separate_pcs_lab_highlights) {
-                    cmsDoTransform (hTransform, hl_buffer.data, hl_buffer.data, im->getWidth());
+                    transform->transform(hl_buffer.data, hl_buffer.data, im->getWidth());
                 }
 
                 // Apply post-processing
@@ -3407,7 +3672,6 @@ void RawImageSource::colorSpaceConversion_ (Imagefloat* im, const ColorManagemen
                 }
             }
         } // End of parallelization
-        cmsDeleteTransform(hTransform);
     }
 
 //t3.set ();
@@ -5371,6 +5635,8 @@ void RawImageSource::WBauto(double & tempref, double & greenref, array2D<float>
 
 void RawImageSource::getrgbloc(int begx, int begy, int yEn, int xEn, int cx, int cy, int bf_h, int bf_w)
 {
+    finishDeferredDemosaic();
+
 //    BENCHFUN
     //used by auto WB local to calculate red, green, blue in local region
     int precision = 5;
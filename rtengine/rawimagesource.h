@@ -34,6 +34,7 @@
 namespace rtengine
 {
 class PixelsMap;
+struct badPix;
 class RawImage;
 class DiagonalCurve;
 class RetinextransmissionCurve;
@@ -101,6 +102,21 @@ protected:
     // the interpolated blue plane:
     array2D<float>* blueCache;
     bool rawDirty;
+    // demosaic postponed by deferDemosaic(), getImage bins rawData as long as the preview is sub-sampled
+    bool demosaicDeferred;
+    bool deferredCache;
+    bool deferredAutoContrast;
+    AutoContrastListener* deferredAutoContrastListener;
+    bool deferredSharpening;
+    bool deferredShowMask;
+    procparams::RAWParams deferredRaw;
+    procparams::CaptureSharpeningParams deferredSharpeningParams;
+    MyMutex deferredMutex;
+    // part of the frame demosaiced by demosaicArea() while the rest is deferred, empty if demosaicWindowW == 0
+    int demosaicWindowX, demosaicWindowY, demosaicWindowW, demosaicWindowH;
+    // auto contrast and auto radius of the last full frame capture sharpening, < 0 if unknown
+    double lastAutoSharpenContrast;
+    double lastAutoSharpenRadius;
     float psRedBrightness[4];
     float psGreenBrightness[4];
     float psBlueBrightness[4];
@@ -115,6 +131,11 @@ protected:
     void ItcWB(bool extra, double &tempref, double &greenref, double &tempitc, double &greenitc, float &studgood, array2D<float> &redloc, array2D<float> &greenloc, array2D<float> &blueloc, int bfw, int bfh, double &avg_rm, double &avg_gm, double &avg_bm, const procparams::ColorManagementParams &cmp, const procparams::RAWParams &raw, const procparams::WBParams & wbpar);
 
     unsigned FC(int row, int col) const;
+    bool canBin(int skip) const;
+    bool isDemosaicedArea(int x1, int y1, int x2, int y2) const;
+    // the caller has to hold deferredMutex
+    void finishDeferredDemosaicLocked();
+    void demosaicFrame(const procparams::RAWParams &raw, bool autoContrast, double &contrastThreshold, bool cache);
     inline void getRowStartEnd (int x, int &start, int &end);
     static void getProfilePreprocParams(cmsHPROFILE in, float& gammafac, float& lineFac, float& lineSum);
 
@@ -126,6 +147,9 @@ public:
     int load(const Glib::ustring &fname, bool firstFrameOnly);
     void        preprocess  (const procparams::RAWParams &raw, const procparams::LensProfParams &lensProf, const procparams::CoarseTransformParams& coarse, bool prepareDenoise = true) override;
     void        demosaic    (const procparams::RAWParams &raw, bool autoContrast, double &contrastThreshold, bool cache = false) override;
+    bool        deferDemosaic (const procparams::RAWParams &raw, bool autoContrast, AutoContrastListener* autoContrastListener, bool cache = false) override;
+    bool        demosaicArea (const procparams::RAWParams &raw, bool autoContrast, AutoContrastListener* autoContrastListener, const std::vector<PreviewProps> &areas, int tran, bool cache = false) override;
+    void        finishDeferredDemosaic () override;
     void        retinex       (const procparams::ColorManagementParams& cmp, const procparams::RetinexParams &deh, const procparams::ToneCurveParams& Tc, LUTf & cdcurve, LUTf & mapcurve, const RetinextransmissionCurve & dehatransmissionCurve, const RetinexgaintransmissionCurve & dehagaintransmissionCurve, multi_array2D<float, 4> &conversionBuffer, bool dehacontlutili, bool mapcontlutili, bool useHsl, float &minCD, float &maxCD, float &mini, float &maxi, float &Tmean, float &Tsigma, float &Tmin, float &Tmax, LUTu &histLRETI) override;
     void        retinexPrepareCurves       (const procparams::RetinexParams &retinexParams, LUTf &cdcurve, LUTf &mapcurve, RetinextransmissionCurve &retinextransmissionCurve, RetinexgaintransmissionCurve &retinexgaintransmissionCurve, bool &retinexcontlutili, bool &mapcontlutili, bool &useHsl, LUTu & lhist16RETI, LUTu & histLRETI) override;
     void        retinexPrepareBuffers      (const procparams::ColorManagementParams& cmp, const procparams::RetinexParams &retinexParams, multi_array2D<float, 4> &conversionBuffer, LUTu &lhist16RETI) override;
@@ -199,6 +223,7 @@ public:
 
     void MSR(float** luminance, float **originalLuminance, float **exLuminance, const LUTf& mapcurve, bool mapcontlutili, int width, int height, const procparams::RetinexParams &deh, const RetinextransmissionCurve & dehatransmissionCurve, const RetinexgaintransmissionCurve & dehagaintransmissionCurve, float &minCD, float &maxCD, float &mini, float &maxi, float &Tmean, float &Tsigma, float &Tmin, float &Tmax);
     void HLRecovery_inpaint (float** red, float** green, float** blue, int blur);
+    void HLRecovery_inpaintRegion (float** red, float** green, float** blue, int blur, int minx, int miny, int maxx, int maxy, const float max_f[3], const float thresh[3], float whitept, float clippt, float blendpt, const float medFactor[3], double progressStart, double progressScale);
     static void HLRecovery_Luminance (float* rin, float* gin, float* bin, float* rout, float* gout, float* bout, int width, float maxval);
     static void HLRecovery_CIELab (float* rin, float* gin, float* bin, float* rout, float* gout, float* bout, int width, float maxval, double cam[3][3], double icam[3][3]);
     static void HLRecovery_blend (float* rin, float* gin, float* bin, int width, float maxval, float* hlmax);
@@ -262,7 +287,7 @@ protected:
     int interpolateBadPixelsBayer(const PixelsMap &bitmapBads, array2D<float> &rawData);
     int interpolateBadPixelsNColours(const PixelsMap &bitmapBads, int colours);
     int interpolateBadPixelsXtrans(const PixelsMap &bitmapBads);
-    int findHotDeadPixels(PixelsMap &bpMap, float thresh, bool findHotPixels, bool findDeadPixels) const;
+    int findHotDeadPixels(PixelsMap &bpMap, float thresh, bool findHotPixels, bool findDeadPixels, std::vector<badPix> *found = nullptr) const;
     int findZeroPixels(PixelsMap &bpMap) const;
     void cfa_linedn (float linenoiselevel, bool horizontal, bool vertical, const CFALineDenoiseRowBlender &rowblender);//Emil's line denoise
 
@@ -307,6 +332,7 @@ protected:
     void    vflip       (Imagefloat* im);
     void getRawValues(int x, int y, int rotate, int &R, int &G, int &B) override;
     void captureSharpening(const procparams::CaptureSharpeningParams &sharpeningParams, bool showMask, double &conrastThreshold, double &radius) override;
+    void captureSharpeningArea(const procparams::CaptureSharpeningParams &sharpeningParams, bool showMask, double &conrastThreshold, double &radius, int x, int y, int w, int h);
     void applyDngGainMap(const float black[4], const std::vector<GainMap> &gainMaps);
 };
 
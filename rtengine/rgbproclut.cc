@@ -0,0 +1,427 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cstring>
+
+#include "color.h"
+#include "imagefloat.h"
+#include "labimage.h"
+#include "LUT.h"
+#include "rgbproclut.h"
+#include "rt_math.h"
+
+namespace
+{
+
+using rtengine::RGBProcLUT;
+
+// the preview and the detail windows of an editor share a lut, keep the ones of two editors
+constexpr std::size_t maxEntries = 2;
+
+constexpr int strideR = 4 * RGBProcLUT::size * RGBProcLUT::size;
+constexpr int strideG = 4 * RGBProcLUT::size;
+constexpr int strideB = 4;
+
+// a cell is processed exactly if the second difference of Lab along an axis at one of its corners exceeds dE 4 (in LabImage units).
+// Interpolating a cell where a channel clips gives errors up to dE 20, with this bound the errors stay below dE 2.
+constexpr float maxSecondDifference = 4.f * 327.68f;
+
+// FNV-1a of the contents of the curves, they are refilled in place so their address doesn't identify them
+std::uint64_t hashCurves(std::initializer_list<const LUTf*> curves)
+{
+    constexpr std::uint64_t prime = 1099511628211ULL;
+    std::uint64_t hash = 14695981039346656037ULL;
+
+    for (const auto curve : curves) {
+        hash = (hash ^ curve->getSize()) * prime;
+        hash = (hash ^ curve->getClip()) * prime;
+
+        for (int i = 0; i < static_cast<int>(curve->getSize()); ++i) {
+            std::uint32_t bits;
+            std::memcpy(&bits, &(*curve)[i], sizeof(bits));
+            hash = (hash ^ bits) * prime;
+        }
+    }
+
+    return hash;
+}
+
+// value of [0;65535] to lattice coordinate
+const LUTf& getCoordinates()
+{
+    static LUTf coordinates(65536, LUT_CLIP_BELOW | LUT_CLIP_ABOVE);
+    static const bool initialized = []() -> bool
+        {
+            for (int i = 0; i < 65536; ++i) {
+                coordinates[i] = (RGBProcLUT::size - 1) * rtengine::Color::gamma2(i / 65535.0);
+            }
+
+            return true;
+        }();
+    static_cast<void>(initialized);
+
+    return coordinates;
+}
+
+// the 4 vertices of the tetrahedron of the lattice cube containing a point and their weights
+struct Tetrahedron {
+    Tetrahedron(const float* nodes, float r, float g, float b)
+    {
+        const int ir = std::min(static_cast<int>(r), RGBProcLUT::size - 2);
+        const int ig = std::min(static_cast<int>(g), RGBProcLUT::size - 2);
+        const int ib = std::min(static_cast<int>(b), RGBProcLUT::size - 2);
+        const float fr = r - ir;
+        const float fg = g - ig;
+        const float fb = b - ib;
+
+        // the order of the fractional parts gives the path from the first to the last vertex of the cube
+        int stride1, stride2;
+        float f1, f2, f3;
+
+        if (fr >= fg) {
+            if (fg >= fb) {
+                stride1 = strideR;
+                stride2 = strideG;
+                f1 = fr;
+                f2 = fg;
+                f3 = fb;
+            } else if (fr >= fb) {
+                stride1 = strideR;
+                stride2 = strideB;
+                f1 = fr;
+                f2 = fb;
+                f3 = fg;
+            } else {
+                stride1 = strideB;
+                stride2 = strideR;
+                f1 = fb;
+                f2 = fr;
+                f3 = fg;
+            }
+        } else {
+            if (fr >= fb) {
+                stride1 = strideG;
+                stride2 = strideR;
+                f1 = fg;
+                f2 = fr;
+                f3 = fb;
+            } else if (fg >= fb) {
+                stride1 = strideG;
+                stride2 = strideB;
+                f1 = fg;
+                f2 = fb;
+                f3 = fr;
+            } else {
+                stride1 = strideB;
+                stride2 = strideG;
+                f1 = fb;
+                f2 = fg;
+                f3 = fr;
+            }
+        }
+
+        vertices[0] = nodes + ir * strideR + ig * strideG + ib * strideB;
+        vertices[1] = vertices[0] + stride1;
+        vertices[2] = vertices[1] + stride2;
+        vertices[3] = vertices[0] + strideR + strideG + strideB;
+        weights[0] = 1.f - f1;
+        weights[1] = f1 - f2;
+        weights[2] = f2 - f3;
+        weights[3] = f3;
+    }
+
+    const float* vertices[4];
+    float weights[4];
+};
+
+}
+
+namespace rtengine
+{
+
+std::unique_ptr<Imagefloat> RGBProcLUT::createLattice()
+{
+    std::unique_ptr<Imagefloat> lattice(new Imagefloat(size * size, size));
+    float values[size];
+
+    for (int i = 0; i < size; ++i) {
+        values[i] = 65535.0 * Color::igamma2(static_cast<double>(i) / (size - 1));
+    }
+
+    // row r, column g * size + b
+    for (int r = 0; r < size; ++r) {
+        for (int g = 0; g < size; ++g) {
+            for (int b = 0; b < size; ++b) {
+                lattice->r(r, g * size + b) = values[r];
+                lattice->g(r, g * size + b) = values[g];
+                lattice->b(r, g * size + b) = values[b];
+            }
+        }
+    }
+
+    return lattice;
+}
+
+RGBProcLUT::RGBProcLUT(const LabImage& lab, const float* histLuminance) :
+    nodes(4 * latticeSize)
+{
+    if (!nodes.data) {
+        return;
+    }
+
+    for (int r = 0; r < size; ++r) {
+        for (int gb = 0; gb < size * size; ++gb) {
+            float* const node = nodes.data + 4 * (r * size * size + gb);
+            node[0] = lab.L[r][gb];
+            node[1] = lab.a[r][gb];
+            node[2] = lab.b[r][gb];
+            node[3] = histLuminance[r * size * size + gb];
+        }
+    }
+
+    // lattice points where the processing bends along one of the axes
+    std::vector<std::uint8_t> bent(latticeSize);
+    constexpr int strides[3] = {strideR, strideG, strideB};
+
+    for (int r = 0; r < size; ++r) {
+        for (int g = 0; g < size; ++g) {
+            for (int b = 0; b < size; ++b) {
+                const int position[3] = {r, g, b};
+                const float* const node = nodes.data + r * strideR + g * strideG + b * strideB;
+
+                for (int axis = 0; axis < 3 && !bent[(r * size + g) * size + b]; ++axis) {
+                    if (position[axis] > 0 && position[axis] < size - 1) {
+                        const float* const previous = node - strides[axis];
+                        const float* const next = node + strides[axis];
+                        const float dL = previous[0] - 2.f * node[0] + next[0];
+                        const float da = previous[1] - 2.f * node[1] + next[1];
+                        const float db = previous[2] - 2.f * node[2] + next[2];
+                        bent[(r * size + g) * size + b] = SQR(dL) + SQR(da) + SQR(db) > SQR(maxSecondDifference);
+                    }
+                }
+            }
+        }
+    }
+
+    exactCells.resize(cells * cells * cells);
+
+    for (int r = 0; r < cells; ++r) {
+        for (int g = 0; g < cells; ++g) {
+            for (int b = 0; b < cells; ++b) {
+                const std::uint8_t* const first = bent.data() + (r * size + g) * size + b;
+                exactCells[(r * cells + g) * cells + b] =
+                    first[0] || first[1] || first[size] || first[size + 1]
+                    || first[size * size] || first[size * size + 1] || first[size * size + size] || first[size * size + size + 1];
+            }
+        }
+    }
+}
+
+bool RGBProcLUT::isValid() const
+{
+    return nodes.data;
+}
+
+bool RGBProcLUT::isExact(float r, float g, float b) const
+{
+    const int ir = std::min(static_cast<int>(r), cells - 1);
+    const int ig = std::min(static_cast<int>(g), cells - 1);
+    const int ib = std::min(static_cast<int>(b), cells - 1);
+
+    return exactCells[(ir * cells + ig) * cells + ib];
+}
+
+void RGBProcLUT::interpolate(float r, float g, float b, float* result) const
+{
+    const Tetrahedron tetrahedron(nodes.data, r, g, b);
+
+    for (int c = 0; c < 4; ++c) {
+        result[c] = 0.f;
+
+        for (int k = 0; k < 4; ++k) {
+            result[c] += tetrahedron.weights[k] * tetrahedron.vertices[k][c];
+        }
+    }
+}
+
+#ifdef __SSE2__
+vfloat RGBProcLUT::interpolate(float r, float g, float b) const
+{
+    const Tetrahedron tetrahedron(nodes.data, r, g, b);
+
+    return F2V(tetrahedron.weights[0]) * LVF(tetrahedron.vertices[0][0])
+           + F2V(tetrahedron.weights[1]) * LVF(tetrahedron.vertices[1][0])
+           + F2V(tetrahedron.weights[2]) * LVF(tetrahedron.vertices[2][0])
+           + F2V(tetrahedron.weights[3]) * LVF(tetrahedron.vertices[3][0]);
+}
+#endif
+
+void RGBProcLUT::apply(const float* r, const float* g, const float* b, float* L, float* a, float* bOut, float* histLuminance, int width, std::vector<int>& exact) const
+{
+    const LUTf& coordinates = getCoordinates();
+
+    int x = 0;
+
+#ifdef __SSE2__
+    const vfloat maxv = F2V(65535.f);
+    const vfloat minusonev = F2V(-1.f);
+
+    for (; x < width - 3; x += 4) {
+        const vfloat rv = LVFU(r[x]);
+        const vfloat gv = LVFU(g[x]);
+        const vfloat bv = LVFU(b[x]);
+        // false for NaN
+        const vmask inRange = vandm(vandm(vandm(vmaskf_ge(rv, ZEROV), vmaskf_le(rv, maxv)), vandm(vmaskf_ge(gv, ZEROV), vmaskf_le(gv, maxv))), vandm(vmaskf_ge(bv, ZEROV), vmaskf_le(bv, maxv)));
+        const int inRangeMask = _mm_movemask_ps((vfloat)inRange);
+
+        float cr[4] ALIGNED16;
+        float cg[4] ALIGNED16;
+        float cb[4] ALIGNED16;
+        STVF(cr[0], coordinates[rv]);
+        STVF(cg[0], coordinates[gv]);
+        STVF(cb[0], coordinates[bv]);
+
+        vfloat result[4];
+        float interpolated[4] ALIGNED16;
+
+        for (int k = 0; k < 4; ++k) {
+            if ((inRangeMask & (1 << k)) && !isExact(cr[k], cg[k], cb[k])) {
+                result[k] = interpolate(cr[k], cg[k], cb[k]);
+                interpolated[k] = 1.f;
+            } else {
+                result[k] = ZEROV;
+                interpolated[k] = 0.f;
+                exact.push_back(x + k);
+            }
+        }
+
+        _MM_TRANSPOSE4_PS(result[0], result[1], result[2], result[3]);
+
+        const vmask useResult = vmaskf_gt(LVF(interpolated[0]), ZEROV);
+        STVFU(L[x], vself(useResult, result[0], LVFU(L[x])));
+        STVFU(a[x], vself(useResult, result[1], LVFU(a[x])));
+        STVFU(bOut[x], vself(useResult, result[2], LVFU(bOut[x])));
+        STVFU(histLuminance[x], vself(useResult, result[3], minusonev));
+    }
+#endif
+
+    for (; x < width; ++x) {
+        if (r[x] >= 0.f && r[x] <= 65535.f && g[x] >= 0.f && g[x] <= 65535.f && b[x] >= 0.f && b[x] <= 65535.f
+            && !isExact(coordinates[r[x]], coordinates[g[x]], coordinates[b[x]])) {
+            float result[4];
+            interpolate(coordinates[r[x]], coordinates[g[x]], coordinates[b[x]], result);
+            L[x] = result[0];
+            a[x] = result[1];
+            bOut[x] = result[2];
+            histLuminance[x] = result[3];
+        } else {
+            histLuminance[x] = -1.f;
+            exact.push_back(x);
+        }
+    }
+}
+
+RGBProcLUTCache::Key::Key(const procparams::ProcParams& params, double expcomp, int hlcompr, int hlcomprthresh, const DCPProfile* dcpProf, int sat, float satLimit, float satLimitOpacity,
+                          bool opautili, std::initializer_list<const LUTf*> curves) :
+    toneCurve(params.toneCurve),
+    rgbCurves(params.rgbCurves),
+    chmixer(params.chmixer),
+    hsvequalizer(params.hsvequalizer),
+    filmSimulation(params.filmSimulation),
+    colorToning(params.colorToning),
+    blackwhite(params.blackwhite),
+    icm(params.icm),
+    expcomp(expcomp),
+    hlcompr(hlcompr),
+    hlcomprthresh(hlcomprthresh),
+    dcpProf(dcpProf),
+    sat(sat),
+    satLimit(satLimit),
+    satLimitOpacity(satLimitOpacity),
+    opautili(opautili),
+    curvesHash(hashCurves(curves))
+{
+}
+
+bool RGBProcLUTCache::Key::operator ==(const Key& other) const
+{
+    return
+        toneCurve == other.toneCurve
+        && rgbCurves == other.rgbCurves
+        && chmixer == other.chmixer
+        && hsvequalizer == other.hsvequalizer
+        && filmSimulation == other.filmSimulation
+        && colorToning == other.colorToning
+        && blackwhite == other.blackwhite
+        && icm == other.icm
+        && expcomp == other.expcomp
+        && hlcompr == other.hlcompr
+        && hlcomprthresh == other.hlcomprthresh
+        && dcpProf == other.dcpProf
+        && sat == other.sat
+        && satLimit == other.satLimit
+        && satLimitOpacity == other.satLimitOpacity
+        && opautili == other.opautili
+        && curvesHash == other.curvesHash;
+}
+
+RGBProcLUTCache& RGBProcLUTCache::getInstance()
+{
+    static RGBProcLUTCache instance;
+    return instance;
+}
+
+std::shared_ptr<const RGBProcLUT> RGBProcLUTCache::get(const Key& key)
+{
+    MyMutex::MyLock lock(mutex);
+
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if (it->key == key) {
+            entries.splice(entries.begin(), entries, it);
+            return entries.front().lut;
+        }
+    }
+
+    return nullptr;
+}
+
+void RGBProcLUTCache::put(const Key& key, const std::shared_ptr<const RGBProcLUT>& lut)
+{
+    MyMutex::MyLock lock(mutex);
+
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if (it->key == key) {
+            entries.erase(it);
+            break;
+        }
+    }
+
+    entries.push_front({key, lut});
+
+    while (entries.size() > maxEntries) {
+        entries.pop_back();
+    }
+}
+
+void RGBProcLUTCache::clear()
+{
+    MyMutex::MyLock lock(mutex);
+
+    entries.clear();
+}
+
+}
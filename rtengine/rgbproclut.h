@@ -0,0 +1,132 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <list>
+#include <memory>
+#include <vector>
+
+#include "alignedbuffer.h"
+#include "LUT.h"
+#include "noncopyable.h"
+#include "opthelper.h"
+#include "procparams.h"
+
+#include "../rtgui/threadutils.h"
+
+namespace rtengine
+{
+
+class DCPProfile;
+class Imagefloat;
+class LabImage;
+
+/* 3D lut of the colour pipeline of ImProcFunctions::rgbProc, from working RGB to Lab, baked by running rgbProc on the
+ * lattice points. Besides Lab, each lattice point holds the luminance which rgbProc puts in the tone curve histogram.
+ * The lattice is regular in sRGB gamma encoded values of [0;65535] and is interpolated with tetrahedrons.
+ * Pixels out of [0;65535] can't be interpolated and have to be processed by rgbProc, as the pixels of the cells
+ * where the processing bends too much to be interpolated, usually because a channel clips inside the cell.
+ */
+class RGBProcLUT final :
+    public NonCopyable
+{
+public:
+    static constexpr int size = 48; // lattice points per axis
+    static constexpr int latticeSize = size * size * size;
+
+    // the lattice points as a size * size by size image, for rgbProc
+    static std::unique_ptr<Imagefloat> createLattice();
+
+    // lab and histLuminance are the results of rgbProc for the image of createLattice()
+    RGBProcLUT(const LabImage& lab, const float* histLuminance);
+
+    bool isValid() const;
+
+    // converts one row, histLuminance is set to -1 for the pixels which need rgbProc, which are appended to exact
+    // and left untouched in L, a and b
+    void apply(const float* r, const float* g, const float* b, float* L, float* a, float* bOut, float* histLuminance, int width, std::vector<int>& exact) const;
+
+private:
+    bool isExact(float r, float g, float b) const;
+    void interpolate(float r, float g, float b, float* result) const;
+#ifdef __SSE2__
+    vfloat interpolate(float r, float g, float b) const;
+#endif
+
+    static constexpr int cells = size - 1; // lattice cells per axis
+
+    AlignedBuffer<float> nodes; // L, a, b and histogram luminance of each lattice point, b varying fastest
+    std::vector<std::uint8_t> exactCells; // 1 for the cells which need rgbProc
+};
+
+/* Cache of the RGBProcLUTs of the preview and of the detail windows, which are processed with the same parameters.
+ * A lut only depends on the parameters of the tools of rgbProc, so it is kept while the other tools are changed.
+ */
+class RGBProcLUTCache final :
+    public NonCopyable
+{
+public:
+    class Key
+    {
+    public:
+        // curves are all the lookup tables passed to rgbProc, their contents are part of the key
+        Key(const procparams::ProcParams& params, double expcomp, int hlcompr, int hlcomprthresh, const DCPProfile* dcpProf, int sat, float satLimit, float satLimitOpacity,
+            bool opautili, std::initializer_list<const LUTf*> curves);
+
+        bool operator ==(const Key& other) const;
+
+    private:
+        procparams::ToneCurveParams toneCurve;
+        procparams::RGBCurvesParams rgbCurves;
+        procparams::ChannelMixerParams chmixer;
+        procparams::HSVEqualizerParams hsvequalizer;
+        procparams::FilmSimulationParams filmSimulation;
+        procparams::ColorToningParams colorToning;
+        procparams::BlackWhiteParams blackwhite;
+        procparams::ColorManagementParams icm;
+        double expcomp;
+        int hlcompr;
+        int hlcomprthresh;
+        const DCPProfile* dcpProf;
+        int sat;
+        float satLimit;
+        float satLimitOpacity;
+        bool opautili;
+        std::uint64_t curvesHash;
+    };
+
+    static RGBProcLUTCache& getInstance();
+
+    std::shared_ptr<const RGBProcLUT> get(const Key& key);
+    void put(const Key& key, const std::shared_ptr<const RGBProcLUT>& lut);
+    void clear();
+
+private:
+    RGBProcLUTCache() = default;
+
+    struct Entry {
+        Key key;
+        std::shared_ptr<const RGBProcLUT> lut;
+    };
+
+    std::list<Entry> entries; // most recently used first
+    MyMutex mutex;
+};
+
+}
@@ -159,6 +159,91 @@ float calcContrastThreshold(const float* const * luminance, int tileY, int tileX
 
     return (c + 1) / 100.f;
 }
+
+// Position of a rank in a histogram, as found by: while (count < rank) count += histo[k++];
+struct HistoRank {
+    size_t k = 0;
+    size_t count = 0;
+    size_t countBefore = 0; // count - histo[k - 1]
+};
+
+// Finds the positions of numRanks ascending ranks in the histogram of histoSize bins of binOf(data[i]).
+template<typename BinOf>
+void findHistogramRanks(const float* data, size_t size, unsigned int histoSize, const BinOf &binOf, const float* ranks, HistoRank* result, int numRanks, size_t numThreads)
+{
+    // We need one main histogram
+    std::vector<uint32_t> histo(histoSize, 0);
+
+    if (numThreads == 1) {
+        // just one thread => use main histogram
+        for (size_t i = 0; i < size; ++i) {
+            histo[binOf(data[i])]++;
+        }
+    } else {
+#ifdef _OPENMP
+    #pragma omp parallel num_threads(numThreads)
+#endif
+        {
+            // We need one histogram per thread
+            std::vector<uint32_t> histothr(histoSize, 0);
+
+#ifdef _OPENMP
+            #pragma omp for nowait
+#endif
+            for (size_t i = 0; i < size; ++i) {
+                histothr[binOf(data[i])]++;
+            }
+
+#ifdef _OPENMP
+            #pragma omp critical
+#endif
+            {
+                // add per thread histogram to main histogram
+#ifdef _OPENMP
+                #pragma omp simd
+#endif
+
+                for (size_t i = 0; i < histoSize; ++i) {
+                    histo[i] += histothr[i];
+                }
+            }
+        }
+    }
+
+    size_t k = 0;
+    size_t count = 0;
+
+    for (int r = 0; r < numRanks; ++r) {
+        while (count < ranks[r]) {
+            count += histo[k++];
+        }
+
+        result[r].k = k;
+        result[r].count = count;
+        result[r].countBefore = k > 0 ? count - histo[k - 1] : 0;
+    }
+}
+
+float findMaxAbs(const float* data, size_t size)
+{
+    float maxAbs = 0.f;
+    size_t i = 0;
+#ifdef __SSE2__
+    vfloat maxAbsv = ZEROV;
+
+    for (; i + 3 < size; i += 4) {
+        maxAbsv = vmaxf(maxAbsv, vabsf(LVFU(data[i])));
+    }
+
+    maxAbs = vhmax(maxAbsv);
+#endif
+
+    for (; i < size; ++i) {
+        maxAbs = std::max(maxAbs, std::fabs(data[i]));
+    }
+
+    return maxAbs;
+}
 }
 
 namespace rtengine
@@ -217,58 +302,19 @@ void findMinMaxPercentile(const float* data, size_t size, float minPrct, float&
     // calculate scale factor to use full range of histogram
     const float scale = (histoSize - 1) / (maxVal - minVal);
 
-    // We need one main histogram
-    std::vector<uint32_t> histo(histoSize, 0);
-
-    if (numThreads == 1) {
-        // just one thread => use main histogram
-        for (size_t i = 0; i < size; ++i) {
-            // we have to subtract minVal and multiply with scale to get the data in [0;histosize] range
-            histo[static_cast<uint16_t>(scale * (data[i] - minVal))]++;
-        }
-    } else {
-#ifdef _OPENMP
-    #pragma omp parallel num_threads(numThreads)
-#endif
-        {
-            // We need one histogram per thread
-            std::vector<uint32_t> histothr(histoSize, 0);
-
-#ifdef _OPENMP
-            #pragma omp for nowait
-#endif
-            for (size_t i = 0; i < size; ++i) {
-                // we have to subtract minVal and multiply with scale to get the data in [0;histosize] range
-                histothr[static_cast<uint16_t>(scale * (data[i] - minVal))]++;
-            }
-
-#ifdef _OPENMP
-            #pragma omp critical
-#endif
-            {
-                // add per thread histogram to main histogram
-#ifdef _OPENMP
-                #pragma omp simd
-#endif
-
-                for (size_t i = 0; i < histoSize; ++i) {
-                    histo[i] += histothr[i];
-                }
-            }
-        }
-    }
-
-    size_t k = 0;
-    size_t count = 0;
-
-    // find (minPrct*size) smallest value
+    // find (minPrct*size) and (maxPrct*size) smallest value
     const float threshmin = minPrct * size;
-    while (count < threshmin) {
-        count += histo[k++];
-    }
+    const float threshmax = maxPrct * size;
+    const float ranks[2] = {threshmin, threshmax};
+    HistoRank positions[2];
+    // we have to subtract minVal and multiply with scale to get the data in [0;histosize] range
+    findHistogramRanks(data, size, histoSize, [minVal, scale](float val) { return static_cast<uint16_t>(scale * (val - minVal)); }, ranks, positions, 2, numThreads);
+
+    size_t k = positions[0].k;
+    size_t count = positions[0].count;
 
     if (k > 0) { // interpolate
-        const size_t count_ = count - histo[k - 1];
+        const size_t count_ = positions[0].countBefore;
         const float c0 = count - threshmin;
         const float c1 = threshmin - count_;
         minOut = (c1 * k + c0 * (k - 1)) / (c0 + c1);
@@ -280,14 +326,11 @@ void findMinMaxPercentile(const float* data, size_t size, float minPrct, float&
     minOut += minVal;
     minOut = rtengine::LIM(minOut, minVal, maxVal);
 
-    // find (maxPrct*size) smallest value
-    const float threshmax = maxPrct * size;
-    while (count < threshmax) {
-        count += histo[k++];
-    }
+    k = positions[1].k;
+    count = positions[1].count;
 
     if (k > 0) { // interpolate
-        const size_t count_ = count - histo[k - 1];
+        const size_t count_ = positions[1].countBefore;
         const float c0 = count - threshmax;
         const float c1 = threshmax - count_;
         maxOut = (c1 * k + c0 * (k - 1)) / (c0 + c1);
@@ -300,6 +343,23 @@ void findMinMaxPercentile(const float* data, size_t size, float minPrct, float&
     maxOut = rtengine::LIM(maxOut, minVal, maxVal);
 }
 
+float findMedianAbs(const float* data, size_t size, unsigned int histoSize)
+{
+    if (size <= 1) {
+        return 0.f;
+    }
+
+    // Wavelet coefficients mostly are much smaller than the histogram range.
+    // For the small subbands, clearing only the bins up to the largest value is much faster than clearing the whole histogram.
+    const float maxBin = size < 4 * histoSize ? std::min<float>(histoSize - 1, std::ceil(findMaxAbs(data, size))) : histoSize - 1;
+    const float rank = size / 2;
+    HistoRank position;
+    findHistogramRanks(data, size, maxBin + 1, [maxBin](float val) { return static_cast<int>(std::min(maxBin, std::fabs(val))); }, &rank, &position, 1, 1);
+
+    // interpolate
+    return (position.k - 1) + (rank - position.countBefore) / static_cast<float>(position.count - position.countBefore);
+}
+
 void buildBlendMask(const float* const * luminance, float **blend, int W, int H, float &contrastThreshold, bool autoContrast, float ** clipMask) {
 
     if (autoContrast) {
@@ -24,6 +24,9 @@
 namespace rtengine
 {
 void findMinMaxPercentile(const float* data, size_t size, float minPrct, float& minOut, float maxPrct, float& maxOut, bool multiThread = true);
+// median of the absolute values of data, using unit bins in [0;histoSize - 1] with interpolation inside the median bin.
+// The median is the (size / 2) smallest value. Larger values are counted in the last bin.
+float findMedianAbs(const float* data, size_t size, unsigned int histoSize);
 void buildBlendMask(const float* const * luminance, float **blend, int W, int H, float &contrastThreshold, bool autoContrast = false, float ** clipmask = nullptr);
 // implemented in tmo_fattal02
 void buildGradientsMask(int W, int H, float **luminance, float **out, 
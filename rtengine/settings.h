@@ -89,6 +89,9 @@ public:
     double          reduclow;
     bool            detectshape;
     bool            fftwsigma;
+    int             nlmeansquality;         // 1...100, 100 = full search window of the local adjustments NLMeans, lower values search the outer part at half resolution
+    bool            previewcolorlut;        // the preview uses a 3D lut of the colour tools of rgbProc when it can
+    bool            storehotdeadpixels;     // remember the detected hot/dead pixels per camera body and apply them without scanning later images
     int             previewselection;
     double          cbdlsensi;
 //    bool            showtooltip;
@@ -17,21 +17,31 @@
  *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 #include <glibmm/thread.h>
 #include <glibmm/ustring.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "cieimage.h"
 #include "clutstore.h"
 #include "color.h"
 #include "colortemp.h"
 #include "curves.h"
 #include "dcp.h"
+#include "denoiseinfocache.h"
 #include "guidedfilter.h"
 #include "iccstore.h"
 #include "imagefloat.h"
 #include "imagesource.h"
 #include "improcfun.h"
 #include "labimage.h"
+#include "locallabspotcache.h"
 #include "mytime.h"
 #include "processingjob.h"
 #include "procparams.h"
@@ -57,6 +67,29 @@ void adjust_radius(const T &default_param, double scale_factor, T &param)
     param = default_param + delta;
 }
 
+// Level of each spot in the dependency graph of the spots: a spot depends on the previous spots whose footprint
+// intersects its own, so the spots of a level can be processed concurrently once the previous levels are done.
+std::vector<int> getLocallabSpotLevels(const procparams::LocallabParams& locallab, int W, int H, std::vector<LocallabSpotFootprint>& footprints)
+{
+    footprints.clear();
+    std::vector<int> levels;
+
+    for (const auto& spot : locallab.spots) {
+        footprints.push_back(getLocallabSpotFootprint(spot, W, H));
+        int level = 0;
+
+        for (size_t i = 0; i < levels.size(); ++i) {
+            if (footprints[i].intersects(footprints.back())) {
+                level = max(level, levels[i] + 1);
+            }
+        }
+
+        levels.push_back(level);
+    }
+
+    return levels;
+}
+
 
 class ImageProcessor
 {
@@ -581,55 +614,78 @@ private:
                 coordH[0] = begH;
                 coordH[1] = fh / 2 - crH / 2;
                 coordH[2] = fh - crH - begH;
+
+                DenoiseInfoCache::Zones zones;
+                const DenoiseInfoCache::Key zonesKey(imgsrc, params, currWB, tr, fw, fh, crW, crH);
+
+                if (!DenoiseInfoCache::getInstance().get(zonesKey, zones)) {
 #ifdef _OPENMP
-                #pragma omp parallel
+                    #pragma omp parallel
 #endif
-                {
-                    Imagefloat *origCropPart;//init auto noise
-                    origCropPart = new Imagefloat(crW, crH); //allocate memory
-                    Imagefloat *provicalc = new Imagefloat((crW + 1) / 2, (crH + 1) / 2);  //for denoise curves
+                    {
+                        Imagefloat *origCropPart;//init auto noise
+                        origCropPart = new Imagefloat(crW, crH); //allocate memory
+                        Imagefloat *provicalc = new Imagefloat((crW + 1) / 2, (crH + 1) / 2);  //for denoise curves
 
 #ifdef _OPENMP
-                    #pragma omp for schedule(dynamic) collapse(2) nowait
+                        #pragma omp for schedule(dynamic) collapse(2) nowait
 #endif
 
-                    for (int wcr = 0; wcr <= 2; wcr++) {
-                        for (int hcr = 0; hcr <= 2; hcr++) {
-                            PreviewProps ppP(coordW[wcr], coordH[hcr], crW, crH, 1);
-                            imgsrc->getImage(currWB, tr, origCropPart, ppP, params.toneCurve, params.raw);
-                            //baseImg->getStdImage(currWB, tr, origCropPart, ppP, true, params.toneCurve);
+                        for (int wcr = 0; wcr <= 2; wcr++) {
+                            for (int hcr = 0; hcr <= 2; hcr++) {
+                                PreviewProps ppP(coordW[wcr], coordH[hcr], crW, crH, 1);
+                                imgsrc->getImage(currWB, tr, origCropPart, ppP, params.toneCurve, params.raw);
+                                //baseImg->getStdImage(currWB, tr, origCropPart, ppP, true, params.toneCurve);
 
 
-                            // we only need image reduced to 1/4 here
-                            for (int ii = 0; ii < crH; ii += 2) {
-                                for (int jj = 0; jj < crW; jj += 2) {
-                                    provicalc->r(ii >> 1, jj >> 1) = origCropPart->r(ii, jj);
-                                    provicalc->g(ii >> 1, jj >> 1) = origCropPart->g(ii, jj);
-                                    provicalc->b(ii >> 1, jj >> 1) = origCropPart->b(ii, jj);
+                                // we only need image reduced to 1/4 here
+                                for (int ii = 0; ii < crH; ii += 2) {
+                                    for (int jj = 0; jj < crW; jj += 2) {
+                                        provicalc->r(ii >> 1, jj >> 1) = origCropPart->r(ii, jj);
+                                        provicalc->g(ii >> 1, jj >> 1) = origCropPart->g(ii, jj);
+                                        provicalc->b(ii >> 1, jj >> 1) = origCropPart->b(ii, jj);
+                                    }
                                 }
-                            }
 
-                            imgsrc->convertColorSpace(provicalc, params.icm, currWB);  //for denoise luminance curve
-                            int nb = 0;
-                            float chaut = 0.f, redaut = 0.f, blueaut = 0.f, maxredaut = 0.f, maxblueaut = 0.f, minredaut = 0.f, minblueaut = 0.f, chromina = 0.f, sigma = 0.f, lumema = 0.f, sigma_L = 0.f, redyel = 0.f, skinc = 0.f, nsknc = 0.f;
-                            ipf.RGB_denoise_info(origCropPart, provicalc, imgsrc->isRAW(), gamcurve, gam, gamthresh, gamslope,  params.dirpyrDenoise, imgsrc->getDirPyrDenoiseExpComp(), chaut, nb, redaut, blueaut, maxredaut, maxblueaut, minredaut, minblueaut, chromina, sigma, lumema, sigma_L, redyel, skinc, nsknc);
-                            Nb[hcr * 3 + wcr] = nb;
-                            ch_M[hcr * 3 + wcr] = chaut;
-                            max_r[hcr * 3 + wcr] = maxredaut;
-                            max_b[hcr * 3 + wcr] = maxblueaut;
-                            min_r[hcr * 3 + wcr] = minredaut;
-                            min_b[hcr * 3 + wcr] = minblueaut;
-                            lumL[hcr * 3 + wcr] = lumema;
-                            chromC[hcr * 3 + wcr] = chromina;
-                            ry[hcr * 3 + wcr] = redyel;
-                            sk[hcr * 3 + wcr] = skinc;
-                            pcsk[hcr * 3 + wcr] = nsknc;
+                                imgsrc->convertColorSpace(provicalc, params.icm, currWB);  //for denoise luminance curve
+                                int nb = 0;
+                                float chaut = 0.f, redaut = 0.f, blueaut = 0.f, maxredaut = 0.f, maxblueaut = 0.f, minredaut = 0.f, minblueaut = 0.f, chromina = 0.f, sigma = 0.f, lumema = 0.f, sigma_L = 0.f, redyel = 0.f, skinc = 0.f, nsknc = 0.f;
+                                ipf.RGB_denoise_info(origCropPart, provicalc, imgsrc->isRAW(), gamcurve, gam, gamthresh, gamslope,  params.dirpyrDenoise, imgsrc->getDirPyrDenoiseExpComp(), chaut, nb, redaut, blueaut, maxredaut, maxblueaut, minredaut, minblueaut, chromina, sigma, lumema, sigma_L, redyel, skinc, nsknc);
+                                zones.Nb[hcr * 3 + wcr] = nb;
+                                zones.ch_M[hcr * 3 + wcr] = chaut;
+                                zones.max_r[hcr * 3 + wcr] = maxredaut;
+                                zones.max_b[hcr * 3 + wcr] = maxblueaut;
+                                zones.min_r[hcr * 3 + wcr] = minredaut;
+                                zones.min_b[hcr * 3 + wcr] = minblueaut;
+                                zones.lumL[hcr * 3 + wcr] = lumema;
+                                zones.chromC[hcr * 3 + wcr] = chromina;
+                                zones.ry[hcr * 3 + wcr] = redyel;
+                                zones.sk[hcr * 3 + wcr] = skinc;
+                                zones.pcsk[hcr * 3 + wcr] = nsknc;
+                            }
                         }
+
+                        delete provicalc;
+                        delete origCropPart;
                     }
 
-                    delete provicalc;
-                    delete origCropPart;
+                    DenoiseInfoCache::getInstance().put(zonesKey, zones);
                 }
+
+                for (int k = 0; k < 9; k++) {
+                    Nb[k] = zones.Nb[k];
+                    ch_M[k] = zones.ch_M[k];
+                    max_r[k] = zones.max_r[k];
+                    max_b[k] = zones.max_b[k];
+                    min_r[k] = zones.min_r[k];
+                    min_b[k] = zones.min_b[k];
+                    lumL[k] = zones.lumL[k];
+                    chromC[k] = zones.chromC[k];
+                    ry[k] = zones.ry[k];
+                    sk[k] = zones.sk[k];
+                    pcsk[k] = zones.pcsk[k];
+                }
+
                 float chM = 0.f;
                 float MaxR = 0.f;
                 float MaxB = 0.f;
@@ -955,94 +1011,6 @@ private:
             const std::unique_ptr<LabImage> lastorigView(new LabImage(*labView, true));
             std::unique_ptr<LabImage> savenormtmView;
             std::unique_ptr<LabImage> savenormretiView;
-            LocretigainCurve locRETgainCurve;
-            LocretitransCurve locRETtransCurve;
-            LocLHCurve loclhCurve;
-            LocHHCurve lochhCurve;
-            LocCHCurve locchCurve;
-            LocHHCurve lochhCurvejz;
-            LocCHCurve locchCurvejz;
-            LocLHCurve loclhCurvejz;
-            LocCCmaskCurve locccmasCurve;
-            LocLLmaskCurve locllmasCurve;
-            LocHHmaskCurve lochhmasCurve;
-            LocHHmaskCurve lochhhmasCurve;
-            LocCCmaskCurve locccmasexpCurve;
-            LocLLmaskCurve locllmasexpCurve;
-            LocHHmaskCurve lochhmasexpCurve;
-            LocCCmaskCurve locccmasSHCurve;
-            LocLLmaskCurve locllmasSHCurve;
-            LocHHmaskCurve lochhmasSHCurve;
-            LocCCmaskCurve locccmasvibCurve;
-            LocLLmaskCurve locllmasvibCurve;
-            LocHHmaskCurve lochhmasvibCurve;
-            LocCCmaskCurve locccmaslcCurve;
-            LocLLmaskCurve locllmaslcCurve;
-            LocHHmaskCurve lochhmaslcCurve;
-            LocCCmaskCurve locccmascbCurve;
-            LocLLmaskCurve locllmascbCurve;
-            LocHHmaskCurve lochhmascbCurve;
-            LocCCmaskCurve locccmasretiCurve;
-            LocLLmaskCurve locllmasretiCurve;
-            LocHHmaskCurve lochhmasretiCurve;
-            LocCCmaskCurve locccmastmCurve;
-            LocLLmaskCurve locllmastmCurve;
-            LocHHmaskCurve lochhmastmCurve;
-            LocCCmaskCurve locccmasblCurve;
-            LocLLmaskCurve locllmasblCurve;
-            LocHHmaskCurve lochhmasblCurve;
-            LocCCmaskCurve locccmaslogCurve;
-            LocLLmaskCurve locllmaslogCurve;
-            LocHHmaskCurve lochhmaslogCurve;
-            LocCCmaskCurve locccmascieCurve;
-            LocLLmaskCurve locllmascieCurve;
-            LocHHmaskCurve lochhmascieCurve;
-
-            LocCCmaskCurve locccmas_Curve;
-            LocLLmaskCurve locllmas_Curve;
-            LocHHmaskCurve lochhmas_Curve;
-            LocHHmaskCurve lochhhmas_Curve;
-            
-            LocwavCurve loclmasCurveblwav;
-            LocwavCurve loclmasCurvecolwav;
-            LocwavCurve loclmasCurve_wav;
-            LocwavCurve locwavCurve;
-            LocwavCurve locwavCurvejz;
-            LocwavCurve loclevwavCurve;
-            LocwavCurve locconwavCurve;
-            LocwavCurve loccompwavCurve;
-            LocwavCurve loccomprewavCurve;
-            LocwavCurve locedgwavCurve;
-            LocwavCurve locwavCurvehue;
-            LocwavCurve locwavCurveden;
-            LUTf lllocalcurve(65536, LUT_CLIP_OFF);
-            LUTf lclocalcurve(65536, LUT_CLIP_OFF);
-            LUTf cllocalcurve(65536, LUT_CLIP_OFF);
-            LUTf cclocalcurve(65536, LUT_CLIP_OFF);
-            LUTf rgblocalcurve(65536, LUT_CLIP_OFF);
-            LUTf hltonecurveloc(65536, LUT_CLIP_OFF);
-            LUTf shtonecurveloc(65536, LUT_CLIP_OFF);
-            LUTf tonecurveloc(65536, LUT_CLIP_OFF);
-            LUTf lightCurveloc(32770, LUT_CLIP_OFF);
-            LUTf exlocalcurve(65536, LUT_CLIP_OFF);
-            LUTf lmasklocalcurve(65536, LUT_CLIP_OFF);
-            LUTf lmaskexplocalcurve(65536, LUT_CLIP_OFF);
-            LUTf lmaskSHlocalcurve(65536, LUT_CLIP_OFF);
-            LUTf lmaskviblocalcurve(65536, LUT_CLIP_OFF);
-            LUTf lmasktmlocalcurve(65536, LUT_CLIP_OFF);
-            LUTf lmaskretilocalcurve(65536, LUT_CLIP_OFF);
-            LUTf lmaskcblocalcurve(65536, LUT_CLIP_OFF);
-            LUTf lmaskbllocalcurve(65536, LUT_CLIP_OFF);
-            LUTf lmasklclocalcurve(65536, LUT_CLIP_OFF);
-            LUTf lmaskloglocalcurve(65536, LUT_CLIP_OFF);
-            LUTf lmasklocal_curve(65536, LUT_CLIP_OFF);
-            LUTf lmaskcielocalcurve(65536, LUT_CLIP_OFF);
-            LUTf cielocalcurve(65536, LUT_CLIP_OFF);
-            LUTf cielocalcurve2(65536, LUT_CLIP_OFF);
-            LUTf jzlocalcurve(65536, LUT_CLIP_OFF);
-            LUTf czlocalcurve(65536, LUT_CLIP_OFF);
-            LUTf czjzlocalcurve(65536, LUT_CLIP_OFF);
-
             array2D<float> shbuffer;
             for (size_t sp = 0; sp < params.locallab.spots.size(); sp++) {
                 if (params.locallab.spots.at(sp).inverssha) {
@@ -1051,196 +1019,332 @@ private:
                 }
             }
 
-            for (size_t sp = 0; sp < params.locallab.spots.size(); sp++) {
-
-                // Set local curves of current spot to LUT
-                locRETgainCurve.Set(params.locallab.spots.at(sp).localTgaincurve);
-                locRETtransCurve.Set(params.locallab.spots.at(sp).localTtranscurve);
-                const bool LHutili = loclhCurve.Set(params.locallab.spots.at(sp).LHcurve);
-                const bool HHutili = lochhCurve.Set(params.locallab.spots.at(sp).HHcurve);
-                const bool CHutili = locchCurve.Set(params.locallab.spots.at(sp).CHcurve);
-                const bool HHutilijz = lochhCurvejz.Set(params.locallab.spots.at(sp).HHcurvejz);
-                const bool CHutilijz = locchCurvejz.Set(params.locallab.spots.at(sp).CHcurvejz);
-                const bool LHutilijz = loclhCurvejz.Set(params.locallab.spots.at(sp).LHcurvejz);
-                const bool lcmasutili = locccmasCurve.Set(params.locallab.spots.at(sp).CCmaskcurve);
-                const bool llmasutili = locllmasCurve.Set(params.locallab.spots.at(sp).LLmaskcurve);
-                const bool lhmasutili = lochhmasCurve.Set(params.locallab.spots.at(sp).HHmaskcurve);
-                const bool lhhmasutili = lochhhmasCurve.Set(params.locallab.spots.at(sp).HHhmaskcurve);
-                const bool lcmasexputili = locccmasexpCurve.Set(params.locallab.spots.at(sp).CCmaskexpcurve);
-                const bool llmasexputili = locllmasexpCurve.Set(params.locallab.spots.at(sp).LLmaskexpcurve);
-                const bool lhmasexputili = lochhmasexpCurve.Set(params.locallab.spots.at(sp).HHmaskexpcurve);
-                const bool lcmasSHutili = locccmasSHCurve.Set(params.locallab.spots.at(sp).CCmaskSHcurve);
-                const bool llmasSHutili = locllmasSHCurve.Set(params.locallab.spots.at(sp).LLmaskSHcurve);
-                const bool lhmasSHutili = lochhmasSHCurve.Set(params.locallab.spots.at(sp).HHmaskSHcurve);
-                const bool lcmasvibutili = locccmasvibCurve.Set(params.locallab.spots.at(sp).CCmaskvibcurve);
-                const bool llmasvibutili = locllmasvibCurve.Set(params.locallab.spots.at(sp).LLmaskvibcurve);
-                const bool lhmasvibutili = lochhmasvibCurve.Set(params.locallab.spots.at(sp).HHmaskvibcurve);
-                const bool lcmascbutili = locccmascbCurve.Set(params.locallab.spots.at(sp).CCmaskcbcurve);
-                const bool llmascbutili = locllmascbCurve.Set(params.locallab.spots.at(sp).LLmaskcbcurve);
-                const bool lhmascbutili = lochhmascbCurve.Set(params.locallab.spots.at(sp).HHmaskcbcurve);
-                const bool lcmasretiutili = locccmasretiCurve.Set(params.locallab.spots.at(sp).CCmaskreticurve);
-                const bool llmasretiutili = locllmasretiCurve.Set(params.locallab.spots.at(sp).LLmaskreticurve);
-                const bool lhmasretiutili = lochhmasretiCurve.Set(params.locallab.spots.at(sp).HHmaskreticurve);
-                const bool lcmastmutili = locccmastmCurve.Set(params.locallab.spots.at(sp).CCmasktmcurve);
-                const bool lhmaslcutili = lochhmaslcCurve.Set(params.locallab.spots.at(sp).HHmasklccurve);
-                const bool llmastmutili = locllmastmCurve.Set(params.locallab.spots.at(sp).LLmasktmcurve);
-                const bool lhmastmutili = lochhmastmCurve.Set(params.locallab.spots.at(sp).HHmasktmcurve);
-                const bool lcmasblutili = locccmasblCurve.Set(params.locallab.spots.at(sp).CCmaskblcurve);
-                const bool llmasblutili = locllmasblCurve.Set(params.locallab.spots.at(sp).LLmaskblcurve);
-                const bool lhmasblutili = lochhmasblCurve.Set(params.locallab.spots.at(sp).HHmaskblcurve);
-                const bool lcmaslogutili = locccmaslogCurve.Set(params.locallab.spots.at(sp).CCmaskcurveL);
-                const bool llmaslogutili = locllmaslogCurve.Set(params.locallab.spots.at(sp).LLmaskcurveL);
-                const bool lhmaslogutili = lochhmaslogCurve.Set(params.locallab.spots.at(sp).HHmaskcurveL);
-                const bool lcmascieutili = locccmascieCurve.Set(params.locallab.spots.at(sp).CCmaskciecurve);
-                const bool llmascieutili = locllmascieCurve.Set(params.locallab.spots.at(sp).LLmaskciecurve);
-                const bool lhmascieutili = lochhmascieCurve.Set(params.locallab.spots.at(sp).HHmaskciecurve);
+            // runs the spot sp on view, the part of the image at cx, cy
+            const auto processSpot =
+                [&](int sp, LabImage* view, LabImage* reserv, LabImage* lastorig, int cx, int cy) -> void
+                {
+                    LocretigainCurve locRETgainCurve;
+                    LocretitransCurve locRETtransCurve;
+                    LocLHCurve loclhCurve;
+                    LocHHCurve lochhCurve;
+                    LocCHCurve locchCurve;
+                    LocHHCurve lochhCurvejz;
+                    LocCHCurve locchCurvejz;
+                    LocLHCurve loclhCurvejz;
+                    LocCCmaskCurve locccmasCurve;
+                    LocLLmaskCurve locllmasCurve;
+                    LocHHmaskCurve lochhmasCurve;
+                    LocHHmaskCurve lochhhmasCurve;
+                    LocCCmaskCurve locccmasexpCurve;
+                    LocLLmaskCurve locllmasexpCurve;
+                    LocHHmaskCurve lochhmasexpCurve;
+                    LocCCmaskCurve locccmasSHCurve;
+                    LocLLmaskCurve locllmasSHCurve;
+                    LocHHmaskCurve lochhmasSHCurve;
+                    LocCCmaskCurve locccmasvibCurve;
+                    LocLLmaskCurve locllmasvibCurve;
+                    LocHHmaskCurve lochhmasvibCurve;
+                    LocCCmaskCurve locccmaslcCurve;
+                    LocLLmaskCurve locllmaslcCurve;
+                    LocHHmaskCurve lochhmaslcCurve;
+                    LocCCmaskCurve locccmascbCurve;
+                    LocLLmaskCurve locllmascbCurve;
+                    LocHHmaskCurve lochhmascbCurve;
+                    LocCCmaskCurve locccmasretiCurve;
+                    LocLLmaskCurve locllmasretiCurve;
+                    LocHHmaskCurve lochhmasretiCurve;
+                    LocCCmaskCurve locccmastmCurve;
+                    LocLLmaskCurve locllmastmCurve;
+                    LocHHmaskCurve lochhmastmCurve;
+                    LocCCmaskCurve locccmasblCurve;
+                    LocLLmaskCurve locllmasblCurve;
+                    LocHHmaskCurve lochhmasblCurve;
+                    LocCCmaskCurve locccmaslogCurve;
+                    LocLLmaskCurve locllmaslogCurve;
+                    LocHHmaskCurve lochhmaslogCurve;
+                    LocCCmaskCurve locccmascieCurve;
+                    LocLLmaskCurve locllmascieCurve;
+                    LocHHmaskCurve lochhmascieCurve;
+
+                    LocCCmaskCurve locccmas_Curve;
+                    LocLLmaskCurve locllmas_Curve;
+                    LocHHmaskCurve lochhmas_Curve;
+                    LocHHmaskCurve lochhhmas_Curve;
+            
+                    LocwavCurve loclmasCurveblwav;
+                    LocwavCurve loclmasCurvecolwav;
+                    LocwavCurve loclmasCurve_wav;
+                    LocwavCurve locwavCurve;
+                    LocwavCurve locwavCurvejz;
+                    LocwavCurve loclevwavCurve;
+                    LocwavCurve locconwavCurve;
+                    LocwavCurve loccompwavCurve;
+                    LocwavCurve loccomprewavCurve;
+                    LocwavCurve locedgwavCurve;
+                    LocwavCurve locwavCurvehue;
+                    LocwavCurve locwavCurveden;
+                    LUTf lllocalcurve(65536, LUT_CLIP_OFF);
+                    LUTf lclocalcurve(65536, LUT_CLIP_OFF);
+                    LUTf cllocalcurve(65536, LUT_CLIP_OFF);
+                    LUTf cclocalcurve(65536, LUT_CLIP_OFF);
+                    LUTf rgblocalcurve(65536, LUT_CLIP_OFF);
+                    LUTf hltonecurveloc(65536, LUT_CLIP_OFF);
+                    LUTf shtonecurveloc(65536, LUT_CLIP_OFF);
+                    LUTf tonecurveloc(65536, LUT_CLIP_OFF);
+                    LUTf lightCurveloc(32770, LUT_CLIP_OFF);
+                    LUTf exlocalcurve(65536, LUT_CLIP_OFF);
+                    LUTf lmasklocalcurve(65536, LUT_CLIP_OFF);
+                    LUTf lmaskexplocalcurve(65536, LUT_CLIP_OFF);
+                    LUTf lmaskSHlocalcurve(65536, LUT_CLIP_OFF);
+                    LUTf lmaskviblocalcurve(65536, LUT_CLIP_OFF);
+                    LUTf lmasktmlocalcurve(65536, LUT_CLIP_OFF);
+                    LUTf lmaskretilocalcurve(65536, LUT_CLIP_OFF);
+                    LUTf lmaskcblocalcurve(65536, LUT_CLIP_OFF);
+                    LUTf lmaskbllocalcurve(65536, LUT_CLIP_OFF);
+                    LUTf lmasklclocalcurve(65536, LUT_CLIP_OFF);
+                    LUTf lmaskloglocalcurve(65536, LUT_CLIP_OFF);
+                    LUTf lmasklocal_curve(65536, LUT_CLIP_OFF);
+                    LUTf lmaskcielocalcurve(65536, LUT_CLIP_OFF);
+                    LUTf cielocalcurve(65536, LUT_CLIP_OFF);
+                    LUTf cielocalcurve2(65536, LUT_CLIP_OFF);
+                    LUTf jzlocalcurve(65536, LUT_CLIP_OFF);
+                    LUTf czlocalcurve(65536, LUT_CLIP_OFF);
+                    LUTf czjzlocalcurve(65536, LUT_CLIP_OFF);
+
+                    // Set local curves of current spot to LUT
+                    locRETgainCurve.Set(params.locallab.spots.at(sp).localTgaincurve);
+                    locRETtransCurve.Set(params.locallab.spots.at(sp).localTtranscurve);
+                    const bool LHutili = loclhCurve.Set(params.locallab.spots.at(sp).LHcurve);
+                    const bool HHutili = lochhCurve.Set(params.locallab.spots.at(sp).HHcurve);
+                    const bool CHutili = locchCurve.Set(params.locallab.spots.at(sp).CHcurve);
+                    const bool HHutilijz = lochhCurvejz.Set(params.locallab.spots.at(sp).HHcurvejz);
+                    const bool CHutilijz = locchCurvejz.Set(params.locallab.spots.at(sp).CHcurvejz);
+                    const bool LHutilijz = loclhCurvejz.Set(params.locallab.spots.at(sp).LHcurvejz);
+                    const bool lcmasutili = locccmasCurve.Set(params.locallab.spots.at(sp).CCmaskcurve);
+                    const bool llmasutili = locllmasCurve.Set(params.locallab.spots.at(sp).LLmaskcurve);
+                    const bool lhmasutili = lochhmasCurve.Set(params.locallab.spots.at(sp).HHmaskcurve);
+                    const bool lhhmasutili = lochhhmasCurve.Set(params.locallab.spots.at(sp).HHhmaskcurve);
+                    const bool lcmasexputili = locccmasexpCurve.Set(params.locallab.spots.at(sp).CCmaskexpcurve);
+                    const bool llmasexputili = locllmasexpCurve.Set(params.locallab.spots.at(sp).LLmaskexpcurve);
+                    const bool lhmasexputili = lochhmasexpCurve.Set(params.locallab.spots.at(sp).HHmaskexpcurve);
+                    const bool lcmasSHutili = locccmasSHCurve.Set(params.locallab.spots.at(sp).CCmaskSHcurve);
+                    const bool llmasSHutili = locllmasSHCurve.Set(params.locallab.spots.at(sp).LLmaskSHcurve);
+                    const bool lhmasSHutili = lochhmasSHCurve.Set(params.locallab.spots.at(sp).HHmaskSHcurve);
+                    const bool lcmasvibutili = locccmasvibCurve.Set(params.locallab.spots.at(sp).CCmaskvibcurve);
+                    const bool llmasvibutili = locllmasvibCurve.Set(params.locallab.spots.at(sp).LLmaskvibcurve);
+                    const bool lhmasvibutili = lochhmasvibCurve.Set(params.locallab.spots.at(sp).HHmaskvibcurve);
+                    const bool lcmascbutili = locccmascbCurve.Set(params.locallab.spots.at(sp).CCmaskcbcurve);
+                    const bool llmascbutili = locllmascbCurve.Set(params.locallab.spots.at(sp).LLmaskcbcurve);
+                    const bool lhmascbutili = lochhmascbCurve.Set(params.locallab.spots.at(sp).HHmaskcbcurve);
+                    const bool lcmasretiutili = locccmasretiCurve.Set(params.locallab.spots.at(sp).CCmaskreticurve);
+                    const bool llmasretiutili = locllmasretiCurve.Set(params.locallab.spots.at(sp).LLmaskreticurve);
+                    const bool lhmasretiutili = lochhmasretiCurve.Set(params.locallab.spots.at(sp).HHmaskreticurve);
+                    const bool lcmastmutili = locccmastmCurve.Set(params.locallab.spots.at(sp).CCmasktmcurve);
+                    const bool lhmaslcutili = lochhmaslcCurve.Set(params.locallab.spots.at(sp).HHmasklccurve);
+                    const bool llmastmutili = locllmastmCurve.Set(params.locallab.spots.at(sp).LLmasktmcurve);
+                    const bool lhmastmutili = lochhmastmCurve.Set(params.locallab.spots.at(sp).HHmasktmcurve);
+                    const bool lcmasblutili = locccmasblCurve.Set(params.locallab.spots.at(sp).CCmaskblcurve);
+                    const bool llmasblutili = locllmasblCurve.Set(params.locallab.spots.at(sp).LLmaskblcurve);
+                    const bool lhmasblutili = lochhmasblCurve.Set(params.locallab.spots.at(sp).HHmaskblcurve);
+                    const bool lcmaslogutili = locccmaslogCurve.Set(params.locallab.spots.at(sp).CCmaskcurveL);
+                    const bool llmaslogutili = locllmaslogCurve.Set(params.locallab.spots.at(sp).LLmaskcurveL);
+                    const bool lhmaslogutili = lochhmaslogCurve.Set(params.locallab.spots.at(sp).HHmaskcurveL);
+                    const bool lcmascieutili = locccmascieCurve.Set(params.locallab.spots.at(sp).CCmaskciecurve);
+                    const bool llmascieutili = locllmascieCurve.Set(params.locallab.spots.at(sp).LLmaskciecurve);
+                    const bool lhmascieutili = lochhmascieCurve.Set(params.locallab.spots.at(sp).HHmaskciecurve);
                 
-                const bool lcmas_utili = locccmas_Curve.Set(params.locallab.spots.at(sp).CCmask_curve);
-                const bool llmas_utili = locllmas_Curve.Set(params.locallab.spots.at(sp).LLmask_curve);
-                const bool lhmas_utili = lochhmas_Curve.Set(params.locallab.spots.at(sp).HHmask_curve);
-                const bool lhhmas_utili = lochhhmas_Curve.Set(params.locallab.spots.at(sp).HHhmask_curve);
-                const bool lmasutiliblwav = loclmasCurveblwav.Set(params.locallab.spots.at(sp).LLmaskblcurvewav);
-                const bool lmasutilicolwav = loclmasCurvecolwav.Set(params.locallab.spots.at(sp).LLmaskcolcurvewav);
-                const bool lcmaslcutili = locccmaslcCurve.Set(params.locallab.spots.at(sp).CCmasklccurve);
-                const bool llmaslcutili = locllmaslcCurve.Set(params.locallab.spots.at(sp).LLmasklccurve);
-                const bool lmasutili_wav = loclmasCurve_wav.Set(params.locallab.spots.at(sp).LLmask_curvewav);
-                const bool locwavutili = locwavCurve.Set(params.locallab.spots.at(sp).locwavcurve);
-                const bool locwavutilijz = locwavCurvejz.Set(params.locallab.spots.at(sp).locwavcurvejz);
-                const bool locwavhueutili = locwavCurvehue.Set(params.locallab.spots.at(sp).locwavcurvehue);
-                const bool locwavdenutili = locwavCurveden.Set(params.locallab.spots.at(sp).locwavcurveden);
-                const bool loclevwavutili = loclevwavCurve.Set(params.locallab.spots.at(sp).loclevwavcurve);
-                const bool locconwavutili = locconwavCurve.Set(params.locallab.spots.at(sp).locconwavcurve);
-                const bool loccompwavutili = loccompwavCurve.Set(params.locallab.spots.at(sp).loccompwavcurve);
-                const bool loccomprewavutili = loccomprewavCurve.Set(params.locallab.spots.at(sp).loccomprewavcurve);
-                const bool locedgwavutili = locedgwavCurve.Set(params.locallab.spots.at(sp).locedgwavcurve);
-                const bool locallutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).llcurve, lllocalcurve, 1);
-                const bool localclutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).clcurve, cllocalcurve, 1);
-                const bool locallcutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).lccurve, lclocalcurve, 1);
-                const bool localcutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).cccurve, cclocalcurve, 1);
-                const bool localrgbutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).rgbcurve, rgblocalcurve, 1);
-                const bool localexutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).excurve, exlocalcurve, 1);
-                const bool localmaskutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).Lmaskcurve, lmasklocalcurve, 1);
-                const bool localmaskexputili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).Lmaskexpcurve, lmaskexplocalcurve, 1);
-                const bool localmaskSHutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).LmaskSHcurve, lmaskSHlocalcurve, 1);
-                const bool localmaskvibutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).Lmaskvibcurve, lmaskviblocalcurve, 1);
-                const bool localmasktmutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).Lmasktmcurve, lmasktmlocalcurve, 1);
-                const bool localmaskretiutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).Lmaskreticurve, lmaskretilocalcurve, 1);
-                const bool localmaskcbutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).Lmaskcbcurve, lmaskcblocalcurve, 1);
-                const bool localmaskblutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).Lmaskblcurve, lmaskbllocalcurve, 1);
-                const bool localmasklcutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).Lmasklccurve, lmasklclocalcurve, 1);
-                const bool localmasklogutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).LmaskcurveL, lmaskloglocalcurve, 1);
-                const bool localmask_utili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).Lmask_curve, lmasklocal_curve, 1);
-                const bool localmaskcieutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).Lmaskciecurve, lmaskcielocalcurve, 1);
-                const bool localcieutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).ciecurve, cielocalcurve, 1);
-                const bool localcieutili2 = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).ciecurve2, cielocalcurve2, 1);
-                const bool localjzutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).jzcurve, jzlocalcurve, 1);
-                const bool localczutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).czcurve, czlocalcurve, 1);
-                const bool localczjzutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).czjzcurve, czjzlocalcurve, 1);
-
-                //provisory
-                double ecomp = params.locallab.spots.at(sp).expcomp;
-                double lblack = params.locallab.spots.at(sp).black;
-                double lhlcompr = params.locallab.spots.at(sp).hlcompr;
-                double lhlcomprthresh = params.locallab.spots.at(sp).hlcomprthresh;
-                double shcompr = params.locallab.spots.at(sp).shcompr;
-                double br = params.locallab.spots.at(sp).lightness;
-                double cont = params.locallab.spots.at(sp).contrast;
-                if (lblack < 0. && params.locallab.spots.at(sp).expMethod == "pde" ) {
-                    lblack *= 1.5;
-                }
+                    const bool lcmas_utili = locccmas_Curve.Set(params.locallab.spots.at(sp).CCmask_curve);
+                    const bool llmas_utili = locllmas_Curve.Set(params.locallab.spots.at(sp).LLmask_curve);
+                    const bool lhmas_utili = lochhmas_Curve.Set(params.locallab.spots.at(sp).HHmask_curve);
+                    const bool lhhmas_utili = lochhhmas_Curve.Set(params.locallab.spots.at(sp).HHhmask_curve);
+                    const bool lmasutiliblwav = loclmasCurveblwav.Set(params.locallab.spots.at(sp).LLmaskblcurvewav);
+                    const bool lmasutilicolwav = loclmasCurvecolwav.Set(params.locallab.spots.at(sp).LLmaskcolcurvewav);
+                    const bool lcmaslcutili = locccmaslcCurve.Set(params.locallab.spots.at(sp).CCmasklccurve);
+                    const bool llmaslcutili = locllmaslcCurve.Set(params.locallab.spots.at(sp).LLmasklccurve);
+                    const bool lmasutili_wav = loclmasCurve_wav.Set(params.locallab.spots.at(sp).LLmask_curvewav);
+                    const bool locwavutili = locwavCurve.Set(params.locallab.spots.at(sp).locwavcurve);
+                    const bool locwavutilijz = locwavCurvejz.Set(params.locallab.spots.at(sp).locwavcurvejz);
+                    const bool locwavhueutili = locwavCurvehue.Set(params.locallab.spots.at(sp).locwavcurvehue);
+                    const bool locwavdenutili = locwavCurveden.Set(params.locallab.spots.at(sp).locwavcurveden);
+                    const bool loclevwavutili = loclevwavCurve.Set(params.locallab.spots.at(sp).loclevwavcurve);
+                    const bool locconwavutili = locconwavCurve.Set(params.locallab.spots.at(sp).locconwavcurve);
+                    const bool loccompwavutili = loccompwavCurve.Set(params.locallab.spots.at(sp).loccompwavcurve);
+                    const bool loccomprewavutili = loccomprewavCurve.Set(params.locallab.spots.at(sp).loccomprewavcurve);
+                    const bool locedgwavutili = locedgwavCurve.Set(params.locallab.spots.at(sp).locedgwavcurve);
+                    const bool locallutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).llcurve, lllocalcurve, 1);
+                    const bool localclutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).clcurve, cllocalcurve, 1);
+                    const bool locallcutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).lccurve, lclocalcurve, 1);
+                    const bool localcutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).cccurve, cclocalcurve, 1);
+                    const bool localrgbutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).rgbcurve, rgblocalcurve, 1);
+                    const bool localexutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).excurve, exlocalcurve, 1);
+                    const bool localmaskutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).Lmaskcurve, lmasklocalcurve, 1);
+                    const bool localmaskexputili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).Lmaskexpcurve, lmaskexplocalcurve, 1);
+                    const bool localmaskSHutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).LmaskSHcurve, lmaskSHlocalcurve, 1);
+                    const bool localmaskvibutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).Lmaskvibcurve, lmaskviblocalcurve, 1);
+                    const bool localmasktmutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).Lmasktmcurve, lmasktmlocalcurve, 1);
+                    const bool localmaskretiutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).Lmaskreticurve, lmaskretilocalcurve, 1);
+                    const bool localmaskcbutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).Lmaskcbcurve, lmaskcblocalcurve, 1);
+                    const bool localmaskblutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).Lmaskblcurve, lmaskbllocalcurve, 1);
+                    const bool localmasklcutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).Lmasklccurve, lmasklclocalcurve, 1);
+                    const bool localmasklogutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).LmaskcurveL, lmaskloglocalcurve, 1);
+                    const bool localmask_utili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).Lmask_curve, lmasklocal_curve, 1);
+                    const bool localmaskcieutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).Lmaskciecurve, lmaskcielocalcurve, 1);
+                    const bool localcieutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).ciecurve, cielocalcurve, 1);
+                    const bool localcieutili2 = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).ciecurve2, cielocalcurve2, 1);
+                    const bool localjzutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).jzcurve, jzlocalcurve, 1);
+                    const bool localczutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).czcurve, czlocalcurve, 1);
+                    const bool localczjzutili = CurveFactory::diagonalCurve2Lut(params.locallab.spots.at(sp).czjzcurve, czjzlocalcurve, 1);
+
+                    //provisory
+                    double ecomp = params.locallab.spots.at(sp).expcomp;
+                    double lblack = params.locallab.spots.at(sp).black;
+                    double lhlcompr = params.locallab.spots.at(sp).hlcompr;
+                    double lhlcomprthresh = params.locallab.spots.at(sp).hlcomprthresh;
+                    double shcompr = params.locallab.spots.at(sp).shcompr;
+                    double br = params.locallab.spots.at(sp).lightness;
+                    double cont = params.locallab.spots.at(sp).contrast;
+                    if (lblack < 0. && params.locallab.spots.at(sp).expMethod == "pde" ) {
+                        lblack *= 1.5;
+                    }
 
-                // Reference parameters computation
-                double huere, chromare, lumare, huerefblu, chromarefblu, lumarefblu, sobelre;
-                int lastsav;
-                float avge;
-                float meantme;
-                float stdtme;
-                float meanretie;
-                float stdretie;
-                float fab = 1.f;
+                    // Reference parameters computation
+                    double huere, chromare, lumare, huerefblu, chromarefblu, lumarefblu, sobelre;
+                    int lastsav;
+                    float avge;
+                    float meantme;
+                    float stdtme;
+                    float meanretie;
+                    float stdretie;
+                    float fab = 1.f;
                 
-                if (params.locallab.spots.at(sp).spotMethod == "exc") {
-                    ipf.calc_ref(sp, reservView.get(), reservView.get(), 0, 0, fw, fh, 1, huerefblu, chromarefblu, lumarefblu, huere, chromare, lumare, sobelre, avge, locwavCurveden, locwavdenutili);
-                } else {
-                    ipf.calc_ref(sp, labView, labView, 0, 0, fw, fh, 1, huerefblu, chromarefblu, lumarefblu, huere, chromare, lumare, sobelre, avge, locwavCurveden, locwavdenutili);
-                }
-                CurveFactory::complexCurvelocal(ecomp, lblack / 65535., lhlcompr, lhlcomprthresh, shcompr, br, cont, lumare,
-                                                hltonecurveloc, shtonecurveloc, tonecurveloc, lightCurveloc, avge,
-                                                1);
-                float minCD;
-                float maxCD;
-                float mini;
-                float maxi;
-                float Tmean;
-                float Tsigma;
-                float Tmin;
-                float Tmax;
-
-                // No Locallab mask is shown in exported picture
-                ipf.Lab_Local(2, sp, shbuffer, labView, labView, reservView.get(), savenormtmView.get(), savenormretiView.get(), lastorigView.get(), fw, fh, 0, 0, fw, fh,  1, locRETgainCurve, locRETtransCurve, 
-                        lllocalcurve, locallutili, 
-                        cllocalcurve, localclutili,
-                        lclocalcurve, locallcutili,
-                        loclhCurve, lochhCurve, locchCurve,
-                        lochhCurvejz, locchCurvejz,loclhCurvejz,
-                        lmasklocalcurve, localmaskutili,
-                        lmaskexplocalcurve, localmaskexputili,
-                        lmaskSHlocalcurve, localmaskSHutili,
-                        lmaskviblocalcurve, localmaskvibutili,
-                        lmasktmlocalcurve, localmasktmutili,
-                        lmaskretilocalcurve, localmaskretiutili,
-                        lmaskcblocalcurve, localmaskcbutili,
-                        lmaskbllocalcurve, localmaskblutili,
-                        lmasklclocalcurve, localmasklcutili,
-                        lmaskloglocalcurve, localmasklogutili,
-                        lmasklocal_curve, localmask_utili,
-                        lmaskcielocalcurve, localmaskcieutili,
-                        cielocalcurve, localcieutili, 
-                        cielocalcurve2, localcieutili2, 
-                        jzlocalcurve, localjzutili, 
-                        czlocalcurve, localczutili, 
-                        czjzlocalcurve, localczjzutili, 
+                    if (params.locallab.spots.at(sp).spotMethod == "exc") {
+                        ipf.calc_ref(sp, reserv, reserv, cx, cy, fw, fh, 1, huerefblu, chromarefblu, lumarefblu, huere, chromare, lumare, sobelre, avge, locwavCurveden, locwavdenutili);
+                    } else {
+                        ipf.calc_ref(sp, view, view, cx, cy, fw, fh, 1, huerefblu, chromarefblu, lumarefblu, huere, chromare, lumare, sobelre, avge, locwavCurveden, locwavdenutili);
+                    }
+                    CurveFactory::complexCurvelocal(ecomp, lblack / 65535., lhlcompr, lhlcomprthresh, shcompr, br, cont, lumare,
+                                                    hltonecurveloc, shtonecurveloc, tonecurveloc, lightCurveloc, avge,
+                                                    1);
+                    float minCD;
+                    float maxCD;
+                    float mini;
+                    float maxi;
+                    float Tmean;
+                    float Tsigma;
+                    float Tmin;
+                    float Tmax;
+
+                    // No Locallab mask is shown in exported picture
+                    ipf.Lab_Local(2, sp, shbuffer, view, view, reserv, savenormtmView.get(), savenormretiView.get(), lastorig, fw, fh, cx, cy, fw, fh, 1, locRETgainCurve, locRETtransCurve, 
+                            lllocalcurve, locallutili, 
+                            cllocalcurve, localclutili,
+                            lclocalcurve, locallcutili,
+                            loclhCurve, lochhCurve, locchCurve,
+                            lochhCurvejz, locchCurvejz,loclhCurvejz,
+                            lmasklocalcurve, localmaskutili,
+                            lmaskexplocalcurve, localmaskexputili,
+                            lmaskSHlocalcurve, localmaskSHutili,
+                            lmaskviblocalcurve, localmaskvibutili,
+                            lmasktmlocalcurve, localmasktmutili,
+                            lmaskretilocalcurve, localmaskretiutili,
+                            lmaskcblocalcurve, localmaskcbutili,
+                            lmaskbllocalcurve, localmaskblutili,
+                            lmasklclocalcurve, localmasklcutili,
+                            lmaskloglocalcurve, localmasklogutili,
+                            lmasklocal_curve, localmask_utili,
+                            lmaskcielocalcurve, localmaskcieutili,
+                            cielocalcurve, localcieutili, 
+                            cielocalcurve2, localcieutili2, 
+                            jzlocalcurve, localjzutili, 
+                            czlocalcurve, localczutili, 
+                            czjzlocalcurve, localczjzutili, 
                         
-                        locccmasCurve, lcmasutili, locllmasCurve, llmasutili, lochhmasCurve, lhmasutili, lochhhmasCurve, lhhmasutili, locccmasexpCurve, lcmasexputili, locllmasexpCurve, llmasexputili, lochhmasexpCurve, lhmasexputili,
-                        locccmasSHCurve, lcmasSHutili, locllmasSHCurve, llmasSHutili, lochhmasSHCurve, lhmasSHutili,
-                        locccmasvibCurve, lcmasvibutili, locllmasvibCurve, llmasvibutili, lochhmasvibCurve, lhmasvibutili,
-                        locccmascbCurve, lcmascbutili, locllmascbCurve, llmascbutili, lochhmascbCurve, lhmascbutili,
-                        locccmasretiCurve, lcmasretiutili, locllmasretiCurve, llmasretiutili, lochhmasretiCurve, lhmasretiutili,
-                        locccmastmCurve, lcmastmutili, locllmastmCurve, llmastmutili, lochhmastmCurve, lhmastmutili,
-                        locccmasblCurve, lcmasblutili, locllmasblCurve, llmasblutili, lochhmasblCurve, lhmasblutili,
-                        locccmaslcCurve, lcmaslcutili, locllmaslcCurve, llmaslcutili, lochhmaslcCurve, lhmaslcutili,
-                        locccmaslogCurve, lcmaslogutili, locllmaslogCurve, llmaslogutili, lochhmaslogCurve, lhmaslogutili,
-
-                        locccmas_Curve, lcmas_utili, locllmas_Curve, llmas_utili, lochhmas_Curve, lhmas_utili,
-                        locccmascieCurve, lcmascieutili, locllmascieCurve, llmascieutili, lochhmascieCurve, lhmascieutili,
-                        lochhhmas_Curve, lhhmas_utili,
-                        loclmasCurveblwav,lmasutiliblwav,
-                        loclmasCurvecolwav,lmasutilicolwav,
-                        locwavCurve, locwavutili,
-                        locwavCurvejz, locwavutilijz,
-                        loclevwavCurve, loclevwavutili,
-                        locconwavCurve, locconwavutili,
-                        loccompwavCurve, loccompwavutili,
-                        loccomprewavCurve, loccomprewavutili,
-                        locwavCurvehue, locwavhueutili,
-                        locwavCurveden, locwavdenutili,
-                        locedgwavCurve, locedgwavutili,
-                        loclmasCurve_wav,lmasutili_wav,
-                        LHutili, HHutili, CHutili, HHutilijz, CHutilijz, LHutilijz, cclocalcurve, localcutili, rgblocalcurve, localrgbutili, localexutili, exlocalcurve, hltonecurveloc, shtonecurveloc, tonecurveloc, lightCurveloc,
-                        huerefblu, chromarefblu, lumarefblu, huere, chromare, lumare, sobelre, lastsav, false, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-                        minCD, maxCD, mini, maxi, Tmean, Tsigma, Tmin, Tmax,
-                        meantme, stdtme, meanretie, stdretie, fab
-);
-
-                if (sp + 1u < params.locallab.spots.size()) {
-                    // do not copy for last spot as it is not needed anymore
-                    lastorigView->CopyFrom(labView);
+                            locccmasCurve, lcmasutili, locllmasCurve, llmasutili, lochhmasCurve, lhmasutili, lochhhmasCurve, lhhmasutili, locccmasexpCurve, lcmasexputili, locllmasexpCurve, llmasexputili, lochhmasexpCurve, lhmasexputili,
+                            locccmasSHCurve, lcmasSHutili, locllmasSHCurve, llmasSHutili, lochhmasSHCurve, lhmasSHutili,
+                            locccmasvibCurve, lcmasvibutili, locllmasvibCurve, llmasvibutili, lochhmasvibCurve, lhmasvibutili,
+                            locccmascbCurve, lcmascbutili, locllmascbCurve, llmascbutili, lochhmascbCurve, lhmascbutili,
+                            locccmasretiCurve, lcmasretiutili, locllmasretiCurve, llmasretiutili, lochhmasretiCurve, lhmasretiutili,
+                            locccmastmCurve, lcmastmutili, locllmastmCurve, llmastmutili, lochhmastmCurve, lhmastmutili,
+                            locccmasblCurve, lcmasblutili, locllmasblCurve, llmasblutili, lochhmasblCurve, lhmasblutili,
+                            locccmaslcCurve, lcmaslcutili, locllmaslcCurve, llmaslcutili, lochhmaslcCurve, lhmaslcutili,
+                            locccmaslogCurve, lcmaslogutili, locllmaslogCurve, llmaslogutili, lochhmaslogCurve, lhmaslogutili,
+
+                            locccmas_Curve, lcmas_utili, locllmas_Curve, llmas_utili, lochhmas_Curve, lhmas_utili,
+                            locccmascieCurve, lcmascieutili, locllmascieCurve, llmascieutili, lochhmascieCurve, lhmascieutili,
+                            lochhhmas_Curve, lhhmas_utili,
+                            loclmasCurveblwav,lmasutiliblwav,
+                            loclmasCurvecolwav,lmasutilicolwav,
+                            locwavCurve, locwavutili,
+                            locwavCurvejz, locwavutilijz,
+                            loclevwavCurve, loclevwavutili,
+                            locconwavCurve, locconwavutili,
+                            loccompwavCurve, loccompwavutili,
+                            loccomprewavCurve, loccomprewavutili,
+                            locwavCurvehue, locwavhueutili,
+                            locwavCurveden, locwavdenutili,
+                            locedgwavCurve, locedgwavutili,
+                            loclmasCurve_wav,lmasutili_wav,
+                            LHutili, HHutili, CHutili, HHutilijz, CHutilijz, LHutilijz, cclocalcurve, localcutili, rgblocalcurve, localrgbutili, localexutili, exlocalcurve, hltonecurveloc, shtonecurveloc, tonecurveloc, lightCurveloc,
+                            huerefblu, chromarefblu, lumarefblu, huere, chromare, lumare, sobelre, lastsav, false, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                            minCD, maxCD, mini, maxi, Tmean, Tsigma, Tmin, Tmax,
+                            meantme, stdtme, meanretie, stdretie, fab
+                    );
+                };
+
+            // spots whose footprints don't intersect are independent and are processed together
+            std::vector<LocallabSpotFootprint> footprints;
+            const std::vector<int> levels = getLocallabSpotLevels(params.locallab, fw, fh, footprints);
+            const int numLevels = levels.empty() ? 0 : *std::max_element(levels.begin(), levels.end()) + 1;
+
+            for (int level = 0; level < numLevels; ++level) {
+                std::vector<int> spots;
+
+                for (size_t sp = 0; sp < levels.size(); ++sp) {
+                    if (levels[sp] == level) {
+                        spots.push_back(sp);
+                    }
                 }
 
-                if (params.locallab.spots.at(sp).spotMethod == "exc") {
-                    ipf.calc_ref(sp, reservView.get(), reservView.get(), 0, 0, fw, fh, 1, huerefblu, chromarefblu, lumarefblu, huere, chromare, lumare, sobelre, avge, locwavCurveden, locwavdenutili);
+                if (spots.size() == 1) {
+                    processSpot(spots[0], labView, reservView.get(), lastorigView.get(), 0, 0);
                 } else {
-                    ipf.calc_ref(sp, labView, labView, 0, 0, fw, fh, 1, huerefblu, chromarefblu, lumarefblu, huere, chromare, lumare, sobelre, avge, locwavCurveden, locwavdenutili);
+#ifdef _OPENMP
+                    // each spot gets its share of the threads for its own loops
+                    const int numThreads = omp_get_max_threads();
+                    const int spotThreads = rtengine::min<int>(spots.size(), numThreads);
+                    const int innerThreads = rtengine::max(numThreads / spotThreads, 1);
+                    const bool oldNested = omp_get_nested();
+
+                    if (innerThreads > 1) {
+                        omp_set_nested(true);
+                    }
+
+                    #pragma omp parallel for schedule(dynamic) num_threads(spotThreads)
+#endif
+                    for (size_t i = 0; i < spots.size(); ++i) {
+#ifdef _OPENMP
+                        omp_set_num_threads(innerThreads);
+#endif
+                        const LocallabSpotFootprint& footprint = footprints[spots[i]];
+                        LabImage view(footprint.width(), footprint.height(), false, false);
+                        LabImage reserv(footprint.width(), footprint.height(), false, false);
+                        footprint.copyFrom(labView, &view);
+                        footprint.copyFrom(reservView.get(), &reserv);
+                        LabImage lastorig(view, false);
+
+                        processSpot(spots[i], &view, &reserv, &lastorig, footprint.xstart, footprint.ystart);
+
+                        footprint.copyTo(&view, labView);
+                    }
+
+#ifdef _OPENMP
+                    omp_set_nested(oldNested);
+#endif
+                }
+
+                if (level + 1 < numLevels) {
+                    // do not copy for last spots as it is not needed anymore
+                    lastorigView->CopyFrom(labView);
                 }
             }
 
@@ -0,0 +1,390 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cmath>
+
+#include "gamutwarning.h"
+#include "icctransform.h"
+#include "rt_math.h"
+#include "rtengine.h"
+#include "softprooflut.h"
+
+namespace
+{
+
+using rtengine::SoftProofLUT;
+
+// a few combinations of profiles and intents are used at the same time, e.g. soft proofing on and off
+constexpr std::size_t maxEntries = 4;
+
+constexpr int cells = SoftProofLUT::size - 1;
+
+constexpr int strideL = 4 * SoftProofLUT::size * SoftProofLUT::size;
+constexpr int strideA = 4 * SoftProofLUT::size;
+constexpr int strideB = 4;
+
+// how the transforms clip a lattice point, the cells whose points are not clipped the same way are not interpolated
+constexpr std::uint16_t invalidSignature = 1 << 15;
+
+struct ToneCurveDeleter {
+    void operator ()(cmsToneCurve* curve) const
+    {
+        cmsFreeToneCurve(curve);
+    }
+};
+
+using ToneCurvePtr = std::unique_ptr<cmsToneCurve, ToneCurveDeleter>;
+
+std::uint16_t getClipBits(const float* rgb, int shift)
+{
+    std::uint16_t res = 0;
+
+    for (int c = 0; c < 3; ++c) {
+        if (std::isnan(rgb[c])) {
+            return invalidSignature;
+        }
+
+        if (rgb[c] < 0.f) {
+            res |= 1 << (shift + 2 * c);
+        } else if (rgb[c] > 1.f) {
+            res |= 2 << (shift + 2 * c);
+        }
+    }
+
+    return res;
+}
+
+}
+
+namespace rtengine
+{
+
+SoftProofLUT::SoftProofLUT(cmsHTRANSFORM monitorTransform, cmsHPROFILE monitor, const ICCTransform* lab2proof, const GamutWarning* gamutWarning, bool multiThread) :
+    hasGamutWarning(gamutWarning)
+{
+    ToneCurvePtr decodeCurves[3];
+
+    {
+        MyMutex::MyLock lcmsLock(*lcmsMutex);
+
+        if (!monitorTransform || !monitor || !cmsIsMatrixShaper(monitor) || cmsGetColorSpace(monitor) != cmsSigRgbData) {
+            return;
+        }
+
+        const cmsTagSignature trcTags[3] = {cmsSigRedTRCTag, cmsSigGreenTRCTag, cmsSigBlueTRCTag};
+
+        for (int c = 0; c < 3; ++c) {
+            const cmsToneCurve* const trc = static_cast<const cmsToneCurve*>(cmsReadTag(monitor, trcTags[c]));
+
+            if (!trc) {
+                return;
+            }
+
+            decodeCurves[c].reset(cmsDupToneCurve(trc));
+        }
+    }
+
+    for (int c = 0; c < 3; ++c) {
+        const ToneCurvePtr encodeCurve(decodeCurves[c] ? cmsReverseToneCurve(decodeCurves[c].get()) : nullptr);
+
+        if (!encodeCurve) {
+            return;
+        }
+
+        encodeCurves[c](65536, LUT_CLIP_BELOW | LUT_CLIP_ABOVE);
+
+        for (int i = 0; i < 65536; ++i) {
+            encodeCurves[c][i] = cmsEvalToneCurveFloat(encodeCurve.get(), SQR(i / 65535.f));
+        }
+    }
+
+    AlignedBuffer<float> lattice(4 * size * size * size);
+
+    if (!lattice.data) {
+        return;
+    }
+
+    std::vector<std::uint16_t> signatures(size * size * size);
+    constexpr int sliceSize = size * size;
+
+#ifdef _OPENMP
+    #pragma omp parallel if (multiThread)
+#endif
+    {
+        AlignedBuffer<float> lab(3 * sliceSize);
+        AlignedBuffer<float> monitorRgb(3 * sliceSize);
+        AlignedBuffer<float> proofRgb(lab2proof ? 3 * sliceSize : 0);
+        AlignedBuffer<float> buf1(gamutWarning ? 3 * sliceSize : 0);
+        AlignedBuffer<float> buf2(gamutWarning ? 3 * sliceSize : 0);
+        std::vector<std::uint8_t> outOfGamut(sliceSize, 0);
+
+#ifdef _OPENMP
+        #pragma omp for schedule(dynamic)
+#endif
+        for (int l = 0; l < size; ++l) {
+            for (int i = 0; i < sliceSize; ++i) {
+                lab.data[3 * i] = l * (100.f / cells);
+                lab.data[3 * i + 1] = (i / size) * (256.f / cells) - 128.f;
+                lab.data[3 * i + 2] = (i % size) * (256.f / cells) - 128.f;
+            }
+
+            cmsDoTransform(monitorTransform, lab.data, monitorRgb.data, sliceSize);
+
+            if (lab2proof) {
+                lab2proof->transform(lab.data, proofRgb.data, sliceSize);
+            }
+
+            if (gamutWarning) {
+                gamutWarning->check(lab.data, buf1.data, buf2.data, sliceSize, outOfGamut.data());
+            }
+
+            for (int i = 0; i < sliceSize; ++i) {
+                const float* const rgb = monitorRgb.data + 3 * i;
+                float* const node = lattice.data + 4 * (l * sliceSize + i);
+                std::uint16_t& signature = signatures[l * sliceSize + i];
+
+                signature = getClipBits(rgb, 0) | (outOfGamut[i] << 12);
+
+                if (lab2proof) {
+                    signature |= getClipBits(proofRgb.data + 3 * i, 6);
+                }
+
+                for (int c = 0; c < 3; ++c) {
+                    node[c] = std::isnan(rgb[c]) ? 0.f : cmsEvalToneCurveFloat(decodeCurves[c].get(), LIM01(rgb[c]));
+                }
+
+                node[3] = outOfGamut[i];
+            }
+        }
+    }
+
+    exactCells.resize(cells * cells * cells);
+
+#ifdef _OPENMP
+    #pragma omp parallel for if (multiThread)
+#endif
+    for (int l = 0; l < cells; ++l) {
+        for (int a = 0; a < cells; ++a) {
+            for (int b = 0; b < cells; ++b) {
+                const std::uint16_t* const first = signatures.data() + (l * size + a) * size + b;
+                const std::uint16_t corners[8] = {
+                    first[0], first[1], first[size], first[size + 1],
+                    first[sliceSize], first[sliceSize + 1], first[sliceSize + size], first[sliceSize + size + 1]
+                };
+
+                exactCells[(l * cells + a) * cells + b] =
+                    (corners[0] & invalidSignature)
+                    || std::any_of(corners + 1, corners + 8, [&corners](std::uint16_t signature) { return signature != corners[0]; });
+            }
+        }
+    }
+
+    nodes.swap(lattice);
+}
+
+bool SoftProofLUT::isValid() const
+{
+    return nodes.data;
+}
+
+void SoftProofLUT::apply(const float* L, const float* a, const float* b, unsigned char* rgb, int width, std::vector<int>& exact) const
+{
+    constexpr float scaleL = cells / (100.f * 327.68f);
+    constexpr float scaleAB = cells / (256.f * 327.68f);
+    constexpr float offsetAB = 128.f * 327.68f;
+
+    for (int j = 0; j < width; ++j) {
+        const float cl = L[j] * scaleL;
+        const float ca = (a[j] + offsetAB) * scaleAB;
+        const float cb = (b[j] + offsetAB) * scaleAB;
+
+        // false for NaN
+        if (!(cl >= 0.f && cl <= cells && ca >= 0.f && ca <= cells && cb >= 0.f && cb <= cells)) {
+            exact.push_back(j);
+            continue;
+        }
+
+        const int il = std::min(static_cast<int>(cl), cells - 1);
+        const int ia = std::min(static_cast<int>(ca), cells - 1);
+        const int ib = std::min(static_cast<int>(cb), cells - 1);
+
+        if (exactCells[(il * cells + ia) * cells + ib]) {
+            exact.push_back(j);
+            continue;
+        }
+
+        const float fl = cl - il;
+        const float fa = ca - ia;
+        const float fb = cb - ib;
+
+        // the order of the fractional parts gives the path from the first to the last vertex of the cube
+        int stride1, stride2;
+        float f1, f2, f3;
+
+        if (fl >= fa) {
+            if (fa >= fb) {
+                stride1 = strideL;
+                stride2 = strideA;
+                f1 = fl;
+                f2 = fa;
+                f3 = fb;
+            } else if (fl >= fb) {
+                stride1 = strideL;
+                stride2 = strideB;
+                f1 = fl;
+                f2 = fb;
+                f3 = fa;
+            } else {
+                stride1 = strideB;
+                stride2 = strideL;
+                f1 = fb;
+                f2 = fl;
+                f3 = fa;
+            }
+        } else {
+            if (fl >= fb) {
+                stride1 = strideA;
+                stride2 = strideL;
+                f1 = fa;
+                f2 = fl;
+                f3 = fb;
+            } else if (fa >= fb) {
+                stride1 = strideA;
+                stride2 = strideB;
+                f1 = fa;
+                f2 = fb;
+                f3 = fl;
+            } else {
+                stride1 = strideB;
+                stride2 = strideA;
+                f1 = fb;
+                f2 = fa;
+                f3 = fl;
+            }
+        }
+
+        const float* const vertex0 = nodes.data + il * strideL + ia * strideA + ib * strideB;
+        const float* const vertex1 = vertex0 + stride1;
+        const float* const vertex2 = vertex1 + stride2;
+        const float* const vertex3 = vertex0 + strideL + strideA + strideB;
+
+        float result[4] ALIGNED16;
+#ifdef __SSE2__
+        STVF(result[0],
+             F2V(1.f - f1) * LVF(vertex0[0])
+             + F2V(f1 - f2) * LVF(vertex1[0])
+             + F2V(f2 - f3) * LVF(vertex2[0])
+             + F2V(f3) * LVF(vertex3[0]));
+#else
+        for (int c = 0; c < 4; ++c) {
+            result[c] = (1.f - f1) * vertex0[c] + (f1 - f2) * vertex1[c] + (f2 - f3) * vertex2[c] + f3 * vertex3[c];
+        }
+#endif
+
+        unsigned char* const dst = rgb + 3 * j;
+
+        // all the points of the cell have the same gamut warning
+        if (hasGamutWarning && result[3] > 0.5f) {
+            dst[0] = 0;
+            dst[1] = 255;
+            dst[2] = 255;
+        } else {
+            for (int c = 0; c < 3; ++c) {
+                dst[c] = uint16ToUint8Rounded(CLIP(encode(c, result[c]) * MAXVALF));
+            }
+        }
+    }
+}
+
+float SoftProofLUT::encode(int channel, float value) const
+{
+    return encodeCurves[channel][std::sqrt(std::max(value, 0.f)) * 65535.f];
+}
+
+SoftProofLUTCache::Key::Key(
+    const Glib::ustring& monitorProfile,
+    RenderingIntent monitorIntent,
+    cmsUInt32Number monitorFlags,
+    const Glib::ustring& proofProfile,
+    RenderingIntent proofIntent,
+    const Glib::ustring& gamutProfile,
+    RenderingIntent gamutIntent,
+    cmsUInt32Number gamutFlags
+) :
+    monitorProfile(monitorProfile),
+    monitorIntent(monitorIntent),
+    monitorFlags(monitorFlags),
+    proofProfile(proofProfile),
+    proofIntent(proofIntent),
+    gamutProfile(gamutProfile),
+    gamutIntent(gamutIntent),
+    gamutFlags(gamutFlags)
+{
+}
+
+bool SoftProofLUTCache::Key::operator ==(const Key& other) const
+{
+    return
+        monitorProfile == other.monitorProfile
+        && monitorIntent == other.monitorIntent
+        && monitorFlags == other.monitorFlags
+        && proofProfile == other.proofProfile
+        && proofIntent == other.proofIntent
+        && gamutProfile == other.gamutProfile
+        && gamutIntent == other.gamutIntent
+        && gamutFlags == other.gamutFlags;
+}
+
+SoftProofLUTCache& SoftProofLUTCache::getInstance()
+{
+    static SoftProofLUTCache instance;
+    return instance;
+}
+
+std::shared_ptr<const SoftProofLUT> SoftProofLUTCache::get(const Key& key)
+{
+    MyMutex::MyLock lock(mutex);
+
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if (it->key == key) {
+            entries.splice(entries.begin(), entries, it);
+            return entries.front().lut;
+        }
+    }
+
+    return nullptr;
+}
+
+void SoftProofLUTCache::put(const Key& key, const std::shared_ptr<const SoftProofLUT>& lut)
+{
+    MyMutex::MyLock lock(mutex);
+
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if (it->key == key) {
+            entries.erase(it);
+            break;
+        }
+    }
+
+    entries.push_front({key, lut});
+
+    while (entries.size() > maxEntries) {
+        entries.pop_back();
+    }
+}
+
+}
@@ -0,0 +1,127 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <vector>
+
+#include <glibmm/ustring.h>
+
+#include <lcms2.h>
+
+#include "alignedbuffer.h"
+#include "LUT.h"
+#include "noncopyable.h"
+#include "opthelper.h"
+
+#include "../rtgui/threadutils.h"
+
+namespace rtengine
+{
+
+class GamutWarning;
+class ICCTransform;
+
+enum RenderingIntent : int;
+
+/* 3D lut of the monitor transform of the preview with soft proofing and/or the gamut warning, from Lab to 8 bit
+ * monitor RGB, baked by running the lcms transforms on the lattice points. It needs a matrix-shaper RGB monitor profile.
+ *
+ * The lattice is regular in Lab (L in [0;100], a and b in [-128;128]) and is interpolated with tetrahedrons in
+ * linear monitor RGB, which is a lot smoother than the gamma encoded output. Clipping (by the monitor or by the soft
+ * proofing profile) and the gamut warning can't be interpolated: the lattice cells whose points are not all clipped
+ * the same way or whose points don't all have the same gamut warning are left to the exact transforms, as are the
+ * colours out of the lattice.
+ */
+class SoftProofLUT final :
+    public NonCopyable
+{
+public:
+    static constexpr int size = 65; // lattice points per axis
+
+    // lab2proof converts Lab to the RGB of the soft proofing profile, it may be null as gamutWarning
+    SoftProofLUT(cmsHTRANSFORM monitorTransform, cmsHPROFILE monitor, const ICCTransform* lab2proof, const GamutWarning* gamutWarning, bool multiThread);
+
+    bool isValid() const;
+
+    // converts one row of a LabImage to rgb, the pixels which need the exact transforms are appended to exact
+    // and left untouched in rgb
+    void apply(const float* L, const float* a, const float* b, unsigned char* rgb, int width, std::vector<int>& exact) const;
+
+private:
+    float encode(int channel, float value) const;
+
+    AlignedBuffer<float> nodes; // linear R, G and B and gamut warning (0 or 1) of each lattice point, b varying fastest
+    std::vector<std::uint8_t> exactCells; // 1 for the cells which need the exact transforms
+    LUTf encodeCurves[3]; // linear to gamma encoded monitor RGB, indexed by the square root of the linear value
+    bool hasGamutWarning;
+};
+
+/* Cache of the SoftProofLUTs of the combinations of monitor profile, soft proofing profile and rendering intents
+ * which are used by the editors, to only bake a lut once when soft proofing or the gamut warning are toggled.
+ */
+class SoftProofLUTCache final :
+    public NonCopyable
+{
+public:
+    class Key
+    {
+    public:
+        Key(
+            const Glib::ustring& monitorProfile,
+            RenderingIntent monitorIntent,
+            cmsUInt32Number monitorFlags,
+            const Glib::ustring& proofProfile,
+            RenderingIntent proofIntent,
+            const Glib::ustring& gamutProfile,
+            RenderingIntent gamutIntent,
+            cmsUInt32Number gamutFlags
+        );
+
+        bool operator ==(const Key& other) const;
+
+    private:
+        Glib::ustring monitorProfile;
+        int monitorIntent;
+        cmsUInt32Number monitorFlags;
+        Glib::ustring proofProfile;
+        int proofIntent;
+        Glib::ustring gamutProfile;
+        int gamutIntent;
+        cmsUInt32Number gamutFlags;
+    };
+
+    static SoftProofLUTCache& getInstance();
+
+    std::shared_ptr<const SoftProofLUT> get(const Key& key);
+    void put(const Key& key, const std::shared_ptr<const SoftProofLUT>& lut);
+
+private:
+    SoftProofLUTCache() = default;
+
+    struct Entry {
+        Key key;
+        std::shared_ptr<const SoftProofLUT> lut;
+    };
+
+    std::list<Entry> entries; // most recently used first
+    MyMutex mutex;
+};
+
+}
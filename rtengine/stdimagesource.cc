@@ -20,6 +20,7 @@
 
 #include "color.h"
 #include "iccstore.h"
+#include "icctransform.h"
 #include "image8.h"
 #include "image16.h"
 #include "imagefloat.h"
@@ -258,21 +259,17 @@ void StdImageSource::colorSpaceConversion (Imagefloat* im, const ColorManagement
             in = ICCStore::getInstance()->getsRGBProfile ();
         }
 
-        lcmsMutex->lock ();
-        cmsHTRANSFORM hTransform = cmsCreateTransform (in, TYPE_RGB_FLT, out, TYPE_RGB_FLT, INTENT_RELATIVE_COLORIMETRIC,
+        const std::shared_ptr<const ICCTransform> transform = ICCStore::getInstance()->getTransform(in, TYPE_RGB_FLT, out, TYPE_RGB_FLT, INTENT_RELATIVE_COLORIMETRIC,
                                    cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE);
-        lcmsMutex->unlock ();
 
-        if(hTransform) {
+        if(transform) {
             // Convert to the [0.0 ; 1.0] range
             im->normalizeFloatTo1();
 
-            im->ExecCMSTransform(hTransform);
+            im->ExecCMSTransform(*transform);
 
             // Converting back to the [0.0 ; 65535.0] range
             im->normalizeFloatTo65535();
-
-            cmsDeleteTransform(hTransform);
         } else {
             printf("Could not convert from %s to %s\n", in == embedded ? "embedded profile" : cmp.inputProfile.data(), cmp.workingProfile.data());
         }
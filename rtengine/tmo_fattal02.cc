@@ -62,7 +62,6 @@
 #include <vector>
 
 #include <assert.h>
-#include <fftw3.h>
 #include <math.h>
 
 #include "array2D.h"
@@ -71,6 +70,7 @@
 #include "imagefloat.h"
 #include "improcfun.h"
 #include "opthelper.h"
+#include "poissonsolver.h"
 #include "procparams.h"
 #include "rescale.h"
 #include "rt_algo.h"
@@ -85,8 +85,6 @@ namespace rtengine
  * RT code
  ******************************************************************************/
 
-extern MyMutex *fftwMutex;
-
 using namespace std;
 
 namespace
@@ -416,9 +414,10 @@ void calculateFiMatrix(Array2Df* FI, Array2Df* gradients[],
     delete[] fi;
 }
 
-void solve_pde_fft(Array2Df *F, Array2Df *U, Array2Df *buf, bool multithread, int algo);
+bool solve_pde_fft(Array2Df *F, Array2Df *U, Array2Df *buf, bool multithread, int algo);
 
-void tmo_fattal02(size_t width,
+// returns false if the pde can't be solved because fftw can't provide a plan
+bool tmo_fattal02(size_t width,
                   size_t height,
                   const Array2Df& Y,
                   Array2Df& L,
@@ -653,13 +652,14 @@ void tmo_fattal02(size_t width,
     //delete Gx; // RT - reused as temp buffer in solve_pde_fft, deleted later
 
     // solve pde and exponentiate (ie recover compressed image)
-    {
-        MyMutex::MyLock lock(*fftwMutex);
-        solve_pde_fft(FI, &L, Gx, multithread, algo);
-    }
+    const bool solved = solve_pde_fft(FI, &L, Gx, multithread, algo);
     delete Gx;
     delete FI;
 
+    if (!solved) {
+        return false;
+    }
+
 #ifdef _OPENMP
     #pragma omp parallel if(multithread)
 #endif
@@ -686,6 +686,8 @@ void tmo_fattal02(size_t width,
             }
         }
     }
+
+    return true;
 }
 
 
@@ -734,9 +736,9 @@ void tmo_fattal02(size_t width,
 // for both solvers.
 
 
-// returns T = EVy A EVx^tr
+// returns T = EVy A EVx^tr, or false if fftw can't provide a plan
 // note, modifies input data
-void transform_ev2normal(Array2Df *A, Array2Df *T, bool multithread)
+bool transform_ev2normal(Array2Df *A, Array2Df *T, const PoissonSolver &solver, bool multithread)
 {
     int width = A->getCols();
     int height = A->getRows();
@@ -773,39 +775,25 @@ void transform_ev2normal(Array2Df *A, Array2Df *T, bool multithread)
     // fftwf_free(in);
 
     // executes 2d discrete cosine transform
-    fftwf_plan p;
-    p = fftwf_plan_r2r_2d(height, width, A->data(), T->data(),
-                          FFTW_REDFT00, FFTW_REDFT00, FFTW_ESTIMATE);
-    fftwf_execute(p);
-    fftwf_destroy_plan(p);
+    return solver.backward(A->data(), T->data());
 }
 
 
-// returns T = EVy^-1 * A * (EVx^-1)^tr
-void transform_normal2ev(Array2Df *A, Array2Df *T, bool multithread)
+// returns T = EVy^-1 * A * (EVx^-1)^tr, without the factor 1 / ((height - 1) * (width - 1)) applied by PoissonSolver::divide
+// or false if fftw can't provide a plan
+// note, modifies input data
+bool transform_normal2ev(Array2Df *A, Array2Df *T, const PoissonSolver &solver)
 {
     int width = A->getCols();
     int height = A->getRows();
     assert((int)T->getCols() == width && (int)T->getRows() == height);
 
     // executes 2d discrete cosine transform
-    fftwf_plan p;
-    p = fftwf_plan_r2r_2d(height, width, A->data(), T->data(),
-                          FFTW_REDFT00, FFTW_REDFT00, FFTW_ESTIMATE);
-    fftwf_execute(p);
-    fftwf_destroy_plan(p);
+    if (!solver.forward(A->data(), T->data())) {
+        return false;
+    }
 
     // need to scale the output matrix to get the right transform
-    float factor = (1.0f / ((height - 1) * (width - 1)));
-#ifdef _OPENMP
-    #pragma omp parallel for if(multithread)
-#endif
-
-    for (int y = 0 ; y < height ; y++)
-        for (int x = 0 ; x < width ; x++) {
-            (*T)(x, y) *= factor;
-        }
-
     for (int x = 0 ; x < width ; x++) {
         (*T)(x, 0) *= 0.5f;
         (*T)(x, height - 1) *= 0.5f;
@@ -815,19 +803,8 @@ void transform_normal2ev(Array2Df *A, Array2Df *T, bool multithread)
         (*T)(0, y) *= 0.5f;
         (*T)(width - 1, y) *= 0.5f;
     }
-}
-
-// returns the eigenvalues of the 1d laplace operator
-std::vector<double> get_lambda(int n)
-{
-    assert(n > 1);
-    std::vector<double> v(n);
-
-    for (int i = 0; i < n; i++) {
-        v[i] = -4.0 * SQR(sin((double)i / (2 * (n - 1)) * RT_PI));
-    }
 
-    return v;
+    return true;
 }
 
 // // makes boundary conditions compatible so that a solution exists
@@ -874,7 +851,7 @@ std::vector<double> get_lambda(int n)
 // not modified and the equation might not have a solution but an
 // approximate solution with a minimum error is then calculated
 // double precision version
-void solve_pde_fft(Array2Df *F, Array2Df *U, Array2Df *buf, bool multithread, int algo)/*, pfs::Progress &ph,
+bool solve_pde_fft(Array2Df *F, Array2Df *U, Array2Df *buf, bool multithread, int algo)/*, pfs::Progress &ph,
                                               bool adjust_bound)*/
 {
     // ph.setValue(20);
@@ -884,18 +861,6 @@ void solve_pde_fft(Array2Df *F, Array2Df *U, Array2Df *buf, bool multithread, in
     assert((int)U->getCols() == width && (int)U->getRows() == height);
     assert(buf->getCols() == width && buf->getRows() == height);
 
-    // activate parallel execution of fft routines
-#ifdef RT_FFTW3F_OMP
-
-    if (multithread) {
-        fftwf_init_threads();
-        fftwf_plan_with_nthreads(omp_get_max_threads());
-    }
-
-// #else
-//   fftwf_plan_with_nthreads( 2 );
-#endif
-
     // in general there might not be a solution to the Poisson pde
     // with Neumann boundary conditions unless the boundary satisfies
     // an integral condition, this function modifies the boundary so that
@@ -908,30 +873,25 @@ void solve_pde_fft(Array2Df *F, Array2Df *U, Array2Df *buf, bool multithread, in
 
     // transforms F into eigenvector space: Ftr =
     //DEBUG_STR << "solve_pde_fft: transform F to ev space (fft)" << std::endl;
+    const PoissonSolver solver(width, height, PoissonSolver::Boundary::WHOLE_SAMPLE, multithread);
     Array2Df* F_tr = buf;
-    transform_normal2ev(F, F_tr, multithread);
+    if (!transform_normal2ev(F, F_tr, solver)) {
+        return false;
+    }
     // TODO: F no longer needed so could release memory, but as it is an
     // input parameter we won't do that
 
 
-    // in the eigenvector space the solution is very simple
-    std::vector<double> l1 = get_lambda(height);
-    std::vector<double> l2 = get_lambda(width);
-
-#ifdef _OPENMP
-    #pragma omp parallel for if(multithread)
-#endif
-
-    for (int y = 0 ; y < height ; y++) {
-        for (int x = 0 ; x < width ; x++) {
-            (*F_tr) (x, y) = static_cast<double>((*F_tr) (x, y)) / (l1[y] + l2[x]);
-        }
-    }
-
-    (*F_tr)(0, 0) = 0.f;  // any value ok, only adds a const to the solution
+    // in the eigenvector space the solution is very simple: divides by the
+    // eigenvalues of the laplace operator (the opposite of the ones of L, the
+    // factor 4 is compensated by transform_ev2normal) and sets (0, 0) to 0,
+    // any value ok, only adds a const to the solution
+    solver.divide(F_tr->data(), -4.0);
 
     // transforms F_tr back to the normal space
-    transform_ev2normal(F_tr, U, multithread);
+    if (!transform_ev2normal(F_tr, U, solver, multithread)) {
+        return false;
+    }
 
     // the solution U as calculated will satisfy something like int U = 0
     // since for any constant c, U-c is also a solution and we are mainly
@@ -957,6 +917,8 @@ void solve_pde_fft(Array2Df *F, Array2Df *U, Array2Df *buf, bool multithread, in
             (*U)(i) -= maxVal;
         }
     }
+
+    return true;
 }
 
 
@@ -1166,7 +1128,10 @@ void ImProcFunctions::ToneMapFattal02(Imagefloat *rgb, const FattalToneMappingPa
 
     rescale_nearest(Yr, L, multiThread);
 
-    tmo_fattal02(w2, h2, L, L, alpha, beta, noise, detail_level, multiThread, 0);
+    if (!tmo_fattal02(w2, h2, L, L, alpha, beta, noise, detail_level, multiThread, 0)) {
+        std::cerr << "ToneMapFattal02: fftw planning failed for " << w2 << " x " << h2 << ", the image is left unchanged" << std::endl;
+        return;
+    }
 
     const float hr = float(h2) / float(h);
     const float wr = float(w2) / float(w);
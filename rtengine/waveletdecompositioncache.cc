@@ -0,0 +1,169 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <vector>
+
+#include "cplx_wavelet_dec.h"
+#include "waveletdecompositioncache.h"
+
+namespace
+{
+
+// L, a and b of the preview and of two detail windows
+constexpr std::size_t maxEntries = 9;
+// number of floats, about 512 MB
+constexpr std::size_t maxCachedSize = 128 * 1024 * 1024;
+
+std::uint64_t hashValues(std::uint64_t hash, const float* values, int count)
+{
+    // FNV-1a on the bit patterns of the floats
+    for (int i = 0; i < count; ++i) {
+        std::uint32_t bits;
+        std::memcpy(&bits, values + i, sizeof(bits));
+        hash = (hash ^ bits) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+std::uint64_t hashImage(const float* src, int width, int height, int numThreads)
+{
+    std::vector<std::uint64_t> rowHashes(height);
+
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(numThreads) if (numThreads > 1)
+#endif
+    for (int y = 0; y < height; ++y) {
+        rowHashes[y] = hashValues(14695981039346656037ULL, src + static_cast<std::size_t>(y) * width, width);
+    }
+
+    std::uint64_t hash = 14695981039346656037ULL;
+
+    for (const auto rowHash : rowHashes) {
+        hash = (hash ^ rowHash) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+// approximate number of floats held by a decomposition
+std::size_t getSize(const rtengine::wavelet_decomposition& decomposition)
+{
+    // the residual image
+    std::size_t size = static_cast<std::size_t>(decomposition.level_W(0) + 1) * (decomposition.level_H(0) + 1);
+
+    for (int lvl = 0; lvl < decomposition.maxlevel(); ++lvl) {
+        size += 3 * static_cast<std::size_t>(decomposition.level_W(lvl)) * decomposition.level_H(lvl);
+    }
+
+    return size;
+}
+
+}
+
+namespace rtengine
+{
+
+WaveletDecompositionCache::Key::Key(const float* src, int width, int height, int levels, int skip, int daubLen, int numThreads) :
+    hash(hashImage(src, width, height, numThreads)),
+    width(width),
+    height(height),
+    levels(levels),
+    skip(skip),
+    daubLen(daubLen)
+{
+}
+
+bool WaveletDecompositionCache::Key::operator ==(const Key& other) const
+{
+    return
+        hash == other.hash
+        && width == other.width
+        && height == other.height
+        && levels == other.levels
+        && skip == other.skip
+        && daubLen == other.daubLen;
+}
+
+WaveletDecompositionCache& WaveletDecompositionCache::getInstance()
+{
+    static WaveletDecompositionCache instance;
+    return instance;
+}
+
+std::unique_ptr<wavelet_decomposition> WaveletDecompositionCache::get(const Key& key)
+{
+    std::shared_ptr<const wavelet_decomposition> decomposition;
+
+    {
+        MyMutex::MyLock lock(mutex);
+
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            if (it->key == key) {
+                decomposition = it->decomposition;
+                entries.splice(entries.begin(), entries, it);
+                break;
+            }
+        }
+    }
+
+    // the copy is made outside of the lock, the entry is kept alive by the shared pointer
+    return decomposition ? decomposition->clone() : nullptr;
+}
+
+void WaveletDecompositionCache::put(const Key& key, const wavelet_decomposition& decomposition)
+{
+    std::shared_ptr<const wavelet_decomposition> copy(decomposition.clone());
+
+    if (!copy) {
+        return;
+    }
+
+    const std::size_t size = getSize(decomposition);
+
+    if (size > maxCachedSize) {
+        return;
+    }
+
+    MyMutex::MyLock lock(mutex);
+
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if (it->key == key) {
+            cachedSize -= it->size;
+            entries.erase(it);
+            break;
+        }
+    }
+
+    entries.push_front({key, std::move(copy), size});
+    cachedSize += size;
+
+    while (entries.size() > maxEntries || cachedSize > maxCachedSize) {
+        cachedSize -= entries.back().size;
+        entries.pop_back();
+    }
+}
+
+void WaveletDecompositionCache::clear()
+{
+    MyMutex::MyLock lock(mutex);
+
+    entries.clear();
+    cachedSize = 0;
+}
+
+}
@@ -0,0 +1,78 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+
+#include "noncopyable.h"
+
+#include "../rtgui/threadutils.h"
+
+namespace rtengine
+{
+
+class wavelet_decomposition;
+
+/* Cache of the wavelet decompositions of the L, a and b channels made by ip_wavelet for the preview and the detail windows.
+ * The decompositions are keyed by the pixels they are made of, so they are reused as long as the image upstream of
+ * the Wavelet Levels tool does not change: changing the gains of the levels, the curves or the residual image settings
+ * only needs a copy of the cached coefficients and the reconstruction.
+ */
+class WaveletDecompositionCache final :
+    public NonCopyable
+{
+public:
+    class Key
+    {
+    public:
+        Key(const float* src, int width, int height, int levels, int skip, int daubLen, int numThreads);
+
+        bool operator ==(const Key& other) const;
+
+    private:
+        std::uint64_t hash;
+        int width;
+        int height;
+        int levels;
+        int skip;
+        int daubLen;
+    };
+
+    static WaveletDecompositionCache& getInstance();
+
+    // returns a copy of the cached decomposition, which the caller may modify and reconstruct, or nullptr
+    std::unique_ptr<wavelet_decomposition> get(const Key& key);
+    void put(const Key& key, const wavelet_decomposition& decomposition);
+    void clear();
+
+private:
+    WaveletDecompositionCache() = default;
+
+    struct Entry {
+        Key key;
+        std::shared_ptr<const wavelet_decomposition> decomposition;
+        std::size_t size;
+    };
+
+    std::list<Entry> entries; // most recently used first
+    std::size_t cachedSize = 0;
+    MyMutex mutex;
+};
+
+}
@@ -39,7 +39,7 @@ namespace
 {
 
 constexpr int cacheDirMode = 0777;
-constexpr const char* cacheDirs[] = { "profiles", "images", "embprofiles", "data" };
+constexpr const char* cacheDirs[] = { "profiles", "images", "embprofiles", "data", "cluts" };
 
 }
 
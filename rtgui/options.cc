@@ -620,6 +620,9 @@ void Options::setDefaults()
     rtSettings.previewselection = 5;//between 1 to 40
     rtSettings.cbdlsensi = 1.0;//between 0.001 to 1
     rtSettings.fftwsigma = true; //choice between sigma^2 or empirical formula
+    rtSettings.nlmeansquality = 100;//between 1 to 100, lower values are faster
+    rtSettings.previewcolorlut = true;
+    rtSettings.storehotdeadpixels = false;
 
     rtSettings.itcwb_thres = 34;//between 10 to 55
     rtSettings.itcwb_sort = false;
@@ -810,6 +813,18 @@ void Options::readFromFile(Glib::ustring fname)
                     rtSettings.fftwsigma = keyFile.get_boolean("General", "Fftwsigma");
                 }
 
+                if (keyFile.has_key("General", "Nlmeansquality")) {
+                    rtSettings.nlmeansquality = keyFile.get_integer("General", "Nlmeansquality");
+                }
+
+                if (keyFile.has_key("General", "Previewcolorlut")) {
+                    rtSettings.previewcolorlut = keyFile.get_boolean("General", "Previewcolorlut");
+                }
+
+                if (keyFile.has_key("General", "Storehotdeadpixels")) {
+                    rtSettings.storehotdeadpixels = keyFile.get_boolean("General", "Storehotdeadpixels");
+                }
+
                 if (keyFile.has_key("General", "Cropsleep")) {
                     rtSettings.cropsleep          = keyFile.get_integer("General", "Cropsleep");
                 }
@@ -2327,6 +2342,9 @@ void Options::saveToFile(Glib::ustring fname)
         keyFile.set_double("General", "Reduclow", rtSettings.reduclow);
         keyFile.set_boolean("General", "Detectshape", rtSettings.detectshape);
         keyFile.set_boolean("General", "Fftwsigma", rtSettings.fftwsigma);
+        keyFile.set_integer("General", "Nlmeansquality", rtSettings.nlmeansquality);
+        keyFile.set_boolean("General", "Previewcolorlut", rtSettings.previewcolorlut);
+        keyFile.set_boolean("General", "Storehotdeadpixels", rtSettings.storehotdeadpixels);
 
         // TODO: Remove.
         keyFile.set_integer("External Editor", "EditorKind", editorToSendTo);